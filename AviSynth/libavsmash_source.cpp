@@ -213,6 +213,7 @@ LSMASHVideoSource::LSMASHVideoSource
     const char         *preferred_decoder_names,
     int                 prefer_hw_decoder,
     const char         *ff_options,
+    size_t              frame_cache_budget,
     IScriptEnvironment *env
 ) : LSMASHVideoSource{}
 {
@@ -235,6 +236,8 @@ LSMASHVideoSource::LSMASHVideoSource
     as_vohp->env = env;
     vohp->private_handler      = as_vohp;
     vohp->free_private_handler = as_free_video_output_handler;
+    if( lw_setup_frame_lru( vohp, frame_cache_budget ) < 0 )
+        env->ThrowError( "LSMASHVideoSource: failed to allocate the decoded frame cache." );
     get_video_track( source, track_number, env );
     prepare_video_decoding( vdhp, vohp, format_ctx.get(), threads, direct_rendering, pixel_format, vi, env );
     lsmash_discard_boxes( libavsmash_video_get_root( vdhp ) );
@@ -542,14 +545,17 @@ AVSValue __cdecl CreateLSMASHVideoSource( AVSValue args, void *user_data, IScrip
     int         prefer_hw_decoder       = args[10].AsInt( 0 );
     int         ff_loglevel             = args[11].AsInt( 0 );
     const char* ff_options              = args[12].AsString( nullptr );
+    int         cache_mb                = args[13].AsInt( 0 );
     threads                = threads >= 0 ? threads : 0;
     seek_mode              = CLIP_VALUE( seek_mode, 0, 2 );
-    forward_seek_threshold = CLIP_VALUE( forward_seek_threshold, 1, 999 );
+    forward_seek_threshold = CLIP_VALUE( forward_seek_threshold, 0, 999 );
     direct_rendering      &= (pixel_format == AV_PIX_FMT_NONE);
     prefer_hw_decoder      = CLIP_VALUE( prefer_hw_decoder, 0, 3 );
+    cache_mb               = CLIP_VALUE( cache_mb, 0, 65536 );
     set_av_log_level( ff_loglevel );
     return new LSMASHVideoSource( source, track_number, threads, seek_mode, forward_seek_threshold,
-                                  direct_rendering, fps_num, fps_den, pixel_format, preferred_decoder_names, prefer_hw_decoder, ff_options, env );
+                                  direct_rendering, fps_num, fps_den, pixel_format, preferred_decoder_names, prefer_hw_decoder, ff_options,
+                                  (size_t)cache_mb << 20, env );
 }
 
 AVSValue __cdecl CreateLSMASHAudioSource( AVSValue args, void *user_data, IScriptEnvironment *env )
@@ -76,6 +76,7 @@ public:
         const char         *preferred_decoder_names,
         int                 prefer_hw_decoder,
         const char         *ff_options,
+        size_t              frame_cache_budget,
         IScriptEnvironment *env
     );
     ~LSMASHVideoSource();
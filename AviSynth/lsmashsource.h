@@ -59,9 +59,3 @@ void throw_error
     lw_log_level      level,
     const char       *message
 );
-
-#ifdef SSE2_ENABLED
-extern "C"
-void planar_yuv_sse2(uint16_t* dstp_y, uint16_t* dstp_u, uint16_t* dstp_v, uint16_t* srcp_y, uint16_t* srcp_uv, const int dst_stride_y, const int dst_stride_uv, const int src_stride_y, const int src_stride_uv,
-    const int width_y, const int width_uv, const int height_y, const int height_uv);
-#endif // SSE2_ENABLED
@@ -39,6 +39,7 @@ extern "C"
 #include "video_output.h"
 #include "audio_output.h"
 #include "lwlibav_source.h"
+#include "../common/osdep.h"
 #include "../common/lwlibav_video_internal.h"
 
 #ifdef _MSC_VER
@@ -81,6 +82,23 @@ static void set_frame_properties
     avs_set_frame_properties(av_frame, stream, duration_num, duration_den, rgb, avs_frame, top, bottom, env, n);
 }
 
+/* Export the costs measured for the adaptive seek decision. */
+static void set_seek_stats_properties
+(
+    lwlibav_video_decode_handler_t *vdhp,
+    PVideoFrame                    &avs_frame,
+    IScriptEnvironment             *env
+)
+{
+    lwlibav_video_seek_stats_t stats;
+    lwlibav_video_get_seek_stats( vdhp, &stats );
+    AVSMap *props = env->getFramePropsRW( avs_frame );
+    env->propSetFloat( props, "DecodeCost",   stats.decode_cost,   0 );
+    env->propSetFloat( props, "SeekCost",     stats.seek_cost,     0 );
+    env->propSetInt  ( props, "ForwardCount", stats.forward_count, 0 );
+    env->propSetInt  ( props, "SeekCount",    stats.seek_count,    0 );
+}
+
 static void prepare_video_decoding
 (
     lwlibav_video_decode_handler_t *vdhp,
@@ -114,12 +132,21 @@ LWLibavVideoSource::LWLibavVideoSource
     lwlibav_option_t   *opt,
     int                 seek_mode,
     uint32_t            forward_seek_threshold,
+    uint32_t            backward_buffer_size,
+    uint32_t            prefetch_depth,
     int                 direct_rendering,
     enum AVPixelFormat  pixel_format,
     const char         *preferred_decoder_names,
     int                 prefer_hw_decoder,
     bool                progress,
     const char         *ff_options,
+    size_t              frame_cache_budget,
+    size_t              packet_cache_size,
+    int                 direct_read,
+    int                 spare_decoders,
+    int                 intra_parallel,
+    int                 gop_parallel,
+    int                 keyframes_only,
     IScriptEnvironment *env
 ) : LWLibavVideoSource{}
 {
@@ -130,6 +157,14 @@ LWLibavVideoSource::LWLibavVideoSource
     set_preferred_decoder_names( preferred_decoder_names );
     lwlibav_video_set_seek_mode              ( vdhp, seek_mode );
     lwlibav_video_set_forward_seek_threshold ( vdhp, forward_seek_threshold );
+    lwlibav_video_set_backward_buffer_size   ( vdhp, backward_buffer_size );
+    lwlibav_video_set_prefetch_depth         ( vdhp, prefetch_depth );
+    lwlibav_video_set_packet_cache_size      ( vdhp, packet_cache_size );
+    lwlibav_video_set_direct_read            ( vdhp, direct_read );
+    lwlibav_video_set_spare_decoders         ( vdhp, spare_decoders );
+    lwlibav_video_set_intra_parallel         ( vdhp, intra_parallel );
+    lwlibav_video_set_gop_parallel           ( vdhp, gop_parallel );
+    lwlibav_video_set_keyframes_only         ( vdhp, keyframes_only );
     lwlibav_video_set_preferred_decoder_names( vdhp, tokenize_preferred_decoder_names() );
     lwlibav_video_set_prefer_hw_decoder      ( vdhp, prefer_hw_decoder );
     lwlibav_video_set_decoder_options        ( vdhp, ff_options );
@@ -140,6 +175,8 @@ LWLibavVideoSource::LWLibavVideoSource
     as_vohp->env = env;
     vohp->private_handler      = as_vohp;
     vohp->free_private_handler = as_free_video_output_handler;
+    if( lw_setup_frame_lru( vohp, frame_cache_budget ) < 0 )
+        env->ThrowError( "LWLibavVideoSource: failed to allocate the decoded frame cache." );
     /* Set up error handler. */
     lw_log_handler_t *lhp = lwlibav_video_get_log_handler( vdhp );
     lhp->level    = LW_LOG_FATAL; /* Ignore other than fatal error. */
@@ -166,6 +203,9 @@ LWLibavVideoSource::LWLibavVideoSource
     /* Get the desired video track. */
     if( lwlibav_video_get_desired_track( lwh.file_path, vdhp, lwh.threads ) < 0 )
         env->ThrowError( "LWLibavVideoSource: failed to get the video track." );
+    /* Expose only the keyframes if requested. */
+    if( lwlibav_video_create_keyframe_list( vdhp, vohp ) < 0 )
+        env->ThrowError( "LWLibavVideoSource: failed to create the keyframe list." );
     /* Set average framerate. */
     int64_t fps_num = 25;
     int64_t fps_den = 1;
@@ -226,6 +266,8 @@ PVideoFrame __stdcall LWLibavVideoSource::GetFrame( int n, IScriptEnvironment *e
         } ();
 
         set_frame_properties( av_frame, vdhp->format->streams[vdhp->stream_index], vi, as_frame, top, bottom, env, n );
+        if( vdhp->forward_seek_threshold == 0 )
+            set_seek_stats_properties( vdhp, as_frame, env );
     }
     if ( vohp->scaler.output_pixel_format == AV_PIX_FMT_XYZ12LE )
     {
@@ -430,6 +472,16 @@ AVSValue __cdecl CreateLWLibavVideoSource( AVSValue args, void *user_data, IScri
     const char* cdir                    = args[16].AsString( nullptr );
     const bool  progress                = args[17].AsBool( true );
     const char* ff_options              = args[18].AsString( nullptr );
+    int         cache_mb                = args[19].AsInt( 0 );
+    uint32_t    backward_buffer_size    = args[20].AsInt( 0 );
+    uint32_t    prefetch_depth          = args[21].AsInt( 0 );
+    int         save_seek_failures      = args[22].AsBool( false ) ? 1 : 0;
+    int         packet_cache_mb         = args[23].AsInt( 0 );
+    int         direct_read             = args[24].AsBool( false ) ? 1 : 0;
+    int         spare_decoders          = args[25].AsInt( 0 );
+    int         intra_parallel          = args[26].AsInt( 0 );
+    int         gop_parallel            = args[27].AsInt( 0 );
+    int         keyframes_only          = args[28].AsInt( 0 );
     /* Set LW-Libav options. */
     lwlibav_option_t opt;
     opt.file_path         = source;
@@ -444,16 +496,36 @@ AVSValue __cdecl CreateLWLibavVideoSource( AVSValue args, void *user_data, IScri
     opt.force_audio_index = -2;
     opt.apply_repeat_flag = apply_repeat_flag;
     opt.field_dominance   = CLIP_VALUE( field_dominance, 0, 2 );    /* 0: Obey source flags, 1: TFF, 2: BFF */
+    opt.text_index        = 0;
+    opt.save_seek_failures = save_seek_failures;
     opt.vfr2cfr.active    = fps_num > 0 && fps_den > 0 ? 1 : 0;
     opt.vfr2cfr.fps_num   = fps_num;
     opt.vfr2cfr.fps_den   = fps_den;
+    opt.progressive       = NULL;
     seek_mode              = CLIP_VALUE( seek_mode, 0, 2 );
-    forward_seek_threshold = CLIP_VALUE( forward_seek_threshold, 1, 999 );
+    forward_seek_threshold = CLIP_VALUE( forward_seek_threshold, 0, 999 );
+    keyframes_only         = CLIP_VALUE( keyframes_only, 0, 2 );
+    if( keyframes_only )
+    {
+        /* Only the keyframes are exposed and each is decoded on its own by a decoder with the default buffers. */
+        opt.apply_repeat_flag = 0;
+        opt.vfr2cfr.active    = 0;
+        direct_rendering      = 0;
+    }
     direct_rendering      &= (pixel_format == AV_PIX_FMT_NONE);
     prefer_hw_decoder      = CLIP_VALUE( prefer_hw_decoder, 0, 3 );
+    cache_mb               = CLIP_VALUE( cache_mb, 0, 65536 );
+    packet_cache_mb        = CLIP_VALUE( packet_cache_mb, 0, 4096 );
+    spare_decoders         = CLIP_VALUE( spare_decoders, 0, 16 );
+    backward_buffer_size   = CLIP_VALUE( backward_buffer_size, 0, 999 );
+    prefetch_depth         = direct_rendering ? 0 : CLIP_VALUE( prefetch_depth, 0, 999 );  /* no decoding ahead with DR */
+    intra_parallel         = direct_rendering ? 0 : CLIP_VALUE( intra_parallel, 0, 64 );
+    gop_parallel           = direct_rendering ? 0 : CLIP_VALUE( gop_parallel, 0, 64 );
     set_av_log_level( ff_loglevel );
-    return new LWLibavVideoSource( &opt, seek_mode, forward_seek_threshold,
-                                   direct_rendering, pixel_format, preferred_decoder_names, prefer_hw_decoder, progress, ff_options, env );
+    return new LWLibavVideoSource( &opt, seek_mode, forward_seek_threshold, backward_buffer_size, prefetch_depth,
+                                   direct_rendering, pixel_format, preferred_decoder_names, prefer_hw_decoder, progress, ff_options,
+                                   (size_t)cache_mb << 20, (size_t)packet_cache_mb << 20, direct_read,
+                                   spare_decoders, intra_parallel, gop_parallel, keyframes_only, env );
 }
 
 AVSValue __cdecl CreateLWLibavAudioSource( AVSValue args, void *user_data, IScriptEnvironment *env )
@@ -485,9 +557,12 @@ AVSValue __cdecl CreateLWLibavAudioSource( AVSValue args, void *user_data, IScri
     opt.force_audio_index = stream_index >= 0 ? stream_index : -1;
     opt.apply_repeat_flag = 0;
     opt.field_dominance   = 0;
+    opt.text_index        = 0;
+    opt.save_seek_failures = 0;
     opt.vfr2cfr.active    = 0;
     opt.vfr2cfr.fps_num   = 0;
     opt.vfr2cfr.fps_den   = 0;
+    opt.progressive       = NULL;
     set_av_log_level( ff_loglevel );
     return new LWLibavAudioSource( &opt, layout_string, sample_rate, preferred_decoder_names, progress, drc, ff_options, env );
 }
@@ -63,12 +63,21 @@ public:
         lwlibav_option_t   *opt,
         int                 seek_mode,
         uint32_t            forward_seek_threshold,
+        uint32_t            backward_buffer_size,
+        uint32_t            prefetch_depth,
         int                 direct_rendering,
         enum AVPixelFormat  pixel_format,
         const char         *preferred_decoder_names,
         int                 prefer_hw_decoder,
         bool                progress,
         const char         *ff_options,
+        size_t              frame_cache_budget,
+        size_t              packet_cache_size,
+        int                 direct_read,
+        int                 spare_decoders,
+        int                 intra_parallel,
+        int                 gop_parallel,
+        int                 keyframes_only,
         IScriptEnvironment *env
     );
     ~LWLibavVideoSource();
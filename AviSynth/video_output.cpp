@@ -41,6 +41,9 @@ extern "C"
 }
 
 #include "video_output.h"
+#ifdef SSE2_ENABLED
+#include "../common/planar_yuv_sse2.h"
+#endif // SSE2_ENABLED
 
 static void make_black_background_planar_yuv
 (
@@ -187,33 +190,18 @@ static int make_frame_planar_yuv
     as_picture.linesize[0] = as_frame->GetPitch   ( PLANAR_Y );
     as_picture.linesize[1] = as_frame->GetPitch   ( PLANAR_U );
     as_picture.linesize[2] = as_frame->GetPitch   ( PLANAR_V );
-    if( vohp->scaler.input_pixel_format == AV_PIX_FMT_P010LE && vohp->scaler.output_pixel_format == AV_PIX_FMT_YUV420P10LE )
-    {
 #ifdef SSE2_ENABLED
-        const int width_y       = as_frame->GetRowSize( PLANAR_Y ) / sizeof( uint16_t );
-        const int width_uv      = as_frame->GetRowSize( PLANAR_U ) / sizeof( uint16_t );
-        const int height_y      = as_frame->GetHeight( PLANAR_Y );
-        const int height_uv     = as_frame->GetHeight( PLANAR_U );
-        const int src_pitch_y   = av_frame->linesize[0] / sizeof( uint16_t );
-        const int src_pitch_uv  = av_frame->linesize[1] / sizeof( uint16_t );
-        const int dst_pitch_y   = as_picture.linesize[0] / sizeof( uint16_t );
-        const int dst_pitch_uv  = as_picture.linesize[1] / sizeof( uint16_t );
-        uint16_t *srcp_y        = (uint16_t *)av_frame->data[0];
-        uint16_t *srcp_uv       = (uint16_t *)av_frame->data[1];
-        uint16_t *dstp_y        = (uint16_t *)as_picture.data[0];
-        uint16_t *dstp_u        = (uint16_t *)as_picture.data[1];
-        uint16_t *dstp_v        = (uint16_t *)as_picture.data[2];
-
-        planar_yuv_sse2(dstp_y, dstp_u, dstp_v, srcp_y, srcp_uv, dst_pitch_y, dst_pitch_uv, src_pitch_y, src_pitch_uv,
-            width_y, width_uv, height_y, height_uv);
-
-        return height_y;
-#else
-        return convert_av_pixel_format(vohp->scaler.sws_ctx, height, av_frame, &as_picture);
+    /* Split the interleaved chroma of semi-planar formats such as NV12 and P010 without swscale. */
+    as_video_output_handler_t *as_vohp = (as_video_output_handler_t *)vohp->private_handler;
+    const int bytes_per_sample = as_vohp->bitdepth_minus_8 ? 2 : 1;
+    int ret = convert_semi_planar_yuv( vohp->scaler.input_pixel_format, vohp->scaler.output_pixel_format,
+                                       as_picture.data, as_picture.linesize, av_frame->data, av_frame->linesize,
+                                       MIN( av_frame->width, as_frame->GetRowSize( PLANAR_Y ) / bytes_per_sample ),
+                                       MIN( height,          as_frame->GetHeight( PLANAR_Y ) ) );
+    if( ret > 0 )
+        return ret;
 #endif // SSE2_ENABLED
-    }
-    else
-        return convert_av_pixel_format( vohp->scaler.sws_ctx, height, av_frame, &as_picture );
+    return convert_av_pixel_format( vohp->scaler.sws_ctx, height, av_frame, &as_picture );
 }
 
 static int make_frame_planar_yuva
@@ -302,6 +290,42 @@ static int make_frame_planar_rgba
     return convert_av_pixel_format( vohp->scaler.sws_ctx, height, av_frame, &as_picture );
 }
 
+static int make_frame_plane_copy
+(
+    lw_video_output_handler_t *vohp,
+    int                        height,
+    AVFrame                   *av_frame,
+    PVideoFrame               &as_frame
+)
+{
+    /* The output pixel format is the same as the input one, so just copy each plane to the corresponding one. */
+    static const int yuv_planes[4] = { PLANAR_Y, PLANAR_U, PLANAR_V, PLANAR_A };
+    static const int rgb_planes[4] = { PLANAR_G, PLANAR_B, PLANAR_R, PLANAR_A };
+    as_video_output_handler_t *as_vohp     = (as_video_output_handler_t *)vohp->private_handler;
+    enum AVPixelFormat         pixel_format = vohp->scaler.output_pixel_format;
+    const int                 *planes       = (av_pix_fmt_desc_get( pixel_format )->flags & AV_PIX_FMT_FLAG_RGB) ? rgb_planes : yuv_planes;
+    int                        num_planes   = av_pix_fmt_count_planes( pixel_format );
+    as_picture_t as_picture = { { NULL } };
+    if( num_planes == 1 )
+    {
+        as_picture.data    [0] = as_frame->GetWritePtr();
+        as_picture.linesize[0] = as_frame->GetPitch   ();
+    }
+    else
+        for( int i = 0; i < num_planes && i < 4; i++ )
+        {
+            as_picture.data    [i] = as_frame->GetWritePtr( planes[i] );
+            as_picture.linesize[i] = as_frame->GetPitch   ( planes[i] );
+        }
+    /* The frame maker is not updated when the decoder changes the pixel format on the way,
+     * in which case the planes are converted by the scaler set up for the frame. */
+    int ret = av_frame->format != pixel_format ? -1
+            : lw_copy_planes( &vohp->scaler, pixel_format,
+                              as_picture.data, as_picture.linesize, av_frame->data, av_frame->linesize,
+                              MIN( av_frame->width, as_vohp->vi->width ), MIN( height, as_vohp->vi->height ) );
+    return ret >= 0 ? ret : convert_av_pixel_format( vohp->scaler.sws_ctx, height, av_frame, &as_picture );
+}
+
 enum AVPixelFormat get_av_output_pixel_format
 (
     const char *format_name
@@ -375,6 +399,97 @@ enum AVPixelFormat get_av_output_pixel_format
     return AV_PIX_FMT_NONE;
 }
 
+static int set_frame_maker
+(
+    as_video_output_handler_t *as_vohp,
+    enum AVPixelFormat         output_pixel_format
+)
+{
+    switch( output_pixel_format )
+    {
+        case AV_PIX_FMT_YUV420P:
+        case AV_PIX_FMT_YUV422P:
+        case AV_PIX_FMT_YUV444P:
+        case AV_PIX_FMT_YUV410P:
+        case AV_PIX_FMT_YUV411P:
+            as_vohp->make_black_background = make_black_background_planar_yuv;
+            as_vohp->make_frame            = make_frame_planar_yuv;
+            return 0;
+        case AV_PIX_FMT_YUV420P10LE:
+        case AV_PIX_FMT_YUV420P12LE:
+        case AV_PIX_FMT_YUV420P14LE:
+        case AV_PIX_FMT_YUV420P16LE:
+        case AV_PIX_FMT_YUV422P10LE:
+        case AV_PIX_FMT_YUV422P12LE:
+        case AV_PIX_FMT_YUV422P14LE:
+        case AV_PIX_FMT_YUV422P16LE:
+        case AV_PIX_FMT_YUV444P10LE:
+        case AV_PIX_FMT_YUV444P12LE:
+        case AV_PIX_FMT_YUV444P14LE:
+        case AV_PIX_FMT_YUV444P16LE:
+            as_vohp->make_black_background = make_black_background_planar_yuv_interleaved;
+            as_vohp->make_frame            = make_frame_planar_yuv;
+            return 0;
+        case AV_PIX_FMT_YUYV422:
+            as_vohp->make_black_background = make_black_background_packed_yuv422;
+            as_vohp->make_frame            = make_frame_packed_yuv;
+            return 0;
+        case AV_PIX_FMT_YUVA420P:
+        case AV_PIX_FMT_YUVA422P:
+        case AV_PIX_FMT_YUVA444P:
+            as_vohp->make_black_background = make_black_background_planar_yuva;
+            as_vohp->make_frame            = make_frame_planar_yuva;
+            return 0;
+        case AV_PIX_FMT_YUVA420P10LE:
+        case AV_PIX_FMT_YUVA420P16LE:
+        case AV_PIX_FMT_YUVA422P10LE:
+        case AV_PIX_FMT_YUVA422P12LE:
+        case AV_PIX_FMT_YUVA422P16LE:
+        case AV_PIX_FMT_YUVA444P10LE:
+        case AV_PIX_FMT_YUVA444P12LE:
+        case AV_PIX_FMT_YUVA444P16LE:
+            as_vohp->make_black_background = make_black_background_planar_yuva_interleaved;
+            as_vohp->make_frame            = make_frame_planar_yuva;
+            return 0;
+        case AV_PIX_FMT_GRAY8:
+        case AV_PIX_FMT_GRAY10LE:
+        case AV_PIX_FMT_GRAY12LE:
+        case AV_PIX_FMT_GRAY14LE:
+        case AV_PIX_FMT_GRAY16LE:
+            as_vohp->make_black_background = make_black_background_packed_all_zero;
+            as_vohp->make_frame            = make_frame_packed_yuv;
+            return 0;
+        case AV_PIX_FMT_BGR24:
+        case AV_PIX_FMT_BGRA:
+        case AV_PIX_FMT_BGR0:
+        case AV_PIX_FMT_BGR48LE:
+        case AV_PIX_FMT_BGRA64LE:
+        case AV_PIX_FMT_XYZ12LE:
+            as_vohp->make_black_background = make_black_background_packed_all_zero;
+            as_vohp->make_frame            = make_frame_packed_rgb;
+            return 0;
+        case AV_PIX_FMT_GBRP:
+        case AV_PIX_FMT_GBRP10LE:
+        case AV_PIX_FMT_GBRP12LE:
+        case AV_PIX_FMT_GBRP14LE:
+        case AV_PIX_FMT_GBRP16LE:
+            as_vohp->make_black_background = make_black_background_planar_rgb;
+            as_vohp->make_frame            = make_frame_planar_rgb;
+            return 0;
+        case AV_PIX_FMT_GBRAP:
+        case AV_PIX_FMT_GBRAP10LE:
+        case AV_PIX_FMT_GBRAP12LE:
+        case AV_PIX_FMT_GBRAP16LE:
+            as_vohp->make_black_background = make_black_background_planar_rgba;
+            as_vohp->make_frame            = make_frame_planar_rgba;
+            return 0;
+        default :
+            as_vohp->make_black_background = NULL;
+            as_vohp->make_frame            = NULL;
+            return -1;
+    }
+}
+
 static int determine_colorspace_conversion
 (
     as_video_output_handler_t *as_vohp,
@@ -411,6 +526,7 @@ static int determine_colorspace_conversion
             { AV_PIX_FMT_YUV420P16BE,  AV_PIX_FMT_YUV420P16LE,  VideoInfo::CS_YUV420P16,  8, 1, 1 },
             { AV_PIX_FMT_P016LE,       AV_PIX_FMT_YUV420P16LE,  VideoInfo::CS_YUV420P16,  8, 1, 1 },
             { AV_PIX_FMT_P016BE,       AV_PIX_FMT_YUV420P16LE,  VideoInfo::CS_YUV420P16,  8, 1, 1 },
+            { AV_PIX_FMT_P012LE,       AV_PIX_FMT_YUV420P12LE,  VideoInfo::CS_YUV420P12,  4, 1, 1 },
             { AV_PIX_FMT_YUYV422,      AV_PIX_FMT_YUYV422,      VideoInfo::CS_YUY2,       0, 1, 0 },
             { AV_PIX_FMT_UYVY422,      AV_PIX_FMT_YUYV422,      VideoInfo::CS_YUY2,       0, 1, 0 },
             { AV_PIX_FMT_YVYU422,      AV_PIX_FMT_YUYV422,      VideoInfo::CS_YUY2,       0, 1, 0 },
@@ -424,6 +540,9 @@ static int determine_colorspace_conversion
             { AV_PIX_FMT_NV20BE,       AV_PIX_FMT_YUV422P10LE,  VideoInfo::CS_YUV422P10,  2, 1, 0 },
             { AV_PIX_FMT_Y210LE,       AV_PIX_FMT_YUV422P10LE,  VideoInfo::CS_YUV422P10,  2, 1, 0 },
             { AV_PIX_FMT_Y210BE,       AV_PIX_FMT_YUV422P10LE,  VideoInfo::CS_YUV422P10,  2, 1, 0 },
+            { AV_PIX_FMT_P210LE,       AV_PIX_FMT_YUV422P10LE,  VideoInfo::CS_YUV422P10,  2, 1, 0 },
+            { AV_PIX_FMT_P212LE,       AV_PIX_FMT_YUV422P12LE,  VideoInfo::CS_YUV422P12,  4, 1, 0 },
+            { AV_PIX_FMT_P216LE,       AV_PIX_FMT_YUV422P16LE,  VideoInfo::CS_YUV422P16,  8, 1, 0 },
             { AV_PIX_FMT_YUV422P12LE,  AV_PIX_FMT_YUV422P12LE,  VideoInfo::CS_YUV422P12,  4, 1, 0 },
             { AV_PIX_FMT_YUV422P12BE,  AV_PIX_FMT_YUV422P12LE,  VideoInfo::CS_YUV422P12,  4, 1, 0 },
             { AV_PIX_FMT_YUV422P14LE,  AV_PIX_FMT_YUV422P14LE,  VideoInfo::CS_YUV422P14,  6, 1, 0 },
@@ -443,6 +562,9 @@ static int determine_colorspace_conversion
             { AV_PIX_FMT_YUV444P14BE,  AV_PIX_FMT_YUV444P14LE,  VideoInfo::CS_YUV444P14,  6, 0, 0 },
             { AV_PIX_FMT_YUV444P16LE,  AV_PIX_FMT_YUV444P16LE,  VideoInfo::CS_YUV444P16,  8, 0, 0 },
             { AV_PIX_FMT_YUV444P16BE,  AV_PIX_FMT_YUV444P16LE,  VideoInfo::CS_YUV444P16,  8, 0, 0 },
+            { AV_PIX_FMT_P410LE,       AV_PIX_FMT_YUV444P10LE,  VideoInfo::CS_YUV444P10,  2, 0, 0 },
+            { AV_PIX_FMT_P412LE,       AV_PIX_FMT_YUV444P12LE,  VideoInfo::CS_YUV444P12,  4, 0, 0 },
+            { AV_PIX_FMT_P416LE,       AV_PIX_FMT_YUV444P16LE,  VideoInfo::CS_YUV444P16,  8, 0, 0 },
             { AV_PIX_FMT_YUV410P,      AV_PIX_FMT_YUV410P,      VideoInfo::CS_YUV9,       0, 2, 2 },
             { AV_PIX_FMT_YUV411P,      AV_PIX_FMT_YUV411P,      VideoInfo::CS_YV411,      0, 2, 0 },
             { AV_PIX_FMT_UYYVYY411,    AV_PIX_FMT_YUV411P,      VideoInfo::CS_YV411,      0, 2, 0 },
@@ -539,89 +661,12 @@ static int determine_colorspace_conversion
     as_vohp->bitdepth_minus_8 = conversion_table[i].output_bitdepth_minus_8;
     as_vohp->sub_width        = conversion_table[i].output_sub_width;
     as_vohp->sub_height       = conversion_table[i].output_sub_height;
-    switch( *output_pixel_format )
-    {
-        case AV_PIX_FMT_YUV420P:
-        case AV_PIX_FMT_YUV422P:
-        case AV_PIX_FMT_YUV444P:
-        case AV_PIX_FMT_YUV410P:
-        case AV_PIX_FMT_YUV411P:
-            as_vohp->make_black_background = make_black_background_planar_yuv;
-            as_vohp->make_frame            = make_frame_planar_yuv;
-            return 0;
-        case AV_PIX_FMT_YUV420P10LE:
-        case AV_PIX_FMT_YUV420P12LE:
-        case AV_PIX_FMT_YUV420P14LE:
-        case AV_PIX_FMT_YUV420P16LE:
-        case AV_PIX_FMT_YUV422P10LE:
-        case AV_PIX_FMT_YUV422P12LE:
-        case AV_PIX_FMT_YUV422P14LE:
-        case AV_PIX_FMT_YUV422P16LE:
-        case AV_PIX_FMT_YUV444P10LE:
-        case AV_PIX_FMT_YUV444P12LE:
-        case AV_PIX_FMT_YUV444P14LE:
-        case AV_PIX_FMT_YUV444P16LE:
-            as_vohp->make_black_background = make_black_background_planar_yuv_interleaved;
-            as_vohp->make_frame            = make_frame_planar_yuv;
-            return 0;
-        case AV_PIX_FMT_YUYV422:
-            as_vohp->make_black_background = make_black_background_packed_yuv422;
-            as_vohp->make_frame            = make_frame_packed_yuv;
-            return 0;
-        case AV_PIX_FMT_YUVA420P:
-        case AV_PIX_FMT_YUVA422P:
-        case AV_PIX_FMT_YUVA444P:
-            as_vohp->make_black_background = make_black_background_planar_yuva;
-            as_vohp->make_frame            = make_frame_planar_yuva;
-            return 0;
-        case AV_PIX_FMT_YUVA420P10LE:
-        case AV_PIX_FMT_YUVA420P16LE:
-        case AV_PIX_FMT_YUVA422P10LE:
-        case AV_PIX_FMT_YUVA422P12LE:
-        case AV_PIX_FMT_YUVA422P16LE:
-        case AV_PIX_FMT_YUVA444P10LE:
-        case AV_PIX_FMT_YUVA444P12LE:
-        case AV_PIX_FMT_YUVA444P16LE:
-            as_vohp->make_black_background = make_black_background_planar_yuva_interleaved;
-            as_vohp->make_frame            = make_frame_planar_yuva;
-            return 0;
-        case AV_PIX_FMT_GRAY8:
-        case AV_PIX_FMT_GRAY10LE:
-        case AV_PIX_FMT_GRAY12LE:
-        case AV_PIX_FMT_GRAY14LE:
-        case AV_PIX_FMT_GRAY16LE:
-            as_vohp->make_black_background = make_black_background_packed_all_zero;
-            as_vohp->make_frame            = make_frame_packed_yuv;
-            return 0;
-        case AV_PIX_FMT_BGR24:
-        case AV_PIX_FMT_BGRA:
-        case AV_PIX_FMT_BGR0:
-        case AV_PIX_FMT_BGR48LE:
-        case AV_PIX_FMT_BGRA64LE:
-        case AV_PIX_FMT_XYZ12LE:
-            as_vohp->make_black_background = make_black_background_packed_all_zero;
-            as_vohp->make_frame            = make_frame_packed_rgb;
-            return 0;
-        case AV_PIX_FMT_GBRP:
-        case AV_PIX_FMT_GBRP10LE:
-        case AV_PIX_FMT_GBRP12LE:
-        case AV_PIX_FMT_GBRP14LE:
-        case AV_PIX_FMT_GBRP16LE:
-            as_vohp->make_black_background = make_black_background_planar_rgb;
-            as_vohp->make_frame            = make_frame_planar_rgb;
-            return 0;
-        case AV_PIX_FMT_GBRAP:
-        case AV_PIX_FMT_GBRAP10LE:
-        case AV_PIX_FMT_GBRAP12LE:
-        case AV_PIX_FMT_GBRAP16LE:
-            as_vohp->make_black_background = make_black_background_planar_rgba;
-            as_vohp->make_frame            = make_frame_planar_rgba;
-            return 0;
-        default :
-            as_vohp->make_black_background = NULL;
-            as_vohp->make_frame            = NULL;
-            return -1;
-    }
+    if( set_frame_maker( as_vohp, *output_pixel_format ) < 0 )
+        return -1;
+    if( input_pixel_format == *output_pixel_format && as_vohp->make_frame != make_frame_packed_rgb )
+        /* swscale would just copy the planes. */
+        as_vohp->make_frame = make_frame_plane_copy;
+    return 0;
 }
 
 int make_frame
@@ -375,6 +375,7 @@ void VS_CC vs_libavsmashsource_create( const VSMap *in, VSMap *out, void *user_d
     int64_t fps_den;
     int64_t prefer_hw_decoder;
     int64_t ff_loglevel;
+    int64_t cache_mb;
     const char *format;
     const char *preferred_decoder_names;
     const char *ff_options;
@@ -388,12 +389,13 @@ void VS_CC vs_libavsmashsource_create( const VSMap *in, VSMap *out, void *user_d
     set_option_int64 ( &fps_den,                 1,    "fpsden",         in, vsapi );
     set_option_int64 ( &prefer_hw_decoder,       0,    "prefer_hw",      in, vsapi );
     set_option_int64 ( &ff_loglevel,             0,    "ff_loglevel",    in, vsapi );
+    set_option_int64 ( &cache_mb,                0,    "cache_mb",       in, vsapi );
     set_option_string( &format,                  NULL, "format",         in, vsapi );
     set_option_string( &preferred_decoder_names, NULL, "decoder",        in, vsapi );
     set_option_string( &ff_options,              NULL, "ff_options",     in, vsapi);
     set_preferred_decoder_names_on_buf( hp->preferred_decoder_names_buf, preferred_decoder_names );
     libavsmash_video_set_seek_mode              ( vdhp, CLIP_VALUE( seek_mode,      0, 2 ) );
-    libavsmash_video_set_forward_seek_threshold ( vdhp, CLIP_VALUE( seek_threshold, 1, 999 ) );
+    libavsmash_video_set_forward_seek_threshold ( vdhp, CLIP_VALUE( seek_threshold, 0, 999 ) );
     libavsmash_video_set_preferred_decoder_names( vdhp, tokenize_preferred_decoder_names( hp->preferred_decoder_names_buf ) );
     libavsmash_video_set_prefer_hw_decoder      ( vdhp, CLIP_VALUE( prefer_hw_decoder, 0, 3 ) );
     libavsmash_video_set_decoder_options        ( vdhp, ff_options );
@@ -436,6 +438,12 @@ void VS_CC vs_libavsmashsource_create( const VSMap *in, VSMap *out, void *user_d
         return;
     }
     /* Set up decoders for this track. */
+    if( lw_setup_frame_lru( vohp, (size_t)CLIP_VALUE( cache_mb, 0, 65536 ) << 20 ) < 0 )
+    {
+        free_handler( &hp );
+        vsapi->setError( out, "lsmas: failed to allocate the decoded frame cache." );
+        return;
+    }
     threads = threads >= 0 ? threads : 0;
     if( prepare_video_decoding( hp, threads, out, core, vsapi ) < 0 )
     {
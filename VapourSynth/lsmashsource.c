@@ -97,7 +97,7 @@ VS_EXTERNAL_API(void) VapourSynthPluginInit( VSConfigPlugin config_func, VSRegis
     register_func
     (
         "LibavSMASHSource",
-        "source:data;track:int:opt;" COMMON_OPTS "ff_loglevel:int:opt;ff_options:data:opt;",
+        "source:data;track:int:opt;" COMMON_OPTS "ff_loglevel:int:opt;ff_options:data:opt;cache_mb:int:opt;",
         vs_libavsmashsource_create,
         NULL,
         plugin
@@ -105,7 +105,7 @@ VS_EXTERNAL_API(void) VapourSynthPluginInit( VSConfigPlugin config_func, VSRegis
     register_func
     (
         "LWLibavSource",
-        "source:data;stream_index:int:opt;cache:int:opt;cachefile:data:opt;" COMMON_OPTS "repeat:int:opt;dominance:int:opt;ff_loglevel:int:opt;cachedir:data:opt;ff_options:data:opt;",
+        "source:data;stream_index:int:opt;cache:int:opt;cachefile:data:opt;" COMMON_OPTS "repeat:int:opt;dominance:int:opt;ff_loglevel:int:opt;cachedir:data:opt;ff_options:data:opt;progressive:int:opt;decoders:int:opt;cache_mb:int:opt;backward_frames:int:opt;prefetch:int:opt;save_seek_failures:int:opt;packet_cache_mb:int:opt;direct_read:int:opt;spare_decoders:int:opt;intra_parallel:int:opt;gop_parallel:int:opt;keyframes_only:int:opt;",
         vs_lwlibavsource_create,
         NULL,
         plugin
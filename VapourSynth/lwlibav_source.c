@@ -75,12 +75,22 @@ void lw_cleanup_audio_output_handler( lw_audio_output_handler_t *aohp ){ }
 #include "video_output.h"
 
 #include "../common/progress.h"
+#include "../common/osdep.h"
 #include "../common/lwlibav_dec.h"
 #include "../common/lwlibav_video.h"
 #include "../common/lwlibav_video_internal.h"
 #include "../common/lwlibav_audio.h"
 #include "../common/lwindex.h"
 
+/* The decode state which serves a frame request at a time. */
+typedef struct
+{
+    lwlibav_video_decode_handler_t *vdhp;
+    lwlibav_video_output_handler_t *vohp;
+    uint32_t                        last_frame_number;  /* the last frame number requested to this decoder */
+    int                             busy;
+} lwlibav_decoder_t;
+
 typedef struct
 {
     VSVideoInfo                     vi[2];
@@ -89,6 +99,15 @@ typedef struct
     lwlibav_video_output_handler_t *vohp;
     lwlibav_audio_decode_handler_t *adhp;
     lwlibav_audio_output_handler_t *aohp;
+    lwlibav_progressive_index_t    *pip;
+    /* The decoder pool for concurrent frame requests.
+     * The first decoder consists of vdhp and vohp above. The others share the index with it. */
+    int                             decoder_count;
+    lwlibav_decoder_t              *decoders;
+    uint32_t                        forward_seek_threshold;
+    size_t                          frame_cache_budget; /* the budget of the decoded frame cache for each decoder */
+    lw_mutex_t                     *mutex;
+    lw_cond_t                      *cond;
     char preferred_decoder_names_buf[PREFERRED_DECODER_NAMES_BUFSIZE];
 } lwlibav_handler_t;
 
@@ -101,6 +120,21 @@ static void free_handler
     if( !hpp || !*hpp )
         return;
     lwlibav_handler_t *hp = *hpp;
+    lwlibav_progressive_index_close( &hp->pip );
+    if( hp->decoders )
+    {
+        /* The first decoder is deallocated below. */
+        for( int i = 1; i < hp->decoder_count; i++ )
+        {
+            lwlibav_video_free_decode_handler( hp->decoders[i].vdhp );
+            lwlibav_video_free_output_handler( hp->decoders[i].vohp );
+        }
+        lw_free( hp->decoders );
+    }
+    if( hp->mutex )
+        lw_mutex_destroy( hp->mutex );
+    if( hp->cond )
+        lw_cond_destroy( hp->cond );
     lw_free( lwlibav_video_get_preferred_decoder_names( hp->vdhp ) );
     lwlibav_video_free_decode_handler( hp->vdhp );
     lwlibav_video_free_output_handler( hp->vohp );
@@ -174,15 +208,14 @@ static void set_frame_properties
 
 static int prepare_video_decoding
 (
-    lwlibav_handler_t *hp,
-    VSMap             *out,
-    VSCore            *core,
-    const VSAPI       *vsapi
+    lwlibav_video_decode_handler_t *vdhp,
+    lwlibav_video_output_handler_t *vohp,
+    VSVideoInfo                    *vi,     /* vi[0]: the main clip, vi[1]: the alpha clip */
+    VSMap                          *out,
+    VSCore                         *core,
+    const VSAPI                    *vsapi
 )
 {
-    lwlibav_video_decode_handler_t *vdhp = hp->vdhp;
-    lwlibav_video_output_handler_t *vohp = hp->vohp;
-    VSVideoInfo                    *vi   = &hp->vi[0];
     /* Import AVIndexEntrys. */
     if( lwlibav_import_av_index_entry( (lwlibav_decode_handler_t *)vdhp ) < 0 )
         return -1;
@@ -195,7 +228,7 @@ static int prepare_video_decoding
     vs_vohp->vsapi     = vsapi;
     int max_width  = lwlibav_video_get_max_width ( vdhp );
     int max_height = lwlibav_video_get_max_height( vdhp );
-    if( vs_setup_video_rendering( vohp, ctx, vi, out, max_width, max_height ) < 0 )
+    if( vs_setup_video_rendering( vohp, ctx, &vi[0], out, max_width, max_height ) < 0 )
         return -1;
     lwlibav_video_set_get_buffer_func( vdhp );
     /* Find the first valid video frame. */
@@ -205,11 +238,11 @@ static int prepare_video_decoding
         return -1;
     }
     if( (av_pix_fmt_desc_get( ctx->pix_fmt )->flags & AV_PIX_FMT_FLAG_ALPHA)
-     && hp->vi[0].format )
+     && vi[0].format )
     {
-        hp->vi[1] = hp->vi[0];
-        hp->vi[1].format = vsapi->registerFormat( cmGray, hp->vi[0].format->sampleType, hp->vi[0].format->bitsPerSample, 0, 0, core );
-        vs_vohp->background_frame[1] = vsapi->newVideoFrame( hp->vi[1].format, hp->vi[1].width, hp->vi[1].height, NULL, core );
+        vi[1] = vi[0];
+        vi[1].format = vsapi->registerFormat( cmGray, vi[0].format->sampleType, vi[0].format->bitsPerSample, 0, 0, core );
+        vs_vohp->background_frame[1] = vsapi->newVideoFrame( vi[1].format, vi[1].width, vi[1].height, NULL, core );
         if( !vs_vohp->background_frame[1] )
         {
             set_error_on_init( out, vsapi, "lsmas: failed to allocate memory for the alpha frame data." );
@@ -221,15 +254,103 @@ static int prepare_video_decoding
     return 0;
 }
 
-static const VSFrameRef *VS_CC vs_filter_get_frame( int n, int activation_reason, void **instance_data, void **frame_data, VSFrameContext *frame_ctx, VSCore *core, const VSAPI *vsapi )
+/* Estimate the cost for the decoder to output the frame from the last requested one.
+ * Decoding forward within the seek threshold is cheaper than any seek. */
+static uint32_t estimate_decoding_cost
+(
+    lwlibav_handler_t *hp,
+    lwlibav_decoder_t *decoder,
+    uint32_t           frame_number
+)
 {
-    if( activation_reason != arInitial )
-        return NULL;
-    lwlibav_handler_t *hp = (lwlibav_handler_t *)*instance_data;
-    VSVideoInfo       *vi = &hp->vi[0];
-    uint32_t frame_number = MIN( n + 1, vi->numFrames );    /* frame_number is 1-origin. */
-    lwlibav_video_decode_handler_t *vdhp = hp->vdhp;
-    lwlibav_video_output_handler_t *vohp = hp->vohp;
+    uint32_t last_frame_number = decoder->last_frame_number;
+    if( last_frame_number == 0 )
+        return hp->forward_seek_threshold + 1;  /* The unused decoder has no position to lose. */
+    if( frame_number >= last_frame_number && frame_number - last_frame_number <= hp->forward_seek_threshold )
+        return frame_number - last_frame_number;
+    /* Prefer the nearest decoder so that the others keep their positions for the other requests. */
+    uint32_t distance = frame_number > last_frame_number ? frame_number - last_frame_number
+                                                         : last_frame_number - frame_number;
+    return hp->forward_seek_threshold + 2 + MIN( distance, UINT32_MAX - hp->forward_seek_threshold - 2 );
+}
+
+/* Take the idle decoder with the lowest cost to output the frame.
+ * Wait until any decoder becomes idle if all decoders are busy. */
+static lwlibav_decoder_t *acquire_decoder
+(
+    lwlibav_handler_t *hp,
+    uint32_t           frame_number
+)
+{
+    lw_mutex_lock( hp->mutex );
+    lwlibav_decoder_t *decoder = NULL;
+    while( 1 )
+    {
+        uint32_t min_cost = UINT32_MAX;
+        for( int i = 0; i < hp->decoder_count; i++ )
+        {
+            if( hp->decoders[i].busy )
+                continue;
+            uint32_t cost = estimate_decoding_cost( hp, &hp->decoders[i], frame_number );
+            if( !decoder || cost < min_cost )
+            {
+                decoder  = &hp->decoders[i];
+                min_cost = cost;
+            }
+        }
+        if( decoder )
+            break;
+        lw_cond_wait( hp->cond, hp->mutex );
+    }
+    decoder->busy = 1;
+    lw_mutex_unlock( hp->mutex );
+    return decoder;
+}
+
+static void release_decoder
+(
+    lwlibav_handler_t *hp,
+    lwlibav_decoder_t *decoder,
+    uint32_t           frame_number
+)
+{
+    lw_mutex_lock( hp->mutex );
+    decoder->busy              = 0;
+    decoder->last_frame_number = frame_number;
+    lw_cond_signal( hp->cond );
+    lw_mutex_unlock( hp->mutex );
+}
+
+/* Export the costs measured for the adaptive seek decision. */
+static void set_seek_stats_properties
+(
+    lwlibav_video_decode_handler_t *vdhp,
+    VSFrameRef                     *vs_frame,
+    const VSAPI                    *vsapi
+)
+{
+    lwlibav_video_seek_stats_t stats;
+    lwlibav_video_get_seek_stats( vdhp, &stats );
+    VSMap *props = vsapi->getFramePropsRW( vs_frame );
+    vsapi->propSetFloat( props, "DecodeCost",   stats.decode_cost,   paReplace );
+    vsapi->propSetFloat( props, "SeekCost",     stats.seek_cost,     paReplace );
+    vsapi->propSetInt  ( props, "ForwardCount", stats.forward_count, paReplace );
+    vsapi->propSetInt  ( props, "SeekCount",    stats.seek_count,    paReplace );
+}
+
+static const VSFrameRef *get_frame
+(
+    lwlibav_handler_t              *hp,
+    lwlibav_video_decode_handler_t *vdhp,
+    lwlibav_video_output_handler_t *vohp,
+    int                             n,
+    uint32_t                        frame_number,
+    VSFrameContext                 *frame_ctx,
+    VSCore                         *core,
+    const VSAPI                    *vsapi
+)
+{
+    VSVideoInfo *vi = &hp->vi[0];
     if( lwlibav_video_get_error( vdhp ) )
     {
         vsapi->setFilterError( "lsmas: failed to output a video frame.", frame_ctx );
@@ -243,6 +364,18 @@ static const VSFrameRef *VS_CC vs_filter_get_frame( int n, int activation_reason
     lw_log_handler_t *lhp = lwlibav_video_get_log_handler( vdhp );
     lhp->priv     = &vsbh;
     lhp->show_log = set_error;
+    if( hp->pip )
+    {
+        /* Wait until the desired video frame is indexed.
+         * The number of frames could be less than the estimated one, so output the last frame beyond the end. */
+        uint32_t available_count = lwlibav_progressive_index_wait( hp->pip, vdhp, vohp, frame_number );
+        if( available_count == 0 )
+        {
+            vsapi->setFilterError( "lsmas: failed to index a video frame.", frame_ctx );
+            return NULL;
+        }
+        frame_number = MIN( frame_number, available_count );
+    }
     /* Get and decode the desired video frame. */
     vs_video_output_handler_t *vs_vohp = (vs_video_output_handler_t *)vohp->private_handler;
     vs_vohp->frame_ctx = frame_ctx;
@@ -262,8 +395,8 @@ static const VSFrameRef *VS_CC vs_filter_get_frame( int n, int activation_reason
         vsapi->setFilterError( "lsmas: failed to output a video frame.", frame_ctx );
         return NULL;
     }
-    AVCodecContext *ctx = lwlibav_video_get_codec_context( vdhp );
-    if ( output_index == 0 && ( av_pix_fmt_desc_get( ctx->pix_fmt )->flags & AV_PIX_FMT_FLAG_ALPHA ) )
+    /* Refer to the output frame instead of the decoder which may be decoding ahead. */
+    if ( output_index == 0 && ( av_pix_fmt_desc_get( (enum AVPixelFormat)av_frame->format )->flags & AV_PIX_FMT_FLAG_ALPHA ) )
     {
         /* api4 compat: save alpha clip into the _Alpha property */
         VSFrameRef *vs_frame2 = make_frame( vohp, av_frame, 1 );
@@ -307,6 +440,132 @@ static const VSFrameRef *VS_CC vs_filter_get_frame( int n, int activation_reason
         }
     }
     set_frame_properties( vi, av_frame, vdhp->format->streams[vdhp->stream_index], vs_frame, top, bottom, vsapi, n );
+    if( vdhp->forward_seek_threshold == 0 )
+        set_seek_stats_properties( vdhp, vs_frame, vsapi );
+    return vs_frame;
+}
+
+/* Set up an extra decoder which has its own demuxer and decoder.
+ * The index is attached from the one constructed for the first decoder if the index cache is available. */
+static int prepare_extra_decoder
+(
+    lwlibav_handler_t    *hp,
+    lwlibav_decoder_t    *decoder,
+    lwlibav_option_t     *opt,
+    lw_log_handler_t     *lhp,
+    progress_indicator_t *indicator,
+    VSMap                *out,
+    VSCore               *core,
+    const VSAPI          *vsapi
+)
+{
+    lwlibav_video_decode_handler_t *vdhp = lwlibav_video_alloc_decode_handler();
+    lwlibav_video_output_handler_t *vohp = lwlibav_video_alloc_output_handler();
+    decoder->vdhp = vdhp;
+    decoder->vohp = vohp;
+    vs_video_output_handler_t *vs_vohp = vohp ? vs_allocate_video_output_handler( vohp ) : NULL;
+    if( !vdhp || !vs_vohp )
+    {
+        vsapi->setError( out, "lsmas: failed to allocate the decoder pool." );
+        return -1;
+    }
+    /* Follow the settings of the first decoder. */
+    lwlibav_video_decode_handler_t *first_vdhp    = hp->vdhp;
+    vs_video_output_handler_t      *first_vs_vohp = (vs_video_output_handler_t *)hp->vohp->private_handler;
+    lwlibav_video_set_seek_mode              ( vdhp, first_vdhp->seek_mode );
+    lwlibav_video_set_backward_buffer_size   ( vdhp, first_vdhp->backward.capacity );
+    lwlibav_video_set_packet_cache_size      ( vdhp, first_vdhp->packet_cache.budget );
+    lwlibav_video_set_direct_read            ( vdhp, first_vdhp->direct_reader.requested );
+    lwlibav_video_set_spare_decoders         ( vdhp, first_vdhp->spare_decoders.capacity );
+    lwlibav_video_set_intra_parallel         ( vdhp, first_vdhp->intra_parallel.worker_count );
+    lwlibav_video_set_gop_parallel           ( vdhp, first_vdhp->gop_parallel.worker_count );
+    lwlibav_video_set_keyframes_only         ( vdhp, first_vdhp->keyframes.mode );
+    lwlibav_video_set_forward_seek_threshold ( vdhp, first_vdhp->forward_seek_threshold );
+    lwlibav_video_set_preferred_decoder_names( vdhp, first_vdhp->preferred_decoder_names );
+    lwlibav_video_set_prefer_hw_decoder      ( vdhp, first_vdhp->prefer_hw_decoder );
+    lwlibav_video_set_decoder_options        ( vdhp, first_vdhp->ff_options );
+    vs_vohp->variable_info          = first_vs_vohp->variable_info;
+    vs_vohp->direct_rendering       = first_vs_vohp->direct_rendering;
+    vs_vohp->vs_output_pixel_format = first_vs_vohp->vs_output_pixel_format;
+    if( lw_setup_frame_lru( vohp, hp->frame_cache_budget ) < 0 )
+    {
+        vsapi->setError( out, "lsmas: failed to allocate the decoded frame cache." );
+        return -1;
+    }
+    lwlibav_file_handler_t          lwh  = { 0 };
+    lwlibav_audio_decode_handler_t *adhp = lwlibav_audio_alloc_decode_handler();
+    lwlibav_audio_output_handler_t *aohp = lwlibav_audio_alloc_output_handler();
+    int ret = adhp && aohp ? lwlibav_construct_index( &lwh, vdhp, vohp, adhp, aohp, lhp, opt, indicator, NULL ) : -1;
+    lwlibav_audio_free_decode_handler( adhp );
+    lwlibav_audio_free_output_handler( aohp );
+    if( ret < 0 )
+    {
+        lw_free( lwh.file_path );
+        set_error_on_init( out, vsapi, "lsmas: failed to construct index for %s.", opt->file_path );
+        return -1;
+    }
+    lwlibav_video_set_log_handler( vdhp, lhp );
+    ret = lwlibav_video_get_desired_track( lwh.file_path, vdhp, lwh.threads );
+    lw_free( lwh.file_path );
+    if( ret < 0 )
+    {
+        vsapi->setError( out, "lsmas: failed to get video track." );
+        return -1;
+    }
+    VSVideoInfo vi[2] = { hp->vi[0], hp->vi[1] };
+    return prepare_video_decoding( vdhp, vohp, vi, out, core, vsapi );
+}
+
+/* Set up the decoder pool to serve concurrent frame requests.
+ * Return the number of decoders, or a negative value on failure. */
+static int prepare_decoder_pool
+(
+    lwlibav_handler_t    *hp,
+    int                   decoder_count,
+    lwlibav_option_t     *opt,
+    lw_log_handler_t     *lhp,
+    progress_indicator_t *indicator,
+    VSMap                *out,
+    VSCore               *core,
+    const VSAPI          *vsapi
+)
+{
+    hp->decoders = (lwlibav_decoder_t *)lw_malloc_zero( decoder_count * sizeof(lwlibav_decoder_t) );
+    hp->mutex    = lw_mutex_create();
+    hp->cond     = lw_cond_create();
+    if( !hp->decoders || !hp->mutex || !hp->cond )
+    {
+        vsapi->setError( out, "lsmas: failed to allocate the decoder pool." );
+        return -1;
+    }
+    hp->decoders[0].vdhp = hp->vdhp;
+    hp->decoders[0].vohp = hp->vohp;
+    hp->decoder_count    = 1;
+    while( hp->decoder_count < decoder_count )
+    {
+        /* Each option is modified through the index construction, so start from the original ones every time.
+         * The index shared in the process is looked up by the source file even if the input is an index file. */
+        lwlibav_option_t decoder_opt = *opt;
+        if( hp->vdhp->index_cache )
+            decoder_opt.file_path = hp->lwh.file_path;
+        lwlibav_decoder_t *decoder = &hp->decoders[ hp->decoder_count++ ];
+        if( prepare_extra_decoder( hp, decoder, &decoder_opt, lhp, indicator, out, core, vsapi ) < 0 )
+            return -1;
+    }
+    return hp->decoder_count;
+}
+
+static const VSFrameRef *VS_CC vs_filter_get_frame( int n, int activation_reason, void **instance_data, void **frame_data, VSFrameContext *frame_ctx, VSCore *core, const VSAPI *vsapi )
+{
+    if( activation_reason != arInitial )
+        return NULL;
+    lwlibav_handler_t *hp = (lwlibav_handler_t *)*instance_data;
+    uint32_t frame_number = MIN( n + 1, hp->vi[0].numFrames );  /* frame_number is 1-origin. */
+    if( hp->decoder_count <= 1 )
+        return get_frame( hp, hp->vdhp, hp->vohp, n, frame_number, frame_ctx, core, vsapi );
+    lwlibav_decoder_t *decoder  = acquire_decoder( hp, frame_number );
+    const VSFrameRef  *vs_frame = get_frame( hp, decoder->vdhp, decoder->vohp, n, frame_number, frame_ctx, core, vsapi );
+    release_decoder( hp, decoder, frame_number );
     return vs_frame;
 }
 
@@ -359,6 +618,18 @@ void VS_CC vs_lwlibavsource_create( const VSMap *in, VSMap *out, void *user_data
     int64_t apply_repeat_flag;
     int64_t field_dominance;
     int64_t ff_loglevel;
+    int64_t progressive;
+    int64_t decoders;
+    int64_t cache_mb;
+    int64_t backward_frames;
+    int64_t prefetch;
+    int64_t save_seek_failures;
+    int64_t packet_cache_mb;
+    int64_t direct_read;
+    int64_t spare_decoders;
+    int64_t intra_parallel;
+    int64_t gop_parallel;
+    int64_t keyframes_only;
     const char *index_file_path;
     const char *format;
     const char *preferred_decoder_names;
@@ -377,12 +648,53 @@ void VS_CC vs_lwlibavsource_create( const VSMap *in, VSMap *out, void *user_data
     set_option_int64 ( &apply_repeat_flag,       2,    "repeat",         in, vsapi );
     set_option_int64 ( &field_dominance,         0,    "dominance",      in, vsapi );
     set_option_int64 ( &ff_loglevel,             0,    "ff_loglevel",    in, vsapi );
+    set_option_int64 ( &progressive,             0,    "progressive",    in, vsapi );
+    set_option_int64 ( &decoders,                1,    "decoders",       in, vsapi );
+    set_option_int64 ( &cache_mb,                0,    "cache_mb",       in, vsapi );
+    set_option_int64 ( &backward_frames,         0,    "backward_frames", in, vsapi );
+    set_option_int64 ( &prefetch,                0,    "prefetch",       in, vsapi );
+    set_option_int64 ( &save_seek_failures,      0,    "save_seek_failures", in, vsapi );
+    set_option_int64 ( &packet_cache_mb,         0,    "packet_cache_mb", in, vsapi );
+    set_option_int64 ( &direct_read,             0,    "direct_read",    in, vsapi );
+    set_option_int64 ( &spare_decoders,          0,    "spare_decoders", in, vsapi );
+    set_option_int64 ( &intra_parallel,          0,    "intra_parallel", in, vsapi );
+    set_option_int64 ( &gop_parallel,            0,    "gop_parallel",   in, vsapi );
+    set_option_int64 ( &keyframes_only,          0,    "keyframes_only", in, vsapi );
     set_option_string( &index_file_path,         NULL, "cachefile",      in, vsapi );
     set_option_string( &format,                  NULL, "format",         in, vsapi );
     set_option_string( &preferred_decoder_names, NULL, "decoder",        in, vsapi );
     set_option_string( &cache_dir,               NULL, "cachedir",       in, vsapi );
     set_option_string( &ff_options,              NULL, "ff_options",     in, vsapi);
     set_preferred_decoder_names_on_buf( hp->preferred_decoder_names_buf, preferred_decoder_names );
+    if( progressive )
+    {
+        /* Repeat control and VFR->CFR conversion require all frames.
+         * The frames indexed progressively are available only to the first decoder. */
+        apply_repeat_flag = 0;
+        fps_num           = 0;
+        decoders          = 1;
+        prefetch          = 0;
+        direct_read       = 0;
+        intra_parallel    = 0;
+        gop_parallel      = 0;
+        keyframes_only    = 0;
+    }
+    if( keyframes_only )
+    {
+        /* Only the keyframes are exposed and each is decoded on its own by a decoder with the default buffers. */
+        apply_repeat_flag = 0;
+        fps_num           = 0;
+        decoders          = 1;
+        direct_rendering  = 0;
+    }
+    /* The frame buffers for direct rendering can't be allocated in the background.
+     * The decoder pool already serves concurrent requests. */
+    if( direct_rendering || decoders > 1 )
+    {
+        prefetch       = 0;
+        intra_parallel = 0;
+        gop_parallel   = 0;
+    }
     /* Set options. */
     lwlibav_option_t opt;
     opt.file_path         = file_path;
@@ -397,14 +709,27 @@ void VS_CC vs_lwlibavsource_create( const VSMap *in, VSMap *out, void *user_data
     opt.force_audio_index = -2;
     opt.apply_repeat_flag = apply_repeat_flag;
     opt.field_dominance   = CLIP_VALUE( field_dominance, 0, 2 );    /* 0: Obey source flags, 1: TFF, 2: BFF */
+    opt.text_index        = 0;
+    opt.save_seek_failures = CLIP_VALUE( save_seek_failures, 0, 1 );
     opt.vfr2cfr.active    = fps_num > 0 && fps_den > 0 ? 1 : 0;
     opt.vfr2cfr.fps_num   = fps_num;
     opt.vfr2cfr.fps_den   = fps_den;
+    opt.progressive       = NULL;
     lwlibav_video_set_seek_mode              ( vdhp, CLIP_VALUE( seek_mode,      0, 2 ) );
-    lwlibav_video_set_forward_seek_threshold ( vdhp, CLIP_VALUE( seek_threshold, 1, 999 ) );
+    lwlibav_video_set_backward_buffer_size   ( vdhp, CLIP_VALUE( backward_frames, 0, 999 ) );
+    lwlibav_video_set_prefetch_depth         ( vdhp, CLIP_VALUE( prefetch, 0, 999 ) );
+    lwlibav_video_set_packet_cache_size      ( vdhp, (size_t)CLIP_VALUE( packet_cache_mb, 0, 4096 ) << 20 );
+    lwlibav_video_set_direct_read            ( vdhp, CLIP_VALUE( direct_read, 0, 1 ) );
+    lwlibav_video_set_spare_decoders         ( vdhp, CLIP_VALUE( spare_decoders, 0, 16 ) );
+    lwlibav_video_set_intra_parallel         ( vdhp, CLIP_VALUE( intra_parallel, 0, 64 ) );
+    lwlibav_video_set_gop_parallel           ( vdhp, CLIP_VALUE( gop_parallel, 0, 64 ) );
+    lwlibav_video_set_keyframes_only         ( vdhp, CLIP_VALUE( keyframes_only, 0, 2 ) );
+    lwlibav_video_set_forward_seek_threshold ( vdhp, CLIP_VALUE( seek_threshold, 0, 999 ) );
     lwlibav_video_set_preferred_decoder_names( vdhp, tokenize_preferred_decoder_names( hp->preferred_decoder_names_buf ) );
     lwlibav_video_set_prefer_hw_decoder      ( vdhp, CLIP_VALUE( prefer_hw_decoder, 0, 3 ) );
     lwlibav_video_set_decoder_options        ( vdhp, ff_options );
+    hp->forward_seek_threshold      = seek_threshold > 0 ? CLIP_VALUE( seek_threshold, 1, 999 ) : 10;   /* for the decoder pool */
+    hp->frame_cache_budget          = (size_t)CLIP_VALUE( cache_mb, 0, 65536 ) << 20;
     vs_vohp->variable_info          = CLIP_VALUE( variable_info,     0, 1 );
     vs_vohp->direct_rendering       = CLIP_VALUE( direct_rendering,  0, 1 ) && !format;
     vs_vohp->vs_output_pixel_format = vs_vohp->variable_info ? pfNone : get_vs_output_pixel_format( format );
@@ -432,7 +757,15 @@ void VS_CC vs_lwlibavsource_create( const VSMap *in, VSMap *out, void *user_data
     indicator.update = update_indicator;
     indicator.close  = close_indicator;
     /* Construct index. */
-    int ret = lwlibav_construct_index( lwhp, vdhp, vohp, hp->adhp, hp->aohp, &lh, &opt, &indicator, NULL );
+    lwlibav_option_t pool_opt = opt;
+    int ret;
+    if( progressive )
+    {
+        hp->pip = lwlibav_progressive_index_start( lwhp, vdhp, vohp, &opt );
+        ret = hp->pip ? 0 : -1;
+    }
+    else
+        ret = lwlibav_construct_index( lwhp, vdhp, vohp, hp->adhp, hp->aohp, &lh, &opt, &indicator, NULL );
     lwlibav_audio_free_decode_handler_ptr( &hp->adhp );
     lwlibav_audio_free_output_handler_ptr( &hp->aohp );
     if( ret < 0 )
@@ -459,16 +792,55 @@ void VS_CC vs_lwlibavsource_create( const VSMap *in, VSMap *out, void *user_data
         vsapi->setError( out, "lsmas: failed to get video track." );
         return;
     }
+    /* Expose only the keyframes if requested. */
+    if( lwlibav_video_create_keyframe_list( vdhp, vohp ) < 0 )
+    {
+        free_handler( &hp );
+        vsapi->setError( out, "lsmas: failed to create the keyframe list." );
+        return;
+    }
     /* Set average framerate. */
-    hp->vi[0].numFrames = vohp->frame_count;
     hp->vi[0].fpsNum    = 25;
     hp->vi[0].fpsDen    = 1;
-    lwlibav_video_setup_timestamp_info( lwhp, vdhp, vohp, &hp->vi[0].fpsNum, &hp->vi[0].fpsDen, opt.apply_repeat_flag );
+    int indexing = hp->pip && !lwlibav_progressive_index_is_complete( hp->pip );
+    if( indexing )
+    {
+        /* Until the indexing completes, use the framerate by libavformat and the number of frames estimated from the duration. */
+        lwlibav_video_setup_timestamp_info( lwhp, vdhp, vohp, &hp->vi[0].fpsNum, &hp->vi[0].fpsDen, 1 );
+        hp->vi[0].numFrames = lwlibav_progressive_index_estimate_frame_count( hp->pip, vdhp, vohp, hp->vi[0].fpsNum, hp->vi[0].fpsDen );
+        indexing = (hp->vi[0].numFrames > 0);
+        if( !indexing && lwlibav_progressive_index_wait( hp->pip, vdhp, vohp, UINT32_MAX ) == 0 )
+        {
+            free_handler( &hp );
+            set_error_on_init( out, vsapi, "lsmas: failed to construct index for %s.", opt.file_path );
+            return;
+        }
+    }
+    if( !indexing )
+    {
+        hp->vi[0].numFrames = vohp->frame_count;
+        lwlibav_video_setup_timestamp_info( lwhp, vdhp, vohp, &hp->vi[0].fpsNum, &hp->vi[0].fpsDen, opt.apply_repeat_flag );
+    }
     /* Set up decoders for this stream. */
-    if( prepare_video_decoding( hp, out, core, vsapi ) < 0 )
+    if( lw_setup_frame_lru( vohp, hp->frame_cache_budget ) < 0 )
+    {
+        free_handler( &hp );
+        vsapi->setError( out, "lsmas: failed to allocate the decoded frame cache." );
+        return;
+    }
+    if( prepare_video_decoding( vdhp, vohp, hp->vi, out, core, vsapi ) < 0 )
+    {
+        free_handler( &hp );
+        return;
+    }
+    decoders = CLIP_VALUE( decoders, 1, 64 );
+    if( decoders > 1 && prepare_decoder_pool( hp, (int)decoders, &pool_opt, &lh, &indicator, out, core, vsapi ) < 0 )
     {
         free_handler( &hp );
         return;
     }
-    vsapi->createFilter( in, out, "LWLibavSource", vs_filter_init, vs_filter_get_frame, vs_filter_free, fmUnordered, nfMakeLinear, hp, core );
+    /* The decoder pool serves scattered requests by the decoder nearest to each, so they are not made linear then. */
+    VSFilterMode filter_mode = decoders > 1 ? fmParallel : fmUnordered;
+    int          flags       = decoders > 1 ? 0          : nfMakeLinear;
+    vsapi->createFilter( in, out, "LWLibavSource", vs_filter_init, vs_filter_get_frame, vs_filter_free, filter_mode, flags, hp, core );
 }
@@ -37,6 +37,9 @@
 
 #include "lsmashsource.h"
 #include "video_output.h"
+#ifdef SSE2_ENABLED
+#include "../common/planar_yuv_sse2.h"
+#endif // SSE2_ENABLED
 #include <VSHelper.h>
 
 typedef struct
@@ -123,30 +126,39 @@ static void make_frame_planar_yuv
             0
         }
     };
-    if( vshp->input_pixel_format == AV_PIX_FMT_P010LE && vshp->output_pixel_format == AV_PIX_FMT_YUV420P10LE )
-    {
 #ifdef SSE2_ENABLED
-        const int width_y       = vsapi->getFrameWidth( vs_frame, 0 );
-        const int width_uv      = vsapi->getFrameWidth( vs_frame, 1 );
-        const int height_y      = vsapi->getFrameHeight( vs_frame, 0 );
-        const int height_uv     = vsapi->getFrameHeight( vs_frame, 1 );
-        const int src_stride_y  = av_picture->linesize[0] / sizeof( uint16_t );
-        const int src_stride_uv = av_picture->linesize[1] / sizeof( uint16_t );
-        const int dst_stride_y  = vs_picture.linesize[0] / sizeof( uint16_t );
-        const int dst_stride_uv = vs_picture.linesize[1] / sizeof( uint16_t );
-        uint16_t *srcp_y        = (uint16_t *)av_picture->data[0];
-        uint16_t *srcp_uv       = (uint16_t *)av_picture->data[1];
-        uint16_t *dstp_y        = (uint16_t *)vs_picture.data[0];
-        uint16_t *dstp_u        = (uint16_t *)vs_picture.data[1];
-        uint16_t *dstp_v        = (uint16_t *)vs_picture.data[2];
-
-        planar_yuv_sse2(dstp_y, dstp_u, dstp_v, srcp_y, srcp_uv, dst_stride_y, dst_stride_uv, src_stride_y, src_stride_uv,
-            width_y, width_uv, height_y, height_uv);
-#else
-        sws_scale(vshp->sws_ctx, (const uint8_t* const*)av_picture->data, av_picture->linesize, 0, av_picture->height, vs_picture.data, vs_picture.linesize);
+    /* Split the interleaved chroma of semi-planar formats such as NV12 and P010 without swscale. */
+    if( convert_semi_planar_yuv( vshp->input_pixel_format, vshp->output_pixel_format,
+                                 vs_picture.data, vs_picture.linesize, av_picture->data, av_picture->linesize,
+                                 MIN( av_picture->width,  vsapi->getFrameWidth ( vs_frame, 0 ) ),
+                                 MIN( av_picture->height, vsapi->getFrameHeight( vs_frame, 0 ) ) ) > 0 )
+        return;
 #endif // SSE2_ENABLED
+    sws_scale( vshp->sws_ctx, (const uint8_t* const*)av_picture->data, av_picture->linesize, 0, av_picture->height, vs_picture.data, vs_picture.linesize );
+}
+
+static void make_frame_plane_copy
+(
+    lw_video_scaler_handler_t *vshp,
+    AVFrame                   *av_picture,
+    const component_reorder_t *component_reorder,
+    VSFrameRef                *vs_frame,
+    VSFrameContext            *frame_ctx,
+    const VSAPI               *vsapi
+)
+{
+    /* The output pixel format is the same as the input one, so just copy each plane to the corresponding one. */
+    vs_picture_t vs_picture = { { NULL } };
+    int num_planes = MIN( vsapi->getFrameFormat( vs_frame )->numPlanes, 3 );
+    for( int i = 0; i < num_planes; i++ )
+    {
+        vs_picture.data    [i] = vsapi->getWritePtr( vs_frame, component_reorder[i] );
+        vs_picture.linesize[i] = vsapi->getStride  ( vs_frame, component_reorder[i] );
     }
-    else
+    if( lw_copy_planes( vshp, vshp->output_pixel_format,
+                        vs_picture.data, vs_picture.linesize, av_picture->data, av_picture->linesize,
+                        MIN( av_picture->width,  vsapi->getFrameWidth ( vs_frame, 0 ) ),
+                        MIN( av_picture->height, vsapi->getFrameHeight( vs_frame, 0 ) ) ) < 0 )
         sws_scale( vshp->sws_ctx, (const uint8_t* const*)av_picture->data, av_picture->linesize, 0, av_picture->height, vs_picture.data, vs_picture.linesize );
 }
 
@@ -569,6 +581,8 @@ static int determine_colorspace_conversion
             { AV_PIX_FMT_YUV420P10BE,  pfYUV420P10, 1 },
             { AV_PIX_FMT_P010LE,       pfYUV420P10, 1 },
             { AV_PIX_FMT_P010BE,       pfYUV420P10, 1 },
+            { AV_PIX_FMT_P210LE,       pfYUV422P10, 1 },
+            { AV_PIX_FMT_P410LE,       pfYUV444P10, 1 },
             { AV_PIX_FMT_YUV422P10LE,  pfYUV422P10, 0 },
             { AV_PIX_FMT_YUV422P10BE,  pfYUV422P10, 1 },
             { AV_PIX_FMT_NV20LE,       pfYUV422P10, 1 },
@@ -583,6 +597,9 @@ static int determine_colorspace_conversion
             { AV_PIX_FMT_YUV422P12BE,  pfYUV422P12, 1 },
             { AV_PIX_FMT_YUV444P12LE,  pfYUV444P12, 0 },
             { AV_PIX_FMT_YUV444P12BE,  pfYUV444P12, 1 },
+            { AV_PIX_FMT_P012LE,       pfYUV420P12, 1 },
+            { AV_PIX_FMT_P212LE,       pfYUV422P12, 1 },
+            { AV_PIX_FMT_P412LE,       pfYUV444P12, 1 },
             { AV_PIX_FMT_YUV420P14LE,  pfYUV420P14, 0 },
             { AV_PIX_FMT_YUV420P14BE,  pfYUV420P14, 1 },
             { AV_PIX_FMT_YUV422P14LE,  pfYUV422P14, 0 },
@@ -593,6 +610,8 @@ static int determine_colorspace_conversion
             { AV_PIX_FMT_YUV420P16BE,  pfYUV420P16, 1 },
             { AV_PIX_FMT_P016LE,       pfYUV420P16, 1 },
             { AV_PIX_FMT_P016BE,       pfYUV420P16, 1 },
+            { AV_PIX_FMT_P216LE,       pfYUV422P16, 1 },
+            { AV_PIX_FMT_P416LE,       pfYUV444P16, 1 },
             { AV_PIX_FMT_YUV422P16LE,  pfYUV422P16, 0 },
             { AV_PIX_FMT_YUV422P16BE,  pfYUV422P16, 1 },
             { AV_PIX_FMT_YUV444P16LE,  pfYUV444P16, 0 },
@@ -683,7 +702,12 @@ static int determine_colorspace_conversion
     if( *output_pixel_format == AV_PIX_FMT_NONE )
         return -1;
     vs_vohp->component_reorder[output_index] = get_component_reorder( output_index ? input_pixel_format : *output_pixel_format );
-    return set_frame_maker( vs_vohp, output_index );
+    if( set_frame_maker( vs_vohp, output_index ) < 0 )
+        return -1;
+    if( !fmt_conv_required && output_index == 0 )
+        /* swscale would just copy the planes. */
+        vs_vohp->make_frame[output_index] = make_frame_plane_copy;
+    return 0;
 }
 
 typedef struct
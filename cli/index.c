@@ -141,10 +141,17 @@ static void close_indicator( progress_handler_t *php )
 int main (const int argc, const char* argv[])
 {
     bool has_index_path = false;
-    if (argc < 2 || argc > 3) {
-        fprintf(stderr, "Usage: %s file.mkv [index.lwi]\n", argv[0]);
+    bool text_index = false;
+    int arg = 1;
+    if (argc >= 2 && !strcmp(argv[1], "--text")) {
+        /* Write the index file in the text format for debugging. */
+        text_index = true;
+        arg++;
+    }
+    if (argc - arg < 1 || argc - arg > 2) {
+        fprintf(stderr, "Usage: %s [--text] file.mkv [index.lwi]\n", argv[0]);
         return 1;
-    } else if (argc == 3) {
+    } else if (argc - arg == 2) {
         has_index_path = true;
     }
 
@@ -160,15 +167,18 @@ int main (const int argc, const char* argv[])
     lwlibav_video_output_handler_t *vohp = hp->vohp;
     /* Get options. */
     lwlibav_option_t opt;
-    opt.file_path         = argv[1];
+    opt.file_path         = argv[arg];
     opt.cache_dir         = "";
     opt.no_create_index   = 0;
-    opt.index_file_path   = has_index_path ? argv[2] : NULL;
+    opt.index_file_path   = has_index_path ? argv[arg + 1] : NULL;
     opt.threads           = 0;
     opt.force_video       = 0;
     opt.force_video_index = -1;
     opt.force_audio       = 0;
     opt.force_audio_index = -2;
+    opt.text_index        = text_index;
+    opt.save_seek_failures = 0;
+    opt.progressive       = NULL;
     /* Set up progress indicator. */
     progress_indicator_t indicator;
     indicator.open   = NULL;
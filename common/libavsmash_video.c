@@ -32,6 +32,7 @@ extern "C"
 #include <lsmash.h>
 #include <libavformat/avformat.h>
 #include <libavcodec/avcodec.h>
+#include <libavutil/time.h>
 #ifdef __cplusplus
 }
 #endif  /* __cplusplus */
@@ -821,6 +822,59 @@ static int get_picture
     return got_picture ? 0 : -1;
 }
 
+#define SEEK_COST_WEIGHT             0.125  /* the weight of a new measurement in the moving averages of the costs */
+#define SEEK_COST_FALLBACK_THRESHOLD 10     /* the forward seek threshold used until the costs are measured */
+
+/* Return 1 if decoding forward from the last requested sample is expected to get the requested sample faster than seeking.
+ * Otherwise return 0. */
+static int is_decoding_forward_cheaper
+(
+    libavsmash_video_decode_handler_t *vdhp,
+    uint32_t                           sample_number
+)
+{
+    if( sample_number <= vdhp->last_sample_number )
+        return 0;
+    if( vdhp->forward_seek_threshold )
+        return sample_number <= vdhp->last_sample_number + vdhp->forward_seek_threshold;
+    if( vdhp->decode_measurements == 0 || vdhp->seek_measurements == 0 )
+        return sample_number <= vdhp->last_sample_number + SEEK_COST_FALLBACK_THRESHOLD;
+    /* Seeking skips the samples between the last decoded one and the random accessible one at the cost of a seek. */
+    uint32_t rap_number;
+    find_random_accessible_point( vdhp, sample_number, 0, &rap_number );
+    uint32_t next_number = get_decoding_sample_number( vdhp->order_converter, vdhp->last_sample_number ) + 1;
+    return rap_number <= next_number
+        || (rap_number - next_number) * vdhp->decode_cost <= vdhp->seek_cost;
+}
+
+static inline void update_moving_average
+(
+    double   *average,
+    uint64_t *measurement_count,
+    double    measurement
+)
+{
+    *average = (*measurement_count)++ ? *average + SEEK_COST_WEIGHT * (measurement - *average) : measurement;
+}
+
+static void update_seek_cost
+(
+    libavsmash_video_decode_handler_t *vdhp,
+    int64_t                            elapsed_time,
+    uint32_t                           decoded_count,
+    int                                seeked
+)
+{
+    if( decoded_count == 0 )
+        return;
+    if( !seeked )
+        update_moving_average( &vdhp->decode_cost, &vdhp->decode_measurements, (double)elapsed_time / decoded_count );
+    else if( vdhp->decode_measurements )
+        /* Separate the time to decode from the random accessible sample. */
+        update_moving_average( &vdhp->seek_cost, &vdhp->seek_measurements,
+                               MAX( elapsed_time - decoded_count * vdhp->decode_cost, 0.0 ) );
+}
+
 static int get_requested_picture
 (
     libavsmash_video_decode_handler_t *vdhp,
@@ -851,11 +905,16 @@ static int get_requested_picture
     uint32_t rap_number;    /* number of sample, for seeking, where decoding starts excluding decoding delay */
     int seek_mode = vdhp->seek_mode;
     int roll_recovery = 0;
-    if( sample_number > vdhp->last_sample_number
-     && sample_number <= vdhp->last_sample_number + vdhp->forward_seek_threshold )
+    /* The time to get the requested sample is measured to decide whether to seek or to decode forward. */
+    int64_t  start_time    = av_gettime_relative();
+    uint32_t target_number = get_decoding_sample_number( vdhp->order_converter, sample_number );
+    uint32_t first_number;  /* decoding number of the first sample to be decoded */
+    int      seeked = 0;
+    if( is_decoding_forward_cheaper( vdhp, sample_number ) )
     {
         start_number = vdhp->last_sample_number + 1 + config->delay_count;
         rap_number   = vdhp->last_rap_number;
+        first_number = get_decoding_sample_number( vdhp->order_converter, vdhp->last_sample_number ) + 1;
     }
     else
     {
@@ -864,16 +923,20 @@ static int get_requested_picture
         {
             roll_recovery = 0;
             start_number  = vdhp->last_sample_number + 1 + config->delay_count;
+            first_number  = get_decoding_sample_number( vdhp->order_converter, vdhp->last_sample_number ) + 1;
         }
         else
         {
             /* Require starting to decode from random accessible sample. */
             vdhp->last_rap_number = rap_number;
+            first_number = rap_number;
+            seeked       = 1;
             start_number = seek_video( vdhp, picture, sample_number, rap_number, roll_recovery || seek_mode != SEEK_MODE_NORMAL );
         }
     }
     /* Get the desired picture. */
     int error_count = 0;
+    int retried     = 0;
     while( start_number == 0    /* Failed to seek. */
      || config->update_pending  /* Need to update the decoder configuration to decode pictures. */
      || get_picture( vdhp, picture, start_number, sample_number + config->delay_count ) < 0 )
@@ -905,7 +968,11 @@ static int get_requested_picture
             }
         }
         start_number = seek_video( vdhp, picture, sample_number, rap_number, roll_recovery || seek_mode != SEEK_MODE_NORMAL );
+        retried      = 1;
     }
+    if( !retried )
+        update_seek_cost( vdhp, av_gettime_relative() - start_time,
+                          target_number >= first_number ? target_number - first_number + 1 : 0, seeked );
     vdhp->last_sample_number = sample_number;
     config_index = config->index;
 return_frame:;
@@ -923,6 +990,33 @@ video_fail:
 #undef MAX_ERROR_COUNT
 }
 
+/* Set up the VFR->CFR table from the composition timestamps of the samples in the same units as libavsmash_vfr2cfr(). */
+static void build_vfr2cfr_table
+(
+    libavsmash_video_decode_handler_t *vdhp,
+    lw_vfr2cfr_table_t                *table
+)
+{
+    lsmash_media_ts_list_t ts_list;
+    if( lsmash_get_media_timestamps( vdhp->root, vdhp->track_id, &ts_list ) < 0 )
+    {
+        table->state = LW_VFR2CFR_TABLE_UNAVAILABLE;
+        return;
+    }
+    if( ts_list.sample_count == vdhp->sample_count
+     && (table->seconds = (double *)lw_malloc_zero( vdhp->sample_count * sizeof(double) )) )
+    {
+        table->count = vdhp->sample_count;
+        for( uint32_t i = 1; i <= vdhp->sample_count; i++ )
+        {
+            uint32_t decoding_sample_number = get_decoding_sample_number( vdhp->order_converter, i );
+            table->seconds[i - 1] = (double)(ts_list.timestamp[decoding_sample_number - 1].cts - vdhp->min_cts) / vdhp->media_timescale;
+        }
+    }
+    lsmash_delete_media_timestamps( &ts_list );
+    lw_check_vfr2cfr_table( table );
+}
+
 static uint32_t libavsmash_vfr2cfr
 (
     libavsmash_video_decode_handler_t *vdhp,
@@ -932,6 +1026,15 @@ static uint32_t libavsmash_vfr2cfr
 {
     /* Convert VFR to CFR. */
     double target_pts  = (double)((uint64_t)(sample_number - 1) * vohp->cfr_den) / vohp->cfr_num;
+    lw_vfr2cfr_table_t *table = &vohp->cfr_table;
+    if( table->state == LW_VFR2CFR_TABLE_UNBUILT )
+        build_vfr2cfr_table( vdhp, table );
+    if( table->state == LW_VFR2CFR_TABLE_AVAILABLE && vdhp->last_sample_number >= 1 )
+    {
+        double next_target_pts = (double)((uint64_t)sample_number * vohp->cfr_den) / vohp->cfr_num;
+        return lw_vfr2cfr_search( table, vdhp->last_sample_number, vdhp->sample_count, target_pts, next_target_pts );
+    }
+    /* Read the samples one by one if the timestamps are out of order. */
     double current_pts = DBL_MAX;
     lsmash_sample_t sample;
     if( vdhp->last_sample_number <= vdhp->sample_count )
@@ -1017,11 +1120,26 @@ int libavsmash_video_get_frame
         if( sample_number == 0 )
             return -1;
     }
-    if( sample_number == vdhp->last_sample_number )
-        return 1;
     int ret;
-    if( (ret = get_requested_picture( vdhp, vdhp->frame_buffer, sample_number )) < 0
-     || (ret = update_scaler_configuration_if_needed( &vohp->scaler, &vdhp->config.lh, vdhp->frame_buffer )) < 0 )
+    if( vohp->frame_lru )
+    {
+        /* The output frame buffer may hold a cached frame other than the last decoded one. */
+        if( (ret = lw_frame_lru_get( vohp->frame_lru, sample_number, vdhp->frame_buffer )) < 0 )
+            return ret;
+    }
+    else if( sample_number == vdhp->last_sample_number )
+        return 1;
+    else
+        ret = 0;
+    if( ret == 0 )
+    {
+        if( (ret = get_requested_picture( vdhp, vdhp->frame_buffer, sample_number )) < 0 )
+            return ret;
+        if( vohp->frame_lru
+         && lw_frame_lru_put( vohp->frame_lru, sample_number, vdhp->frame_buffer ) < 0 )
+            lw_log_show( &vdhp->config.lh, LW_LOG_WARNING, "Failed to cache a decoded video frame." );
+    }
+    if( (ret = update_scaler_configuration_if_needed( &vohp->scaler, &vdhp->config.lh, vdhp->frame_buffer )) < 0 )
         return ret;
     return 0;
 }
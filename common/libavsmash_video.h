@@ -81,6 +81,8 @@ void libavsmash_video_set_track_id
     uint32_t                           track_id
 );
 
+/* Set the maximum distance to decode forward instead of seeking.
+ * Setting 0 decides whether to seek or to decode forward by comparing the costs measured while decoding. */
 void libavsmash_video_set_forward_seek_threshold
 (
     libavsmash_video_decode_handler_t *vdhp,
@@ -37,6 +37,10 @@ struct libavsmash_video_decode_handler_tag
     AVFrame              *frame_buffer;
     uint32_t              forward_seek_threshold;
     int                   seek_mode;
+    double                decode_cost;          /* the moving average of the time to decode a sample in microseconds */
+    double                seek_cost;            /* the moving average of the time to seek excluding decoding in microseconds */
+    uint64_t              decode_measurements;  /* the number of measurements of decoding forward */
+    uint64_t              seek_measurements;    /* the number of measurements of seeking */
     order_converter_t    *order_converter;
     uint8_t              *keyframe_list;
     uint32_t              sample_count;
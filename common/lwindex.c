@@ -37,6 +37,7 @@ extern "C"
 #include <libswresample/swresample.h>   /* Resampler/Buffer */
 #include <libavutil/mathematics.h>      /* Timebase rescaler */
 #include <libavutil/pixdesc.h>
+#include <libavutil/cpu.h>
 #ifdef __cplusplus
 }
 #endif  /* __cplusplus */
@@ -54,11 +55,15 @@ extern "C"
 #include "lwindex.h"
 #include "decode.h"
 
+#include <stddef.h>
 #include <sys/stat.h>
 #include "xxhash.h"
 #ifdef _WIN32
 #define WIN32_LEAN_AND_MEAN
 #include <windows.h>
+#include <io.h>
+#else
+#include <sys/mman.h>
 #endif
 
 typedef struct
@@ -119,6 +124,60 @@ typedef struct
     video_timestamp_t core;
 } video_timestamp_temp_t;
 
+/* A packet analysed by its index helper.
+ * The state of the decoder is captured at the analysis so that the packet can be registered
+ * into the frame lists and the index file apart from the analysis. */
+typedef struct
+{
+    int64_t  pos;
+    int64_t  pts;
+    int64_t  dts;
+    uint64_t ch_mask;
+    int32_t  stream_index;
+    int32_t  flags;             /* AVPacket.flags after the analysis */
+    int32_t  extradata_index;
+    int32_t  poc;
+    int32_t  frame_length;
+    int32_t  size;              /* size of the packet in bytes */
+    int32_t  prior_width;       /* width before parsing this packet */
+    int32_t  prior_height;      /* height before parsing this packet */
+    int32_t  width;
+    int32_t  height;
+    int32_t  sample_rate;
+    int32_t  bits_per_sample;
+    int16_t  prior_colorspace;
+    int16_t  pix_fmt;
+    int16_t  sample_fmt;
+    int16_t  ch_order;
+    int16_t  channels;
+    int8_t   pict_type;
+    int8_t   repeat_pict;
+    int8_t   field_info;
+    int8_t   field_inherited;   /* 1: field_info is inherited from the preceding packets */
+    int8_t   invisible;         /* 1: VPx invisible altref frame */
+    int8_t   corrupt;
+    int8_t   skip;              /* 1: not to be registered */
+    int8_t   split_point;       /* 1: video keyframe which can start a range of the parallel indexing */
+} lwindex_packet_t;
+
+typedef struct
+{
+    video_frame_info_t *video_info;
+    audio_frame_info_t *audio_info;
+    uint32_t            video_info_count;
+    uint32_t            audio_info_count;
+    uint32_t            video_sample_count;
+    uint32_t            video_keyframe_count;
+    uint32_t            invisible_count;
+    int64_t             last_keyframe_pts;
+    int                 video_resolution;
+    int                 is_attached_pic;
+    uint32_t            audio_sample_count;
+    int                 audio_sample_rate;
+    int                 constant_frame_length;
+    uint64_t            audio_duration;
+} lwindex_builder_t;
+
 static inline int check_frame_reordering
 (
     video_frame_info_t *info,
@@ -678,9 +737,48 @@ static int decide_video_seek_method
             }
         }
     }
-    /* Set up keyframe list: presentation order (info) -> decoding order (keyframe_list) */
+    /* Set up RAP list: presentation order (info) -> decoding order (rap_list)
+     * Each entry is the nearest random accessible picture at or before the picture, or 0 if none. */
+    uint32_t *rap_list = vdhp->rap_list;
+    for( uint32_t i = 1; i <= sample_count; i++ )
+        rap_list[ info[i].sample_number ] = (info[i].flags & LW_VFRAME_FLAG_KEY) ? info[i].sample_number : 0;
+    rap_list[0] = 0;
     for( uint32_t i = 1; i <= sample_count; i++ )
-        vdhp->keyframe_list[ info[i].sample_number ] = !!(info[i].flags & LW_VFRAME_FLAG_KEY);
+        if( rap_list[i] == 0 )
+            rap_list[i] = rap_list[i - 1];
+    /* Detect intra-only streams, where each frame can be decoded apart from the others. */
+    vdhp->intra_only = !vdhp->order_converter && sample_count > 1;
+    for( uint32_t i = 1; i <= sample_count && vdhp->intra_only; i++ )
+        if( (info[i].flags & (LW_VFRAME_FLAG_KEY | LW_VFRAME_FLAG_LEADING | LW_VFRAME_FLAG_INVISIBLE | LW_VFRAME_FLAG_CORRUPT)) != LW_VFRAME_FLAG_KEY
+         || info[i].repeat_pict == 0
+         || info[i].extradata_index != info[1].extradata_index )
+            vdhp->intra_only = 0;
+    /* Detect streams which may consist of closed GOPs, where each GOP can be decoded apart from the others.
+     * Each GOP consists of the pictures from a random accessible picture up to the next one in decoding order,
+     * and its pictures must be displayed contiguously, that is, the random accessible pictures of the pictures
+     * in presentation order never decrease. The GOPs with leading pictures, which are displayed before their
+     * random accessible picture, are closed only if the leading pictures don't refer to the previous GOP,
+     * which is left to be checked on decoding. */
+    uint32_t gop_count = 0;
+    uint32_t gop_rap   = 0;
+    vdhp->closed_gop = !vdhp->intra_only && sample_count > 1 && rap_list[1] == 1;
+    for( uint32_t i = 1; i <= sample_count && vdhp->closed_gop; i++ )
+    {
+        uint32_t rap_number = rap_list[ info[i].sample_number ];
+        if( rap_number != gop_rap )
+        {
+            if( rap_number < gop_rap )
+                vdhp->closed_gop = 0;
+            gop_rap = rap_number;
+            ++gop_count;
+        }
+        if( (info[i].flags & LW_VFRAME_FLAG_INVISIBLE)
+         || info[i].repeat_pict == 0
+         || info[i].extradata_index != info[1].extradata_index )
+            vdhp->closed_gop = 0;
+    }
+    if( gop_count < 2 )
+        vdhp->closed_gop = 0;
     return 0;
 }
 
@@ -770,7 +868,7 @@ static int64_t calculate_av_gap
 {
     /* Pick the first video timestamp.
      * If invalid, skip A/V gap calculation. */
-    int64_t video_ts = (vdhp->lw_seek_flags & SEEK_PTS_BASED) ? vdhp->frame_list[1].pts : vdhp->frame_list[1].dts;
+    int64_t video_ts = (vdhp->lw_seek_flags & SEEK_PTS_BASED) ? lw_vframe_pts( vdhp->frame_table, 1 ) : lw_vframe_dts( vdhp->frame_table, 1 );
     if( video_ts == AV_NOPTS_VALUE )
         return 0;
     /* Pick the first valid audio timestamp.
@@ -954,6 +1052,193 @@ static void vfr2cfr_settings
         vohp->vfr2cfr = 0;
 }
 
+/* Fill in the unknown field order, and mark the field coded pictures which fail to make a pair.
+ * The frame info is modified only here so that the frame order list can be created for each option. */
+static void complete_video_field_info
+(
+    lwlibav_video_decode_handler_t *vdhp
+)
+{
+    if( !(vdhp->lw_seek_flags & (SEEK_PTS_BASED | SEEK_PTS_GENERATED)) )
+        return;
+    video_frame_info_t *info            = vdhp->frame_list;
+    int                 complete_frame  = 1;
+    lw_field_info_t     next_field_info = info[1].field_info;
+    for( uint32_t i = 1; i <= vdhp->frame_count; i++ )
+    {
+        lw_field_info_t field_info = info[i].field_info;
+        if( field_info == LW_FIELD_INFO_UNKNOWN )
+        {
+            /* Override with TFF or BFF. */
+            field_info = next_field_info;
+            info[i].field_info = field_info;
+        }
+        else if( field_info != next_field_info && !complete_frame )
+        {
+            /* The previous picture in output order fails to make a pair to construct a frame.
+             *    coded order: {I[0],P[1]},{P[4],P[5]},{B[2],}
+             *   output order: {I[0],P[1]},{B[2],},{P[4],P[5]}
+             * We exclude this picture from the output buffer. */
+            info[i - 1].flags |= LW_VFRAME_FLAG_COUNTERPART_MISSING;
+            complete_frame ^= 1;
+        }
+        if( info[i].repeat_pict == 0 && !(info[i].flags & (LW_VFRAME_FLAG_CORRUPT | LW_VFRAME_FLAG_COUNTERPART_MISSING)) )
+            /* PAFF field coded picture */
+            complete_frame ^= 1;
+        if( !(info[i].repeat_pict & 1) )
+            next_field_info = field_info == LW_FIELD_INFO_TOP ? LW_FIELD_INFO_BOTTOM : LW_FIELD_INFO_TOP;
+    }
+}
+
+#define VIDEO_FRAME_FIELD( info, i, offset ) (*(const int64_t *)((const uint8_t *)&(info)[i] + (offset)))
+
+/* Return 1 if every valid value fits in a 32-bit difference from the first valid value in its block, otherwise 0. */
+static int check_video_frame_deltas
+(
+    const video_frame_info_t *info,
+    uint32_t                  frame_count,
+    size_t                    offset,
+    int64_t                   invalid
+)
+{
+    int64_t base = invalid;
+    for( uint32_t i = 1; i <= frame_count; i++ )
+    {
+        if( (i & ((1 << LW_VFRAME_BLOCK_SHIFT) - 1)) == 0 )
+            base = invalid;
+        int64_t value = VIDEO_FRAME_FIELD( info, i, offset );
+        if( value == invalid )
+            continue;
+        if( base == invalid )
+            base = value;
+        else if( value >= base ? (uint64_t)value - (uint64_t)base > INT32_MAX
+                               : (uint64_t)base - (uint64_t)value > INT32_MAX )
+            return 0;
+    }
+    return 1;
+}
+
+static void fill_video_frame_column
+(
+    video_frame_column_t     *column,
+    const video_frame_info_t *info,
+    uint32_t                  frame_count,
+    size_t                    offset
+)
+{
+    uint32_t based_block = UINT32_MAX;
+    for( uint32_t i = 0; i <= frame_count + 1; i++ )
+    {
+        /* The entries out of the frames are invalid. */
+        int64_t value = (i >= 1 && i <= frame_count) ? VIDEO_FRAME_FIELD( info, i, offset ) : column->invalid;
+        if( column->value )
+        {
+            column->value[i] = value;
+            continue;
+        }
+        if( value == column->invalid )
+        {
+            column->delta[i] = LW_VFRAME_DELTA_INVALID;
+            continue;
+        }
+        uint32_t block = i >> LW_VFRAME_BLOCK_SHIFT;
+        if( block != based_block )
+        {
+            column->base[block] = value;
+            based_block         = block;
+        }
+        column->delta[i] = (int32_t)(value - column->base[block]);
+    }
+}
+
+/* Pack the frame info into the frame table used for decoding.
+ * The frame info itself is left as it is since the construction of the index could still need it. */
+static int pack_video_frame_list
+(
+    lwlibav_video_decode_handler_t *vdhp
+)
+{
+    const video_frame_info_t *info        = vdhp->frame_list;
+    uint32_t                  frame_count = vdhp->frame_count;
+    for( uint32_t i = 1; i <= frame_count; i++ )
+        if( info[i].repeat_pict < 0 || info[i].repeat_pict > LW_VFRAME_ATTR_REPEAT_PICT_MASK
+         || info[i].extradata_index < -1 || info[i].extradata_index > LW_VFRAME_ATTR_EXTRADATA_MAX )
+        {
+            lw_log_show( &vdhp->lh, LW_LOG_FATAL, "Failed to pack the frame info for video at frame %" PRIu32 ".", i );
+            return -1;
+        }
+    static const struct
+    {
+        size_t  offset;
+        int64_t invalid;
+    } fields[3] =
+        {
+            { offsetof( video_frame_info_t, pts ),         AV_NOPTS_VALUE },
+            { offsetof( video_frame_info_t, dts ),         AV_NOPTS_VALUE },
+            { offsetof( video_frame_info_t, file_offset ), -1             }
+        };
+    /* One more entry is allocated for safety. */
+    size_t entry_count = (size_t)frame_count + 2;
+    size_t block_count = ((frame_count + 1) >> LW_VFRAME_BLOCK_SHIFT) + 1;
+    size_t size        = sizeof(video_frame_table_t) + 3 * entry_count * sizeof(uint32_t);
+    int    packed[3];
+    for( int j = 0; j < 3; j++ )
+    {
+        packed[j] = check_video_frame_deltas( info, frame_count, fields[j].offset, fields[j].invalid );
+        size += packed[j] ? block_count * sizeof(int64_t) + entry_count * sizeof(int32_t)
+              :             entry_count * sizeof(int64_t);
+    }
+    video_frame_table_t *table = (video_frame_table_t *)lw_malloc_zero( size );
+    if( !table )
+    {
+        lw_log_show( &vdhp->lh, LW_LOG_FATAL, "Failed to allocate memory to the frame table for video." );
+        return -1;
+    }
+    video_frame_column_t *columns[3] = { &table->pts, &table->dts, &table->file_offset };
+    /* Place the 64-bit columns first to keep their alignment. */
+    uint8_t *p = (uint8_t *)(table + 1);
+    for( int j = 0; j < 3; j++ )
+    {
+        columns[j]->invalid = fields[j].invalid;
+        if( packed[j] )
+        {
+            columns[j]->base = (int64_t *)p;
+            p += block_count * sizeof(int64_t);
+        }
+        else
+        {
+            columns[j]->value = (int64_t *)p;
+            p += entry_count * sizeof(int64_t);
+        }
+    }
+    for( int j = 0; j < 3; j++ )
+        if( packed[j] )
+        {
+            columns[j]->delta = (int32_t *)p;
+            p += entry_count * sizeof(int32_t);
+        }
+    table->sample_number = (uint32_t *)p;
+    table->attributes    = (uint32_t *)(p + entry_count * sizeof(uint32_t));
+    table->packet_size   = (uint32_t *)(p + 2 * entry_count * sizeof(uint32_t));
+    table->frame_count   = frame_count;
+    for( int j = 0; j < 3; j++ )
+        fill_video_frame_column( columns[j], info, frame_count, fields[j].offset );
+    for( uint32_t i = 1; i <= frame_count; i++ )
+    {
+        table->sample_number[i] = info[i].sample_number;
+        table->packet_size[i]   = info[i].packet_size > 0 ? (uint32_t)info[i].packet_size : 0;
+        table->attributes[i]    = ((uint32_t)info[i].flags       & LW_VFRAME_ATTR_FLAGS_MASK)
+                                | ((uint32_t)info[i].repeat_pict << LW_VFRAME_ATTR_REPEAT_PICT_SHIFT)
+                                | (((uint32_t)info[i].field_info & LW_VFRAME_ATTR_FIELD_INFO_MASK) << LW_VFRAME_ATTR_FIELD_INFO_SHIFT)
+                                | ((uint32_t)(info[i].extradata_index + 1) << LW_VFRAME_ATTR_EXTRADATA_SHIFT);
+    }
+    lw_free( vdhp->frame_table );
+    vdhp->frame_table = table;
+    return 0;
+}
+
+#undef VIDEO_FRAME_FIELD
+
 static void create_video_frame_order_list
 (
     lwlibav_video_decode_handler_t *vdhp,
@@ -964,7 +1249,7 @@ static void create_video_frame_order_list
     /* Eliminate guesswork: first determine if repeat is requested in the source. */
     for( uint32_t i = 1; i <= vdhp->frame_count; i++ )
     {
-        if ( vdhp->frame_list[i].repeat_pict > 1 )
+        if ( lw_vframe_repeat_pict( vdhp->frame_table, i ) > 1 )
             vohp->repeat_requested++;
     }
 
@@ -972,43 +1257,30 @@ static void create_video_frame_order_list
         goto disable_repeat;
     if( opt->vfr2cfr.active )
         opt->apply_repeat_flag = 0;
-    video_frame_info_t *info                      = vdhp->frame_list;
-    uint32_t            frame_count               = vdhp->frame_count;
-    uint32_t            order_count               = 0;
-    int                 no_support_frame_tripling = (vdhp->codec_id != AV_CODEC_ID_MPEG2VIDEO);
-    int                 specified_field_dominance = opt->field_dominance == 0 ? LW_FIELD_INFO_UNKNOWN   /* Obey source flags. */
-                                                  : opt->field_dominance == 1 ? LW_FIELD_INFO_TOP       /* TFF: Top -> Bottom */
-                                                  :                             LW_FIELD_INFO_BOTTOM;   /* BFF: Bottom -> Top */
+    video_frame_table_t *table                     = vdhp->frame_table;
+    uint32_t             frame_count               = vdhp->frame_count;
+    uint32_t             order_count               = 0;
+    int                  no_support_frame_tripling = (vdhp->codec_id != AV_CODEC_ID_MPEG2VIDEO);
+    int                  specified_field_dominance = opt->field_dominance == 0 ? LW_FIELD_INFO_UNKNOWN   /* Obey source flags. */
+                                                   : opt->field_dominance == 1 ? LW_FIELD_INFO_TOP       /* TFF: Top -> Bottom */
+                                                   :                             LW_FIELD_INFO_BOTTOM;   /* BFF: Bottom -> Top */
     /* Check repeat_pict and order_count. */
-    if( specified_field_dominance > 0 && (lw_field_info_t)specified_field_dominance != info[1].field_info )
+    if( specified_field_dominance > 0 && (lw_field_info_t)specified_field_dominance != lw_vframe_field_info( table, 1 ) )
         ++order_count;
     int             enable_repeat   = 0;
     int             complete_frame  = 1;
     int             repeat_field    = 1;
-    lw_field_info_t next_field_info = info[1].field_info;
+    lw_field_info_t next_field_info = lw_vframe_field_info( table, 1 );
     for( uint32_t i = 1; i <= frame_count; i++, order_count++ )
     {
-        int             repeat_pict = info[i].repeat_pict;
-        lw_field_info_t field_info  = info[i].field_info;
+        int             repeat_pict = lw_vframe_repeat_pict( table, i );
+        lw_field_info_t field_info  = lw_vframe_field_info( table, i );
         int             field_shift = !(repeat_pict & 1);
-        if( field_info == LW_FIELD_INFO_UNKNOWN )
-        {
-            /* Override with TFF or BFF. */
-            field_info = next_field_info;
-            info[i].field_info = field_info;
-        }
-        else if( field_info != next_field_info )
+        if( field_info != next_field_info )
         {
-            if( !complete_frame )
-            {
-                /* The previous picture in output order fails to make a pair to construct a frame.
-                 *    coded order: {I[0],P[1]},{P[4],P[5]},{B[2],}
-                 *   output order: {I[0],P[1]},{B[2],},{P[4],P[5]}
-                 * We exclude this picture from the output buffer. */
-                info[i - 1].flags |= LW_VFRAME_FLAG_COUNTERPART_MISSING;
-                complete_frame ^= 1;
-                order_count    -= 1;
-            }
+            if( i > 1 && (lw_vframe_flags( table, i - 1 ) & LW_VFRAME_FLAG_COUNTERPART_MISSING) )
+                /* The previous picture is excluded from the output buffer. See complete_video_field_info(). */
+                order_count -= 1;
             else if (!repeat_field)
             {
                 opt->apply_repeat_flag = i;
@@ -1033,7 +1305,7 @@ static void create_video_frame_order_list
                 default :
                     break;
             }
-        if( repeat_pict == 0 && !(info[i].flags & (LW_VFRAME_FLAG_CORRUPT | LW_VFRAME_FLAG_COUNTERPART_MISSING)) )
+        if( repeat_pict == 0 && !(lw_vframe_flags( table, i ) & (LW_VFRAME_FLAG_CORRUPT | LW_VFRAME_FLAG_COUNTERPART_MISSING)) )
         {
             /* PAFF field coded picture */
             complete_frame ^= 1;
@@ -1057,19 +1329,19 @@ static void create_video_frame_order_list
     uint32_t b_count       = 1;
     if( specified_field_dominance > 0 )
     {
-        if( (lw_field_info_t)specified_field_dominance == LW_FIELD_INFO_TOP && info[1].field_info == LW_FIELD_INFO_BOTTOM )
+        if( (lw_field_info_t)specified_field_dominance == LW_FIELD_INFO_TOP && lw_vframe_field_info( table, 1 ) == LW_FIELD_INFO_BOTTOM )
             order_list[t_count++].top = 1;
-        else if( (lw_field_info_t)specified_field_dominance == LW_FIELD_INFO_BOTTOM && info[1].field_info == LW_FIELD_INFO_TOP )
+        else if( (lw_field_info_t)specified_field_dominance == LW_FIELD_INFO_BOTTOM && lw_vframe_field_info( table, 1 ) == LW_FIELD_INFO_TOP )
             order_list[b_count++].bottom = 1;
         if( t_count > 1 || b_count > 1 )
-            correction_ts = (info[2].pts - info[1].pts) / (info[1].repeat_pict + 1);
+            correction_ts = (lw_vframe_pts( table, 2 ) - lw_vframe_pts( table, 1 )) / (lw_vframe_repeat_pict( table, 1 ) + 1);
     }
     complete_frame  = 1;
     for( uint32_t i = 1; i <= frame_count; i++ )
     {
         /* Check repeat_pict and field dominance. */
-        int             repeat_pict = info[i].repeat_pict;
-        lw_field_info_t field_info  = info[i].field_info;
+        int             repeat_pict = lw_vframe_repeat_pict( table, i );
+        lw_field_info_t field_info  = lw_vframe_field_info( table, i );
         order_list[t_count++].top    = i;
         order_list[b_count++].bottom = i;
         if( opt->apply_repeat_flag )
@@ -1097,14 +1369,14 @@ static void create_video_frame_order_list
         if( repeat_pict == 0 )
         {
             /* PAFF field coded picture */
-            if( info[i].flags & LW_VFRAME_FLAG_COUNTERPART_MISSING )
+            if( lw_vframe_flags( table, i ) & LW_VFRAME_FLAG_COUNTERPART_MISSING )
             {
                 /* Exclude this picture from the output buffer. */
                 --t_count;
                 --b_count;
                 complete_frame = 1;
             }
-            else if( !(info[i].flags & LW_VFRAME_FLAG_CORRUPT) )
+            else if( !(lw_vframe_flags( table, i ) & LW_VFRAME_FLAG_CORRUPT) )
             {
                 if( field_info == LW_FIELD_INFO_BOTTOM )
                     --t_count;
@@ -1160,7 +1432,7 @@ static void create_video_visible_frame_list
     if( vohp->repeat_control || invisible_count == 0 )
         return;
     lw_video_frame_order_t *order_list = NULL;
-    video_frame_info_t     *info       = vdhp->frame_list;
+    video_frame_table_t    *table      = vdhp->frame_table;
     if( vohp->vfr2cfr )
     {
         /* Duplicated frame numbers could be occured, so frame cache buffers are needed. */
@@ -1175,7 +1447,7 @@ static void create_video_visible_frame_list
         uint32_t visible_number = 0;
         for( uint32_t i = 1; i <= vdhp->frame_count; i++ )
         {
-            if( !(info[i].flags & LW_VFRAME_FLAG_INVISIBLE) )
+            if( !(lw_vframe_flags( table, i ) & LW_VFRAME_FLAG_INVISIBLE) )
                 ++visible_number;
             order_list[i].top    = visible_number;
             order_list[i].bottom = visible_number;
@@ -1193,7 +1465,7 @@ static void create_video_visible_frame_list
         }
         uint32_t order_count = 0;
         for( uint32_t i = 1; i <= vdhp->frame_count; i++ )
-            if( !(info[i].flags & LW_VFRAME_FLAG_INVISIBLE) )
+            if( !(lw_vframe_flags( table, i ) & LW_VFRAME_FLAG_INVISIBLE) )
             {
                 ++order_count;
                 order_list[order_count].top    = i;
@@ -1778,6 +2050,87 @@ static int get_ticks_per_frame
     return ctx->ticks_per_frame;
 }
 
+/* Return the number of samples in Blu-ray LPCM packet from its 4-byte header, or 0 if unknown. */
+static int get_pcm_bluray_frame_length
+(
+    const AVPacket *pkt
+)
+{
+    /* The number of channels including the padding channel for each channel_assignment */
+    static const uint8_t coded_channels[16] = { 0, 2, 0, 2, 4, 4, 4, 4, 6, 6, 8, 8, 0, 0, 0, 0 };
+    if( pkt->size <= 4 )
+        return 0;
+    int channels        = coded_channels[ pkt->data[2] >> 4 ];
+    int bits_per_sample = (pkt->data[3] >> 6) & 0x03;
+    if( channels == 0 || bits_per_sample == 0 )
+        return 0;
+    int bytes_per_sample = bits_per_sample == 1 ? 2 : 3;    /* 20-bit samples are stored in 24 bits. */
+    return (pkt->size - 4) / (channels * bytes_per_sample);
+}
+
+/* Return the number of samples in MLP/TrueHD packet by counting access units, or 0 if unknown.
+ * The number of samples in an access unit is signalled only in the major sync, so a packet without it is unknown. */
+static int get_mlp_frame_length
+(
+    enum AVCodecID  codec_id,
+    const AVPacket *pkt
+)
+{
+    int access_unit_size  = 0;
+    int access_unit_count = 0;
+    for( int offset = 0; offset + 4 <= pkt->size; )
+    {
+        const uint8_t *p = pkt->data + offset;
+        if( p[0] == 0x0B && p[1] == 0x77 )
+            /* AC-3 frame interleaved in Blu-ray TrueHD */
+            return 0;
+        int length = (((p[0] & 0x0f) << 8) | p[1]) << 1;    /* access_unit_length in 16-bit words */
+        if( length < 4 || offset + length > pkt->size )
+            return 0;
+        if( access_unit_size == 0 && length >= 10 && p[4] == 0xF8 && p[5] == 0x72 && p[6] == 0x6F )
+        {
+            /* major sync */
+            int ratebits;
+            if( codec_id == AV_CODEC_ID_TRUEHD && p[7] == 0xBA )
+                ratebits = p[8] >> 4;
+            else if( codec_id == AV_CODEC_ID_MLP && p[7] == 0xBB )
+                ratebits = p[9] >> 4;
+            else
+                return 0;
+            if( ratebits == 0x0F )
+                return 0;
+            access_unit_size = 40 << (ratebits & 7);
+        }
+        ++access_unit_count;
+        offset += length;
+    }
+    return access_unit_size * access_unit_count;
+}
+
+/* Get audio frame length from the packet size and the codec parameters, or the frame headers.
+ * Return 0 if unknown. */
+static int get_audio_frame_length_without_decoding
+(
+    AVCodecContext *ctx,
+    AVPacket       *pkt
+)
+{
+    /* PCM, ADPCM and the codecs with fixed frame length */
+    int frame_length = av_get_audio_frame_duration( ctx, pkt->size );
+    if( frame_length > 0 )
+        return frame_length;
+    switch( ctx->codec_id )
+    {
+        case AV_CODEC_ID_PCM_BLURAY :
+            return get_pcm_bluray_frame_length( pkt );
+        case AV_CODEC_ID_MLP :
+        case AV_CODEC_ID_TRUEHD :
+            return get_mlp_frame_length( ctx->codec_id, pkt );
+        default :
+            return 0;
+    }
+}
+
 static int get_audio_frame_length
 (
     lwindex_helper_t *helper,
@@ -1800,6 +2153,9 @@ static int get_audio_frame_length
         frame_length = 0;
     if( frame_length == 0 && helper->delay_count == 0 )
         frame_length = ctx->frame_size;
+    if( frame_length == 0 && helper->delay_count == 0 && !helper->already_decoded )
+        /* Try to get without decoding. Once the decoder delays, keep decoding to align its output. */
+        frame_length = get_audio_frame_length_without_decoding( ctx, pkt );
     if( frame_length == 0 )
     {
         if( helper->already_decoded )
@@ -1892,6 +2248,125 @@ static enum AVSampleFormat select_better_sample_format
     return a;
 }
 
+/* Binary index file
+ * Every section starts on an 8-byte boundary so that the records can be used in place from the mapped file.
+ * Values are stored in the native byte order. An index file written on a host of the other endianness fails
+ * the version check and is simply re-created. */
+#define LWINDEX_BINARY_MAGIC "LWIB"
+#define LWINDEX_BINARY_ALIGN( x ) (((x) + 7) & ~(uint64_t)7)
+
+typedef struct
+{
+    char     magic[4];
+    uint32_t lwindex_version;
+    uint32_t index_file_version;
+    uint32_t header_size;
+    int64_t  file_size;
+    int64_t  file_last_modification_time;
+    uint64_t file_hash;
+    uint32_t format_flags;
+    int32_t  raw_demuxer;
+    char     format_name[64];
+    int32_t  active_video_index;
+    int32_t  active_audio_index;
+    int32_t  default_audio_index;
+    uint32_t path_length;
+    uint64_t path_offset;
+    uint64_t stream_info_offset;
+    uint64_t packet_offset;
+    uint64_t duration_offset;
+    uint64_t index_entry_offset;
+    uint64_t extradata_offset;
+    uint32_t stream_info_count;
+    uint32_t packet_count;
+    uint32_t duration_count;
+    uint32_t index_entry_count;
+    uint32_t extradata_count;
+    uint32_t reserved;
+    uint64_t head_hash;         /* hash of the head of the input file, which is unchanged while the file grows */
+    int64_t  checkpoint_pos;    /* file offset to resume the indexing from when the file grows, or -1 */
+} lwindex_binary_header_t;
+
+typedef struct
+{
+    int32_t  stream_index;
+    int32_t  codec_type;
+    int32_t  codec_id;
+    int32_t  time_base_num;
+    int32_t  time_base_den;
+    int32_t  width;
+    int32_t  height;
+    int32_t  colorspace;
+    int32_t  channels;
+    int32_t  sample_rate;
+    int32_t  bits_per_sample;
+    int32_t  reserved;
+    uint64_t layout;
+    char     fmt[64];
+} lwindex_binary_stream_info_t;
+
+/* The same record is also used to pass a packet parsed from the text index file. */
+typedef struct
+{
+    int64_t pos;
+    int64_t pts;
+    int64_t dts;
+    int32_t stream_index;
+    int32_t extradata_index;
+    int32_t poc;            /* video only */
+    int32_t length;         /* audio only */
+    int8_t  key;            /* video only */
+    int8_t  pict_type;      /* video only */
+    int8_t  repeat_pict;    /* video only */
+    int8_t  field_info;     /* video only */
+    int32_t size;           /* video only */
+} lwindex_packet_record_t;
+
+typedef struct
+{
+    int32_t stream_index;
+    int32_t codec_type;
+    int64_t duration;
+} lwindex_binary_duration_t;
+
+typedef struct
+{
+    int64_t pos;
+    int64_t timestamp;
+    int32_t stream_index;
+    int32_t codec_type;
+    int32_t flags;
+    int32_t size;
+    int32_t min_distance;
+    int32_t reserved;
+} lwindex_binary_index_entry_t;
+
+/* Followed by the extradata padded to an 8-byte boundary. */
+typedef struct
+{
+    int32_t  stream_index;
+    int32_t  codec_type;
+    int32_t  extradata_size;
+    int32_t  codec_id;
+    uint32_t codec_tag;
+    int32_t  width;
+    int32_t  height;
+    int32_t  sample_rate;
+    int32_t  bits_per_sample;
+    int32_t  block_align;
+    uint64_t channel_layout;
+    char     fmt[64];
+} lwindex_binary_extradata_t;
+
+typedef struct
+{
+    FILE                   *fp;
+    int                     text;
+    int32_t                 video_index_pos;    /* text only */
+    int32_t                 audio_index_pos;    /* text only */
+    lwindex_binary_header_t header;             /* binary only */
+} lwindex_writer_t;
+
 static inline void print_index
 (
     FILE       *index,
@@ -1907,141 +2382,535 @@ static inline void print_index
     va_end( args );
 }
 
-static inline void write_av_index_entry
+static void write_index_padding
 (
-    FILE         *index,
-    const AVIndexEntry *ie
+    FILE    *index,
+    uint64_t size
 )
 {
-    print_index( index, "POS=%" PRId64 ",TS=%" PRId64 ",Flags=%x,Size=%d,Distance=%d\n",
-                 ie->pos, ie->timestamp, ie->flags, ie->size, ie->min_distance );
+    static const uint8_t zero[8] = { 0 };
+    fwrite( zero, 1, LWINDEX_BINARY_ALIGN( size ) - size, index );
 }
 
-static void write_video_extradata
+/* Write a binary record and set the offset of its section if this is the first record. */
+static void write_index_record
 (
-    FILE                *index,
-    lwlibav_extradata_t *entry
+    lwindex_writer_t *writer,
+    uint64_t         *section_offset,
+    uint32_t         *section_count,
+    const void       *record,
+    size_t            record_size
 )
 {
-    if( !index )
-        return;
-    fprintf( index, "Size=%d,Codec=%d,4CC=0x%x,Width=%d,Height=%d,Format=%s,BPS=%d\n",
-             entry->extradata_size, entry->codec_id, entry->codec_tag, entry->width, entry->height,
-             av_get_pix_fmt_name( entry->pixel_format ) ? av_get_pix_fmt_name( entry->pixel_format ) : "none",
-             entry->bits_per_sample );
-    if( entry->extradata_size > 0 )
-        fwrite( entry->extradata, 1, entry->extradata_size, index );
-    fprintf( index, "\n" );
+    if( (*section_count)++ == 0 )
+        *section_offset = ftell( writer->fp );
+    fwrite( record, 1, record_size, writer->fp );
 }
 
-static void write_audio_extradata
+static void write_index_header
 (
-    FILE                *index,
-    lwlibav_extradata_t *entry
+    lwindex_writer_t       *writer,
+    lwlibav_file_handler_t *lwhp,
+    int64_t                 file_size,
+    int64_t                 file_last_modification_time,
+    uint64_t                file_hash,
+    uint64_t                head_hash,
+    int                     active_audio_index
 )
 {
-    if( !index )
+    if( !writer->fp )
         return;
-    fprintf( index, "Size=%d,Codec=%d,4CC=0x%x,Layout=0x%" PRIx64 ",Rate=%d,Format=%s,BPS=%d,Align=%d\n",
-             entry->extradata_size, entry->codec_id, entry->codec_tag, entry->channel_layout, entry->sample_rate,
-             av_get_sample_fmt_name( entry->sample_format ) ? av_get_sample_fmt_name( entry->sample_format ) : "none",
-             entry->bits_per_sample, entry->block_align );
-    if( entry->extradata_size > 0 )
-        fwrite( entry->extradata, 1, entry->extradata_size, index );
-    fprintf( index, "\n" );
-}
-
-static void disable_video_stream( lwlibav_video_decode_handler_t *vdhp )
-{
-    lw_freep( &vdhp->frame_list );
-    lw_freep( &vdhp->keyframe_list );
-    lw_freep( &vdhp->order_converter );
-    av_freep( &vdhp->index_entries );
-    vdhp->stream_index        = -1;
-    vdhp->index_entries_count = 0;
-    vdhp->frame_count         = 0;
-}
-
-static void cleanup_index_helpers( lwindex_indexer_t *indexer, AVFormatContext *format_ctx )
-{
-    for( unsigned int stream_index = 0; stream_index < format_ctx->nb_streams; stream_index++ )
+    if( writer->text )
     {
-        lwindex_helper_t *helper = get_index_helper( indexer, format_ctx->streams[stream_index] );
-        if( !helper )
-            continue;
-        avcodec_free_context( &helper->codec_ctx );
-        av_parser_close( helper->parser_ctx );
-        av_bsf_free( &helper->bsf_ctx );
-        av_frame_free( &helper->picture );
-        av_packet_unref( &helper->pkt );
-        lwlibav_extradata_handler_t *list = &helper->exh;
-        if( list->entries )
+        uint8_t lwindex_version[4] =
         {
-            for( int i = 0; i < list->entry_count; i++ )
-                av_freep( &list->entries[i].extradata );
-            free( list->entries );
-        }
-        /* Free an index helper. */
-        lw_free( helper );
+            (LWINDEX_VERSION >> 24) & 0xff,
+            (LWINDEX_VERSION >> 16) & 0xff,
+            (LWINDEX_VERSION >>  8) & 0xff,
+             LWINDEX_VERSION        & 0xff
+        };
+        fprintf( writer->fp, "<LSMASHWorksIndexVersion=%" PRIu8 ".%" PRIu8 ".%" PRIu8 ".%" PRIu8 ">\n",
+                 lwindex_version[0], lwindex_version[1], lwindex_version[2], lwindex_version[3] );
+        fprintf( writer->fp, "<LibavReaderIndexFile=%d>\n", LWINDEX_INDEX_FILE_VERSION );
+        fprintf( writer->fp, "<InputFilePath>%s</InputFilePath>\n", lwhp->file_path );
+        fprintf( writer->fp, "<FileSize=%" PRId64 ">\n", file_size );
+        fprintf( writer->fp, "<FileLastModificationTime=%" PRId64 ">\n", file_last_modification_time );
+        fprintf( writer->fp, "<FileHash=0x%016" PRIx64 ">\n", file_hash );
+        fprintf( writer->fp, "<LibavReaderIndex=0x%08x,%d,%s>\n", lwhp->format_flags, lwhp->raw_demuxer, lwhp->format_name );
+        writer->video_index_pos = ftell( writer->fp );
+        fprintf( writer->fp, "<ActiveVideoStreamIndex>%+011d</ActiveVideoStreamIndex>\n", -1 );
+        writer->audio_index_pos = ftell( writer->fp );
+        fprintf( writer->fp, "<ActiveAudioStreamIndex>%+011d</ActiveAudioStreamIndex>\n", active_audio_index );
+        fprintf( writer->fp, "<DefaultAudioStreamIndex>%+011d</DefaultAudioStreamIndex>\n", -1 );
+        return;
     }
-    av_freep( &indexer->helpers );
+    /* The magic and the versions are written by write_index_trailer() so that an incomplete index file is never accepted. */
+    lwindex_binary_header_t *header = &writer->header;
+    memset( header, 0, sizeof(lwindex_binary_header_t) );
+    header->header_size                 = sizeof(lwindex_binary_header_t);
+    header->file_size                   = file_size;
+    header->file_last_modification_time = file_last_modification_time;
+    header->file_hash                   = file_hash;
+    header->head_hash                   = head_hash;
+    header->checkpoint_pos              = -1;
+    header->format_flags                = lwhp->format_flags;
+    header->raw_demuxer                 = lwhp->raw_demuxer;
+    header->active_video_index          = -1;
+    header->active_audio_index          = active_audio_index;
+    header->default_audio_index         = -1;
+    header->path_length                 = strlen( lwhp->file_path );
+    header->path_offset                 = sizeof(lwindex_binary_header_t);
+    snprintf( header->format_name, sizeof(header->format_name), "%s", lwhp->format_name );
+    fwrite( header, 1, sizeof(lwindex_binary_header_t), writer->fp );
+    fwrite( lwhp->file_path, 1, header->path_length, writer->fp );
+    write_index_padding( writer->fp, header->path_length );
 }
 
-/* Hash the first and last mebibytes. */
-static uint64_t xxhash_file( const char *file_path, int64_t file_size )
+static void write_index_active_video_stream
+(
+    lwindex_writer_t *writer,
+    int               stream_index
+)
 {
-    FILE *fp = lw_fopen( file_path, "rb" );
-    if( !fp ) return 0;
-    uint8_t *file_buffer = (uint8_t *)lw_malloc_zero( 1 << 21 );
-    const size_t read_len = 1 << 20;
-    size_t buffer_len = fread( file_buffer, 1, read_len, fp );
-    if( file_size > (1 << 21) )
+    if( !writer->fp )
+        return;
+    if( !writer->text )
     {
-        /* Only if file is larger than 2 mebibytes */
-        fseek( fp, -(1 << 20), SEEK_END );
-        buffer_len += fread( file_buffer + buffer_len, 1, read_len, fp );
+        writer->header.active_video_index = stream_index;
+        return;
     }
-    fclose( fp );
-    uint64_t hash = XXH3_64bits( file_buffer, buffer_len );
-    lw_free( file_buffer );
-    return hash;
+    int32_t current_pos = ftell( writer->fp );
+    fseek( writer->fp, writer->video_index_pos, SEEK_SET );
+    fprintf( writer->fp, "<ActiveVideoStreamIndex>%+011d</ActiveVideoStreamIndex>\n", stream_index );
+    fseek( writer->fp, current_pos, SEEK_SET );
 }
 
-/* Hash the first and last mebibytes. */
-static unsigned xxhash32_file( const char *file_path, int64_t file_size )
+static void write_index_active_audio_stream
+(
+    lwindex_writer_t *writer,
+    int               stream_index
+)
 {
-    uint8_t *file_buffer = (uint8_t *)lw_malloc_zero( 1 << 21 );
-    const size_t read_len = 1 << 20;
-    FILE *fp = lw_fopen( file_path, "rb" );
-    size_t buffer_len = fread( file_buffer, 1, read_len, fp );
-    if( file_size > (1 << 21) )
+    if( !writer->fp )
+        return;
+    if( !writer->text )
     {
-        /* Only if file is larger than 2 mebibytes */
-        fseek( fp, -(1 << 20), SEEK_END );
-        buffer_len += fread( file_buffer + buffer_len, 1, read_len, fp );
+        writer->header.active_audio_index  = stream_index;
+        writer->header.default_audio_index = stream_index;
+        return;
     }
-    fclose( fp );
-    unsigned hash = XXH32( file_buffer, buffer_len, 0 );
-    lw_free( file_buffer );
-    return hash;
+    int32_t current_pos = ftell( writer->fp );
+    fseek( writer->fp, writer->audio_index_pos, SEEK_SET );
+    fprintf( writer->fp, "<ActiveAudioStreamIndex>%+011d</ActiveAudioStreamIndex>\n", stream_index );
+    fprintf( writer->fp, "<DefaultAudioStreamIndex>%+011d</DefaultAudioStreamIndex>\n", stream_index );
+    fseek( writer->fp, current_pos, SEEK_SET );
 }
 
-static char *create_lwi_path
+/* The text index file has no checkpoint since it is never resumed. */
+static void write_index_checkpoint
 (
-    lwlibav_option_t *opt
+    lwindex_writer_t *writer,
+    int64_t           pos
 )
 {
-    if ( !opt->cache_dir || opt->cache_dir[0] == '\0' ) {
-        char *buf = lw_malloc_zero ( strlen( opt->file_path ) + 5 );
-        sprintf( buf, "%s.lwi", opt->file_path );
-        return buf;
-    }
+    if( writer->fp && !writer->text )
+        writer->header.checkpoint_pos = pos;
+}
 
-    const int max_filename = 254; // be conservative
-    const char *dir = opt->cache_dir ? opt->cache_dir : ".";
-    const char *rpath = lw_realpath( opt->file_path, NULL );
-    char *malloced = NULL;
-    if ( rpath )
+static void write_index_stream_info
+(
+    lwindex_writer_t *writer,
+    AVStream         *stream,
+    AVCodecContext   *pkt_ctx,
+    int               bits_per_sample
+)
+{
+    if( !writer->fp )
+        return;
+    const char *fmt_name = pkt_ctx->codec_type == AVMEDIA_TYPE_VIDEO
+                         ? av_get_pix_fmt_name( pkt_ctx->pix_fmt )
+                         : av_get_sample_fmt_name( pkt_ctx->sample_fmt );
+    if( !fmt_name )
+        fmt_name = "none";
+    if( writer->text )
+    {
+        print_index( writer->fp, "<StreamInfo=%d,%d>\n", stream->index, pkt_ctx->codec_type );
+        if( pkt_ctx->codec_type == AVMEDIA_TYPE_VIDEO )
+            print_index( writer->fp, "Codec=%d,TimeBase=%d/%d,Width=%d,Height=%d,Format=%s,ColorSpace=%d\n",
+                         pkt_ctx->codec_id, stream->time_base.num, stream->time_base.den,
+                         pkt_ctx->width, pkt_ctx->height, fmt_name, pkt_ctx->colorspace );
+        else
+            print_index( writer->fp, "Codec=%d,TimeBase=%d/%d,Channels=%d:0x%" PRIx64 ",Rate=%d,Format=%s,BPS=%d\n",
+                         pkt_ctx->codec_id, stream->time_base.num, stream->time_base.den,
+                         pkt_ctx->ch_layout.nb_channels, pkt_ctx->ch_layout.u.mask, pkt_ctx->sample_rate,
+                         fmt_name, bits_per_sample );
+        print_index( writer->fp, "</StreamInfo>\n" );
+        return;
+    }
+    lwindex_binary_stream_info_t info = { 0 };
+    info.stream_index  = stream->index;
+    info.codec_type    = pkt_ctx->codec_type;
+    info.codec_id      = pkt_ctx->codec_id;
+    info.time_base_num = stream->time_base.num;
+    info.time_base_den = stream->time_base.den;
+    if( pkt_ctx->codec_type == AVMEDIA_TYPE_VIDEO )
+    {
+        info.width      = pkt_ctx->width;
+        info.height     = pkt_ctx->height;
+        info.colorspace = pkt_ctx->colorspace;
+    }
+    else
+    {
+        info.channels        = pkt_ctx->ch_layout.nb_channels;
+        info.layout          = pkt_ctx->ch_layout.u.mask;
+        info.sample_rate     = pkt_ctx->sample_rate;
+        info.bits_per_sample = bits_per_sample;
+    }
+    snprintf( info.fmt, sizeof(info.fmt), "%s", fmt_name );
+    write_index_record( writer, &writer->header.stream_info_offset, &writer->header.stream_info_count, &info, sizeof(info) );
+}
+
+static void write_index_video_packet
+(
+    lwindex_writer_t       *writer,
+    const lwindex_packet_t *ipkt
+)
+{
+    if( !writer->fp )
+        return;
+    if( writer->text )
+    {
+        print_index( writer->fp, "Index=%d,POS=%" PRId64 ",PTS=%" PRId64 ",DTS=%" PRId64 ",EDI=%d\n"
+                     "Key=%d,Pic=%d,POC=%d,Repeat=%d,Field=%d,Size=%d\n",
+                     ipkt->stream_index, ipkt->pos, ipkt->pts, ipkt->dts, ipkt->extradata_index,
+                     !!(ipkt->flags & AV_PKT_FLAG_KEY), ipkt->pict_type, ipkt->poc, ipkt->repeat_pict, ipkt->field_info, ipkt->size );
+        return;
+    }
+    lwindex_packet_record_t record = { 0 };
+    record.pos             = ipkt->pos;
+    record.pts             = ipkt->pts;
+    record.dts             = ipkt->dts;
+    record.stream_index    = ipkt->stream_index;
+    record.extradata_index = ipkt->extradata_index;
+    record.poc             = ipkt->poc;
+    record.key             = !!(ipkt->flags & AV_PKT_FLAG_KEY);
+    record.pict_type       = ipkt->pict_type;
+    record.repeat_pict     = ipkt->repeat_pict;
+    record.field_info      = ipkt->field_info;
+    record.size            = ipkt->size;
+    write_index_record( writer, &writer->header.packet_offset, &writer->header.packet_count, &record, sizeof(record) );
+}
+
+static void write_index_audio_packet
+(
+    lwindex_writer_t *writer,
+    int               stream_index,
+    int64_t           pos,
+    int64_t           pts,
+    int64_t           dts,
+    int               extradata_index,
+    int               frame_length
+)
+{
+    if( !writer->fp )
+        return;
+    if( writer->text )
+    {
+        print_index( writer->fp, "Index=%d,POS=%" PRId64 ",PTS=%" PRId64 ",DTS=%" PRId64 ",EDI=%d\n"
+                     "Length=%d\n",
+                     stream_index, pos, pts, dts, extradata_index, frame_length );
+        return;
+    }
+    lwindex_packet_record_t record = { 0 };
+    record.pos             = pos;
+    record.pts             = pts;
+    record.dts             = dts;
+    record.stream_index    = stream_index;
+    record.extradata_index = extradata_index;
+    record.length          = frame_length;
+    write_index_record( writer, &writer->header.packet_offset, &writer->header.packet_count, &record, sizeof(record) );
+}
+
+static void write_index_stream_duration
+(
+    lwindex_writer_t *writer,
+    int               stream_index,
+    int               codec_type,
+    int64_t           duration
+)
+{
+    if( !writer->fp )
+        return;
+    if( writer->text )
+    {
+        print_index( writer->fp, "<StreamDuration=%d,%d>%" PRId64 "</StreamDuration>\n", stream_index, codec_type, duration );
+        return;
+    }
+    lwindex_binary_duration_t record = { stream_index, codec_type, duration };
+    write_index_record( writer, &writer->header.duration_offset, &writer->header.duration_count, &record, sizeof(record) );
+}
+
+static inline void write_av_index_entry
+(
+    lwindex_writer_t   *writer,
+    int                 stream_index,
+    int                 codec_type,
+    const AVIndexEntry *ie
+)
+{
+    if( !writer->fp )
+        return;
+    if( writer->text )
+    {
+        print_index( writer->fp, "POS=%" PRId64 ",TS=%" PRId64 ",Flags=%x,Size=%d,Distance=%d\n",
+                     ie->pos, ie->timestamp, ie->flags, ie->size, ie->min_distance );
+        return;
+    }
+    lwindex_binary_index_entry_t record = { 0 };
+    record.pos          = ie->pos;
+    record.timestamp    = ie->timestamp;
+    record.stream_index = stream_index;
+    record.codec_type   = codec_type;
+    record.flags        = ie->flags;
+    record.size         = ie->size;
+    record.min_distance = ie->min_distance;
+    write_index_record( writer, &writer->header.index_entry_offset, &writer->header.index_entry_count, &record, sizeof(record) );
+}
+
+static void write_binary_extradata
+(
+    lwindex_writer_t    *writer,
+    int                  stream_index,
+    int                  codec_type,
+    lwlibav_extradata_t *entry,
+    const char          *fmt_name
+)
+{
+    lwindex_binary_extradata_t record = { 0 };
+    record.stream_index    = stream_index;
+    record.codec_type      = codec_type;
+    record.extradata_size  = entry->extradata_size;
+    record.codec_id        = entry->codec_id;
+    record.codec_tag       = entry->codec_tag;
+    record.width           = entry->width;
+    record.height          = entry->height;
+    record.sample_rate     = entry->sample_rate;
+    record.bits_per_sample = entry->bits_per_sample;
+    record.block_align     = entry->block_align;
+    record.channel_layout  = entry->channel_layout;
+    snprintf( record.fmt, sizeof(record.fmt), "%s", fmt_name );
+    write_index_record( writer, &writer->header.extradata_offset, &writer->header.extradata_count, &record, sizeof(record) );
+    if( entry->extradata_size > 0 )
+    {
+        fwrite( entry->extradata, 1, entry->extradata_size, writer->fp );
+        write_index_padding( writer->fp, entry->extradata_size );
+    }
+}
+
+static void write_video_extradata
+(
+    lwindex_writer_t    *writer,
+    int                  stream_index,
+    lwlibav_extradata_t *entry
+)
+{
+    if( !writer->fp )
+        return;
+    const char *fmt_name = av_get_pix_fmt_name( entry->pixel_format ) ? av_get_pix_fmt_name( entry->pixel_format ) : "none";
+    if( !writer->text )
+    {
+        write_binary_extradata( writer, stream_index, AVMEDIA_TYPE_VIDEO, entry, fmt_name );
+        return;
+    }
+    fprintf( writer->fp, "Size=%d,Codec=%d,4CC=0x%x,Width=%d,Height=%d,Format=%s,BPS=%d\n",
+             entry->extradata_size, entry->codec_id, entry->codec_tag, entry->width, entry->height,
+             fmt_name, entry->bits_per_sample );
+    if( entry->extradata_size > 0 )
+        fwrite( entry->extradata, 1, entry->extradata_size, writer->fp );
+    fprintf( writer->fp, "\n" );
+}
+
+static void write_audio_extradata
+(
+    lwindex_writer_t    *writer,
+    int                  stream_index,
+    lwlibav_extradata_t *entry
+)
+{
+    if( !writer->fp )
+        return;
+    const char *fmt_name = av_get_sample_fmt_name( entry->sample_format ) ? av_get_sample_fmt_name( entry->sample_format ) : "none";
+    if( !writer->text )
+    {
+        write_binary_extradata( writer, stream_index, AVMEDIA_TYPE_AUDIO, entry, fmt_name );
+        return;
+    }
+    fprintf( writer->fp, "Size=%d,Codec=%d,4CC=0x%x,Layout=0x%" PRIx64 ",Rate=%d,Format=%s,BPS=%d,Align=%d\n",
+             entry->extradata_size, entry->codec_id, entry->codec_tag, entry->channel_layout, entry->sample_rate,
+             fmt_name, entry->bits_per_sample, entry->block_align );
+    if( entry->extradata_size > 0 )
+        fwrite( entry->extradata, 1, entry->extradata_size, writer->fp );
+    fprintf( writer->fp, "\n" );
+}
+
+/* Print a text-only line such as a section tag. Nothing is written to the binary index file. */
+static inline void write_index_tag
+(
+    lwindex_writer_t *writer,
+    const char       *format,
+    ...
+)
+{
+    if( !writer->fp || !writer->text )
+        return;
+    va_list args;
+    va_start( args, format );
+    vfprintf( writer->fp, format, args );
+    va_end( args );
+}
+
+static void write_index_trailer
+(
+    lwindex_writer_t *writer
+)
+{
+    if( !writer->fp )
+        return;
+    if( writer->text )
+    {
+        print_index( writer->fp, "</LibavReaderIndexFile>\n" );
+        return;
+    }
+    lwindex_binary_header_t *header = &writer->header;
+    memcpy( header->magic, LWINDEX_BINARY_MAGIC, sizeof(header->magic) );
+    header->lwindex_version    = LWINDEX_VERSION;
+    header->index_file_version = LWINDEX_BINARY_INDEX_FILE_VERSION;
+    fseek( writer->fp, 0, SEEK_SET );
+    fwrite( header, 1, sizeof(lwindex_binary_header_t), writer->fp );
+}
+
+static void disable_video_stream( lwlibav_video_decode_handler_t *vdhp )
+{
+    lw_freep( &vdhp->frame_list );
+    lw_freep( &vdhp->frame_table );
+    lw_freep( &vdhp->rap_list );
+    lw_freep( &vdhp->order_converter );
+    av_freep( &vdhp->index_entries );
+    vdhp->stream_index        = -1;
+    vdhp->index_entries_count = 0;
+    vdhp->frame_count         = 0;
+}
+
+static void cleanup_index_helpers( lwindex_indexer_t *indexer )
+{
+    for( int stream_index = 0; stream_index < indexer->number_of_helpers; stream_index++ )
+    {
+        lwindex_helper_t *helper = indexer->helpers[stream_index];
+        if( !helper )
+            continue;
+        avcodec_free_context( &helper->codec_ctx );
+        av_parser_close( helper->parser_ctx );
+        av_bsf_free( &helper->bsf_ctx );
+        av_frame_free( &helper->picture );
+        av_packet_unref( &helper->pkt );
+        lwlibav_extradata_handler_t *list = &helper->exh;
+        if( list->entries )
+        {
+            for( int i = 0; i < list->entry_count; i++ )
+                av_freep( &list->entries[i].extradata );
+            free( list->entries );
+        }
+        /* Free an index helper. */
+        lw_free( helper );
+    }
+    av_freep( &indexer->helpers );
+}
+
+/* Hash the first and last mebibytes. */
+static uint64_t xxhash_file( const char *file_path, int64_t file_size )
+{
+    FILE *fp = lw_fopen( file_path, "rb" );
+    if( !fp ) return 0;
+    uint8_t *file_buffer = (uint8_t *)lw_malloc_zero( 1 << 21 );
+    const size_t read_len = 1 << 20;
+    size_t buffer_len = fread( file_buffer, 1, read_len, fp );
+    if( file_size > (1 << 21) )
+    {
+        /* Only if file is larger than 2 mebibytes */
+        fseek( fp, -(1 << 20), SEEK_END );
+        buffer_len += fread( file_buffer + buffer_len, 1, read_len, fp );
+    }
+    fclose( fp );
+    uint64_t hash = XXH3_64bits( file_buffer, buffer_len );
+    lw_free( file_buffer );
+    return hash;
+}
+
+/* Hash the first mebibyte within the given size. */
+static uint64_t xxhash_file_head( const char *file_path, int64_t file_size )
+{
+    FILE *fp = lw_fopen( file_path, "rb" );
+    if( !fp ) return 0;
+    const size_t read_len = (size_t)MIN( file_size, 1 << 20 );
+    uint8_t *file_buffer = (uint8_t *)lw_malloc_zero( 1 << 20 );
+    if( !file_buffer )
+    {
+        fclose( fp );
+        return 0;
+    }
+    size_t buffer_len = fread( file_buffer, 1, read_len, fp );
+    fclose( fp );
+    uint64_t hash = buffer_len == read_len ? XXH3_64bits( file_buffer, buffer_len ) : 0;
+    lw_free( file_buffer );
+    return hash;
+}
+
+/* Hash the first and last mebibytes. */
+static unsigned xxhash32_file( const char *file_path, int64_t file_size )
+{
+    uint8_t *file_buffer = (uint8_t *)lw_malloc_zero( 1 << 21 );
+    const size_t read_len = 1 << 20;
+    FILE *fp = lw_fopen( file_path, "rb" );
+    size_t buffer_len = fread( file_buffer, 1, read_len, fp );
+    if( file_size > (1 << 21) )
+    {
+        /* Only if file is larger than 2 mebibytes */
+        fseek( fp, -(1 << 20), SEEK_END );
+        buffer_len += fread( file_buffer + buffer_len, 1, read_len, fp );
+    }
+    fclose( fp );
+    unsigned hash = XXH32( file_buffer, buffer_len, 0 );
+    lw_free( file_buffer );
+    return hash;
+}
+
+static char *duplicate_string( const char *str )
+{
+    if( !str )
+        return NULL;
+    size_t length = strlen( str );
+    char *dup = (char *)lw_malloc_zero( length + 1 );
+    if( dup )
+        memcpy( dup, str, length );
+    return dup;
+}
+
+static char *create_lwi_path
+(
+    lwlibav_option_t *opt
+)
+{
+    if ( !opt->cache_dir || opt->cache_dir[0] == '\0' ) {
+        char *buf = lw_malloc_zero ( strlen( opt->file_path ) + 5 );
+        sprintf( buf, "%s.lwi", opt->file_path );
+        return buf;
+    }
+
+    const int max_filename = 254; // be conservative
+    const char *dir = opt->cache_dir ? opt->cache_dir : ".";
+    const char *rpath = lw_realpath( opt->file_path, NULL );
+    char *malloced = NULL;
+    if ( rpath )
         malloced = (char *)rpath;
     else // realpath on Unix might fail if the file does not exist.
         rpath = opt->file_path;
@@ -2071,1156 +2940,2746 @@ static char *create_lwi_path
     return buf;
 }
 
-static int create_index
+/* Analyse a packet by its index helper.
+ * Note that the analysis might clear AV_PKT_FLAG_KEY of the packet.
+ * Return 0 on success. Otherwise return a negative value. */
+static int analyze_index_packet
 (
-    lwlibav_file_handler_t         *lwhp,
-    lwlibav_video_decode_handler_t *vdhp,
-    lwlibav_video_output_handler_t *vohp,
-    lwlibav_audio_decode_handler_t *adhp,
-    lwlibav_audio_output_handler_t *aohp,
-    AVFormatContext                *format_ctx,
-    lwlibav_option_t               *opt,
-    progress_indicator_t           *indicator,
-    progress_handler_t             *php
+    lwindex_helper_t *helper,
+    AVPacket         *pkt,
+    AVFrame          *frame_buffer,
+    int              *pix_fmt_investigated,
+    lwindex_packet_t *ipkt
 )
 {
-    uint32_t video_info_count = 1 << 16;
-    uint32_t audio_info_count = 1 << 16;
-    video_frame_info_t *video_info = (video_frame_info_t *)malloc( video_info_count * sizeof(video_frame_info_t) );
-    if( !video_info )
+    AVCodecContext *pkt_ctx = helper->codec_ctx;
+    memset( ipkt, 0, sizeof(lwindex_packet_t) );
+    int extradata_index = append_extradata_if_new( helper, pkt_ctx, pkt );
+    if( extradata_index < 0 )
         return -1;
-    audio_frame_info_t *audio_info = (audio_frame_info_t *)malloc( audio_info_count * sizeof(audio_frame_info_t) );
-    if( !audio_info )
+    if( pkt_ctx->codec_type == AVMEDIA_TYPE_VIDEO )
     {
-        free( video_info );
-        return -1;
+        if( pkt_ctx->pix_fmt == AV_PIX_FMT_NONE
+         || (pkt_ctx->codec->wrapper_name && !*pix_fmt_investigated) )
+        {
+            investigate_pix_fmt_by_decoding( pkt_ctx, pkt, frame_buffer );
+            *pix_fmt_investigated = 1;
+        }
+        /* The active video stream is decided by the resolution before parsing. */
+        ipkt->prior_width      = pkt_ctx->width;
+        ipkt->prior_height     = pkt_ctx->height;
+        ipkt->prior_colorspace = pkt_ctx->colorspace;
+        /* Get picture type. */
+        int pict_type = get_picture_type( helper, pkt_ctx, pkt );
+        if( pict_type < 0 )
+            return -1;
+        /* Get Picture Order Count. */
+        int poc = helper->parser_ctx ? helper->parser_ctx->output_picture_number : 0;
+        /* Get field information. */
+        int             repeat_pict;
+        lw_field_info_t field_info;
+        if( helper->parser_ctx )
+        {
+            if( helper->parser_ctx->picture_structure == AV_PICTURE_STRUCTURE_TOP_FIELD
+             || helper->parser_ctx->picture_structure == AV_PICTURE_STRUCTURE_BOTTOM_FIELD )
+            {
+                /* field coded picture */
+                if( helper->parser_ctx->picture_structure == AV_PICTURE_STRUCTURE_TOP_FIELD )
+                    field_info = LW_FIELD_INFO_TOP;
+                else
+                    field_info = LW_FIELD_INFO_BOTTOM;
+                repeat_pict = helper->parser_ctx->repeat_pict;
+            }
+            else
+            {
+                /* frame coded picture */
+                if( helper->parser_ctx->field_order == AV_FIELD_TT
+                 || helper->parser_ctx->field_order == AV_FIELD_TB )
+                    field_info = LW_FIELD_INFO_TOP;
+                else if( helper->parser_ctx->field_order == AV_FIELD_BB
+                      || helper->parser_ctx->field_order == AV_FIELD_BT )
+                    field_info = LW_FIELD_INFO_BOTTOM;
+                else
+                {
+                    field_info = helper->last_field_info;
+                    ipkt->field_inherited = (field_info == LW_FIELD_INFO_UNKNOWN);
+                }
+                if( get_ticks_per_frame( pkt_ctx ) == 2 && helper->parser_ctx->repeat_pict != 0 )
+                    repeat_pict = helper->parser_ctx->repeat_pict;
+                else
+                    repeat_pict = 2 * helper->parser_ctx->repeat_pict + 1;
+            }
+            helper->last_field_info = field_info;
+        }
+        else
+        {
+            repeat_pict = 1;
+            field_info = helper->last_field_info;
+            ipkt->field_inherited = (field_info == LW_FIELD_INFO_UNKNOWN);
+        }
+        ipkt->pict_type   = pict_type;
+        ipkt->poc         = poc;
+        ipkt->repeat_pict = repeat_pict;
+        ipkt->field_info  = field_info;
+        ipkt->corrupt     = repeat_pict == 0 && field_info == LW_FIELD_INFO_UNKNOWN && pkt_ctx->pix_fmt == AV_PIX_FMT_NONE
+                         && (pkt_ctx->codec_id == AV_CODEC_ID_H264 || pkt_ctx->codec_id == AV_CODEC_ID_HEVC)
+                         && (pkt_ctx->width == 0 || pkt_ctx->height == 0);
+        ipkt->invisible   = pkt_ctx->codec_id == AV_CODEC_ID_VP8 && check_vp8_invisible_frame( pkt );
+        ipkt->width       = pkt_ctx->width;
+        ipkt->height      = pkt_ctx->height;
+        ipkt->pix_fmt     = pkt_ctx->pix_fmt;
+        /* Set width, height and pixel_format for the current extradata. */
+        lwlibav_extradata_handler_t *list = &helper->exh;
+        lwlibav_extradata_t *entry = &list->entries[ list->current_index ];
+        if( entry->width < pkt_ctx->width )
+            entry->width = pkt_ctx->width;
+        if( entry->height < pkt_ctx->height )
+            entry->height = pkt_ctx->height;
+        if( entry->pixel_format == AV_PIX_FMT_NONE )
+            entry->pixel_format = pkt_ctx->pix_fmt;
+        if( entry->bits_per_sample == 0 )
+            entry->bits_per_sample = pkt_ctx->bits_per_coded_sample;
+        if( entry->codec_id == AV_CODEC_ID_NONE )
+            entry->codec_id = pkt_ctx->codec_id;
+        if( entry->codec_tag == 0 )
+            entry->codec_tag = pkt_ctx->codec_tag;
     }
-    /*
-        # Structure of Libav reader index file
-        <LibavReaderIndexFile=17>
-        <InputFilePath>foobar.omo</InputFilePath>
-        <FileSize=1048576>
-        <FileLastModificationTime=000>
-        <FileHash=0x0123456789abcdef>
-        <LibavReaderIndex=0x00000208,0,marumoska>
-        <ActiveVideoStreamIndex>+0000000000</ActiveVideoStreamIndex>
-        <ActiveAudioStreamIndex>-0000000001</ActiveAudioStreamIndex>
-        <DefaultAudioStreamIndex>-0000000001</DefaultAudioStreamIndex>
-        <StreamInfo=0,0>
-        Codec=2,TimeBase=1001/24000,Width=1920,Height=1080,Format=yuv420p,ColorSpace=5
-        </StreamInfo>
-        Index=0,POS=0,PTS=2002,DTS=0,EDI=0
-        Key=1,Pic=1,POC=0,Repeat=1,Field=0
-        </LibavReaderIndex>
-        <StreamDuration=0,0>5000</StreamDuration>
-        <StreamIndexEntries=0,0,1>
-        POS=0,TS=2002,Flags=1,Size=1024,Distance=0
-        </StreamIndexEntries>
-        <ExtraDataList=0,0,1>
-        Size=252,Codec=28,4CC=0x564d4448,Width=1920,Height=1080,Format=yuv420p,BPS=0
-        ... binary string ...
-        </ExtraDataList>
-        </LibavReaderIndexFile>
-     */
-    FILE *index = NULL;
-    if( opt->index_file_path )
-        index = !opt->no_create_index ? lw_fopen( opt->index_file_path, "wb" ) : NULL;
-    else if ( !opt->no_create_index )
-    {
-        char *index_path = create_lwi_path( opt );
-        index = lw_fopen( index_path, "wb" );
-        if ( !index )
-            fprintf(stderr, "lsmas: unable to create index file %s\n", index_path);
-        lw_free( index_path );
-    }
-    if( !index && !opt->no_create_index )
-    {
-        free( video_info );
-        free( audio_info );
-        return -1;
-    }
-    lwhp->format_name  = (char *)format_ctx->iformat->name;
-    lwhp->format_flags = format_ctx->iformat->flags;
-    char lname[4];
-    snprintf(lname, sizeof lname, "%.3s", format_ctx->iformat->long_name);
-    lwhp->raw_demuxer  = !strcmp(lname, "raw");
-    vdhp->format       = format_ctx;
-    adhp->format       = format_ctx;
-    adhp->dv_in_avi    = !strcmp( lwhp->format_name, "avi" ) ? -1 : 0;
-    int32_t video_index_pos = 0;
-    int32_t audio_index_pos = 0;
-#ifdef _WIN32
-    wchar_t* wname = NULL;
-#endif // _WIN32
-    if( index )
+    else
     {
-        /* Write Index file header. */
-        uint8_t lwindex_version[4] =
+        int bits_per_sample = pkt_ctx->bits_per_raw_sample   > 0 ? pkt_ctx->bits_per_raw_sample
+                            : pkt_ctx->bits_per_coded_sample > 0 ? pkt_ctx->bits_per_coded_sample
+                            : av_get_bytes_per_sample( pkt_ctx->sample_fmt ) << 3;
+        /* Get audio frame_length. */
+        ipkt->frame_length    = get_audio_frame_length( helper, pkt_ctx, pkt );
+        ipkt->bits_per_sample = bits_per_sample;
+        ipkt->sample_rate     = pkt_ctx->sample_rate;
+        ipkt->sample_fmt      = pkt_ctx->sample_fmt;
+        if( pkt_ctx->ch_layout.order != AV_CHANNEL_ORDER_CUSTOM )
         {
-            (LWINDEX_VERSION >> 24) & 0xff,
-            (LWINDEX_VERSION >> 16) & 0xff,
-            (LWINDEX_VERSION >>  8) & 0xff,
-             LWINDEX_VERSION        & 0xff
-        };
-        fprintf( index, "<LSMASHWorksIndexVersion=%" PRIu8 ".%" PRIu8 ".%" PRIu8 ".%" PRIu8 ">\n",
-                 lwindex_version[0], lwindex_version[1], lwindex_version[2], lwindex_version[3] );
-        fprintf( index, "<LibavReaderIndexFile=%d>\n", LWINDEX_INDEX_FILE_VERSION );
-        fprintf( index, "<InputFilePath>%s</InputFilePath>\n", lwhp->file_path );
-#ifdef _WIN32
-        struct _stat64 file_stat;
-        if( lw_string_to_wchar( CP_UTF8, lwhp->file_path, &wname ) )
-            _wstat64( wname, &file_stat );
+            ipkt->ch_order = pkt_ctx->ch_layout.order;
+            ipkt->ch_mask  = pkt_ctx->ch_layout.u.mask;
+        }
         else
-            _stat64( lwhp->file_path, &file_stat );
-#else
-        struct stat file_stat;
-        stat( lwhp->file_path, &file_stat );
-#endif
-        fprintf( index, "<FileSize=%" PRId64 ">\n", file_stat.st_size );
-        fprintf( index, "<FileLastModificationTime=%" PRId64 ">\n", file_stat.st_mtime );
-        fprintf( index, "<FileHash=0x%016" PRIx64 ">\n", xxhash_file( lwhp->file_path, file_stat.st_size ) );
-        fprintf( index, "<LibavReaderIndex=0x%08x,%d,%s>\n", lwhp->format_flags, lwhp->raw_demuxer, lwhp->format_name );
-        video_index_pos = ftell( index );
-        fprintf( index, "<ActiveVideoStreamIndex>%+011d</ActiveVideoStreamIndex>\n", -1 );
-        audio_index_pos = ftell( index );
-        fprintf( index, "<ActiveAudioStreamIndex>%+011d</ActiveAudioStreamIndex>\n", adhp->stream_index );
-        fprintf(index, "<DefaultAudioStreamIndex>%+011d</DefaultAudioStreamIndex>\n", -1);
+            /* The channel map is owned by the decoder, so keep only the number of channels. */
+            ipkt->ch_order = AV_CHANNEL_ORDER_UNSPEC;
+        ipkt->channels = pkt_ctx->ch_layout.nb_channels;
+        /* Set channel_layout, sample_rate, sample_format and bits_per_sample for the current extradata. */
+        lwlibav_extradata_handler_t *list = &helper->exh;
+        lwlibav_extradata_t *entry = &list->entries[ list->current_index ];
+        if( entry->channel_layout == 0 )
+            entry->channel_layout = pkt_ctx->ch_layout.u.mask;
+        if( entry->sample_rate == 0 )
+            entry->sample_rate = pkt_ctx->sample_rate;
+        if( entry->sample_format == AV_SAMPLE_FMT_NONE )
+            entry->sample_format = pkt_ctx->sample_fmt;
+        if( entry->bits_per_sample == 0 )
+            entry->bits_per_sample = bits_per_sample;
+        if( entry->block_align == 0 )
+            entry->block_align = pkt_ctx->block_align;
+        if( entry->codec_id == AV_CODEC_ID_NONE )
+            entry->codec_id = pkt_ctx->codec_id;
+        if( entry->codec_tag == 0 )
+            entry->codec_tag = pkt_ctx->codec_tag;
     }
-    AVPacket pkt = { 0 };
-    int       pix_fmt_investigated  = 0;
-    int       video_resolution      = 0;
-    int       is_attached_pic       = 0;
-    uint32_t  video_sample_count    = 0;
-    uint32_t  invisible_count       = 0;
-    uint32_t  video_keyframe_count  = 0;
-    int64_t   last_keyframe_pts     = AV_NOPTS_VALUE;
-    uint32_t  audio_sample_count    = 0;
-    int       audio_sample_rate     = 0;
-    int       constant_frame_length = 1;
-    uint64_t  audio_duration        = 0;
-    int64_t   first_dts             = AV_NOPTS_VALUE;
-    int64_t   filesize              = avio_size( format_ctx->pb );
-    if( indicator->open )
-        indicator->open( php );
-    /* Start to read frames and write the index file. */
-    lwindex_indexer_t indexer =
-    {
-        0,                              /* number_of_helpers */
-        NULL,                           /* helpers */
-        vdhp->preferred_decoder_names,  /* preferred_video_decoder_names */
-        vdhp->prefer_hw_decoder,        /* prefer_video_hw_decoder */
-        adhp->preferred_decoder_names,  /* preferred_audio_decoder_names */
-        lwhp->threads,                  /* thread_count */
-        lwhp->format_name               /* format_name */
-    };
-    for( unsigned int stream_index = 0; stream_index < format_ctx->nb_streams; stream_index++ )
+    ipkt->pos             = pkt->pos;
+    ipkt->size            = pkt->size;
+    ipkt->pts             = pkt->pts;
+    ipkt->dts             = pkt->dts;
+    ipkt->stream_index    = pkt->stream_index;
+    ipkt->flags           = pkt->flags;
+    ipkt->extradata_index = extradata_index;
+    return 0;
+}
+
+/* Progressive indexing
+ *
+ * The index is constructed by a background thread with its own handlers, and the indexer publishes the frames
+ * indexed so far at each keyframe of the active video stream. The reader takes a snapshot of them, decides the
+ * seek method for them, and serves the frames which cannot be preceded in presentation order by the frames
+ * indexed later, i.e. the frames presented before the previous keyframe. When the indexing completes, the reader
+ * adopts the final frame lists. */
+typedef struct
+{
+    video_frame_info_t *frame_list;         /* stored in decoding order */
+    uint32_t            frame_count;
+    uint32_t            frame_alloc;
+    uint32_t            horizon;            /* the decoding number of the previous keyframe */
+    lwlibav_extradata_handler_t exh;
+    int                 stream_index;
+    enum AVCodecID      codec_id;
+    AVRational          time_base;
+    int                 max_width;
+    int                 max_height;
+    int                 initial_width;
+    int                 initial_height;
+    enum AVPixelFormat  initial_pix_fmt;
+    enum AVColorSpace   initial_colorspace;
+} lwindex_progressive_snapshot_t;
+
+struct lwlibav_progressive_index_tag
+{
+    /* owned by the indexing thread until the indexing completes */
+    lw_thread_t                    *thread;
+    lwlibav_file_handler_t          lwh;
+    lwlibav_video_decode_handler_t *vdhp;
+    lwlibav_video_output_handler_t *vohp;
+    lwlibav_audio_decode_handler_t *adhp;
+    lwlibav_audio_output_handler_t *aohp;
+    lw_log_handler_t                lh;
+    lwlibav_option_t                opt;
+    char                           *file_path;
+    char                           *cache_dir;
+    char                           *index_file_path;
+    int                             publishable;    /* -1: not checked yet */
+    uint32_t                        last_keyframe_number;
+    int                             result;
+    /* shared with the reader */
+    lw_mutex_t                     *mutex;
+    lw_cond_t                      *cond;
+    int                             abort;          /* protected by mutex */
+    int                             complete;       /* protected by mutex */
+    uint32_t                        generation;     /* protected by mutex */
+    lwindex_progressive_snapshot_t  snapshot;       /* protected by mutex */
+    /* owned by the reader */
+    uint32_t                        installed_generation;
+    uint32_t                        available_count;
+    int                             adopted;
+};
+
+static void free_extradata_entries
+(
+    lwlibav_extradata_handler_t *exhp
+)
+{
+    for( int i = 0; i < exhp->entry_count; i++ )
+        av_free( exhp->entries[i].extradata );
+    lw_freep( &exhp->entries );
+    exhp->entry_count = 0;
+}
+
+/* Update the copy of the extradata list.
+ * The entries are only appended and the extradata of each entry never changes once stored. */
+static int copy_progressive_extradata
+(
+    lwlibav_extradata_handler_t       *dst,
+    const lwlibav_extradata_handler_t *src
+)
+{
+    int copied_count = dst->entry_count;
+    if( src->entry_count > dst->entry_count
+     && !alloc_extradata_entries( dst, src->entry_count ) )
+        return -1;
+    for( int i = 0; i < src->entry_count; i++ )
     {
-        AVStream *stream = format_ctx->streams[stream_index];
-        enum AVMediaType codec_type = stream->codecpar->codec_type;
-        if( codec_type != AVMEDIA_TYPE_VIDEO
-         && (codec_type != AVMEDIA_TYPE_AUDIO || adhp->stream_index == -2) )
-            continue;
-        lwindex_helper_t *helper = get_index_helper( &indexer, stream );
-        if( !helper || !helper->codec_ctx )
-            continue;
-        AVCodecContext *pkt_ctx = helper->codec_ctx;
-        print_index( index, "<StreamInfo=%d,%d>\n", stream_index, codec_type );
-        if( codec_type == AVMEDIA_TYPE_VIDEO )
-            print_index( index, "Codec=%d,TimeBase=%d/%d,Width=%d,Height=%d,Format=%s,ColorSpace=%d\n",
-                         pkt_ctx->codec_id, stream->time_base.num, stream->time_base.den,
-                         pkt_ctx->width, pkt_ctx->height,
-                         av_get_pix_fmt_name( pkt_ctx->pix_fmt ) ? av_get_pix_fmt_name( pkt_ctx->pix_fmt ) : "none",
-                         pkt_ctx->colorspace );
-        else
+        lwlibav_extradata_t       *dst_entry = &dst->entries[i];
+        const lwlibav_extradata_t *src_entry = &src->entries[i];
+        uint8_t *extradata      = dst_entry->extradata;
+        int      extradata_size = dst_entry->extradata_size;
+        if( i >= copied_count && src_entry->extradata_size > 0 )
         {
-            if (pkt_ctx->ch_layout.order == AV_CHANNEL_ORDER_UNSPEC)
-                av_channel_layout_default(&pkt_ctx->ch_layout, pkt_ctx->ch_layout.nb_channels);
-            int bits_per_sample = pkt_ctx->bits_per_raw_sample   > 0 ? pkt_ctx->bits_per_raw_sample
-                                : pkt_ctx->bits_per_coded_sample > 0 ? pkt_ctx->bits_per_coded_sample
-                                : av_get_bytes_per_sample( pkt_ctx->sample_fmt ) << 3;
-            print_index( index, "Codec=%d,TimeBase=%d/%d,Channels=%d:0x%" PRIx64 ",Rate=%d,Format=%s,BPS=%d\n",
-                         pkt_ctx->codec_id, stream->time_base.num, stream->time_base.den,
-                         pkt_ctx->ch_layout.nb_channels, pkt_ctx->ch_layout.u.mask, pkt_ctx->sample_rate,
-                         av_get_sample_fmt_name( pkt_ctx->sample_fmt ) ? av_get_sample_fmt_name( pkt_ctx->sample_fmt ) : "none",
-                         bits_per_sample );
+            extradata = (uint8_t *)av_malloc( src_entry->extradata_size + AV_INPUT_BUFFER_PADDING_SIZE );
+            if( !extradata )
+                return -1;
+            memcpy( extradata, src_entry->extradata, src_entry->extradata_size );
+            memset( extradata + src_entry->extradata_size, 0, AV_INPUT_BUFFER_PADDING_SIZE );
+            extradata_size = src_entry->extradata_size;
         }
-        print_index( index, "</StreamInfo>\n" );
+        *dst_entry = *src_entry;
+        dst_entry->extradata      = extradata;
+        dst_entry->extradata_size = extradata_size;
     }
-    while( read_av_frame( format_ctx, &pkt ) >= 0 )
+    return 0;
+}
+
+/* Check if the frames indexed so far never change by the frames indexed later. */
+static int is_progressive_publishable
+(
+    lwlibav_progressive_index_t *pip,
+    AVFormatContext             *format_ctx
+)
+{
+    if( pip->opt.field_dominance )
+        return 0;
+    if( pip->opt.force_video )
+        return 1;
+    /* The active video stream could be replaced with a higher resolution one. */
+    int video_stream_count = 0;
+    for( unsigned int i = 0; i < format_ctx->nb_streams; i++ )
+        video_stream_count += (format_ctx->streams[i]->codecpar->codec_type == AVMEDIA_TYPE_VIDEO);
+    return video_stream_count == 1;
+}
+
+/* Publish the frames before the current keyframe of the active video stream. */
+static void publish_progressive_index
+(
+    lwlibav_progressive_index_t    *pip,
+    lwindex_builder_t              *builder,
+    lwindex_helper_t               *helper,
+    lwlibav_video_decode_handler_t *vdhp,
+    uint32_t                        keyframe_number
+)
+{
+    if( pip->publishable < 0 )
+        pip->publishable = is_progressive_publishable( pip, vdhp->format );
+    /* Invisible frames and field coded pictures require the output frame list over all frames. */
+    video_frame_info_t *info = builder->video_info;
+    if( builder->invisible_count )
+        pip->publishable = 0;
+    for( uint32_t i = pip->snapshot.frame_count + 1; i < keyframe_number && pip->publishable; i++ )
+        if( info[i].repeat_pict == 0 )
+            pip->publishable = 0;
+    uint32_t horizon = pip->last_keyframe_number;
+    pip->last_keyframe_number = keyframe_number;
+    lwindex_progressive_snapshot_t *snapshot = &pip->snapshot;
+    uint32_t frame_count = keyframe_number - 1;
+    /* The frames already published are registered again if resuming the indexing from the checkpoint failed. */
+    if( !pip->publishable || horizon == 0 || frame_count <= snapshot->frame_count )
+        return;
+    lw_mutex_lock( pip->mutex );
+    if( frame_count + 1 > snapshot->frame_alloc )
     {
-        AVStream          *stream   = format_ctx->streams[ pkt.stream_index ];
-        AVCodecParameters *codecpar = stream->codecpar;
-        if( codecpar->codec_type != AVMEDIA_TYPE_VIDEO
-         && codecpar->codec_type != AVMEDIA_TYPE_AUDIO )
-        {
-            stream->discard = AVDISCARD_ALL;
-            continue;
-        }
-        if( codecpar->codec_id == AV_CODEC_ID_NONE )
-        {
-            stream->discard = AVDISCARD_ALL;
-            continue;
-        }
-        lwindex_helper_t *helper = get_index_helper( &indexer, stream );
-        if( !helper )
-        {
-            av_packet_unref( &pkt );
-            goto fail_index;
-        }
-        AVCodecContext *pkt_ctx = helper->codec_ctx;
-        if( !pkt_ctx )
+        uint32_t frame_alloc = MAX( 2 * snapshot->frame_alloc, frame_count + 1 );
+        video_frame_info_t *temp = (video_frame_info_t *)realloc( snapshot->frame_list, frame_alloc * sizeof(video_frame_info_t) );
+        if( !temp )
+            goto fail;
+        snapshot->frame_list  = temp;
+        snapshot->frame_alloc = frame_alloc;
+    }
+    memcpy( &snapshot->frame_list[ snapshot->frame_count + 1 ], &info[ snapshot->frame_count + 1 ],
+            (frame_count - snapshot->frame_count) * sizeof(video_frame_info_t) );
+    if( copy_progressive_extradata( &snapshot->exh, &helper->exh ) < 0 )
+        goto fail;
+    snapshot->frame_count        = frame_count;
+    snapshot->horizon            = horizon;
+    snapshot->stream_index       = vdhp->stream_index;
+    snapshot->codec_id           = vdhp->codec_id;
+    snapshot->time_base          = vdhp->time_base;
+    snapshot->max_width          = vdhp->max_width;
+    snapshot->max_height         = vdhp->max_height;
+    snapshot->initial_width      = vdhp->initial_width;
+    snapshot->initial_height     = vdhp->initial_height;
+    snapshot->initial_pix_fmt    = vdhp->ctx->pix_fmt;
+    snapshot->initial_colorspace = vdhp->initial_colorspace;
+    ++ pip->generation;
+    lw_cond_broadcast( pip->cond );
+    lw_mutex_unlock( pip->mutex );
+    return;
+fail:
+    /* The reader waits for the completion instead. */
+    pip->publishable = 0;
+    lw_mutex_unlock( pip->mutex );
+}
+
+/* Register an analysed packet into the frame lists and write it to the index file.
+ * Return 0 on success. Otherwise return a negative value. */
+static int register_index_packet
+(
+    lwindex_builder_t              *builder,
+    lwindex_writer_t               *writer,
+    lwindex_helper_t               *helper,
+    AVStream                       *stream,
+    lwindex_packet_t               *ipkt,
+    const AVChannelLayout          *ch_layout,
+    lwlibav_video_decode_handler_t *vdhp,
+    lwlibav_audio_decode_handler_t *adhp,
+    lwlibav_audio_output_handler_t *aohp,
+    lwlibav_option_t               *opt
+)
+{
+    AVCodecContext *pkt_ctx = helper->codec_ctx;
+    if( pkt_ctx->codec_type == AVMEDIA_TYPE_VIDEO )
+    {
+        int dv_in_avi_init = 0;
+        if( adhp->dv_in_avi    == -1
+         && vdhp->stream_index == -1
+         && pkt_ctx->codec_id  == AV_CODEC_ID_DVVIDEO
+         && opt->force_audio   == 0 )
         {
-            stream->discard = AVDISCARD_ALL;
-            continue;
+            dv_in_avi_init     = 1;
+            adhp->dv_in_avi    = 1;
+            vdhp->stream_index = ipkt->stream_index;
         }
-        int extradata_index = append_extradata_if_new( helper, pkt_ctx, &pkt );
-        if( extradata_index < 0 )
+        /* Replace lower resolution stream with higher. Override attached picture. */
+        int higher_priority = ((ipkt->prior_width * ipkt->prior_height > builder->video_resolution)
+                            || (builder->is_attached_pic && !(stream->disposition & AV_DISPOSITION_ATTACHED_PIC)));
+        if( dv_in_avi_init
+         || (!opt->force_video && (vdhp->stream_index == -1 || (ipkt->stream_index != vdhp->stream_index && higher_priority)))
+         || (opt->force_video && vdhp->stream_index == -1 && ipkt->stream_index == opt->force_video_index) )
         {
-            av_packet_unref( &pkt );
-            goto fail_index;
+            /* Update active video stream. */
+            write_index_active_video_stream( writer, ipkt->stream_index );
+            memset( builder->video_info, 0, (builder->video_sample_count + 1) * sizeof(video_frame_info_t) );
+            vdhp->ctx                   = pkt_ctx;
+            vdhp->codec_id              = pkt_ctx->codec_id;
+            vdhp->stream_index          = ipkt->stream_index;
+            builder->video_resolution   = ipkt->prior_width * ipkt->prior_height;
+            builder->is_attached_pic    = !!(stream->disposition & AV_DISPOSITION_ATTACHED_PIC);
+            builder->video_sample_count = 0;
+            builder->last_keyframe_pts  = AV_NOPTS_VALUE;
+            vdhp->max_width             = ipkt->prior_width;
+            vdhp->max_height            = ipkt->prior_height;
+            vdhp->initial_width         = ipkt->prior_width;
+            vdhp->initial_height        = ipkt->prior_height;
+            vdhp->initial_colorspace    = (enum AVColorSpace)ipkt->prior_colorspace;
         }
-        if( pkt_ctx->codec_type == AVMEDIA_TYPE_VIDEO )
+        /* Set video frame info if this stream is active. */
+        if( ipkt->stream_index == vdhp->stream_index )
         {
-            if( pkt_ctx->pix_fmt == AV_PIX_FMT_NONE
-             || (pkt_ctx->codec->wrapper_name && !pix_fmt_investigated) )
-            {
-                investigate_pix_fmt_by_decoding( pkt_ctx, &pkt, vdhp->frame_buffer );
-                pix_fmt_investigated = 1;
-            }
-            int dv_in_avi_init = 0;
-            if( adhp->dv_in_avi    == -1
-             && vdhp->stream_index == -1
-             && pkt_ctx->codec_id  == AV_CODEC_ID_DVVIDEO
-             && opt->force_audio   == 0 )
+            uint32_t video_sample_count = ++ builder->video_sample_count;
+            video_frame_info_t *info = &builder->video_info[video_sample_count];
+            memset( info, 0, sizeof(video_frame_info_t) );
+            info->pts             = ipkt->pts;
+            info->dts             = ipkt->dts;
+            info->file_offset     = ipkt->pos;
+            info->packet_size     = ipkt->size;
+            info->sample_number   = video_sample_count;
+            info->extradata_index = ipkt->extradata_index;
+            info->pict_type       = ipkt->pict_type;
+            info->poc             = ipkt->poc;
+            info->repeat_pict     = ipkt->repeat_pict;
+            info->field_info      = (lw_field_info_t)ipkt->field_info;
+            if( ipkt->pts != AV_NOPTS_VALUE && builder->last_keyframe_pts != AV_NOPTS_VALUE && ipkt->pts < builder->last_keyframe_pts )
+                info->flags |= LW_VFRAME_FLAG_LEADING;
+            if( ipkt->flags & AV_PKT_FLAG_KEY )
             {
-                dv_in_avi_init     = 1;
-                adhp->dv_in_avi    = 1;
-                vdhp->stream_index = pkt.stream_index;
+                /* For the present, treat this frame as a keyframe. */
+                info->flags |= LW_VFRAME_FLAG_KEY;
+                builder->last_keyframe_pts = ipkt->pts;
+                ++ builder->video_keyframe_count;
             }
-            /* Replace lower resolution stream with higher. Override attached picture. */
-            int higher_priority = ((pkt_ctx->width * pkt_ctx->height > video_resolution)
-                                || (is_attached_pic && !(stream->disposition & AV_DISPOSITION_ATTACHED_PIC)));
-            if( dv_in_avi_init
-             || (!opt->force_video && (vdhp->stream_index == -1 || (pkt.stream_index != vdhp->stream_index && higher_priority)))
-             || (opt->force_video && vdhp->stream_index == -1 && pkt.stream_index == opt->force_video_index) )
+            if( ipkt->corrupt )
+                info->flags |= LW_VFRAME_FLAG_CORRUPT;
+            if( opt->progressive && (ipkt->flags & AV_PKT_FLAG_KEY) )
+                publish_progressive_index( opt->progressive, builder, helper, vdhp, video_sample_count );
+            if( ipkt->invisible )
             {
-                /* Update active video stream. */
-                if( index )
-                {
-                    int32_t current_pos = ftell( index );
-                    fseek( index, video_index_pos, SEEK_SET );
-                    fprintf( index, "<ActiveVideoStreamIndex>%+011d</ActiveVideoStreamIndex>\n", pkt.stream_index );
-                    fseek( index, current_pos, SEEK_SET );
-                }
-                memset( video_info, 0, (video_sample_count + 1) * sizeof(video_frame_info_t) );
-                vdhp->ctx                = pkt_ctx;
-                vdhp->codec_id           = pkt_ctx->codec_id;
-                vdhp->stream_index       = pkt.stream_index;
-                video_resolution         = pkt_ctx->width * pkt_ctx->height;
-                is_attached_pic          = !!(stream->disposition & AV_DISPOSITION_ATTACHED_PIC);
-                video_sample_count       = 0;
-                last_keyframe_pts        = AV_NOPTS_VALUE;
-                vdhp->max_width          = pkt_ctx->width;
-                vdhp->max_height         = pkt_ctx->height;
-                vdhp->initial_width      = pkt_ctx->width;
-                vdhp->initial_height     = pkt_ctx->height;
-                vdhp->initial_colorspace = pkt_ctx->colorspace;
-            }
-            /* Get picture type. */
-            int pict_type = get_picture_type( helper, pkt_ctx, &pkt );
-            if( pict_type < 0 )
-            {
-                av_packet_unref( &pkt );
-                goto fail_index;
+                /* VPx invisible altref frame. */
+                info->pts         = AV_NOPTS_VALUE;
+                info->dts         = AV_NOPTS_VALUE;
+                info->file_offset = -1;
+                info->packet_size = 0;
+                info->flags      |= LW_VFRAME_FLAG_INVISIBLE;
+                ++ builder->invisible_count;
+                /* backward compatible hack for the index */
+                ipkt->pts = AV_NOPTS_VALUE;
+                ipkt->dts = AV_NOPTS_VALUE;
+                ipkt->pos  = -1;
+                ipkt->size = 0;
             }
-            /* Get Picture Order Count. */
-            int poc = helper->parser_ctx ? helper->parser_ctx->output_picture_number : 0;
-            /* Get field information. */
-            int             repeat_pict;
-            lw_field_info_t field_info;
-            if( helper->parser_ctx )
+            if( vdhp->time_base.num == 0 || vdhp->time_base.den == 0 )
             {
-                if( helper->parser_ctx->picture_structure == AV_PICTURE_STRUCTURE_TOP_FIELD
-                 || helper->parser_ctx->picture_structure == AV_PICTURE_STRUCTURE_BOTTOM_FIELD )
-                {
-                    /* field coded picture */
-                    if( helper->parser_ctx->picture_structure == AV_PICTURE_STRUCTURE_TOP_FIELD )
-                        field_info = LW_FIELD_INFO_TOP;
-                    else
-                        field_info = LW_FIELD_INFO_BOTTOM;
-                    repeat_pict = helper->parser_ctx->repeat_pict;
-                }
-                else
-                {
-                    /* frame coded picture */
-                    if( helper->parser_ctx->field_order == AV_FIELD_TT
-                     || helper->parser_ctx->field_order == AV_FIELD_TB )
-                        field_info = LW_FIELD_INFO_TOP;
-                    else if( helper->parser_ctx->field_order == AV_FIELD_BB
-                          || helper->parser_ctx->field_order == AV_FIELD_BT )
-                        field_info = LW_FIELD_INFO_BOTTOM;
-                    else
-                        field_info = helper->last_field_info;
-                    if( get_ticks_per_frame( pkt_ctx ) == 2 && helper->parser_ctx->repeat_pict != 0 )
-                        repeat_pict = helper->parser_ctx->repeat_pict;
-                    else
-                        repeat_pict = 2 * helper->parser_ctx->repeat_pict + 1;
-                }
-                helper->last_field_info = field_info;
+                vdhp->time_base.num = stream->time_base.num;
+                vdhp->time_base.den = stream->time_base.den;
             }
-            else
+            /* Set maximum resolution. */
+            if( vdhp->max_width  < ipkt->width )
+                vdhp->max_width  = ipkt->width;
+            if( vdhp->max_height < ipkt->height )
+                vdhp->max_height = ipkt->height;
+            if( video_sample_count + 1 == builder->video_info_count )
             {
-                repeat_pict = 1;
-                field_info = helper->last_field_info;
+                video_frame_info_t *temp = (video_frame_info_t *)realloc( builder->video_info, 2 * builder->video_info_count * sizeof(video_frame_info_t) );
+                if( !temp )
+                    return -1;
+                builder->video_info        = temp;
+                builder->video_info_count <<= 1;
             }
-            /* Set video frame info if this stream is active. */
-            if( pkt.stream_index == vdhp->stream_index )
+        }
+        /* Write a video packet info to the index file. */
+        write_index_video_packet( writer, ipkt );
+    }
+    else
+    {
+        if( adhp->stream_index == -1 && (!opt->force_audio || (opt->force_audio && ipkt->stream_index == opt->force_audio_index)) )
+        {
+            /* Update active audio stream. */
+            write_index_active_audio_stream( writer, ipkt->stream_index );
+            adhp->ctx          = pkt_ctx;
+            adhp->codec_id     = pkt_ctx->codec_id;
+            adhp->stream_index = ipkt->stream_index;
+        }
+        int frame_length = ipkt->frame_length;
+        /* Set audio frame info if this stream is active. */
+        if( ipkt->stream_index == adhp->stream_index )
+        {
+            if( frame_length != -1 )
+                builder->audio_duration += frame_length;
+            if( builder->audio_duration <= INT32_MAX )
             {
-                ++video_sample_count;
-                video_frame_info_t *info = &video_info[video_sample_count];
-                memset( info, 0, sizeof(video_frame_info_t) );
-                info->pts             = pkt.pts;
-                info->dts             = pkt.dts;
-                info->file_offset     = pkt.pos;
-                info->sample_number   = video_sample_count;
-                info->extradata_index = extradata_index;
-                info->pict_type       = pict_type;
-                info->poc             = poc;
-                info->repeat_pict     = repeat_pict;
-                info->field_info      = field_info;
-                if( pkt.pts != AV_NOPTS_VALUE && last_keyframe_pts != AV_NOPTS_VALUE && pkt.pts < last_keyframe_pts )
-                    info->flags |= LW_VFRAME_FLAG_LEADING;
-                if( pkt.flags & AV_PKT_FLAG_KEY )
-                {
-                    /* For the present, treat this frame as a keyframe. */
-                    info->flags |= LW_VFRAME_FLAG_KEY;
-                    last_keyframe_pts = pkt.pts;
-                    ++video_keyframe_count;
-                }
-                if( repeat_pict == 0 && field_info == LW_FIELD_INFO_UNKNOWN && pkt_ctx->pix_fmt == AV_PIX_FMT_NONE
-                 && (pkt_ctx->codec_id == AV_CODEC_ID_H264 || pkt_ctx->codec_id == AV_CODEC_ID_HEVC)
-                 && (pkt_ctx->width == 0 || pkt_ctx->height == 0) )
-                    info->flags |= LW_VFRAME_FLAG_CORRUPT;
-                if( pkt_ctx->codec_id == AV_CODEC_ID_VP8 && check_vp8_invisible_frame( &pkt ) )
-                {
-                    /* VPx invisible altref frame. */
-                    info->pts         = AV_NOPTS_VALUE;
-                    info->dts         = AV_NOPTS_VALUE;
-                    info->file_offset = -1;
-                    info->flags      |= LW_VFRAME_FLAG_INVISIBLE;
-                    ++invisible_count;
-                    /* backward compatible hack for the index */
-                    pkt.pts = AV_NOPTS_VALUE;
-                    pkt.dts = AV_NOPTS_VALUE;
-                    pkt.pos = -1;
-                }
-                if( vdhp->time_base.num == 0 || vdhp->time_base.den == 0 )
+                /* Set up audio frame info. */
+                uint32_t audio_sample_count = ++ builder->audio_sample_count;
+                audio_frame_info_t *audio_info = builder->audio_info;
+                audio_frame_info_t *info = &audio_info[audio_sample_count];
+                memset( info, 0, sizeof(audio_frame_info_t) );
+                info->pts             = ipkt->pts;
+                info->dts             = ipkt->dts;
+                info->file_offset     = ipkt->pos;
+                info->sample_number   = audio_sample_count;
+                info->extradata_index = ipkt->extradata_index;
+                info->sample_rate     = ipkt->sample_rate;
+                if( frame_length != -1 && audio_sample_count > helper->delay_count )
                 {
-                    vdhp->time_base.num = stream->time_base.num;
-                    vdhp->time_base.den = stream->time_base.den;
+                    uint32_t audio_frame_number = audio_sample_count - helper->delay_count;
+                    audio_info[audio_frame_number].length = frame_length;
+                    if( audio_frame_number > 1 && audio_info[audio_frame_number].length != audio_info[audio_frame_number - 1].length )
+                        builder->constant_frame_length = 0;
                 }
-                /* Set maximum resolution. */
-                if( vdhp->max_width  < pkt_ctx->width )
-                    vdhp->max_width  = pkt_ctx->width;
-                if( vdhp->max_height < pkt_ctx->height )
-                    vdhp->max_height = pkt_ctx->height;
-                if( video_sample_count + 1 == video_info_count )
+                if( builder->audio_sample_rate == 0 )
+                    builder->audio_sample_rate = ipkt->sample_rate;
+                if( audio_sample_count + 1 == builder->audio_info_count )
                 {
-                    video_info_count <<= 1;
-                    video_frame_info_t *temp = (video_frame_info_t *)realloc( video_info, video_info_count * sizeof(video_frame_info_t) );
+                    audio_frame_info_t *temp = (audio_frame_info_t *)realloc( audio_info, 2 * builder->audio_info_count * sizeof(audio_frame_info_t) );
                     if( !temp )
-                    {
-                        av_packet_unref( &pkt );
-                        goto fail_index;
-                    }
-                    video_info = temp;
+                        return -1;
+                    builder->audio_info        = temp;
+                    builder->audio_info_count <<= 1;
                 }
+                if( ch_layout->nb_channels > aohp->output_channel_layout.nb_channels )
+                    av_channel_layout_copy( &aohp->output_channel_layout, ch_layout );
+                aohp->output_sample_format   = select_better_sample_format( aohp->output_sample_format, (enum AVSampleFormat)ipkt->sample_fmt );
+                aohp->output_sample_rate     = MAX( aohp->output_sample_rate, builder->audio_sample_rate );
+                aohp->output_bits_per_sample = MAX( aohp->output_bits_per_sample, ipkt->bits_per_sample );
             }
-            /* Set width, height and pixel_format for the current extradata. */
-            if( extradata_index >= 0 )
-            {
-                lwlibav_extradata_handler_t *list = &helper->exh;
-                lwlibav_extradata_t *entry = &list->entries[ list->current_index ];
-                if( entry->width < pkt_ctx->width )
-                    entry->width = pkt_ctx->width;
-                if( entry->height < pkt_ctx->height )
-                    entry->height = pkt_ctx->height;
-                if( entry->pixel_format == AV_PIX_FMT_NONE )
-                    entry->pixel_format = pkt_ctx->pix_fmt;
-                if( entry->bits_per_sample == 0 )
-                    entry->bits_per_sample = pkt_ctx->bits_per_coded_sample;
-                if( entry->codec_id == AV_CODEC_ID_NONE )
-                    entry->codec_id = pkt_ctx->codec_id;
-                if( entry->codec_tag == 0 )
-                    entry->codec_tag = pkt_ctx->codec_tag;
-            }
-            /* Write a video packet info to the index file. */
-            print_index( index, "Index=%d,POS=%" PRId64 ",PTS=%" PRId64 ",DTS=%" PRId64 ",EDI=%d\n"
-                         "Key=%d,Pic=%d,POC=%d,Repeat=%d,Field=%d\n",
-                         pkt.stream_index, pkt.pos, pkt.pts, pkt.dts, extradata_index,
-                         !!(pkt.flags & AV_PKT_FLAG_KEY), pict_type, poc, repeat_pict, field_info );
-        }
-        else if( adhp->stream_index != -2 )
-        {
-            if( adhp->stream_index == -1 && (!opt->force_audio || (opt->force_audio && pkt.stream_index == opt->force_audio_index)) )
-            {
-                /* Update active audio stream. */
-                if( index )
-                {
-                    int32_t current_pos = ftell( index );
-                    fseek( index, audio_index_pos, SEEK_SET );
-                    fprintf( index, "<ActiveAudioStreamIndex>%+011d</ActiveAudioStreamIndex>\n", pkt.stream_index );
-                    fprintf(index, "<DefaultAudioStreamIndex>%+011d</DefaultAudioStreamIndex>\n", pkt.stream_index);
-                    fseek( index, current_pos, SEEK_SET );
-                }
-                adhp->ctx          = pkt_ctx;
-                adhp->codec_id     = pkt_ctx->codec_id;
-                adhp->stream_index = pkt.stream_index;
-            }
-            int bits_per_sample = pkt_ctx->bits_per_raw_sample   > 0 ? pkt_ctx->bits_per_raw_sample
-                                : pkt_ctx->bits_per_coded_sample > 0 ? pkt_ctx->bits_per_coded_sample
-                                : av_get_bytes_per_sample( pkt_ctx->sample_fmt ) << 3;
-            /* Get audio frame_length. */
-            int frame_length = get_audio_frame_length( helper, pkt_ctx, &pkt );
-            /* Set audio frame info if this stream is active. */
-            if( pkt.stream_index == adhp->stream_index )
-            {
-                if( frame_length != -1 )
-                    audio_duration += frame_length;
-                if( audio_duration <= INT32_MAX )
-                {
-                    /* Set up audio frame info. */
-                    ++audio_sample_count;
-                    audio_frame_info_t *info = &audio_info[audio_sample_count];
-                    memset( info, 0, sizeof(audio_frame_info_t) );
-                    info->pts             = pkt.pts;
-                    info->dts             = pkt.dts;
-                    info->file_offset     = pkt.pos;
-                    info->sample_number   = audio_sample_count;
-                    info->extradata_index = extradata_index;
-                    info->sample_rate     = pkt_ctx->sample_rate;
-                    if( frame_length != -1 && audio_sample_count > helper->delay_count )
-                    {
-                        uint32_t audio_frame_number = audio_sample_count - helper->delay_count;
-                        audio_info[audio_frame_number].length = frame_length;
-                        if( audio_frame_number > 1 && audio_info[audio_frame_number].length != audio_info[audio_frame_number - 1].length )
-                            constant_frame_length = 0;
-                    }
-                    if( audio_sample_rate == 0 )
-                        audio_sample_rate = pkt_ctx->sample_rate;
-                    if( audio_sample_count + 1 == audio_info_count )
-                    {
-                        audio_info_count <<= 1;
-                        audio_frame_info_t *temp = (audio_frame_info_t *)realloc( audio_info, audio_info_count * sizeof(audio_frame_info_t) );
-                        if( !temp )
-                        {
-                            av_packet_unref( &pkt );
-                            goto fail_index;
-                        }
-                        audio_info = temp;
-                    }
-                    if (pkt_ctx->ch_layout.nb_channels > aohp->output_channel_layout.nb_channels)
-                        av_channel_layout_copy(&aohp->output_channel_layout, &pkt_ctx->ch_layout);
-                    aohp->output_sample_format   = select_better_sample_format( aohp->output_sample_format, pkt_ctx->sample_fmt );
-                    aohp->output_sample_rate     = MAX( aohp->output_sample_rate, audio_sample_rate );
-                    aohp->output_bits_per_sample = MAX( aohp->output_bits_per_sample, bits_per_sample );
-                }
-                if( adhp->time_base.num == 0 || adhp->time_base.den == 0 )
-                {
-                    adhp->time_base.num = stream->time_base.num;
-                    adhp->time_base.den = stream->time_base.den;
-                }
+            if( adhp->time_base.num == 0 || adhp->time_base.den == 0 )
+            {
+                adhp->time_base.num = stream->time_base.num;
+                adhp->time_base.den = stream->time_base.den;
             }
-            /* Set channel_layout, sample_rate, sample_format and bits_per_sample for the current extradata. */
-            if( extradata_index >= 0 )
-            {
-                lwlibav_extradata_handler_t *list = &helper->exh;
-                lwlibav_extradata_t *entry = &list->entries[ list->current_index ];
-                if( entry->channel_layout == 0 )
-                    entry->channel_layout = pkt_ctx->ch_layout.u.mask;
-                if( entry->sample_rate == 0 )
-                    entry->sample_rate = pkt_ctx->sample_rate;
-                if( entry->sample_format == AV_SAMPLE_FMT_NONE )
-                    entry->sample_format = pkt_ctx->sample_fmt;
-                if( entry->bits_per_sample == 0 )
-                    entry->bits_per_sample = bits_per_sample;
-                if( entry->block_align == 0 )
-                    entry->block_align = pkt_ctx->block_align;
-                if( entry->codec_id == AV_CODEC_ID_NONE )
-                    entry->codec_id = pkt_ctx->codec_id;
-                if( entry->codec_tag == 0 )
-                    entry->codec_tag = pkt_ctx->codec_tag;
-            }
-            /* Write an audio packet info to the index file. */
-            print_index( index, "Index=%d,POS=%" PRId64 ",PTS=%" PRId64 ",DTS=%" PRId64 ",EDI=%d\n"
-                         "Length=%d\n",
-                         pkt.stream_index, pkt.pos, pkt.pts, pkt.dts, extradata_index,
-                         frame_length );
-        }
-        else
-            stream->discard = AVDISCARD_ALL;
-        if( indicator->update )
-        {
-            /* Update progress dialog. */
-            int percent = 0;
-            if( first_dts == AV_NOPTS_VALUE )
-                first_dts = pkt.dts;
-            if( filesize > 0 && format_ctx->pb->pos > 0 )
-                /* Update if I/O context's file offset is valid. */
-                percent = (int)(100.0 * ((double)format_ctx->pb->pos / filesize) + 0.5);
-            else if( format_ctx->duration > 0 && first_dts != AV_NOPTS_VALUE && pkt.dts != AV_NOPTS_VALUE )
-                /* Update if packet's DTS is valid. */
-                percent = (int)(100.0
-                             * (pkt.dts - first_dts) * (stream->time_base.num / (double)stream->time_base.den)
-                             / (format_ctx->duration / AV_TIME_BASE)
-                             + 0.5);
-            const char *message = index ? "Creating Index file" : "Parsing input file";
-            int abort = indicator->update( php, message, percent );
-            av_packet_unref( &pkt );
-            if( abort )
-                goto fail_index;
         }
-        else
-            av_packet_unref( &pkt );
+        /* Write an audio packet info to the index file. */
+        write_index_audio_packet( writer, ipkt->stream_index, ipkt->pos, ipkt->pts, ipkt->dts, ipkt->extradata_index, frame_length );
     }
-    /* Handle delay derived from the audio decoder. */
-    for( unsigned int stream_index = 0; stream_index < format_ctx->nb_streams; stream_index++ )
-    {
-        AVStream         *stream = format_ctx->streams[stream_index];
-        lwindex_helper_t *helper = get_index_helper( &indexer, stream );
-        if( !helper || !helper->codec_ctx || !helper->decode || stream->codecpar->codec_type != AVMEDIA_TYPE_AUDIO || adhp->stream_index == -2 )
-            continue;
-        AVCodecContext *pkt_ctx = helper->codec_ctx;
-        /* Flush if decoding is delayed. */
-        for( uint32_t i = 1; i <= helper->delay_count; i++ )
-        {
-            AVPacket null_pkt = { 0 };
-            int decode_complete;
-            if( helper->decode( pkt_ctx, helper->picture, &decode_complete, &null_pkt ) >= 0 )
-            {
-                int frame_length = decode_complete ? helper->picture->nb_samples : 0;
-                if( stream_index == adhp->stream_index )
-                {
-                    audio_duration += frame_length;
-                    if( audio_duration > INT32_MAX )
-                        break;
-                    uint32_t audio_frame_number = audio_sample_count - helper->delay_count + i;
-                    audio_info[audio_frame_number].length = frame_length;
-                    if( audio_frame_number > 1
-                     && audio_info[audio_frame_number].length != audio_info[audio_frame_number - 1].length )
-                        constant_frame_length = 0;
-                }
-                print_index( index, "Index=%d,POS=-1,PTS=%" PRId64 ",DTS=%" PRId64 ",EDI=-1\n"
-                             "Length=%d\n",
-                             stream_index, AV_NOPTS_VALUE, AV_NOPTS_VALUE, frame_length );
-            }
-        }
+    return 0;
+}
+
+/* Resumable indexing of a growing file
+ *
+ * The binary index file records a checkpoint, the file offset of a video keyframe which resets the state of the
+ * parser in the same way as the start of a range of the parallel indexing. When the input file has grown since
+ * indexing and its head is unchanged, the packets before the checkpoint are registered from the index file without
+ * reading the input file, and only the rest of the file is read from the checkpoint. The checkpoint is kept away
+ * from the end of the file since the last packets of a file being recorded may be incomplete. */
+#ifndef LWINDEX_CHECKPOINT_MARGIN   /* overridden by the tests to resume small files */
+#define LWINDEX_CHECKPOINT_MARGIN  (INT64_C(4) << 20)
+#endif
+
+typedef struct
+{
+    int64_t                       pos;              /* file offset of the video keyframe to resume the indexing from */
+    int                           video_stream_index;
+    lwindex_binary_stream_info_t *streams;
+    uint32_t                      stream_count;
+    lwindex_packet_record_t      *records;          /* the packets before the checkpoint in the reading order */
+    uint32_t                      record_count;
+    uint8_t                      *extradata;        /* the extradata section of the index file */
+    uint32_t                      extradata_count;
+    int                           video_started;
+    int                           failed;           /* 1: the file does not continue from the checkpoint */
+} lwindex_checkpoint_t;
+
+static void cleanup_index_checkpoint
+(
+    lwindex_checkpoint_t *checkpoint
+)
+{
+    lw_freep( &checkpoint->streams );
+    lw_freep( &checkpoint->records );
+    lw_freep( &checkpoint->extradata );
+}
+
+static int import_binary_extradata
+(
+    lwlibav_extradata_t              *entry,
+    const lwindex_binary_extradata_t *record,
+    const uint8_t                    *extradata
+)
+{
+    entry->extradata_size  = record->extradata_size;
+    entry->codec_id        = (enum AVCodecID)record->codec_id;
+    entry->codec_tag       = record->codec_tag;
+    entry->bits_per_sample = record->bits_per_sample;
+    if( record->codec_type == AVMEDIA_TYPE_VIDEO )
+    {
+        entry->width        = record->width;
+        entry->height       = record->height;
+        entry->pixel_format = av_get_pix_fmt( record->fmt );
     }
-    print_index( index, "</LibavReaderIndex>\n" );
-    /* Deallocate video frame info if no active video stream. */
-    if( vdhp->stream_index < 0 )
-        lw_freep( &video_info );
-    /* Deallocate audio frame info if no active audio stream. */
-    if( adhp->stream_index < 0 )
-        lw_freep( &audio_info );
     else
     {
-        /* Check the active stream is DV in AVI Type-1 or not. */
-        if( adhp->dv_in_avi == 1 && avformat_index_get_entries_count(format_ctx->streams[ adhp->stream_index ]) == 0 )
-        {
-            /* DV in AVI Type-1 */
-            audio_sample_count = video_info ? MIN( video_sample_count, audio_sample_count ) : 0;
-            for( uint32_t i = 1; i <= audio_sample_count; i++ )
-            {
-                audio_info[i].keyframe        = !!(video_info[i].flags & LW_VFRAME_FLAG_KEY);
-                audio_info[i].sample_number   = video_info[i].sample_number;
-                audio_info[i].pts             = video_info[i].pts;
-                audio_info[i].dts             = video_info[i].dts;
-                audio_info[i].file_offset     = video_info[i].file_offset;
-                audio_info[i].extradata_index = video_info[i].extradata_index;
-            }
-        }
-        else
-        {
-            if( adhp->dv_in_avi == 1 && opt->force_video && opt->force_video_index == -1 )
-            {
-                /* Disable DV video stream. */
-                disable_video_stream( vdhp );
-                video_info = NULL;
-            }
-            adhp->dv_in_avi = 0;
-        }
+        entry->channel_layout = record->channel_layout;
+        entry->sample_rate    = record->sample_rate;
+        entry->block_align    = record->block_align;
+        entry->sample_format  = av_get_sample_fmt( record->fmt );
     }
-    for( unsigned int stream_index = 0; stream_index < format_ctx->nb_streams; stream_index++ )
+    if( entry->extradata_size > 0 )
     {
-        AVStream *stream = format_ctx->streams[stream_index];
-        if( stream->codecpar->codec_type == AVMEDIA_TYPE_VIDEO
-         || (stream->codecpar->codec_type == AVMEDIA_TYPE_AUDIO && adhp->stream_index != -2) )
-            print_index( index, "<StreamDuration=%d,%d>%" PRId64 "</StreamDuration>\n",
-                         stream_index, stream->codecpar->codec_type, stream->duration );
+        entry->extradata = (uint8_t *)av_malloc( entry->extradata_size + AV_INPUT_BUFFER_PADDING_SIZE );
+        if( !entry->extradata )
+            return -1;
+        memcpy( entry->extradata, extradata, entry->extradata_size );
+        memset( entry->extradata + entry->extradata_size, 0, AV_INPUT_BUFFER_PADDING_SIZE );
     }
-    if( !strcmp( lwhp->format_name, "asf" ) )
+    return 0;
+}
+
+/* Parallel indexing of MPEG-2 transport stream
+ *
+ * The file is split into byte ranges and each range is read by its own demuxer and analysed by its own index
+ * helpers in a worker thread. Every range except the first starts at a video keyframe which resets the state
+ * of the parser, i.e. an IDR picture with its parameter sets for H.264/HEVC or a picture following a sequence
+ * header for MPEG-1/2 Video and VC-1. So, POCs do not need to be rebased. After all workers finish, the ranges
+ * are spliced by the first packets beyond each range, and the analysed packets are registered in the reading
+ * order, which rebases sample numbers and merges extradata. If the ranges do not line up, the caller falls back
+ * to the sequential indexing.
+ * Raw elementary streams are never indexed in parallel because their timestamps are generated by libavformat
+ * from the beginning of the file and cannot be reproduced after a byte seek. */
+#define LWINDEX_PARALLEL_MAX_RANGES      16
+#ifndef LWINDEX_PARALLEL_MIN_RANGE_SIZE  /* overridden by the tests to split small files */
+#define LWINDEX_PARALLEL_MIN_RANGE_SIZE  (INT64_C(256) << 20)
+#endif
+#define LWINDEX_PARALLEL_SPLICE_MARGIN   (INT64_C(32) << 20)
+#define LWINDEX_PARALLEL_PROGRESS_STEP   (INT64_C(4) << 20)
+#define LWINDEX_PARALLEL_MAX_SKIPS       16
+
+enum
+{
+    LWINDEX_RANGE_PENDING = 0,  /* still searching the start of the range */
+    LWINDEX_RANGE_FOUND   = 1,  /* the start of the range is found */
+    LWINDEX_RANGE_NONE    = 2,  /* no start in the range; the preceding range covers this range */
+};
+
+typedef struct
+{
+    int     present;
+    int64_t pos;
+    int64_t pts;
+    int64_t dts;
+} lwindex_splice_t;
+
+typedef struct lwindex_parallel_tag lwindex_parallel_t;
+
+typedef struct
+{
+    lwindex_parallel_t *parallel;
+    int                 number;
+    lw_thread_t        *thread;
+    int                 state;          /* protected by lwindex_parallel_t.mutex */
+    int64_t             progress;       /* protected by lwindex_parallel_t.mutex */
+    int64_t             split_pos;      /* nominal start of the range */
+    int64_t             start_pos;      /* file offset of the first video packet of the range */
+    int64_t             read_end;       /* file offset of the packet at which the reading stopped */
+    lwindex_indexer_t   indexer;
+    lwindex_packet_t   *packets;
+    uint32_t            packet_count;
+    uint32_t            packet_alloc;
+    lwindex_splice_t   *splice;         /* the first packet of each stream beyond the range */
+} lwindex_range_t;
+
+struct lwindex_parallel_tag
+{
+    const char      *file_path;
+    AVFormatContext *format_ctx;
+    int              video_stream_index;
+    enum AVCodecID   video_codec_id;
+    int              audio_disabled;
+    int64_t          file_size;
+    lw_mutex_t      *mutex;
+    lw_cond_t       *cond;
+    int              abort;             /* protected by mutex */
+    int              finished;          /* protected by mutex */
+    int              range_count;
+    lwindex_range_t *ranges;
+};
+
+/* Check if the packet has a sequence header and a picture which resets the state of the parser.
+ * Packets demuxed from MPEG-2 transport stream are in the byte stream format. */
+static int is_parallel_split_point
+(
+    enum AVCodecID  codec_id,
+    const AVPacket *pkt
+)
+{
+    int sequence_header = 0;
+    int reset_picture   = 0;
+    const uint8_t *end = pkt->data + pkt->size;
+    for( const uint8_t *p = pkt->data; p + 4 <= end; p++ )
     {
-        /* Pretty hackish workaround for the ASF demuxer
-         * The Simple Index Object does not always describe all keyframes in corresponding video stream.
-         * Since the Simple Index Object cannot indicate PTS offset derived from missing indexes of early keyframes,
-         * the Simple Index Object is unreliable on frame-accurate seek. So, this section makes up the indexes from
-         * the actual timestamps and file offsets without the Simple Index Object.
-         * Here, also construct the indexes for audio stream from the actual timestamps and file offsets if present. */
-        for( unsigned int stream_index = 0; stream_index < format_ctx->nb_streams; stream_index++ )
+        if( p[0] != 0x00 || p[1] != 0x00 || p[2] != 0x01 )
+            continue;
+        uint8_t code = p[3];
+        if( codec_id == AV_CODEC_ID_H264 )
         {
-            AVStream *stream = format_ctx->streams[stream_index];
-            AVIndexEntry *temp = NULL;
-            if( stream->codecpar->codec_type == AVMEDIA_TYPE_VIDEO )
-            {
-                uint32_t i = 0;
-                for (uint32_t j = 1; j <= video_sample_count && i < video_keyframe_count; j++)
-                    if ((video_info[j].flags & LW_VFRAME_FLAG_KEY)
-                        && (video_info[j].pts != AV_NOPTS_VALUE
-                            || video_info[j].dts != AV_NOPTS_VALUE))
-                    {
-                        av_add_index_entry(stream, video_info[j].file_offset,
-                            video_info[j].pts != AV_NOPTS_VALUE ? video_info[j].pts : video_info[j].dts,
-                            0, // size
-                            0, // distance
-                            AVINDEX_KEYFRAME);
-                        i++;
-                    }
-            }
-            else if( stream->codecpar->codec_type == AVMEDIA_TYPE_AUDIO )
-            {
-                av_add_index_entry(stream, 0, 0, 0, 0, 0);
-                uint32_t i = 0;
-                for (uint32_t j = 1; j <= audio_sample_count && i < audio_sample_count; j++)
-                {
-                    if (audio_info[j].pts != AV_NOPTS_VALUE
-                        || audio_info[j].dts != AV_NOPTS_VALUE)
-                    {
-                        av_add_index_entry(stream, audio_info[j].file_offset,
-                            audio_info[j].pts != AV_NOPTS_VALUE ? audio_info[j].pts : audio_info[j].dts,
-                            0, // size
-                            0, // distance
-                            AVINDEX_KEYFRAME);
-                        i++;
-                    }
-                }
-            }
-            if( !temp )
-            {
-                /* Anyway clear the index entries. */
-                av_add_index_entry(stream, 0, 0, 0, 0, 0);
-            }
+            int nal_unit_type = code & 0x1f;
+            sequence_header |= (nal_unit_type == 7);    /* SPS */
+            reset_picture   |= (nal_unit_type == 5);    /* IDR picture */
         }
-    }
-    for( unsigned int stream_index = 0; stream_index < format_ctx->nb_streams; stream_index++ )
-    {
-        AVStream *stream = format_ctx->streams[stream_index];
-        if( stream->codecpar->codec_type == AVMEDIA_TYPE_VIDEO )
+        else if( codec_id == AV_CODEC_ID_HEVC )
         {
-            print_index( index, "<StreamIndexEntries=%d,%d,%d>\n", stream_index, AVMEDIA_TYPE_VIDEO, avformat_index_get_entries_count(stream) );
-            if( vdhp->stream_index != stream_index )
-                for( int i = 0; i < avformat_index_get_entries_count(stream); i++ )
-                    write_av_index_entry( index, avformat_index_get_entry(stream, i) );
-            else if(avformat_index_get_entries_count(stream) > 0 )
-            {
-                vdhp->index_entries = (AVIndexEntry *)av_malloc( avformat_index_get_entries_count(stream) * sizeof(AVIndexEntry) );
-                if( !vdhp->index_entries )
-                    goto fail_index;
-                for( int i = 0; i < avformat_index_get_entries_count(stream); i++ )
-                {
-                    const AVIndexEntry *ie = avformat_index_get_entry(stream, i);
-                    vdhp->index_entries[i] = *ie;
-                    write_av_index_entry( index, ie );
-                }
-                vdhp->index_entries_count = avformat_index_get_entries_count(stream);
-            }
-            print_index( index, "</StreamIndexEntries>\n" );
+            int nal_unit_type = (code >> 1) & 0x3f;
+            sequence_header |= (nal_unit_type == 33);   /* SPS */
+            reset_picture   |= (nal_unit_type == 19     /* IDR_W_RADL */
+                             || nal_unit_type == 20);   /* IDR_N_LP */
         }
-        else if( stream->codecpar->codec_type == AVMEDIA_TYPE_AUDIO && adhp->stream_index != -2 )
+        else if( codec_id == AV_CODEC_ID_VC1 )
         {
-            print_index( index, "<StreamIndexEntries=%d,%d,%d>\n", stream_index, AVMEDIA_TYPE_AUDIO, avformat_index_get_entries_count(stream) );
-            if( adhp->stream_index != stream_index )
-                for( int i = 0; i < avformat_index_get_entries_count(stream); i++ )
-                    write_av_index_entry( index, avformat_index_get_entry(stream, i) );
-            else if(avformat_index_get_entries_count(stream) > 0 )
-            {
-                /* Audio stream in matroska container requires index_entries for seeking.
-                 * This avoids for re-reading the file to create index_entries since the file will be closed once. */
-                adhp->index_entries = (AVIndexEntry *)av_malloc( avformat_index_get_entries_count(stream) * sizeof(AVIndexEntry) );
-                if( !adhp->index_entries )
-                    goto fail_index;
-                for( int i = 0; i < avformat_index_get_entries_count(stream); i++ )
-                {
-                    const AVIndexEntry *ie = avformat_index_get_entry(stream, i);
-                    adhp->index_entries[i] = *ie;
-                    write_av_index_entry( index, ie );
-                }
-                adhp->index_entries_count = avformat_index_get_entries_count(stream);
-            }
-            print_index( index, "</StreamIndexEntries>\n" );
+            sequence_header |= (code == 0x0F);          /* sequence header */
+            reset_picture   |= (code == 0x0D);          /* frame */
         }
-    }
-    for( unsigned int stream_index = 0; stream_index < format_ctx->nb_streams; stream_index++ )
-    {
-        AVStream          *stream   = format_ctx->streams[stream_index];
-        AVCodecParameters *codecpar = stream->codecpar;
-        if( codecpar->codec_type == AVMEDIA_TYPE_VIDEO
-         || (codecpar->codec_type == AVMEDIA_TYPE_AUDIO && adhp->stream_index != -2) )
+        else
         {
-            lwindex_helper_t *helper = get_index_helper( &indexer, stream );
-            if( !helper || !helper->codec_ctx )
-                continue;
-            lwlibav_extradata_handler_t *list = &helper->exh;
-            void (*write_av_extradata)( FILE *, lwlibav_extradata_t * ) = codecpar->codec_type == AVMEDIA_TYPE_VIDEO
-                                                                        ? write_video_extradata
-                                                                        : write_audio_extradata;
-            print_index( index, "<ExtraDataList=%d,%d,%d>\n", stream_index, codecpar->codec_type, list->entry_count );
-            if( (codecpar->codec_type == AVMEDIA_TYPE_VIDEO && stream_index == vdhp->stream_index)
-             || (codecpar->codec_type == AVMEDIA_TYPE_AUDIO && stream_index == adhp->stream_index) )
-            {
-                for( int i = 0; i < list->entry_count; i++ )
-                    write_av_extradata( index, &list->entries[i] );
-                lwlibav_extradata_handler_t *exhp = codecpar->codec_type == AVMEDIA_TYPE_VIDEO ? &vdhp->exh : &adhp->exh;
-                exhp->entry_count   = list->entry_count;
-                exhp->entries       = list->entries;
-                exhp->current_index = codecpar->codec_type == AVMEDIA_TYPE_VIDEO
-                                    ? video_info[1].extradata_index
-                                    : audio_info[1].extradata_index;
-                /* Avoid freeing entries. */
-                list->entry_count = 0;
-                list->entries     = NULL;
-            }
-            else
-                for( int i = 0; i < list->entry_count; i++ )
-                    write_av_extradata( index, &list->entries[i] );
-            print_index( index, "</ExtraDataList>\n" );
+            sequence_header |= (code == 0xB3);          /* sequence header */
+            reset_picture   |= (code == 0x00);          /* picture */
         }
+        if( sequence_header && reset_picture )
+            return 1;
+        p += 3;
     }
-    print_index( index, "</LibavReaderIndexFile>\n" );
-    if( vdhp->stream_index >= 0 )
-    {
-        vdhp->keyframe_list = (uint8_t *)lw_malloc_zero( (video_sample_count + 1) * sizeof(uint8_t) );
-        if( !vdhp->keyframe_list )
-            goto fail_index;
-        vdhp->frame_list      = video_info;
-        vdhp->frame_count     = video_sample_count;
-        vdhp->initial_pix_fmt = vdhp->ctx->pix_fmt;
-        if( decide_video_seek_method( lwhp, vdhp, video_sample_count ) )
-            goto fail_index;
-        /* Compute the stream duration. */
-        compute_stream_duration( lwhp, vdhp, format_ctx->streams[ vdhp->stream_index ]->duration );
-        /* Create the repeat control info. */
-        create_video_frame_order_list( vdhp, vohp, opt );
-        /* Exclude invisible frames from the output handler. */
-        create_video_visible_frame_list( vdhp, vohp, invisible_count );
-    }
-    if( adhp->stream_index >= 0 )
-    {
-        adhp->frame_list   = audio_info;
-        adhp->frame_count  = audio_sample_count;
-        adhp->frame_length = constant_frame_length ? adhp->frame_list[1].length : 0;
-        decide_audio_seek_method( lwhp, adhp, audio_sample_count );
-        if( opt->av_sync && vdhp->stream_index >= 0 )
-            lwhp->av_gap = calculate_av_gap( vdhp, vohp, adhp, audio_sample_rate );
-    }
-#ifdef _WIN32
-    lw_free(wname);
-#endif // _WIN32
-    cleanup_index_helpers( &indexer, format_ctx );
-    if( index )
-        fclose( index );
-    if( indicator->close )
-        indicator->close( php );
-    vdhp->format = NULL;
-    adhp->format = NULL;
     return 0;
-fail_index:
-#ifdef _WIN32
-    lw_free(wname);
-#endif // _WIN32
-    cleanup_index_helpers( &indexer, format_ctx );
-    free( video_info );
-    free( audio_info );
-    if( index )
-        fclose( index );
-    if( indicator->close )
-        indicator->close( php );
-    vdhp->format = NULL;
-    adhp->format = NULL;
-    return -1;
 }
 
-static int parse_index
+/* Return the index of the video stream if the file can be split at its sequence headers. Otherwise return -1. */
+static int find_split_video_stream
 (
-    lwlibav_file_handler_t         *lwhp,
-    lwlibav_video_decode_handler_t *vdhp,
-    lwlibav_video_output_handler_t *vohp,
-    lwlibav_audio_decode_handler_t *adhp,
-    lwlibav_audio_output_handler_t *aohp,
-    lwlibav_option_t               *opt,
-    FILE                           *index
+    lwlibav_file_handler_t *lwhp,
+    AVFormatContext        *format_ctx
 )
 {
-    /* Test to open the target file. */
-    char file_path[512] = { 0 };
-    if( fscanf( index, "<InputFilePath>%[^\n<]</InputFilePath>\n", file_path ) != 1 )
+    if( strcmp( lwhp->format_name, "mpegts" )
+     || (lwhp->format_flags & AVFMT_GENERIC_INDEX)
+     || !format_ctx->pb
+     || !(format_ctx->pb->seekable & AVIO_SEEKABLE_NORMAL) )
         return -1;
-    size_t file_path_length = strlen( opt->file_path );
-    const char *ext = file_path_length >= 5 ? &opt->file_path[file_path_length - 4] : NULL;
-    if( ext && !strncmp( ext, ".lwi", strlen( ".lwi" ) ) )
-    {
-        FILE *target = lw_fopen( file_path, "rb" );
-        if( !target )
-            return -1;
-        fclose( target );
-        file_path_length = strlen( file_path );
-        lwhp->file_path = (char *)lw_malloc_zero( file_path_length + 1 );
-        if( !lwhp->file_path )
-            return -1;
-        memcpy( lwhp->file_path, file_path, file_path_length );
-    }
-    else
+    /* Only one video stream which can be split at a sequence header is supported. */
+    int video_stream_index = -1;
+    for( unsigned int i = 0; i < format_ctx->nb_streams; i++ )
     {
-        lwhp->file_path = (char *)lw_malloc_zero( file_path_length + 1 );
-        if( !lwhp->file_path )
+        AVCodecParameters *codecpar = format_ctx->streams[i]->codecpar;
+        if( codecpar->codec_type != AVMEDIA_TYPE_VIDEO || codecpar->codec_id == AV_CODEC_ID_NONE )
+            continue;
+        if( video_stream_index >= 0 )
             return -1;
-        memcpy( lwhp->file_path, opt->file_path, file_path_length );
+        video_stream_index = i;
     }
-    /* Parse the index file. */
-    int64_t file_size;
-    int64_t file_last_modification_time;
-    uint64_t file_hash = 0;
-    unsigned file_hash_32 = 0;
-    char format_name[256];
-    int active_video_index;
-    int active_audio_index;
-    int default_audio;
-#ifdef _WIN32
-    wchar_t *wname = NULL;
-    struct _stat64 file_stat;
-    if( lw_string_to_wchar( CP_UTF8, lwhp->file_path, &wname ) )
+    if( video_stream_index < 0 )
+        return -1;
+    enum AVCodecID video_codec_id = format_ctx->streams[video_stream_index]->codecpar->codec_id;
+    if( video_codec_id != AV_CODEC_ID_H264
+     && video_codec_id != AV_CODEC_ID_HEVC
+     && video_codec_id != AV_CODEC_ID_MPEG1VIDEO
+     && video_codec_id != AV_CODEC_ID_MPEG2VIDEO
+     && video_codec_id != AV_CODEC_ID_VC1 )
+        return -1;
+    return video_stream_index;
+}
+
+static int is_parallel_indexing_aborted( lwindex_parallel_t *parallel )
+{
+    lw_mutex_lock( parallel->mutex );
+    int abort = parallel->abort;
+    lw_mutex_unlock( parallel->mutex );
+    return abort;
+}
+
+static void set_parallel_range_state
+(
+    lwindex_parallel_t *parallel,
+    lwindex_range_t    *range,
+    int                 state
+)
+{
+    lw_mutex_lock( parallel->mutex );
+    range->state = state;
+    lw_cond_broadcast( parallel->cond );
+    lw_mutex_unlock( parallel->mutex );
+}
+
+/* Return the state of the range after its start is searched.
+ * Return a negative value if the parallel indexing is aborted. */
+static int wait_parallel_range_start
+(
+    lwindex_parallel_t *parallel,
+    lwindex_range_t    *range
+)
+{
+    lw_mutex_lock( parallel->mutex );
+    while( range->state == LWINDEX_RANGE_PENDING && !parallel->abort )
+        lw_cond_wait( parallel->cond, parallel->mutex );
+    int state = parallel->abort ? -1 : range->state;
+    lw_mutex_unlock( parallel->mutex );
+    return state;
+}
+
+/* Search the first split point within the range.
+ * Return 0 and set start_pos if found. Otherwise return a negative value. */
+static int find_parallel_range_start
+(
+    lwindex_range_t *range,
+    AVFormatContext *format_ctx
+)
+{
+    lwindex_parallel_t *parallel = range->parallel;
+    int64_t limit_pos = range->number + 1 < parallel->range_count
+                      ? parallel->ranges[ range->number + 1 ].split_pos
+                      : INT64_MAX;
+    if( av_seek_frame( format_ctx, -1, range->split_pos, AVSEEK_FLAG_BYTE ) < 0 )
+        return -1;
+    AVPacket pkt = { 0 };
+    int64_t  next_check_pos = range->split_pos + LWINDEX_PARALLEL_PROGRESS_STEP;
+    while( read_av_frame( format_ctx, &pkt ) >= 0 )
     {
-        if (_wstat64(wname, &file_stat))
+        int64_t pos = pkt.pos;
+        int     found = pkt.stream_index == parallel->video_stream_index
+                     && pos >= range->split_pos
+                     && (pkt.flags & AV_PKT_FLAG_KEY)
+                     && is_parallel_split_point( parallel->video_codec_id, &pkt );
+        av_packet_unref( &pkt );
+        if( found )
         {
-            lw_free(wname);
-            return -1;
+            range->start_pos = pos;
+            return 0;
+        }
+        if( pos >= limit_pos )
+            break;
+        if( pos >= next_check_pos )
+        {
+            if( is_parallel_indexing_aborted( parallel ) )
+                break;
+            next_check_pos = pos + LWINDEX_PARALLEL_PROGRESS_STEP;
         }
     }
-    else
+    return -1;
+}
+
+static int has_same_stream_layout
+(
+    AVFormatContext *a,
+    AVFormatContext *b
+)
+{
+    if( a->nb_streams != b->nb_streams )
+        return 0;
+    for( unsigned int i = 0; i < a->nb_streams; i++ )
+        if( a->streams[i]->codecpar->codec_type != b->streams[i]->codecpar->codec_type
+         || a->streams[i]->codecpar->codec_id   != b->streams[i]->codecpar->codec_id )
+            return 0;
+    return 1;
+}
+
+static void *index_parallel_range( void *arg )
+{
+    lwindex_range_t    *range        = (lwindex_range_t *)arg;
+    lwindex_parallel_t *parallel     = range->parallel;
+    lwindex_indexer_t  *indexer      = &range->indexer;
+    AVFormatContext    *format_ctx   = NULL;
+    AVFrame            *frame_buffer = NULL;
+    AVPacket            pkt          = { 0 };
+    int                 ret          = -1;
+    if( lavf_open_file( &format_ctx, parallel->file_path, NULL ) < 0
+     || !has_same_stream_layout( format_ctx, parallel->format_ctx ) )
+        goto end;
+    if( range->number > 0 )
     {
-        if( _stat64( lwhp->file_path, &file_stat ) )
-            return -1;
+        if( find_parallel_range_start( range, format_ctx ) < 0 )
+        {
+            /* Leave this range to the preceding range. */
+            set_parallel_range_state( parallel, range, LWINDEX_RANGE_NONE );
+            ret = 0;
+            goto end;
+        }
+        set_parallel_range_state( parallel, range, LWINDEX_RANGE_FOUND );
+        if( av_seek_frame( format_ctx, -1, range->start_pos, AVSEEK_FLAG_BYTE ) < 0 )
+            goto end;
     }
-#else
-    struct stat file_stat;
-    if( stat( lwhp->file_path, &file_stat ) )
-        return -1;
-#endif
-    if( fscanf( index, "<FileSize=%" SCNd64 ">\n", &file_size ) != 1
-     || fscanf( index, "<FileLastModificationTime=%" SCNd64 ">\n", &file_last_modification_time ) != 1 )
+    frame_buffer = av_frame_alloc();
+    if( !frame_buffer )
+        goto end;
+    int      pix_fmt_investigated = 0;
+    int      video_started        = (range->number == 0);
+    int      pending_splices      = 0;  /* the number of streams without the first packet beyond the range */
+    int      next_range           = range->number + 1;
+    int64_t  end_pos              = INT64_MAX;
+    int64_t  next_progress_pos    = range->start_pos + LWINDEX_PARALLEL_PROGRESS_STEP;
+    range->read_end = INT64_MAX;
+    while( read_av_frame( format_ctx, &pkt ) >= 0 )
+    {
+        AVStream          *stream   = format_ctx->streams[ pkt.stream_index ];
+        AVCodecParameters *codecpar = stream->codecpar;
+        if( (codecpar->codec_type != AVMEDIA_TYPE_VIDEO && codecpar->codec_type != AVMEDIA_TYPE_AUDIO)
+         || (codecpar->codec_type == AVMEDIA_TYPE_AUDIO && parallel->audio_disabled)
+         || codecpar->codec_id == AV_CODEC_ID_NONE )
+        {
+            stream->discard = AVDISCARD_ALL;
+            av_packet_unref( &pkt );
+            continue;
+        }
+        /* Decide the end of this range when reaching the nominal start of the following range. */
+        while( end_pos == INT64_MAX && next_range < parallel->range_count && pkt.pos >= parallel->ranges[next_range].split_pos )
+        {
+            int state = wait_parallel_range_start( parallel, &parallel->ranges[next_range] );
+            if( state < 0 )
+                goto end;
+            if( state == LWINDEX_RANGE_FOUND )
+                end_pos = parallel->ranges[next_range].start_pos;
+            else
+                ++next_range;
+        }
+        if( pkt.pos >= end_pos )
+        {
+            /* This packet belongs to the following range.
+             * Record the first packet of each stream to splice the ranges. */
+            int64_t           pos    = pkt.pos;
+            lwindex_splice_t *splice = &range->splice[ pkt.stream_index ];
+            if( !splice->present )
+            {
+                splice->present = 1;
+                splice->pos     = pkt.pos;
+                splice->pts     = pkt.pts;
+                splice->dts     = pkt.dts;
+                if( pkt.stream_index < indexer->number_of_helpers
+                 && indexer->helpers[ pkt.stream_index ]
+                 && indexer->helpers[ pkt.stream_index ]->codec_ctx )
+                    --pending_splices;
+            }
+            av_packet_unref( &pkt );
+            if( pending_splices == 0 || pos >= end_pos + LWINDEX_PARALLEL_SPLICE_MARGIN )
+            {
+                range->read_end = pos;
+                break;
+            }
+            continue;
+        }
+        int is_new_stream = pkt.stream_index >= indexer->number_of_helpers || !indexer->helpers[ pkt.stream_index ];
+        lwindex_helper_t *helper = get_index_helper( indexer, stream );
+        if( !helper )
+            goto end;
+        AVCodecContext *pkt_ctx = helper->codec_ctx;
+        if( !pkt_ctx )
+        {
+            stream->discard = AVDISCARD_ALL;
+            av_packet_unref( &pkt );
+            continue;
+        }
+        if( is_new_stream )
+        {
+            /* Same as the stream info for the sequential indexing. */
+            if( pkt_ctx->codec_type == AVMEDIA_TYPE_AUDIO && pkt_ctx->ch_layout.order == AV_CHANNEL_ORDER_UNSPEC )
+                av_channel_layout_default( &pkt_ctx->ch_layout, pkt_ctx->ch_layout.nb_channels );
+            ++pending_splices;
+        }
+        int first_video_packet = !video_started && pkt.stream_index == parallel->video_stream_index;
+        /* The range shall start from the split point found in searching. */
+        if( first_video_packet && (pkt.pos != range->start_pos || !(pkt.flags & AV_PKT_FLAG_KEY)) )
+            goto end;
+        if( range->packet_count == range->packet_alloc )
+        {
+            uint32_t packet_alloc = range->packet_alloc ? 2 * range->packet_alloc : 1 << 16;
+            lwindex_packet_t *temp = (lwindex_packet_t *)realloc( range->packets, packet_alloc * sizeof(lwindex_packet_t) );
+            if( !temp )
+                goto end;
+            range->packets      = temp;
+            range->packet_alloc = packet_alloc;
+        }
+        int split_point = pkt.stream_index == parallel->video_stream_index
+                       && (pkt.flags & AV_PKT_FLAG_KEY)
+                       && pkt.pos >= 0
+                       && is_parallel_split_point( parallel->video_codec_id, &pkt );
+        lwindex_packet_t *ipkt = &range->packets[ range->packet_count ];
+        if( analyze_index_packet( helper, &pkt, frame_buffer, &pix_fmt_investigated, ipkt ) < 0 )
+            goto end;
+        ipkt->split_point = split_point;
+        ++ range->packet_count;
+        if( first_video_packet )
+        {
+            /* The state of the parser must be reset here. Otherwise, the sequential indexing is needed. */
+            if( !(ipkt->flags & AV_PKT_FLAG_KEY)
+             || ((parallel->video_codec_id == AV_CODEC_ID_H264 || parallel->video_codec_id == AV_CODEC_ID_HEVC) && ipkt->poc != 0) )
+                goto end;
+            video_started = 1;
+        }
+        if( pkt.pos >= next_progress_pos )
+        {
+            lw_mutex_lock( parallel->mutex );
+            range->progress = pkt.pos - range->split_pos;
+            int abort = parallel->abort;
+            lw_cond_broadcast( parallel->cond );
+            lw_mutex_unlock( parallel->mutex );
+            if( abort )
+                goto end;
+            next_progress_pos = pkt.pos + LWINDEX_PARALLEL_PROGRESS_STEP;
+        }
+        av_packet_unref( &pkt );
+    }
+    ret = 0;
+end:
+    av_packet_unref( &pkt );
+    av_frame_free( &frame_buffer );
+    if( format_ctx )
+        lavf_close_file( &format_ctx );
+    lw_mutex_lock( parallel->mutex );
+    if( range->state == LWINDEX_RANGE_PENDING )
+        range->state = LWINDEX_RANGE_NONE;
+    if( ret < 0 )
+        parallel->abort = 1;
+    ++ parallel->finished;
+    lw_cond_broadcast( parallel->cond );
+    lw_mutex_unlock( parallel->mutex );
+    return NULL;
+}
+
+/* Wait for all workers finishing with updating the progress.
+ * Return 1 if all ranges are indexed, 0 if any worker failed, or a negative value if aborted by the user. */
+static int wait_parallel_ranges
+(
+    lwindex_parallel_t   *parallel,
+    progress_indicator_t *indicator,
+    progress_handler_t   *php,
+    const char           *message
+)
+{
+    int user_abort = 0;
+    lw_mutex_lock( parallel->mutex );
+    while( parallel->finished < parallel->range_count )
+    {
+        lw_cond_wait( parallel->cond, parallel->mutex );
+        if( !indicator->update || parallel->abort )
+            continue;
+        int64_t progress = 0;
+        for( int i = 0; i < parallel->range_count; i++ )
+            progress += parallel->ranges[i].progress;
+        lw_mutex_unlock( parallel->mutex );
+        int percent = (int)(100.0 * ((double)progress / parallel->file_size) + 0.5);
+        int abort   = indicator->update( php, message, MIN( percent, 100 ) );
+        lw_mutex_lock( parallel->mutex );
+        if( abort )
+        {
+            user_abort      = 1;
+            parallel->abort = 1;
+            lw_cond_broadcast( parallel->cond );
+        }
+    }
+    int ret = user_abort ? -1 : !parallel->abort;
+    lw_mutex_unlock( parallel->mutex );
+    return ret;
+}
+
+/* Check if the range continues from the preceding range.
+ * Packets which the preceding range would not demux are marked to be skipped.
+ * Return 0 on success. Otherwise return a negative value. */
+static int splice_parallel_range
+(
+    lwindex_parallel_t *parallel,
+    lwindex_range_t    *prev,
+    lwindex_range_t    *range
+)
+{
+    uint8_t *spliced = (uint8_t *)lw_malloc_zero( parallel->format_ctx->nb_streams );
+    if( !spliced )
         return -1;
-    if( file_size != file_stat.st_size )
+    int ret   = -1;
+    int skips = 0;
+    for( uint32_t i = 0; i < range->packet_count; i++ )
+    {
+        lwindex_packet_t *ipkt = &range->packets[i];
+        if( spliced[ ipkt->stream_index ] )
+            continue;
+        const lwindex_splice_t *splice = &prev->splice[ ipkt->stream_index ];
+        if( !splice->present )
+        {
+            /* The preceding range stopped reading before this stream appears. */
+            if( ipkt->stream_index == parallel->video_stream_index || ipkt->pos <= prev->read_end )
+                goto end;
+            spliced[ ipkt->stream_index ] = 1;
+        }
+        else if( ipkt->pos == splice->pos && ipkt->pts == splice->pts && ipkt->dts == splice->dts )
+            spliced[ ipkt->stream_index ] = 1;
+        else if( ipkt->stream_index != parallel->video_stream_index
+              && ipkt->pos <= splice->pos
+              && ++skips <= LWINDEX_PARALLEL_MAX_SKIPS )
+            ipkt->skip = 1;
+        else
+            goto end;
+    }
+    ret = 0;
+end:
+    lw_free( spliced );
+    return ret;
+}
+
+/* Move an extradata of a range into the extradata list of the whole file.
+ * Return the index in the list on success. Otherwise return a negative value. */
+static int merge_parallel_extradata
+(
+    lwlibav_extradata_handler_t *dst,
+    lwlibav_extradata_handler_t *src,
+    int                          src_index,
+    int                         *index_map
+)
+{
+    if( src_index < 0 || src_index >= src->entry_count )
         return -1;
-    int32_t pos = ftell( index );
-    if( fscanf( index, "<FileHash=0x%" SCNx64 ">\n", &file_hash ) != 1 )
-        fseek( index, pos, SEEK_SET);
-    pos = ftell( index );
-    if( fscanf( index, "<FileHash=0x%x>\n", &file_hash_32 ) != 1 )
-        fseek( index, pos, SEEK_SET);
-    if( file_last_modification_time != file_stat.st_mtime )
+    if( index_map[src_index] >= 0 )
+        return index_map[src_index];
+    lwlibav_extradata_t *entry = &src->entries[src_index];
+    int dst_index;
+    for( dst_index = 0; dst_index < dst->entry_count; dst_index++ )
     {
-        // Also check hashsum
-        if( ( !file_hash
-             || file_hash != xxhash_file( lwhp->file_path, file_stat.st_size ) )
-         &&
-            ( !file_hash_32
-             || file_hash_32 != xxhash32_file( lwhp->file_path, file_stat.st_size ) ) )
+        lwlibav_extradata_t *dst_entry = &dst->entries[dst_index];
+        if( entry->extradata_size == dst_entry->extradata_size
+         && (entry->extradata_size == 0 || !memcmp( entry->extradata, dst_entry->extradata, entry->extradata_size )) )
+            break;
+    }
+    if( dst_index == dst->entry_count )
+    {
+        lwlibav_extradata_t *dst_entry = alloc_extradata_entries( dst, dst->entry_count + 1 );
+        if( !dst_entry )
             return -1;
+        /* Take over the extradata. */
+        *dst_entry = *entry;
+        entry->extradata      = NULL;
+        entry->extradata_size = 0;
     }
-    if( fscanf( index, "<LibavReaderIndex=0x%x,%d,%[^>]>\n",
-                (unsigned int *)&lwhp->format_flags, &lwhp->raw_demuxer, format_name ) != 3 )
-        return -1;
-    int32_t active_index_pos = ftell( index );
-    if( fscanf( index, "<ActiveVideoStreamIndex>%d</ActiveVideoStreamIndex>\n", &active_video_index ) != 1
-     || fscanf( index, "<ActiveAudioStreamIndex>%d</ActiveAudioStreamIndex>\n", &active_audio_index ) != 1
-     || fscanf( index, "<DefaultAudioStreamIndex>%d</DefaultAudioStreamIndex>\n", &default_audio ) != 1 )
+    else
+    {
+        lwlibav_extradata_t *dst_entry = &dst->entries[dst_index];
+        if( dst_entry->width < entry->width )
+            dst_entry->width = entry->width;
+        if( dst_entry->height < entry->height )
+            dst_entry->height = entry->height;
+        if( dst_entry->pixel_format == AV_PIX_FMT_NONE )
+            dst_entry->pixel_format = entry->pixel_format;
+        if( dst_entry->channel_layout == 0 )
+            dst_entry->channel_layout = entry->channel_layout;
+        if( dst_entry->sample_rate == 0 )
+            dst_entry->sample_rate = entry->sample_rate;
+        if( dst_entry->sample_format == AV_SAMPLE_FMT_NONE )
+            dst_entry->sample_format = entry->sample_format;
+        if( dst_entry->bits_per_sample == 0 )
+            dst_entry->bits_per_sample = entry->bits_per_sample;
+        if( dst_entry->block_align == 0 )
+            dst_entry->block_align = entry->block_align;
+        if( dst_entry->codec_id == AV_CODEC_ID_NONE )
+            dst_entry->codec_id = entry->codec_id;
+        if( dst_entry->codec_tag == 0 )
+            dst_entry->codec_tag = entry->codec_tag;
+    }
+    index_map[src_index] = dst_index;
+    return dst_index;
+}
+
+/* Register the analysed packets of a range in the reading order.
+ * Return 0 on success. Otherwise return a negative value. */
+static int register_parallel_range
+(
+    lwindex_parallel_t             *parallel,
+    lwindex_range_t                *range,
+    lw_field_info_t                *last_field_info,
+    lwindex_indexer_t              *indexer,
+    lwindex_builder_t              *builder,
+    lwindex_writer_t               *writer,
+    lwlibav_video_decode_handler_t *vdhp,
+    lwlibav_audio_decode_handler_t *adhp,
+    lwlibav_audio_output_handler_t *aohp,
+    lwlibav_option_t               *opt
+)
+{
+    int   number_of_helpers = range->indexer.number_of_helpers;
+    int **index_maps        = (int **)lw_malloc_zero( number_of_helpers * sizeof(int *) );
+    if( !index_maps )
         return -1;
-    lwhp->format_name = format_name;
-    adhp->dv_in_avi = !strcmp( lwhp->format_name, "avi" ) ? -1 : 0;
-    int video_present = (active_video_index >= 0);
-    int audio_present = (active_audio_index >= 0);
-    vdhp->stream_index = opt->force_video ? opt->force_video_index : active_video_index;
-    switch (opt->force_audio_index)
+    int ret = -1;
+    for( int i = 0; i < number_of_helpers; i++ )
     {
-        case -1:
+        lwindex_helper_t *src_helper = range->indexer.helpers[i];
+        if( !src_helper || src_helper->exh.entry_count == 0 )
+            continue;
+        index_maps[i] = (int *)lw_malloc_zero( src_helper->exh.entry_count * sizeof(int) );
+        if( !index_maps[i] )
+            goto end;
+        for( int j = 0; j < src_helper->exh.entry_count; j++ )
+            index_maps[i][j] = -1;
+    }
+    for( uint32_t i = 0; i < range->packet_count; i++ )
+    {
+        lwindex_packet_t *ipkt = &range->packets[i];
+        if( ipkt->skip )
+            continue;
+        AVStream         *stream     = parallel->format_ctx->streams[ ipkt->stream_index ];
+        lwindex_helper_t *src_helper = range->indexer.helpers[ ipkt->stream_index ];
+        lwindex_helper_t *helper     = get_index_helper( indexer, stream );
+        if( !helper || !helper->codec_ctx || !index_maps[ ipkt->stream_index ] )
+            goto end;
+        ipkt->extradata_index = merge_parallel_extradata( &helper->exh, &src_helper->exh, ipkt->extradata_index, index_maps[ ipkt->stream_index ] );
+        if( ipkt->extradata_index < 0 )
+            goto end;
+        AVChannelLayout ch_layout = { 0 };
+        if( stream->codecpar->codec_type == AVMEDIA_TYPE_VIDEO )
         {
-            if (default_audio != active_audio_index)
+            if( ipkt->field_inherited )
             {
-#ifdef _WIN32
-                lw_free(wname);
-#endif // _WIN32
-                return -1;
+                /* Inherit the field information across the ranges. */
+                ipkt->field_info = last_field_info[ ipkt->stream_index ];
+                if( ipkt->field_info != LW_FIELD_INFO_UNKNOWN )
+                    ipkt->corrupt = 0;
             }
+            last_field_info[ ipkt->stream_index ] = (lw_field_info_t)ipkt->field_info;
+            /* Reproduce the state of the decoder after the analysis. */
+            helper->codec_ctx->width   = ipkt->width;
+            helper->codec_ctx->height  = ipkt->height;
+            helper->codec_ctx->pix_fmt = (enum AVPixelFormat)ipkt->pix_fmt;
         }
-        case -2: adhp->stream_index = active_audio_index; break;
-        default: adhp->stream_index = opt->force_audio_index; break;
-    }
-    uint32_t video_info_count = 1 << 16;
-    uint32_t audio_info_count = 1 << 16;
-    video_frame_info_t *video_info = NULL;
-    audio_frame_info_t *audio_info = NULL;
-    lwindex_stream_info_t *stream_info = NULL;
-    if( vdhp->stream_index >= 0 )
-    {
-        video_info = (video_frame_info_t *)malloc( video_info_count * sizeof(video_frame_info_t) );
-        if( !video_info )
-            goto fail_parsing;
+        else
+        {
+            ch_layout.order       = (enum AVChannelOrder)ipkt->ch_order;
+            ch_layout.nb_channels = ipkt->channels;
+            ch_layout.u.mask      = ipkt->ch_mask;
+        }
+        if( register_index_packet( builder, writer, helper, stream, ipkt, &ch_layout, vdhp, adhp, aohp, opt ) < 0 )
+            goto end;
+        /* Same as the checkpoint recorded by the sequential indexing. */
+        int reset_point = (ipkt->flags & AV_PKT_FLAG_KEY)
+                       && ((parallel->video_codec_id != AV_CODEC_ID_H264 && parallel->video_codec_id != AV_CODEC_ID_HEVC) || ipkt->poc == 0);
+        if( ipkt->split_point && reset_point
+         && ipkt->pos <= parallel->file_size - LWINDEX_CHECKPOINT_MARGIN
+         && ipkt->stream_index == vdhp->stream_index )
+            write_index_checkpoint( writer, ipkt->pos );
     }
-    if( adhp->stream_index >= 0 )
+    ret = 0;
+end:
+    for( int i = 0; i < number_of_helpers; i++ )
+        lw_free( index_maps[i] );
+    lw_free( index_maps );
+    return ret;
+}
+
+static void cleanup_parallel_ranges( lwindex_parallel_t *parallel )
+{
+    if( parallel->ranges )
+        for( int i = 0; i < parallel->range_count; i++ )
+        {
+            lwindex_range_t *range = &parallel->ranges[i];
+            cleanup_index_helpers( &range->indexer );
+            free( range->packets );
+            lw_free( range->splice );
+        }
+    lw_freep( &parallel->ranges );
+    if( parallel->cond )
+        lw_cond_destroy( parallel->cond );
+    if( parallel->mutex )
+        lw_mutex_destroy( parallel->mutex );
+}
+
+/* Create the index by parallel reading if possible.
+ * Return 1 if the index is created, 0 if the sequential indexing is needed, or a negative value if aborted. */
+static int create_index_parallel
+(
+    lwlibav_file_handler_t         *lwhp,
+    lwlibav_video_decode_handler_t *vdhp,
+    lwlibav_audio_decode_handler_t *adhp,
+    lwlibav_audio_output_handler_t *aohp,
+    AVFormatContext                *format_ctx,
+    lwlibav_option_t               *opt,
+    lwindex_indexer_t              *indexer,
+    lwindex_builder_t              *builder,
+    lwindex_writer_t               *writer,
+    progress_indicator_t           *indicator,
+    progress_handler_t             *php,
+    const char                     *message
+)
+{
+    int video_stream_index = find_split_video_stream( lwhp, format_ctx );
+    if( video_stream_index < 0 )
+        return 0;
+    enum AVCodecID video_codec_id = format_ctx->streams[video_stream_index]->codecpar->codec_id;
+    int64_t file_size   = avio_size( format_ctx->pb );
+    int     range_count = lwhp->threads > 0 ? lwhp->threads : av_cpu_count();
+    range_count = MIN( range_count, LWINDEX_PARALLEL_MAX_RANGES );
+    if( file_size <= 0 || file_size / LWINDEX_PARALLEL_MIN_RANGE_SIZE < range_count )
+        range_count = file_size > 0 ? (int)(file_size / LWINDEX_PARALLEL_MIN_RANGE_SIZE) : 0;
+    if( range_count < 2 )
+        return 0;
+    lwindex_parallel_t parallel = { 0 };
+    parallel.file_path          = lwhp->file_path;
+    parallel.format_ctx         = format_ctx;
+    parallel.video_stream_index = video_stream_index;
+    parallel.video_codec_id     = video_codec_id;
+    parallel.audio_disabled     = (adhp->stream_index == -2);
+    parallel.file_size          = file_size;
+    parallel.range_count        = range_count;
+    parallel.mutex              = lw_mutex_create();
+    parallel.cond               = lw_cond_create();
+    parallel.ranges             = (lwindex_range_t *)lw_malloc_zero( range_count * sizeof(lwindex_range_t) );
+    lw_field_info_t *last_field_info = NULL;
+    int ret = 0;
+    if( !parallel.mutex || !parallel.cond || !parallel.ranges )
+        goto end;
+    for( int i = 0; i < range_count; i++ )
     {
-        audio_info = (audio_frame_info_t *)malloc( audio_info_count * sizeof(audio_frame_info_t) );
-        if( !audio_info )
-            goto fail_parsing;
+        lwindex_range_t *range = &parallel.ranges[i];
+        range->parallel                  = &parallel;
+        range->number                    = i;
+        range->split_pos                 = file_size / range_count * i;
+        range->indexer                   = *indexer;
+        range->indexer.number_of_helpers = 0;
+        range->indexer.helpers           = NULL;
+        range->indexer.thread_count      = 1;
+        range->splice                    = (lwindex_splice_t *)lw_malloc_zero( format_ctx->nb_streams * sizeof(lwindex_splice_t) );
+        if( !range->splice )
+            goto end;
     }
-    if( active_audio_index == -2 && opt->force_audio_index != -2 )
-        goto fail_parsing;
-    vdhp->codec_id             = AV_CODEC_ID_NONE;
-    adhp->codec_id             = AV_CODEC_ID_NONE;
-    vdhp->initial_pix_fmt      = AV_PIX_FMT_NONE;
-    vdhp->initial_colorspace   = AVCOL_SPC_NB;
-    aohp->output_sample_format = AV_SAMPLE_FMT_NONE;
-    uint32_t video_sample_count    = 0;
-    uint32_t invisible_count       = 0;
-    int64_t  last_keyframe_pts     = AV_NOPTS_VALUE;
-    uint32_t audio_sample_count    = 0;
-    int      audio_sample_rate     = 0;
-    int      constant_frame_length = 1;
-    uint64_t audio_duration        = 0;
-    char buf[1024];
-    if( !fgets( buf, sizeof(buf), index ) )
-        goto fail_parsing;
-    while( !strncmp( buf, "<StreamInfo=", strlen( "<StreamInfo=" ) ) )
+    parallel.ranges[0].state     = LWINDEX_RANGE_FOUND;
+    parallel.ranges[0].start_pos = 0;
+    for( int i = 0; i < range_count; i++ )
     {
-        int stream_index;
-        int codec_type;
-        if( sscanf( buf, "<StreamInfo=%d,%d>", &stream_index, &codec_type ) != 2 )
-            goto fail_parsing;
-        if( !fgets( buf, sizeof(buf), index ) )
-            goto fail_parsing;
-        lwindex_stream_info_t *temp = (lwindex_stream_info_t *)realloc( stream_info, (stream_index + 1) * sizeof(lwindex_stream_info_t) );
-        if( !temp )
-            goto fail_parsing;
-        stream_info = temp;
-        lwindex_stream_info_t *info = &stream_info[stream_index];
-        info->codec_type = codec_type;
-        if( codec_type == AVMEDIA_TYPE_VIDEO )
+        parallel.ranges[i].thread = lw_thread_create( index_parallel_range, &parallel.ranges[i] );
+        if( !parallel.ranges[i].thread )
         {
-            if( sscanf( buf, "Codec=%d,TimeBase=%d/%d,Width=%d,Height=%d,Format=%[^,],ColorSpace=%d",
-                        &info->codec_id, &info->time_base.num, &info->time_base.den, &info->width, &info->height, info->fmt, &info->colorspace ) != 7 )
-                goto fail_parsing;
+            /* Stop the workers already started. */
+            lw_mutex_lock( parallel.mutex );
+            parallel.abort     = 1;
+            parallel.finished += range_count - i;
+            lw_cond_broadcast( parallel.cond );
+            lw_mutex_unlock( parallel.mutex );
+            break;
         }
-        else if( codec_type == AVMEDIA_TYPE_AUDIO )
+    }
+    ret = wait_parallel_ranges( &parallel, indicator, php, message );
+    for( int i = 0; i < range_count; i++ )
+        if( parallel.ranges[i].thread )
+            lw_thread_join( parallel.ranges[i].thread );
+    if( ret <= 0 )
+        goto end;
+    /* Splice the ranges. Nothing has been registered yet, so the sequential indexing is still available here. */
+    ret = 0;
+    lwindex_range_t *prev = NULL;
+    for( int i = 0; i < range_count; i++ )
+    {
+        lwindex_range_t *range = &parallel.ranges[i];
+        if( range->state != LWINDEX_RANGE_FOUND )
+            continue;
+        for( int j = 0; j < range->indexer.number_of_helpers; j++ )
+            if( range->indexer.helpers[j] && range->indexer.helpers[j]->delay_count > 0 )
+                /* The frame length of delayed audio frames depends on the preceding packets. */
+                goto end;
+        if( prev && splice_parallel_range( &parallel, prev, range ) < 0 )
+            goto end;
+        prev = range;
+    }
+    last_field_info = (lw_field_info_t *)lw_malloc_zero( format_ctx->nb_streams * sizeof(lw_field_info_t) );
+    if( !last_field_info )
+        goto end;
+    for( unsigned int i = 0; i < format_ctx->nb_streams; i++ )
+        last_field_info[i] = LW_FIELD_INFO_UNKNOWN;
+    for( int i = 0; i < range_count; i++ )
+        if( parallel.ranges[i].state == LWINDEX_RANGE_FOUND
+         && register_parallel_range( &parallel, &parallel.ranges[i], last_field_info, indexer, builder, writer, vdhp, adhp, aohp, opt ) < 0 )
         {
-            if( sscanf( buf, "Codec=%d,TimeBase=%d/%d,Channels=%d:0x%" SCNx64 ",Rate=%d,Format=%[^,],BPS=%d",
-                        &info->codec_id, &info->time_base.num, &info->time_base.den, &info->channels, &info->layout, &info->sample_rate, info->fmt, &info->bits_per_sample ) != 8 )
-                goto fail_parsing;
+            ret = -1;
+            goto end;
         }
-        if( !fgets( buf, sizeof(buf), index ) )
-            goto fail_parsing;
-        if( strncmp( buf, "</StreamInfo>", strlen( "</StreamInfo>" ) ) )
-            goto fail_parsing;
+    ret = 1;
+end:
+    lw_free( last_field_info );
+    cleanup_parallel_ranges( &parallel );
+    return ret;
+}
+
+/* Container index fast path
+ *
+ * The ISO Base Media demuxer knows the file offset, the timestamp and the keyframe flag of every sample from the
+ * sample tables. For intra-only video, the per-frame fields taken from the bitstream, i.e. picture type, POC,
+ * repeat_pict and field information, do not vary over frames, so only the first frame is read and analysed and
+ * the other frames are registered from the index entries without reading their data.
+ * Matroska Cues list keyframes only, so this path is not applicable to Matroska. */
+typedef struct
+{
+    AVStream         *stream;       /* NULL if the fast path is not used */
+    lwindex_helper_t *helper;
+    lwindex_packet_t  first;        /* the analysed first packet */
+    int               entry_index;  /* the next index entry to register; 0 until the first packet is analysed */
+    int               entry_count;
+} lwindex_container_index_t;
+
+static AVStream *find_container_indexed_stream
+(
+    lwlibav_file_handler_t *lwhp,
+    AVFormatContext        *format_ctx
+)
+{
+    if( strcmp( lwhp->format_name, "mov,mp4,m4a,3gp,3g2,mj2" ) )
+        return NULL;
+    AVStream *video_stream = NULL;
+    for( unsigned int i = 0; i < format_ctx->nb_streams; i++ )
+    {
+        AVStream *stream = format_ctx->streams[i];
+        if( stream->codecpar->codec_type != AVMEDIA_TYPE_VIDEO || stream->codecpar->codec_id == AV_CODEC_ID_NONE )
+            continue;
+        if( video_stream )
+            /* Leave the selection of the active video stream to the regular path. */
+            return NULL;
+        video_stream = stream;
+    }
+    if( !video_stream || (video_stream->disposition & AV_DISPOSITION_ATTACHED_PIC) )
+        return NULL;
+    enum AVCodecID codec_id = video_stream->codecpar->codec_id;
+    const AVCodecDescriptor *desc = avcodec_descriptor_get( codec_id );
+    if( !desc || !(desc->props & AV_CODEC_PROP_INTRA_ONLY)
+     || codec_id == AV_CODEC_ID_MPEG1VIDEO || codec_id == AV_CODEC_ID_MPEG2VIDEO
+     || codec_id == AV_CODEC_ID_VC1IMAGE   || codec_id == AV_CODEC_ID_WMV3IMAGE )
+        return NULL;
+    /* Fragmented files extend the index entries while reading, so require complete sample tables. */
+    int entry_count = avformat_index_get_entries_count( video_stream );
+    if( entry_count <= 0 || entry_count != video_stream->nb_frames )
+        return NULL;
+    for( int i = 0; i < entry_count; i++ )
+    {
+        const AVIndexEntry *ie = avformat_index_get_entry( video_stream, i );
+        if( !(ie->flags & AVINDEX_KEYFRAME) || (ie->flags & AVINDEX_DISCARD_FRAME)
+         || (i > 0 && ie->timestamp <= avformat_index_get_entry( video_stream, i - 1 )->timestamp) )
+            return NULL;
+    }
+    return video_stream;
+}
+
+/* Check if the analysed first packet agrees with the first index entry.
+ * If so, stop reading the video stream and return 1. Otherwise return 0. */
+static int start_container_index
+(
+    lwindex_container_index_t *cidx,
+    lwindex_helper_t          *helper,
+    const lwindex_packet_t    *ipkt
+)
+{
+    const AVIndexEntry *ie = avformat_index_get_entry( cidx->stream, 0 );
+    if( !ie
+     || ipkt->pos != ie->pos
+     || ipkt->pts != ie->timestamp
+     || ipkt->dts != ie->timestamp
+     || !(ipkt->flags & AV_PKT_FLAG_KEY)
+     || ipkt->invisible
+     || ipkt->corrupt )
+        return 0;
+    cidx->helper      = helper;
+    cidx->first       = *ipkt;
+    cidx->entry_index = 1;
+    cidx->entry_count = avformat_index_get_entries_count( cidx->stream );
+    /* The state of the decoder does not change over frames. */
+    cidx->first.prior_width  = ipkt->width;
+    cidx->first.prior_height = ipkt->height;
+    cidx->stream->discard = AVDISCARD_ALL;
+    return 1;
+}
+
+/* Register the video frames before pos_limit from the index entries.
+ * Return 0 on success. Otherwise return a negative value. */
+static int register_container_index_entries
+(
+    lwindex_container_index_t      *cidx,
+    int64_t                         pos_limit,
+    lwindex_builder_t              *builder,
+    lwindex_writer_t               *writer,
+    lwlibav_video_decode_handler_t *vdhp,
+    lwlibav_audio_decode_handler_t *adhp,
+    lwlibav_audio_output_handler_t *aohp,
+    lwlibav_option_t               *opt
+)
+{
+    for( ; cidx->entry_index < cidx->entry_count; cidx->entry_index++ )
+    {
+        const AVIndexEntry *ie = avformat_index_get_entry( cidx->stream, cidx->entry_index );
+        if( !ie )
+            return -1;
+        if( ie->pos >= pos_limit )
+            break;
+        lwindex_packet_t ipkt = cidx->first;
+        ipkt.pos  = ie->pos;
+        ipkt.size = ie->size;
+        ipkt.pts  = ie->timestamp;
+        ipkt.dts  = ie->timestamp;
+        if( register_index_packet( builder, writer, cidx->helper, cidx->stream, &ipkt, NULL, vdhp, adhp, aohp, opt ) < 0 )
+            return -1;
+    }
+    return 0;
+}
+
+static const lwindex_binary_stream_info_t *find_checkpoint_stream_info
+(
+    lwindex_checkpoint_t *checkpoint,
+    int                   stream_index
+)
+{
+    for( uint32_t i = 0; i < checkpoint->stream_count; i++ )
+        if( checkpoint->streams[i].stream_index == stream_index )
+            return &checkpoint->streams[i];
+    return NULL;
+}
+
+/* Register the packets before the checkpoint from the index file, and then seek to the checkpoint.
+ * Return 1 on success, 0 if the file does not continue from the checkpoint, or a negative value on error. */
+static int resume_index_from_checkpoint
+(
+    lwindex_checkpoint_t           *checkpoint,
+    lwlibav_file_handler_t         *lwhp,
+    AVFormatContext                *format_ctx,
+    lwindex_indexer_t              *indexer,
+    lwindex_builder_t              *builder,
+    lwindex_writer_t               *writer,
+    lwlibav_video_decode_handler_t *vdhp,
+    lwlibav_audio_decode_handler_t *adhp,
+    lwlibav_audio_output_handler_t *aohp,
+    lwlibav_option_t               *opt
+)
+{
+    if( find_split_video_stream( lwhp, format_ctx ) != checkpoint->video_stream_index )
+        return 0;
+    for( uint32_t i = 0; i < checkpoint->stream_count; i++ )
+    {
+        const lwindex_binary_stream_info_t *info = &checkpoint->streams[i];
+        if( info->stream_index >= (int)format_ctx->nb_streams
+         || info->codec_type   != format_ctx->streams[ info->stream_index ]->codecpar->codec_type
+         || info->codec_id     != format_ctx->streams[ info->stream_index ]->codecpar->codec_id )
+            return 0;
+    }
+    /* The extradata entries are appended in the order of their first appearance, so the entries referenced by the
+     * packets before the checkpoint are the leading ones of each stream. The rest are dropped and found again from
+     * the checkpoint as indexing the whole file does. */
+    int *entry_counts = (int *)lw_malloc_zero( format_ctx->nb_streams * sizeof(int) );
+    if( !entry_counts )
+        return -1;
+    for( uint32_t i = 0; i < checkpoint->record_count; i++ )
+    {
+        const lwindex_packet_record_t *record = &checkpoint->records[i];
+        if( record->stream_index >= 0 && record->stream_index < (int)format_ctx->nb_streams )
+            entry_counts[ record->stream_index ] = MAX( entry_counts[ record->stream_index ], record->extradata_index + 1 );
+    }
+    /* Restore the extradata lists. */
+    int      ret    = 0;
+    uint64_t offset = 0;
+    for( uint32_t i = 0; i < checkpoint->extradata_count; i++ )
+    {
+        const lwindex_binary_extradata_t *record = (const lwindex_binary_extradata_t *)(checkpoint->extradata + offset);
+        offset += sizeof(lwindex_binary_extradata_t);
+        const uint8_t *extradata = checkpoint->extradata + offset;
+        offset += LWINDEX_BINARY_ALIGN( record->extradata_size );
+        if( !find_checkpoint_stream_info( checkpoint, record->stream_index ) )
+            goto done;
+        lwindex_helper_t *helper = get_index_helper( indexer, format_ctx->streams[ record->stream_index ] );
+        if( !helper || !helper->codec_ctx )
+            goto done;
+        if( helper->exh.entry_count >= entry_counts[ record->stream_index ] )
+            continue;
+        lwlibav_extradata_t *entry = alloc_extradata_entries( &helper->exh, helper->exh.entry_count + 1 );
+        if( !entry || import_binary_extradata( entry, record, extradata ) < 0 )
+        {
+            ret = -1;
+            goto done;
+        }
+    }
+    ret = 1;
+done:
+    lw_free( entry_counts );
+    if( ret <= 0 )
+        return ret;
+    /* Register the packets in the same way as parsing the index file. */
+    for( uint32_t i = 0; i < checkpoint->record_count; i++ )
+    {
+        const lwindex_packet_record_t      *record = &checkpoint->records[i];
+        const lwindex_binary_stream_info_t *info   = find_checkpoint_stream_info( checkpoint, record->stream_index );
+        if( !info )
+            return 0;
+        AVStream         *stream = format_ctx->streams[ record->stream_index ];
+        lwindex_helper_t *helper = get_index_helper( indexer, stream );
+        if( !helper || !helper->codec_ctx || record->extradata_index < 0 || record->extradata_index >= helper->exh.entry_count )
+            return 0;
+        helper->exh.current_index = record->extradata_index;
+        lwindex_packet_t ipkt = { 0 };
+        ipkt.pos             = record->pos;
+        ipkt.pts             = record->pts;
+        ipkt.dts             = record->dts;
+        ipkt.stream_index    = record->stream_index;
+        ipkt.extradata_index = record->extradata_index;
+        AVChannelLayout ch_layout = { 0 };
+        if( info->codec_type == AVMEDIA_TYPE_VIDEO )
+        {
+            ipkt.flags            = record->key ? AV_PKT_FLAG_KEY : 0;
+            ipkt.size             = record->size;
+            ipkt.poc              = record->poc;
+            ipkt.pict_type        = record->pict_type;
+            ipkt.repeat_pict      = record->repeat_pict;
+            ipkt.field_info       = record->field_info;
+            ipkt.prior_width      = info->width;
+            ipkt.prior_height     = info->height;
+            ipkt.width            = info->width;
+            ipkt.height           = info->height;
+            ipkt.prior_colorspace = info->colorspace;
+            ipkt.pix_fmt          = av_get_pix_fmt( info->fmt );
+            ipkt.corrupt          = record->repeat_pict == 0 && record->field_info == LW_FIELD_INFO_UNKNOWN
+                                 && ipkt.pix_fmt == AV_PIX_FMT_NONE
+                                 && (info->codec_id == AV_CODEC_ID_H264 || info->codec_id == AV_CODEC_ID_HEVC)
+                                 && (info->width == 0 || info->height == 0);
+            helper->last_field_info = (lw_field_info_t)record->field_info;
+        }
+        else
+        {
+            /* The frame length of delayed audio frames depends on the state of the decoder. */
+            if( record->length == -1 )
+                return 0;
+            ipkt.flags           = AV_PKT_FLAG_KEY;
+            ipkt.frame_length    = record->length;
+            ipkt.sample_rate     = info->sample_rate;
+            ipkt.sample_fmt      = av_get_sample_fmt( info->fmt );
+            ipkt.bits_per_sample = info->bits_per_sample;
+            if( info->layout )
+                av_channel_layout_from_mask( &ch_layout, info->layout );
+            else
+                av_channel_layout_default( &ch_layout, info->channels );
+        }
+        if( register_index_packet( builder, writer, helper, stream, &ipkt, &ch_layout, vdhp, adhp, aohp, opt ) < 0 )
+            return -1;
+    }
+    if( av_seek_frame( format_ctx, -1, checkpoint->pos, AVSEEK_FLAG_BYTE ) < 0 )
+        return 0;
+    write_index_checkpoint( writer, checkpoint->pos );
+    return 1;
+}
+
+static int create_index
+(
+    lwlibav_file_handler_t         *lwhp,
+    lwlibav_video_decode_handler_t *vdhp,
+    lwlibav_video_output_handler_t *vohp,
+    lwlibav_audio_decode_handler_t *adhp,
+    lwlibav_audio_output_handler_t *aohp,
+    AVFormatContext                *format_ctx,
+    const char                     *index_path,
+    lwlibav_option_t               *opt,
+    lwindex_checkpoint_t           *checkpoint,
+    progress_indicator_t           *indicator,
+    progress_handler_t             *php
+)
+{
+    lwindex_builder_t builder = { 0 };
+    builder.video_info_count      = 1 << 16;
+    builder.audio_info_count      = 1 << 16;
+    builder.last_keyframe_pts     = AV_NOPTS_VALUE;
+    builder.constant_frame_length = 1;
+    builder.video_info = (video_frame_info_t *)malloc( builder.video_info_count * sizeof(video_frame_info_t) );
+    if( !builder.video_info )
+        return -1;
+    builder.audio_info = (audio_frame_info_t *)malloc( builder.audio_info_count * sizeof(audio_frame_info_t) );
+    if( !builder.audio_info )
+    {
+        free( builder.video_info );
+        return -1;
+    }
+    /*
+        # Structure of Libav reader index file (text)
+        <LibavReaderIndexFile=18>
+        <InputFilePath>foobar.omo</InputFilePath>
+        <FileSize=1048576>
+        <FileLastModificationTime=000>
+        <FileHash=0x0123456789abcdef>
+        <LibavReaderIndex=0x00000208,0,marumoska>
+        <ActiveVideoStreamIndex>+0000000000</ActiveVideoStreamIndex>
+        <ActiveAudioStreamIndex>-0000000001</ActiveAudioStreamIndex>
+        <DefaultAudioStreamIndex>-0000000001</DefaultAudioStreamIndex>
+        <StreamInfo=0,0>
+        Codec=2,TimeBase=1001/24000,Width=1920,Height=1080,Format=yuv420p,ColorSpace=5
+        </StreamInfo>
+        Index=0,POS=0,PTS=2002,DTS=0,EDI=0
+        Key=1,Pic=1,POC=0,Repeat=1,Field=0,Size=1024
+        </LibavReaderIndex>
+        <StreamDuration=0,0>5000</StreamDuration>
+        <StreamIndexEntries=0,0,1>
+        POS=0,TS=2002,Flags=1,Size=1024,Distance=0
+        </StreamIndexEntries>
+        <ExtraDataList=0,0,1>
+        Size=252,Codec=28,4CC=0x564d4448,Width=1920,Height=1080,Format=yuv420p,BPS=0
+        ... binary string ...
+        </ExtraDataList>
+        </LibavReaderIndexFile>
+
+        # Structure of Libav reader index file (binary)
+        lwindex_binary_header_t         : file information, active streams, checkpoint and offset/count of each section
+        InputFilePath                   : padded to 8 bytes
+        lwindex_binary_stream_info_t[]
+        lwindex_packet_record_t[]       : all packets in the reading order
+        lwindex_binary_duration_t[]
+        lwindex_binary_index_entry_t[]
+        lwindex_binary_extradata_t[]    : each followed by its extradata padded to 8 bytes
+     */
+    /* The index file is written into a temporary file, which replaces the index file when completed,
+     * so that an incomplete index file is never seen by the other processes. */
+    FILE *index     = NULL;
+    char *temp_path = NULL;
+    if( index_path )
+    {
+        temp_path = (char *)lw_malloc_zero( strlen( index_path ) + sizeof(".tmp") );
+        if( temp_path )
+        {
+            sprintf( temp_path, "%s.tmp", index_path );
+            index = lw_fopen( temp_path, "wb" );
+        }
+        if( !index )
+        {
+            fprintf( stderr, "lsmas: unable to create index file %s\n", index_path );
+            lw_free( temp_path );
+            free( builder.video_info );
+            free( builder.audio_info );
+            return -1;
+        }
+    }
+    lwhp->format_name  = (char *)format_ctx->iformat->name;
+    lwhp->format_flags = format_ctx->iformat->flags;
+    char lname[4];
+    snprintf(lname, sizeof lname, "%.3s", format_ctx->iformat->long_name);
+    lwhp->raw_demuxer  = !strcmp(lname, "raw");
+    vdhp->format       = format_ctx;
+    adhp->format       = format_ctx;
+    adhp->dv_in_avi    = !strcmp( lwhp->format_name, "avi" ) ? -1 : 0;
+    lwindex_writer_t writer = { 0 };
+    writer.fp   = index;
+    writer.text = opt->text_index;
+#ifdef _WIN32
+    wchar_t* wname = NULL;
+#endif // _WIN32
+    if( index )
+    {
+        /* Write Index file header. */
+#ifdef _WIN32
+        struct _stat64 file_stat;
+        if( lw_string_to_wchar( CP_UTF8, lwhp->file_path, &wname ) )
+            _wstat64( wname, &file_stat );
+        else
+            _stat64( lwhp->file_path, &file_stat );
+#else
+        struct stat file_stat;
+        stat( lwhp->file_path, &file_stat );
+#endif
+        write_index_header( &writer, lwhp, file_stat.st_size, file_stat.st_mtime,
+                            xxhash_file( lwhp->file_path, file_stat.st_size ),
+                            xxhash_file_head( lwhp->file_path, file_stat.st_size ), adhp->stream_index );
+    }
+    AVPacket pkt = { 0 };
+    int         pix_fmt_investigated = 0;
+    int64_t     first_dts            = AV_NOPTS_VALUE;
+    int64_t     filesize             = avio_size( format_ctx->pb );
+    const char *message              = index ? "Creating Index file" : "Parsing input file";
+    if( indicator->open )
+        indicator->open( php );
+    /* Start to read frames and write the index file. */
+    lwindex_indexer_t indexer =
+    {
+        0,                              /* number_of_helpers */
+        NULL,                           /* helpers */
+        vdhp->preferred_decoder_names,  /* preferred_video_decoder_names */
+        vdhp->prefer_hw_decoder,        /* prefer_video_hw_decoder */
+        adhp->preferred_decoder_names,  /* preferred_audio_decoder_names */
+        lwhp->threads,                  /* thread_count */
+        lwhp->format_name               /* format_name */
+    };
+    for( unsigned int stream_index = 0; stream_index < format_ctx->nb_streams; stream_index++ )
+    {
+        AVStream *stream = format_ctx->streams[stream_index];
+        enum AVMediaType codec_type = stream->codecpar->codec_type;
+        if( codec_type != AVMEDIA_TYPE_VIDEO
+         && (codec_type != AVMEDIA_TYPE_AUDIO || adhp->stream_index == -2) )
+            continue;
+        lwindex_helper_t *helper = get_index_helper( &indexer, stream );
+        if( !helper || !helper->codec_ctx )
+            continue;
+        AVCodecContext *pkt_ctx = helper->codec_ctx;
+        int bits_per_sample = 0;
+        if( codec_type == AVMEDIA_TYPE_AUDIO )
+        {
+            if (pkt_ctx->ch_layout.order == AV_CHANNEL_ORDER_UNSPEC)
+                av_channel_layout_default(&pkt_ctx->ch_layout, pkt_ctx->ch_layout.nb_channels);
+            bits_per_sample = pkt_ctx->bits_per_raw_sample   > 0 ? pkt_ctx->bits_per_raw_sample
+                            : pkt_ctx->bits_per_coded_sample > 0 ? pkt_ctx->bits_per_coded_sample
+                            : av_get_bytes_per_sample( pkt_ctx->sample_fmt ) << 3;
+        }
+        write_index_stream_info( &writer, stream, pkt_ctx, bits_per_sample );
+    }
+    /* Try to read the file in parallel unless resuming the indexing. */
+    int parallel = checkpoint ? 0 : create_index_parallel( lwhp, vdhp, adhp, aohp, format_ctx, opt, &indexer, &builder, &writer, indicator, php, message );
+    if( parallel < 0 )
+        goto fail_index;
+    if( checkpoint )
+    {
+        int resumed = resume_index_from_checkpoint( checkpoint, lwhp, format_ctx, &indexer, &builder, &writer, vdhp, adhp, aohp, opt );
+        if( resumed <= 0 )
+        {
+            checkpoint->failed = (resumed == 0);
+            goto fail_index;
+        }
+    }
+    /* The checkpoint is recorded at the video keyframes which can start a range of the parallel indexing. */
+    int     split_video_index = find_split_video_stream( lwhp, format_ctx );
+    int64_t checkpoint_limit  = filesize - LWINDEX_CHECKPOINT_MARGIN;
+    lwindex_container_index_t cidx = { 0 };
+    if( !parallel )
+        cidx.stream = find_container_indexed_stream( lwhp, format_ctx );
+    while( !parallel && read_av_frame( format_ctx, &pkt ) >= 0 )
+    {
+        AVStream          *stream   = format_ctx->streams[ pkt.stream_index ];
+        AVCodecParameters *codecpar = stream->codecpar;
+        if( codecpar->codec_type != AVMEDIA_TYPE_VIDEO
+         && codecpar->codec_type != AVMEDIA_TYPE_AUDIO )
+        {
+            stream->discard = AVDISCARD_ALL;
+            continue;
+        }
+        if( codecpar->codec_id == AV_CODEC_ID_NONE )
+        {
+            stream->discard = AVDISCARD_ALL;
+            continue;
+        }
+        lwindex_helper_t *helper = get_index_helper( &indexer, stream );
+        if( !helper )
+        {
+            av_packet_unref( &pkt );
+            goto fail_index;
+        }
+        AVCodecContext *pkt_ctx = helper->codec_ctx;
+        if( !pkt_ctx )
+        {
+            stream->discard = AVDISCARD_ALL;
+            continue;
+        }
+        if( pkt_ctx->codec_type == AVMEDIA_TYPE_VIDEO || adhp->stream_index != -2 )
+        {
+            if( cidx.entry_index > 0 )
+            {
+                if( stream == cidx.stream )
+                {
+                    /* This frame is registered from the index entries. */
+                    av_packet_unref( &pkt );
+                    continue;
+                }
+                /* Keep the reading order of the frames. */
+                if( register_container_index_entries( &cidx, pkt.pos, &builder, &writer, vdhp, adhp, aohp, opt ) < 0 )
+                {
+                    av_packet_unref( &pkt );
+                    goto fail_index;
+                }
+            }
+            if( checkpoint && pkt.pos < checkpoint->pos )
+            {
+                /* This packet is registered from the index file. */
+                av_packet_unref( &pkt );
+                continue;
+            }
+            int split_point = pkt.stream_index == split_video_index
+                           && (pkt.flags & AV_PKT_FLAG_KEY)
+                           && pkt.pos >= 0 && pkt.pos <= checkpoint_limit
+                           && is_parallel_split_point( codecpar->codec_id, &pkt );
+            lwindex_packet_t ipkt;
+            if( analyze_index_packet( helper, &pkt, vdhp->frame_buffer, &pix_fmt_investigated, &ipkt ) < 0 )
+            {
+                av_packet_unref( &pkt );
+                goto fail_index;
+            }
+            int reset_point = (ipkt.flags & AV_PKT_FLAG_KEY)
+                           && ((codecpar->codec_id != AV_CODEC_ID_H264 && codecpar->codec_id != AV_CODEC_ID_HEVC) || ipkt.poc == 0);
+            if( checkpoint && !checkpoint->video_started && pkt.stream_index == checkpoint->video_stream_index )
+            {
+                /* The state of the parser must be reset at the checkpoint. */
+                if( ipkt.pos != checkpoint->pos || !reset_point )
+                {
+                    checkpoint->failed = 1;
+                    av_packet_unref( &pkt );
+                    goto fail_index;
+                }
+                checkpoint->video_started = 1;
+            }
+            if( register_index_packet( &builder, &writer, helper, stream, &ipkt, &pkt_ctx->ch_layout, vdhp, adhp, aohp, opt ) < 0 )
+            {
+                av_packet_unref( &pkt );
+                goto fail_index;
+            }
+            if( split_point && reset_point && ipkt.stream_index == vdhp->stream_index )
+                write_index_checkpoint( &writer, ipkt.pos );
+            if( stream == cidx.stream && cidx.entry_index == 0 && !start_container_index( &cidx, helper, &ipkt ) )
+                cidx.stream = NULL;
+        }
+        else
+            stream->discard = AVDISCARD_ALL;
+        if( indicator->update )
+        {
+            /* Update progress dialog. */
+            int percent = 0;
+            if( first_dts == AV_NOPTS_VALUE )
+                first_dts = pkt.dts;
+            if( filesize > 0 && format_ctx->pb->pos > 0 )
+                /* Update if I/O context's file offset is valid. */
+                percent = (int)(100.0 * ((double)format_ctx->pb->pos / filesize) + 0.5);
+            else if( format_ctx->duration > 0 && first_dts != AV_NOPTS_VALUE && pkt.dts != AV_NOPTS_VALUE )
+                /* Update if packet's DTS is valid. */
+                percent = (int)(100.0
+                             * (pkt.dts - first_dts) * (stream->time_base.num / (double)stream->time_base.den)
+                             / (format_ctx->duration / AV_TIME_BASE)
+                             + 0.5);
+            int abort = indicator->update( php, message, percent );
+            av_packet_unref( &pkt );
+            if( abort )
+                goto fail_index;
+        }
+        else
+            av_packet_unref( &pkt );
+    }
+    /* Register the rest of the video frames from the index entries. */
+    if( cidx.entry_index > 0
+     && register_container_index_entries( &cidx, INT64_MAX, &builder, &writer, vdhp, adhp, aohp, opt ) < 0 )
+        goto fail_index;
+    /* Handle delay derived from the audio decoder. */
+    for( unsigned int stream_index = 0; stream_index < format_ctx->nb_streams; stream_index++ )
+    {
+        AVStream         *stream = format_ctx->streams[stream_index];
+        lwindex_helper_t *helper = get_index_helper( &indexer, stream );
+        if( !helper || !helper->codec_ctx || !helper->decode || stream->codecpar->codec_type != AVMEDIA_TYPE_AUDIO || adhp->stream_index == -2 )
+            continue;
+        AVCodecContext *pkt_ctx = helper->codec_ctx;
+        /* The frame length of delayed audio frames depends on the preceding packets. */
+        if( helper->delay_count > 0 )
+            write_index_checkpoint( &writer, -1 );
+        /* Flush if decoding is delayed. */
+        for( uint32_t i = 1; i <= helper->delay_count; i++ )
+        {
+            AVPacket null_pkt = { 0 };
+            int decode_complete;
+            if( helper->decode( pkt_ctx, helper->picture, &decode_complete, &null_pkt ) >= 0 )
+            {
+                int frame_length = decode_complete ? helper->picture->nb_samples : 0;
+                if( stream_index == adhp->stream_index )
+                {
+                    builder.audio_duration += frame_length;
+                    if( builder.audio_duration > INT32_MAX )
+                        break;
+                    uint32_t audio_frame_number = builder.audio_sample_count - helper->delay_count + i;
+                    builder.audio_info[audio_frame_number].length = frame_length;
+                    if( audio_frame_number > 1
+                     && builder.audio_info[audio_frame_number].length != builder.audio_info[audio_frame_number - 1].length )
+                        builder.constant_frame_length = 0;
+                }
+                write_index_audio_packet( &writer, stream_index, -1, AV_NOPTS_VALUE, AV_NOPTS_VALUE, -1, frame_length );
+            }
+        }
+    }
+    write_index_tag( &writer, "</LibavReaderIndex>\n" );
+    /* Deallocate video frame info if no active video stream. */
+    if( vdhp->stream_index < 0 )
+        lw_freep( &builder.video_info );
+    /* Deallocate audio frame info if no active audio stream. */
+    if( adhp->stream_index < 0 )
+        lw_freep( &builder.audio_info );
+    else
+    {
+        /* Check the active stream is DV in AVI Type-1 or not. */
+        if( adhp->dv_in_avi == 1 && avformat_index_get_entries_count(format_ctx->streams[ adhp->stream_index ]) == 0 )
+        {
+            /* DV in AVI Type-1 */
+            builder.audio_sample_count = builder.video_info ? MIN( builder.video_sample_count, builder.audio_sample_count ) : 0;
+            for( uint32_t i = 1; i <= builder.audio_sample_count; i++ )
+            {
+                builder.audio_info[i].keyframe        = !!(builder.video_info[i].flags & LW_VFRAME_FLAG_KEY);
+                builder.audio_info[i].sample_number   = builder.video_info[i].sample_number;
+                builder.audio_info[i].pts             = builder.video_info[i].pts;
+                builder.audio_info[i].dts             = builder.video_info[i].dts;
+                builder.audio_info[i].file_offset     = builder.video_info[i].file_offset;
+                builder.audio_info[i].extradata_index = builder.video_info[i].extradata_index;
+            }
+        }
+        else
+        {
+            if( adhp->dv_in_avi == 1 && opt->force_video && opt->force_video_index == -1 )
+            {
+                /* Disable DV video stream. */
+                disable_video_stream( vdhp );
+                builder.video_info = NULL;
+            }
+            adhp->dv_in_avi = 0;
+        }
+    }
+    for( unsigned int stream_index = 0; stream_index < format_ctx->nb_streams; stream_index++ )
+    {
+        AVStream *stream = format_ctx->streams[stream_index];
+        if( stream->codecpar->codec_type == AVMEDIA_TYPE_VIDEO
+         || (stream->codecpar->codec_type == AVMEDIA_TYPE_AUDIO && adhp->stream_index != -2) )
+            write_index_stream_duration( &writer, stream_index, stream->codecpar->codec_type, stream->duration );
+    }
+    if( !strcmp( lwhp->format_name, "asf" ) )
+    {
+        /* Pretty hackish workaround for the ASF demuxer
+         * The Simple Index Object does not always describe all keyframes in corresponding video stream.
+         * Since the Simple Index Object cannot indicate PTS offset derived from missing indexes of early keyframes,
+         * the Simple Index Object is unreliable on frame-accurate seek. So, this section makes up the indexes from
+         * the actual timestamps and file offsets without the Simple Index Object.
+         * Here, also construct the indexes for audio stream from the actual timestamps and file offsets if present. */
+        for( unsigned int stream_index = 0; stream_index < format_ctx->nb_streams; stream_index++ )
+        {
+            AVStream *stream = format_ctx->streams[stream_index];
+            AVIndexEntry *temp = NULL;
+            if( stream->codecpar->codec_type == AVMEDIA_TYPE_VIDEO )
+            {
+                uint32_t i = 0;
+                for (uint32_t j = 1; j <= builder.video_sample_count && i < builder.video_keyframe_count; j++)
+                    if ((builder.video_info[j].flags & LW_VFRAME_FLAG_KEY)
+                        && (builder.video_info[j].pts != AV_NOPTS_VALUE
+                            || builder.video_info[j].dts != AV_NOPTS_VALUE))
+                    {
+                        av_add_index_entry(stream, builder.video_info[j].file_offset,
+                            builder.video_info[j].pts != AV_NOPTS_VALUE ? builder.video_info[j].pts : builder.video_info[j].dts,
+                            0, // size
+                            0, // distance
+                            AVINDEX_KEYFRAME);
+                        i++;
+                    }
+            }
+            else if( stream->codecpar->codec_type == AVMEDIA_TYPE_AUDIO )
+            {
+                av_add_index_entry(stream, 0, 0, 0, 0, 0);
+                uint32_t i = 0;
+                for (uint32_t j = 1; j <= builder.audio_sample_count && i < builder.audio_sample_count; j++)
+                {
+                    if (builder.audio_info[j].pts != AV_NOPTS_VALUE
+                        || builder.audio_info[j].dts != AV_NOPTS_VALUE)
+                    {
+                        av_add_index_entry(stream, builder.audio_info[j].file_offset,
+                            builder.audio_info[j].pts != AV_NOPTS_VALUE ? builder.audio_info[j].pts : builder.audio_info[j].dts,
+                            0, // size
+                            0, // distance
+                            AVINDEX_KEYFRAME);
+                        i++;
+                    }
+                }
+            }
+            if( !temp )
+            {
+                /* Anyway clear the index entries. */
+                av_add_index_entry(stream, 0, 0, 0, 0, 0);
+            }
+        }
+    }
+    for( unsigned int stream_index = 0; stream_index < format_ctx->nb_streams; stream_index++ )
+    {
+        AVStream *stream = format_ctx->streams[stream_index];
+        if( stream->codecpar->codec_type == AVMEDIA_TYPE_VIDEO )
+        {
+            write_index_tag( &writer, "<StreamIndexEntries=%d,%d,%d>\n", stream_index, AVMEDIA_TYPE_VIDEO, avformat_index_get_entries_count(stream) );
+            if( vdhp->stream_index != stream_index )
+                for( int i = 0; i < avformat_index_get_entries_count(stream); i++ )
+                    write_av_index_entry( &writer, stream_index, stream->codecpar->codec_type, avformat_index_get_entry(stream, i) );
+            else if(avformat_index_get_entries_count(stream) > 0 )
+            {
+                vdhp->index_entries = (AVIndexEntry *)av_malloc( avformat_index_get_entries_count(stream) * sizeof(AVIndexEntry) );
+                if( !vdhp->index_entries )
+                    goto fail_index;
+                for( int i = 0; i < avformat_index_get_entries_count(stream); i++ )
+                {
+                    const AVIndexEntry *ie = avformat_index_get_entry(stream, i);
+                    vdhp->index_entries[i] = *ie;
+                    write_av_index_entry( &writer, stream_index, stream->codecpar->codec_type, ie );
+                }
+                vdhp->index_entries_count = avformat_index_get_entries_count(stream);
+            }
+            write_index_tag( &writer, "</StreamIndexEntries>\n" );
+        }
+        else if( stream->codecpar->codec_type == AVMEDIA_TYPE_AUDIO && adhp->stream_index != -2 )
+        {
+            write_index_tag( &writer, "<StreamIndexEntries=%d,%d,%d>\n", stream_index, AVMEDIA_TYPE_AUDIO, avformat_index_get_entries_count(stream) );
+            if( adhp->stream_index != stream_index )
+                for( int i = 0; i < avformat_index_get_entries_count(stream); i++ )
+                    write_av_index_entry( &writer, stream_index, stream->codecpar->codec_type, avformat_index_get_entry(stream, i) );
+            else if(avformat_index_get_entries_count(stream) > 0 )
+            {
+                /* Audio stream in matroska container requires index_entries for seeking.
+                 * This avoids for re-reading the file to create index_entries since the file will be closed once. */
+                adhp->index_entries = (AVIndexEntry *)av_malloc( avformat_index_get_entries_count(stream) * sizeof(AVIndexEntry) );
+                if( !adhp->index_entries )
+                    goto fail_index;
+                for( int i = 0; i < avformat_index_get_entries_count(stream); i++ )
+                {
+                    const AVIndexEntry *ie = avformat_index_get_entry(stream, i);
+                    adhp->index_entries[i] = *ie;
+                    write_av_index_entry( &writer, stream_index, stream->codecpar->codec_type, ie );
+                }
+                adhp->index_entries_count = avformat_index_get_entries_count(stream);
+            }
+            write_index_tag( &writer, "</StreamIndexEntries>\n" );
+        }
+    }
+    for( unsigned int stream_index = 0; stream_index < format_ctx->nb_streams; stream_index++ )
+    {
+        AVStream          *stream   = format_ctx->streams[stream_index];
+        AVCodecParameters *codecpar = stream->codecpar;
+        if( codecpar->codec_type == AVMEDIA_TYPE_VIDEO
+         || (codecpar->codec_type == AVMEDIA_TYPE_AUDIO && adhp->stream_index != -2) )
+        {
+            lwindex_helper_t *helper = get_index_helper( &indexer, stream );
+            if( !helper || !helper->codec_ctx )
+                continue;
+            lwlibav_extradata_handler_t *list = &helper->exh;
+            void (*write_av_extradata)( lwindex_writer_t *, int, lwlibav_extradata_t * ) = codecpar->codec_type == AVMEDIA_TYPE_VIDEO
+                                                                                         ? write_video_extradata
+                                                                                         : write_audio_extradata;
+            write_index_tag( &writer, "<ExtraDataList=%d,%d,%d>\n", stream_index, codecpar->codec_type, list->entry_count );
+            if( (codecpar->codec_type == AVMEDIA_TYPE_VIDEO && stream_index == vdhp->stream_index)
+             || (codecpar->codec_type == AVMEDIA_TYPE_AUDIO && stream_index == adhp->stream_index) )
+            {
+                for( int i = 0; i < list->entry_count; i++ )
+                    write_av_extradata( &writer, stream_index, &list->entries[i] );
+                lwlibav_extradata_handler_t *exhp = codecpar->codec_type == AVMEDIA_TYPE_VIDEO ? &vdhp->exh : &adhp->exh;
+                exhp->entry_count   = list->entry_count;
+                exhp->entries       = list->entries;
+                exhp->current_index = codecpar->codec_type == AVMEDIA_TYPE_VIDEO
+                                    ? builder.video_info[1].extradata_index
+                                    : builder.audio_info[1].extradata_index;
+                /* Avoid freeing entries. */
+                list->entry_count = 0;
+                list->entries     = NULL;
+            }
+            else
+                for( int i = 0; i < list->entry_count; i++ )
+                    write_av_extradata( &writer, stream_index, &list->entries[i] );
+            write_index_tag( &writer, "</ExtraDataList>\n" );
+        }
+    }
+    write_index_trailer( &writer );
+    if( vdhp->stream_index >= 0 )
+    {
+        vdhp->rap_list = (uint32_t *)lw_malloc_zero( (builder.video_sample_count + 1) * sizeof(uint32_t) );
+        if( !vdhp->rap_list )
+            goto fail_index;
+        vdhp->frame_list      = builder.video_info;
+        vdhp->frame_count     = builder.video_sample_count;
+        vdhp->initial_pix_fmt = vdhp->ctx->pix_fmt;
+        if( decide_video_seek_method( lwhp, vdhp, builder.video_sample_count ) )
+            goto fail_index;
+        /* Compute the stream duration. */
+        compute_stream_duration( lwhp, vdhp, format_ctx->streams[ vdhp->stream_index ]->duration );
+        complete_video_field_info( vdhp );
+        if( pack_video_frame_list( vdhp ) < 0 )
+            goto fail_index;
+        /* Only the frame table is kept for decoding. */
+        lw_freep( &vdhp->frame_list );
+        builder.video_info = NULL;
+        /* Create the repeat control info. */
+        create_video_frame_order_list( vdhp, vohp, opt );
+        /* Exclude invisible frames from the output handler. */
+        create_video_visible_frame_list( vdhp, vohp, builder.invisible_count );
+    }
+    if( adhp->stream_index >= 0 )
+    {
+        adhp->frame_list   = builder.audio_info;
+        adhp->frame_count  = builder.audio_sample_count;
+        adhp->frame_length = builder.constant_frame_length ? adhp->frame_list[1].length : 0;
+        decide_audio_seek_method( lwhp, adhp, builder.audio_sample_count );
+        if( opt->av_sync && vdhp->stream_index >= 0 )
+            lwhp->av_gap = calculate_av_gap( vdhp, vohp, adhp, builder.audio_sample_rate );
+    }
+#ifdef _WIN32
+    lw_free(wname);
+#endif // _WIN32
+    cleanup_index_helpers( &indexer );
+    if( index )
+    {
+        /* A write error leaves the existing index file as it is instead of replacing it with a truncated one. */
+        int error = ferror( index );
+        if( fclose( index ) )
+            error = 1;
+        if( error )
+        {
+            fprintf( stderr, "lsmas: unable to write index file %s\n", index_path );
+            lw_remove( temp_path );
+        }
+        else if( lw_rename( temp_path, index_path ) )
+        {
+            fprintf( stderr, "lsmas: unable to replace index file %s\n", index_path );
+            lw_remove( temp_path );
+        }
+        lw_free( temp_path );
+    }
+    if( indicator->close )
+        indicator->close( php );
+    vdhp->format = NULL;
+    adhp->format = NULL;
+    return 0;
+fail_index:
+#ifdef _WIN32
+    lw_free(wname);
+#endif // _WIN32
+    cleanup_index_helpers( &indexer );
+    free( builder.video_info );
+    free( builder.audio_info );
+    vdhp->frame_list = NULL;
+    adhp->frame_list = NULL;
+    if( index )
+    {
+        fclose( index );
+        lw_remove( temp_path );
+        lw_free( temp_path );
+    }
+    if( indicator->close )
+        indicator->close( php );
+    vdhp->format = NULL;
+    adhp->format = NULL;
+    return -1;
+}
+
+typedef struct
+{
+    video_frame_info_t *video_info;
+    audio_frame_info_t *audio_info;
+    uint32_t            video_info_count;
+    uint32_t            audio_info_count;
+    uint32_t            video_sample_count;
+    uint32_t            invisible_count;
+    int64_t             last_keyframe_pts;
+    uint32_t            audio_sample_count;
+    int                 audio_sample_rate;
+    int                 constant_frame_length;
+    uint64_t            audio_duration;
+} lwindex_parser_t;
+
+/* Set up the input file path and check if the index file still describes the input file. */
+static int check_index_source
+(
+    lwlibav_file_handler_t *lwhp,
+    lwlibav_option_t       *opt,
+    const char             *file_path,
+    int64_t                 file_size,
+    int64_t                 file_last_modification_time,
+    uint64_t                file_hash,
+    unsigned                file_hash_32
+)
+{
+    /* Test to open the target file. */
+    size_t file_path_length = strlen( opt->file_path );
+    const char *ext = file_path_length >= 5 ? &opt->file_path[file_path_length - 4] : NULL;
+    if( ext && !strncmp( ext, ".lwi", strlen( ".lwi" ) ) )
+    {
+        FILE *target = lw_fopen( file_path, "rb" );
+        if( !target )
+            return -1;
+        fclose( target );
+        file_path_length = strlen( file_path );
+        lwhp->file_path = (char *)lw_malloc_zero( file_path_length + 1 );
+        if( !lwhp->file_path )
+            return -1;
+        memcpy( lwhp->file_path, file_path, file_path_length );
+    }
+    else
+    {
+        lwhp->file_path = (char *)lw_malloc_zero( file_path_length + 1 );
+        if( !lwhp->file_path )
+            return -1;
+        memcpy( lwhp->file_path, opt->file_path, file_path_length );
+    }
+#ifdef _WIN32
+    wchar_t *wname = NULL;
+    struct _stat64 file_stat;
+    if( lw_string_to_wchar( CP_UTF8, lwhp->file_path, &wname ) )
+    {
+        int err = _wstat64( wname, &file_stat );
+        lw_free( wname );
+        if( err )
+            return -1;
+    }
+    else
+    {
+        if( _stat64( lwhp->file_path, &file_stat ) )
+            return -1;
+    }
+#else
+    struct stat file_stat;
+    if( stat( lwhp->file_path, &file_stat ) )
+        return -1;
+#endif
+    if( file_size != file_stat.st_size )
+        return -1;
+    if( file_last_modification_time != file_stat.st_mtime )
+    {
+        // Also check hashsum
+        if( ( !file_hash
+             || file_hash != xxhash_file( lwhp->file_path, file_stat.st_size ) )
+         &&
+            ( !file_hash_32
+             || file_hash_32 != xxhash32_file( lwhp->file_path, file_stat.st_size ) ) )
+            return -1;
+    }
+    return 0;
+}
+
+/* Decide the stream indexes to be used and allocate the frame info for them. */
+static int setup_index_parser
+(
+    lwindex_parser_t               *ip,
+    lwlibav_video_decode_handler_t *vdhp,
+    lwlibav_audio_decode_handler_t *adhp,
+    lwlibav_audio_output_handler_t *aohp,
+    lwlibav_option_t               *opt,
+    int                             active_video_index,
+    int                             active_audio_index,
+    int                             default_audio
+)
+{
+    memset( ip, 0, sizeof(lwindex_parser_t) );
+    ip->video_info_count      = 1 << 16;
+    ip->audio_info_count      = 1 << 16;
+    ip->last_keyframe_pts     = AV_NOPTS_VALUE;
+    ip->constant_frame_length = 1;
+    vdhp->stream_index = opt->force_video ? opt->force_video_index : active_video_index;
+    switch (opt->force_audio_index)
+    {
+        case -1:
+        {
+            if (default_audio != active_audio_index)
+                return -1;
+        }
+        case -2: adhp->stream_index = active_audio_index; break;
+        default: adhp->stream_index = opt->force_audio_index; break;
+    }
+    if( vdhp->stream_index >= 0 )
+    {
+        ip->video_info = (video_frame_info_t *)malloc( ip->video_info_count * sizeof(video_frame_info_t) );
+        if( !ip->video_info )
+            return -1;
+    }
+    if( adhp->stream_index >= 0 )
+    {
+        ip->audio_info = (audio_frame_info_t *)malloc( ip->audio_info_count * sizeof(audio_frame_info_t) );
+        if( !ip->audio_info )
+            return -1;
+    }
+    if( active_audio_index == -2 && opt->force_audio_index != -2 )
+        return -1;
+    vdhp->codec_id             = AV_CODEC_ID_NONE;
+    adhp->codec_id             = AV_CODEC_ID_NONE;
+    vdhp->initial_pix_fmt      = AV_PIX_FMT_NONE;
+    vdhp->initial_colorspace   = AVCOL_SPC_NB;
+    aohp->output_sample_format = AV_SAMPLE_FMT_NONE;
+    return 0;
+}
+
+static void cleanup_index_parser
+(
+    lwindex_parser_t               *ip,
+    lwlibav_video_decode_handler_t *vdhp,
+    lwlibav_audio_decode_handler_t *adhp
+)
+{
+    vdhp->frame_list = NULL;
+    adhp->frame_list = NULL;
+    lw_freep( &vdhp->frame_table );
+    lw_freep( &ip->video_info );
+    lw_freep( &ip->audio_info );
+    av_freep( &vdhp->index_entries );
+    av_freep( &adhp->index_entries );
+    vdhp->index_entries_count = 0;
+    adhp->index_entries_count = 0;
+}
+
+/* Add a packet of the index file to the frame info if it belongs to the active streams. */
+static int parse_index_packet
+(
+    lwindex_parser_t               *ip,
+    lwlibav_video_decode_handler_t *vdhp,
+    lwlibav_audio_decode_handler_t *adhp,
+    lwlibav_audio_output_handler_t *aohp,
+    lwlibav_option_t               *opt,
+    lwindex_stream_info_t          *stream_info,
+    const lwindex_packet_record_t  *record
+)
+{
+    int        stream_index = record->stream_index;
+    int        codec_type   = stream_info[stream_index].codec_type;
+    int        codec_id     = stream_info[stream_index].codec_id;
+    AVRational time_base    = stream_info[stream_index].time_base;
+    if( codec_type == AVMEDIA_TYPE_VIDEO )
+    {
+        if( adhp->dv_in_avi == -1 && codec_id == AV_CODEC_ID_DVVIDEO && !opt->force_audio )
+        {
+            adhp->dv_in_avi = 1;
+            if( vdhp->stream_index == -1 )
+            {
+                vdhp->stream_index = stream_index;
+                ip->video_info = (video_frame_info_t *)malloc( ip->video_info_count * sizeof(video_frame_info_t) );
+                if( !ip->video_info )
+                    return -1;
+            }
+        }
+        if( stream_index == vdhp->stream_index )
+        {
+            int   width      = stream_info[stream_index].width;
+            int   height     = stream_info[stream_index].height;
+            char *pix_fmt    = stream_info[stream_index].fmt;
+            int   colorspace = stream_info[stream_index].colorspace;
+            int   key        = record->key;
+            int   pict_type  = record->pict_type;
+            if( vdhp->codec_id == AV_CODEC_ID_NONE )
+                vdhp->codec_id = (enum AVCodecID)codec_id;
+            if( (key | width | height) || pict_type == -1 || colorspace != AVCOL_SPC_NB )
+            {
+                if( vdhp->initial_width == 0 || vdhp->initial_height == 0 )
+                {
+                    vdhp->initial_width  = width;
+                    vdhp->initial_height = height;
+                    vdhp->max_width      = width;
+                    vdhp->max_height     = height;
+                }
+                else
+                {
+                    if( vdhp->max_width  < width )
+                        vdhp->max_width  = width;
+                    if( vdhp->max_height < width )
+                        vdhp->max_height = height;
+                }
+                if( vdhp->initial_pix_fmt == AV_PIX_FMT_NONE )
+                    vdhp->initial_pix_fmt = av_get_pix_fmt( pix_fmt );
+                if( vdhp->initial_colorspace == AVCOL_SPC_NB )
+                    vdhp->initial_colorspace = (enum AVColorSpace)colorspace;
+                if( vdhp->time_base.num == 0 || vdhp->time_base.den == 0 )
+                {
+                    vdhp->time_base.num = time_base.num;
+                    vdhp->time_base.den = time_base.den;
+                }
+                ++ip->video_sample_count;
+                video_frame_info_t *info = &ip->video_info[ip->video_sample_count];
+                memset( info, 0, sizeof(video_frame_info_t) );
+                info->pts             = record->pts;
+                info->dts             = record->dts;
+                info->file_offset     = record->pos;
+                info->packet_size     = record->size;
+                info->sample_number   = ip->video_sample_count;
+                info->extradata_index = record->extradata_index;
+                info->pict_type       = pict_type;
+                info->poc             = record->poc;
+                info->repeat_pict     = record->repeat_pict;
+                info->field_info      = (lw_field_info_t)record->field_info;
+                if( record->pts != AV_NOPTS_VALUE && ip->last_keyframe_pts != AV_NOPTS_VALUE && record->pts < ip->last_keyframe_pts )
+                    info->flags |= LW_VFRAME_FLAG_LEADING;
+                if( key )
+                {
+                    info->flags |= LW_VFRAME_FLAG_KEY;
+                    ip->last_keyframe_pts = record->pts;
+                }
+                if( record->repeat_pict == 0 && record->field_info == LW_FIELD_INFO_UNKNOWN
+                 && av_get_pix_fmt( pix_fmt ) == AV_PIX_FMT_NONE
+                 && ((enum AVCodecID)codec_id == AV_CODEC_ID_H264 || (enum AVCodecID)codec_id == AV_CODEC_ID_HEVC)
+                 && (width == 0 || height == 0) )
+                    info->flags |= LW_VFRAME_FLAG_CORRUPT;
+                if( (enum AVCodecID)codec_id == AV_CODEC_ID_VP8
+                 && record->pts == AV_NOPTS_VALUE && record->dts == AV_NOPTS_VALUE && record->pos == -1 )
+                {
+                    /* VPx invisible altref frame. */
+                    info->flags |= LW_VFRAME_FLAG_INVISIBLE;
+                    ++ip->invisible_count;
+                }
+            }
+            if( ip->video_sample_count + 1 == ip->video_info_count )
+            {
+                ip->video_info_count <<= 1;
+                video_frame_info_t *temp = (video_frame_info_t *)realloc( ip->video_info, ip->video_info_count * sizeof(video_frame_info_t) );
+                if( !temp )
+                    return -1;
+                ip->video_info = temp;
+            }
+        }
+    }
+    else if( codec_type == AVMEDIA_TYPE_AUDIO )
+    {
+        if( stream_index == adhp->stream_index )
+        {
+            uint64_t layout          = stream_info[stream_index].layout;
+            int      channels        = stream_info[stream_index].channels;
+            int      sample_rate     = stream_info[stream_index].sample_rate;
+            char    *sample_fmt      = stream_info[stream_index].fmt;
+            int      bits_per_sample = stream_info[stream_index].bits_per_sample;
+            int      frame_length    = record->length;
+            audio_frame_info_t *audio_info = ip->audio_info;
+            if( adhp->codec_id == AV_CODEC_ID_NONE )
+                adhp->codec_id = (enum AVCodecID)codec_id;
+            if( (channels | layout | sample_rate | bits_per_sample) && record->extradata_index != -1 && ip->audio_duration <= INT32_MAX )
+            {
+                if( ip->audio_sample_rate == 0 )
+                    ip->audio_sample_rate = sample_rate;
+                if( adhp->time_base.num == 0 || adhp->time_base.den == 0 )
+                {
+                    adhp->time_base.num = time_base.num;
+                    adhp->time_base.den = time_base.den;
+                }
+                if (channels > aohp->output_channel_layout.nb_channels)
+                    av_channel_layout_from_mask(&aohp->output_channel_layout, layout);
+                aohp->output_sample_format   = select_better_sample_format( aohp->output_sample_format,
+                                                                            av_get_sample_fmt( sample_fmt ) );
+                aohp->output_sample_rate     = MAX( aohp->output_sample_rate, ip->audio_sample_rate );
+                aohp->output_bits_per_sample = MAX( aohp->output_bits_per_sample, bits_per_sample );
+                ++ip->audio_sample_count;
+                audio_frame_info_t *info = &audio_info[ip->audio_sample_count];
+                memset( info, 0, sizeof(audio_frame_info_t) );
+                info->pts             = record->pts;
+                info->dts             = record->dts;
+                info->file_offset     = record->pos;
+                info->sample_number   = ip->audio_sample_count;
+                info->extradata_index = record->extradata_index;
+                info->sample_rate     = sample_rate;
+            }
+            else
+                for( uint32_t i = 1; i <= adhp->exh.delay_count; i++ )
+                {
+                    uint32_t audio_frame_number = ip->audio_sample_count - adhp->exh.delay_count + i;
+                    if( audio_frame_number > ip->audio_sample_count )
+                        return -1;
+                    audio_info[audio_frame_number].length = frame_length;
+                    if( audio_frame_number > 1 && audio_info[audio_frame_number].length != audio_info[audio_frame_number - 1].length )
+                        ip->constant_frame_length = 0;
+                    ip->audio_duration += frame_length;
+                }
+            if( ip->audio_sample_count + 1 == ip->audio_info_count )
+            {
+                ip->audio_info_count <<= 1;
+                audio_frame_info_t *temp = (audio_frame_info_t *)realloc( ip->audio_info, ip->audio_info_count * sizeof(audio_frame_info_t) );
+                if( !temp )
+                    return -1;
+                ip->audio_info = audio_info = temp;
+            }
+            if( frame_length == -1 )
+                ++ adhp->exh.delay_count;
+            else if( ip->audio_sample_count > adhp->exh.delay_count )
+            {
+                uint32_t audio_frame_number = ip->audio_sample_count - adhp->exh.delay_count;
+                audio_info[audio_frame_number].length = frame_length;
+                if( audio_frame_number > 1 && audio_info[audio_frame_number].length != audio_info[audio_frame_number - 1].length )
+                    ip->constant_frame_length = 0;
+                ip->audio_duration += frame_length;
+            }
+        }
+    }
+    return 0;
+}
+
+/* Check if the forced streams are present in the index file. */
+static int check_parsed_streams
+(
+    lwindex_parser_t               *ip,
+    lwlibav_video_decode_handler_t *vdhp,
+    lwlibav_option_t               *opt,
+    int                             active_video_index,
+    int                             active_audio_index
+)
+{
+    int video_present = (active_video_index >= 0);
+    int audio_present = (active_audio_index >= 0);
+    if( video_present && opt->force_video && opt->force_video_index != -1
+     && (ip->video_sample_count == 0 || vdhp->initial_pix_fmt == AV_PIX_FMT_NONE || vdhp->initial_width == 0 || vdhp->initial_height == 0) )
+        return -1;  /* Need to re-create the index file. */
+    if( audio_present && opt->force_audio && opt->force_audio_index != -1 && (ip->audio_sample_count == 0 || ip->audio_duration == 0) )
+        return -1;  /* Need to re-create the index file. */
+    return 0;
+}
+
+/* Hand over the parsed frame info to the decode handlers and set up them. */
+static int finish_index_parsing
+(
+    lwindex_parser_t               *ip,
+    lwlibav_file_handler_t         *lwhp,
+    lwlibav_video_decode_handler_t *vdhp,
+    lwlibav_video_output_handler_t *vohp,
+    lwlibav_audio_decode_handler_t *adhp,
+    lwlibav_audio_output_handler_t *aohp,
+    lwlibav_option_t               *opt,
+    int                             active_video_index
+)
+{
+    video_frame_info_t *video_info = ip->video_info;
+    audio_frame_info_t *audio_info = ip->audio_info;
+    if( vdhp->stream_index >= 0 )
+    {
+        vdhp->rap_list = (uint32_t *)lw_malloc_zero( (ip->video_sample_count + 1) * sizeof(uint32_t) );
+        if( !vdhp->rap_list )
+            return -1;
+        vdhp->frame_list  = video_info;
+        vdhp->frame_count = ip->video_sample_count;
+        if( decide_video_seek_method( lwhp, vdhp, ip->video_sample_count ) )
+            return -1;
+        /* Compute the stream duration. */
+        compute_stream_duration( lwhp, vdhp, vdhp->stream_duration );
+        complete_video_field_info( vdhp );
+        if( pack_video_frame_list( vdhp ) < 0 )
+            return -1;
+        /* Create the repeat control info. */
+        create_video_frame_order_list( vdhp, vohp, opt );
+        /* Exclude invisible frames from the output handler. */
+        create_video_visible_frame_list( vdhp, vohp, ip->invisible_count );
+    }
+    if( adhp->stream_index >= 0 )
+    {
+        if( adhp->dv_in_avi == 1 && adhp->index_entries_count == 0 )
+        {
+            /* DV in AVI Type-1 */
+            ip->audio_sample_count = MIN( ip->video_sample_count, ip->audio_sample_count );
+            for( uint32_t i = 0; i <= ip->audio_sample_count; i++ )
+            {
+                audio_info[i].keyframe        = !!(video_info[i].flags & LW_VFRAME_FLAG_KEY);
+                audio_info[i].sample_number   = video_info[i].sample_number;
+                audio_info[i].pts             = video_info[i].pts;
+                audio_info[i].dts             = video_info[i].dts;
+                audio_info[i].file_offset     = video_info[i].file_offset;
+                audio_info[i].extradata_index = video_info[i].extradata_index;
+            }
+        }
+        else
+        {
+            if( adhp->dv_in_avi == 1 && ((!opt->force_video && active_video_index == -1) || (opt->force_video && opt->force_video_index == -1)) )
+            {
+                /* Disable DV video stream. */
+                disable_video_stream( vdhp );
+                ip->video_info = NULL;
+            }
+            adhp->dv_in_avi = 0;
+        }
+        adhp->frame_list   = audio_info;
+        adhp->frame_count  = ip->audio_sample_count;
+        adhp->frame_length = ip->constant_frame_length ? audio_info[1].length : 0;
+        decide_audio_seek_method( lwhp, adhp, ip->audio_sample_count );
+        if( opt->av_sync && vdhp->stream_index >= 0 )
+            lwhp->av_gap = calculate_av_gap( vdhp, vohp, adhp, ip->audio_sample_rate );
+    }
+    /* Only the frame table is kept for decoding. */
+    vdhp->frame_list = NULL;
+    lw_freep( &ip->video_info );
+    return 0;
+}
+
+static int parse_index
+(
+    lwlibav_file_handler_t         *lwhp,
+    lwlibav_video_decode_handler_t *vdhp,
+    lwlibav_video_output_handler_t *vohp,
+    lwlibav_audio_decode_handler_t *adhp,
+    lwlibav_audio_output_handler_t *aohp,
+    lwlibav_option_t               *opt,
+    FILE                           *index,
+    int                            *default_audio_index
+)
+{
+    char file_path[512] = { 0 };
+    if( fscanf( index, "<InputFilePath>%[^\n<]</InputFilePath>\n", file_path ) != 1 )
+        return -1;
+    /* Parse the index file. */
+    int64_t file_size;
+    int64_t file_last_modification_time;
+    uint64_t file_hash = 0;
+    unsigned file_hash_32 = 0;
+    char format_name[256];
+    int active_video_index;
+    int active_audio_index;
+    int default_audio;
+    if( fscanf( index, "<FileSize=%" SCNd64 ">\n", &file_size ) != 1
+     || fscanf( index, "<FileLastModificationTime=%" SCNd64 ">\n", &file_last_modification_time ) != 1 )
+        return -1;
+    int32_t pos = ftell( index );
+    if( fscanf( index, "<FileHash=0x%" SCNx64 ">\n", &file_hash ) != 1 )
+        fseek( index, pos, SEEK_SET);
+    pos = ftell( index );
+    if( fscanf( index, "<FileHash=0x%x>\n", &file_hash_32 ) != 1 )
+        fseek( index, pos, SEEK_SET);
+    if( check_index_source( lwhp, opt, file_path, file_size, file_last_modification_time, file_hash, file_hash_32 ) )
+        return -1;
+    if( fscanf( index, "<LibavReaderIndex=0x%x,%d,%[^>]>\n",
+                (unsigned int *)&lwhp->format_flags, &lwhp->raw_demuxer, format_name ) != 3 )
+        return -1;
+    int32_t active_index_pos = ftell( index );
+    if( fscanf( index, "<ActiveVideoStreamIndex>%d</ActiveVideoStreamIndex>\n", &active_video_index ) != 1
+     || fscanf( index, "<ActiveAudioStreamIndex>%d</ActiveAudioStreamIndex>\n", &active_audio_index ) != 1
+     || fscanf( index, "<DefaultAudioStreamIndex>%d</DefaultAudioStreamIndex>\n", &default_audio ) != 1 )
+        return -1;
+    lwhp->format_name = format_name;
+    adhp->dv_in_avi = !strcmp( lwhp->format_name, "avi" ) ? -1 : 0;
+    lwindex_parser_t ip;
+    lwindex_stream_info_t *stream_info = NULL;
+    if( setup_index_parser( &ip, vdhp, adhp, aohp, opt, active_video_index, active_audio_index, default_audio ) )
+        goto fail_parsing;
+    char buf[1024];
+    if( !fgets( buf, sizeof(buf), index ) )
+        goto fail_parsing;
+    while( !strncmp( buf, "<StreamInfo=", strlen( "<StreamInfo=" ) ) )
+    {
+        int stream_index;
+        int codec_type;
+        if( sscanf( buf, "<StreamInfo=%d,%d>", &stream_index, &codec_type ) != 2 )
+            goto fail_parsing;
+        if( !fgets( buf, sizeof(buf), index ) )
+            goto fail_parsing;
+        lwindex_stream_info_t *temp = (lwindex_stream_info_t *)realloc( stream_info, (stream_index + 1) * sizeof(lwindex_stream_info_t) );
+        if( !temp )
+            goto fail_parsing;
+        stream_info = temp;
+        lwindex_stream_info_t *info = &stream_info[stream_index];
+        info->codec_type = codec_type;
+        if( codec_type == AVMEDIA_TYPE_VIDEO )
+        {
+            if( sscanf( buf, "Codec=%d,TimeBase=%d/%d,Width=%d,Height=%d,Format=%[^,],ColorSpace=%d",
+                        &info->codec_id, &info->time_base.num, &info->time_base.den, &info->width, &info->height, info->fmt, &info->colorspace ) != 7 )
+                goto fail_parsing;
+        }
+        else if( codec_type == AVMEDIA_TYPE_AUDIO )
+        {
+            if( sscanf( buf, "Codec=%d,TimeBase=%d/%d,Channels=%d:0x%" SCNx64 ",Rate=%d,Format=%[^,],BPS=%d",
+                        &info->codec_id, &info->time_base.num, &info->time_base.den, &info->channels, &info->layout, &info->sample_rate, info->fmt, &info->bits_per_sample ) != 8 )
+                goto fail_parsing;
+        }
+        if( !fgets( buf, sizeof(buf), index ) )
+            goto fail_parsing;
+        if( strncmp( buf, "</StreamInfo>", strlen( "</StreamInfo>" ) ) )
+            goto fail_parsing;
         if( !fgets( buf, sizeof(buf), index ) )
             goto fail_parsing;
     }
     while( !strncmp( buf, "Index=", strlen( "Index=" ) ) )
     {
+        lwindex_packet_record_t record = { 0 };
         int stream_index;
         int extradata_index;
-        int64_t pos;
-        int64_t pts;
-        int64_t dts;
         if( sscanf( buf, "Index=%d,POS=%" SCNd64 ",PTS=%" SCNd64 ",DTS=%" SCNd64 ",EDI=%d",
-                    &stream_index, &pos, &pts, &dts, &extradata_index ) != 5 )
+                    &stream_index, &record.pos, &record.pts, &record.dts, &extradata_index ) != 5 )
             goto fail_parsing;
         if( !fgets( buf, sizeof(buf), index ) )
             goto fail_parsing;
-        int        codec_type = stream_info[stream_index].codec_type;
-        int        codec_id   = stream_info[stream_index].codec_id;
-        AVRational time_base  = stream_info[stream_index].time_base;
+        record.stream_index    = stream_index;
+        record.extradata_index = extradata_index;
+        int codec_type = stream_info[stream_index].codec_type;
         if( codec_type == AVMEDIA_TYPE_VIDEO )
         {
-            if( adhp->dv_in_avi == -1 && codec_id == AV_CODEC_ID_DVVIDEO && !opt->force_audio )
-            {
-                adhp->dv_in_avi = 1;
-                if( vdhp->stream_index == -1 )
-                {
-                    vdhp->stream_index = stream_index;
-                    video_info = (video_frame_info_t *)malloc( video_info_count * sizeof(video_frame_info_t) );
-                    if( !video_info )
-                        goto fail_parsing;
-                }
-            }
-            if( stream_index == vdhp->stream_index )
-            {
-                int   width      = stream_info[stream_index].width;
-                int   height     = stream_info[stream_index].height;
-                char *pix_fmt    = stream_info[stream_index].fmt;
-                int   colorspace = stream_info[stream_index].colorspace;
-                int   key;
-                int   pict_type;
-                int   poc;
-                int   repeat_pict;
-                int   field_info;
-                if( sscanf( buf, "Key=%d,Pic=%d,POC=%d,Repeat=%d,Field=%d",
-                            &key, &pict_type, &poc, &repeat_pict, &field_info ) != 5 )
-                    goto fail_parsing;
-                if( vdhp->codec_id == AV_CODEC_ID_NONE )
-                    vdhp->codec_id = (enum AVCodecID)codec_id;
-                if( (key | width | height) || pict_type == -1 || colorspace != AVCOL_SPC_NB )
-                {
-                    if( vdhp->initial_width == 0 || vdhp->initial_height == 0 )
-                    {
-                        vdhp->initial_width  = width;
-                        vdhp->initial_height = height;
-                        vdhp->max_width      = width;
-                        vdhp->max_height     = height;
-                    }
-                    else
-                    {
-                        if( vdhp->max_width  < width )
-                            vdhp->max_width  = width;
-                        if( vdhp->max_height < width )
-                            vdhp->max_height = height;
-                    }
-                    if( vdhp->initial_pix_fmt == AV_PIX_FMT_NONE )
-                        vdhp->initial_pix_fmt = av_get_pix_fmt( pix_fmt );
-                    if( vdhp->initial_colorspace == AVCOL_SPC_NB )
-                        vdhp->initial_colorspace = (enum AVColorSpace)colorspace;
-                    if( vdhp->time_base.num == 0 || vdhp->time_base.den == 0 )
-                    {
-                        vdhp->time_base.num = time_base.num;
-                        vdhp->time_base.den = time_base.den;
-                    }
-                    ++video_sample_count;
-                    video_frame_info_t *info = &video_info[video_sample_count];
-                    memset( info, 0, sizeof(video_frame_info_t) );
-                    info->pts             = pts;
-                    info->dts             = dts;
-                    info->file_offset     = pos;
-                    info->sample_number   = video_sample_count;
-                    info->extradata_index = extradata_index;
-                    info->pict_type       = pict_type;
-                    info->poc             = poc;
-                    info->repeat_pict     = repeat_pict;
-                    info->field_info      = (lw_field_info_t)field_info;
-                    if( pts != AV_NOPTS_VALUE && last_keyframe_pts != AV_NOPTS_VALUE && pts < last_keyframe_pts )
-                        info->flags |= LW_VFRAME_FLAG_LEADING;
-                    if( key )
-                    {
-                        info->flags |= LW_VFRAME_FLAG_KEY;
-                        last_keyframe_pts = pts;
-                    }
-                    if( repeat_pict == 0 && field_info == LW_FIELD_INFO_UNKNOWN
-                     && av_get_pix_fmt( pix_fmt ) == AV_PIX_FMT_NONE
-                     && ((enum AVCodecID)codec_id == AV_CODEC_ID_H264 || (enum AVCodecID)codec_id == AV_CODEC_ID_HEVC)
-                     && (width == 0 || height == 0) )
-                        info->flags |= LW_VFRAME_FLAG_CORRUPT;
-                    if( (enum AVCodecID)codec_id == AV_CODEC_ID_VP8
-                     && pts == AV_NOPTS_VALUE && dts == AV_NOPTS_VALUE && pos == -1 )
-                    {
-                        /* VPx invisible altref frame. */
-                        info->flags |= LW_VFRAME_FLAG_INVISIBLE;
-                        ++invisible_count;
-                    }
-                }
-                if( video_sample_count + 1 == video_info_count )
-                {
-                    video_info_count <<= 1;
-                    video_frame_info_t *temp = (video_frame_info_t *)realloc( video_info, video_info_count * sizeof(video_frame_info_t) );
-                    if( !temp )
-                        goto fail_parsing;
-                    video_info = temp;
-                }
-            }
+            int key;
+            int pict_type;
+            int poc;
+            int repeat_pict;
+            int field_info;
+            int size;
+            if( sscanf( buf, "Key=%d,Pic=%d,POC=%d,Repeat=%d,Field=%d,Size=%d",
+                        &key, &pict_type, &poc, &repeat_pict, &field_info, &size ) != 6 )
+                goto fail_parsing;
+            record.key         = key;
+            record.pict_type   = pict_type;
+            record.poc         = poc;
+            record.repeat_pict = repeat_pict;
+            record.field_info  = field_info;
+            record.size        = size;
         }
         else if( codec_type == AVMEDIA_TYPE_AUDIO )
         {
-            if( stream_index == adhp->stream_index )
-            {
-                uint64_t layout          = stream_info[stream_index].layout;
-                int      channels        = stream_info[stream_index].channels;
-                int      sample_rate     = stream_info[stream_index].sample_rate;
-                char    *sample_fmt      = stream_info[stream_index].fmt;
-                int      bits_per_sample = stream_info[stream_index].bits_per_sample;
-                int      frame_length;
-                if( sscanf( buf, "Length=%d", &frame_length ) != 1 )
-                    goto fail_parsing;
-                if( adhp->codec_id == AV_CODEC_ID_NONE )
-                    adhp->codec_id = (enum AVCodecID)codec_id;
-                if( (channels | layout | sample_rate | bits_per_sample) && extradata_index != -1 && audio_duration <= INT32_MAX )
-                {
-                    if( audio_sample_rate == 0 )
-                        audio_sample_rate = sample_rate;
-                    if( adhp->time_base.num == 0 || adhp->time_base.den == 0 )
-                    {
-                        adhp->time_base.num = time_base.num;
-                        adhp->time_base.den = time_base.den;
-                    }
-                    if (channels > aohp->output_channel_layout.nb_channels)
-                        av_channel_layout_from_mask(&aohp->output_channel_layout, layout);
-                    aohp->output_sample_format   = select_better_sample_format( aohp->output_sample_format,
-                                                                                av_get_sample_fmt( sample_fmt ) );
-                    aohp->output_sample_rate     = MAX( aohp->output_sample_rate, audio_sample_rate );
-                    aohp->output_bits_per_sample = MAX( aohp->output_bits_per_sample, bits_per_sample );
-                    ++audio_sample_count;
-                    audio_frame_info_t *info = &audio_info[audio_sample_count];
-                    memset( info, 0, sizeof(audio_frame_info_t) );
-                    info->pts             = pts;
-                    info->dts             = dts;
-                    info->file_offset     = pos;
-                    info->sample_number   = audio_sample_count;
-                    info->extradata_index = extradata_index;
-                    info->sample_rate     = sample_rate;
-                }
-                else
-                    for( uint32_t i = 1; i <= adhp->exh.delay_count; i++ )
-                    {
-                        uint32_t audio_frame_number = audio_sample_count - adhp->exh.delay_count + i;
-                        if( audio_frame_number > audio_sample_count )
-                            goto fail_parsing;
-                        audio_info[audio_frame_number].length = frame_length;
-                        if( audio_frame_number > 1 && audio_info[audio_frame_number].length != audio_info[audio_frame_number - 1].length )
-                            constant_frame_length = 0;
-                        audio_duration += frame_length;
-                    }
-                if( audio_sample_count + 1 == audio_info_count )
-                {
-                    audio_info_count <<= 1;
-                    audio_frame_info_t *temp = (audio_frame_info_t *)realloc( audio_info, audio_info_count * sizeof(audio_frame_info_t) );
-                    if( !temp )
-                        goto fail_parsing;
-                    audio_info = temp;
-                }
-                if( frame_length == -1 )
-                    ++ adhp->exh.delay_count;
-                else if( audio_sample_count > adhp->exh.delay_count )
-                {
-                    uint32_t audio_frame_number = audio_sample_count - adhp->exh.delay_count;
-                    audio_info[audio_frame_number].length = frame_length;
-                    if( audio_frame_number > 1 && audio_info[audio_frame_number].length != audio_info[audio_frame_number - 1].length )
-                        constant_frame_length = 0;
-                    audio_duration += frame_length;
-                }
-            }
+            int frame_length;
+            if( sscanf( buf, "Length=%d", &frame_length ) != 1 )
+                goto fail_parsing;
+            record.length = frame_length;
         }
+        if( parse_index_packet( &ip, vdhp, adhp, aohp, opt, stream_info, &record ) )
+            goto fail_parsing;
         if( !fgets( buf, sizeof(buf), index ) )
             goto fail_parsing;
     }
-    if( video_present && opt->force_video && opt->force_video_index != -1
-     && (video_sample_count == 0 || vdhp->initial_pix_fmt == AV_PIX_FMT_NONE || vdhp->initial_width == 0 || vdhp->initial_height == 0) )
-        goto fail_parsing;  /* Need to re-create the index file. */
-    if( audio_present && opt->force_audio && opt->force_audio_index != -1 && (audio_sample_count == 0 || audio_duration == 0) )
-        goto fail_parsing;  /* Need to re-create the index file. */
+    if( check_parsed_streams( &ip, vdhp, opt, active_video_index, active_audio_index ) )
+        goto fail_parsing;
     if( strncmp( buf, "</LibavReaderIndex>", strlen( "</LibavReaderIndex>" ) ) )
         goto fail_parsing;
     /* Parse stream durations. */
@@ -3321,8 +5780,8 @@ static int parse_index
                 if( !alloc_extradata_entries( exhp, entry_count ) )
                     goto fail_parsing;
                 exhp->current_index = codec_type == AVMEDIA_TYPE_VIDEO
-                                    ? video_info[1].extradata_index
-                                    : audio_info[1].extradata_index;
+                                    ? ip.video_info[1].extradata_index
+                                    : ip.audio_info[1].extradata_index;
                 for( int i = 0; i < exhp->entry_count; i++ )
                 {
                     lwlibav_extradata_t *entry = &exhp->entries[i];
@@ -3385,167 +5844,1082 @@ static int parse_index
         }
         if( strncmp( buf, "</ExtraDataList>", strlen( "</ExtraDataList>" ) ) )
             goto fail_parsing;
-        if( !fgets( buf, sizeof(buf), index ) )
+        if( !fgets( buf, sizeof(buf), index ) )
+            goto fail_parsing;
+    }
+    if( !strncmp( buf, "</LibavReaderIndexFile>", strlen( "</LibavReaderIndexFile>" ) )
+     && finish_index_parsing( &ip, lwhp, vdhp, vohp, adhp, aohp, opt, active_video_index ) == 0 )
+    {
+        if( vdhp->stream_index != active_video_index || adhp->stream_index != active_audio_index )
+        {
+            /* Update the active stream indexes when specifying different stream indexes. */
+            fseek( index, active_index_pos, SEEK_SET );
+            fprintf( index, "<ActiveVideoStreamIndex>%+011d</ActiveVideoStreamIndex>\n", vdhp->stream_index );
+            fprintf( index, "<ActiveAudioStreamIndex>%+011d</ActiveAudioStreamIndex>\n", adhp->stream_index );
+        }
+        *default_audio_index = default_audio;
+        free( stream_info );
+        return 0;
+    }
+fail_parsing:
+    cleanup_index_parser( &ip, vdhp, adhp );
+    free( stream_info );
+    return -1;
+}
+
+typedef struct
+{
+    const uint8_t *data;
+    uint64_t       size;
+    uint8_t       *buffer;  /* Used instead of the mapping if the index file cannot be mapped. */
+#ifdef _WIN32
+    HANDLE         mapping;
+#endif
+} lwindex_map_t;
+
+static int map_index_file
+(
+    lwindex_map_t *map,
+    FILE          *index
+)
+{
+    memset( map, 0, sizeof(lwindex_map_t) );
+#ifdef _WIN32
+    struct _stat64 index_stat;
+    if( _fstat64( _fileno( index ), &index_stat ) || index_stat.st_size <= 0 )
+        return -1;
+    map->size    = index_stat.st_size;
+    map->mapping = CreateFileMappingW( (HANDLE)_get_osfhandle( _fileno( index ) ), NULL, PAGE_READONLY, 0, 0, NULL );
+    if( map->mapping )
+    {
+        map->data = (const uint8_t *)MapViewOfFile( map->mapping, FILE_MAP_READ, 0, 0, 0 );
+        if( map->data )
+            return 0;
+        CloseHandle( map->mapping );
+        map->mapping = NULL;
+    }
+#else
+    struct stat index_stat;
+    if( fstat( fileno( index ), &index_stat ) || index_stat.st_size <= 0 )
+        return -1;
+    map->size = index_stat.st_size;
+    void *data = mmap( NULL, map->size, PROT_READ, MAP_SHARED, fileno( index ), 0 );
+    if( data != MAP_FAILED )
+    {
+        map->data = (const uint8_t *)data;
+        return 0;
+    }
+#endif
+    /* Fall back to reading the whole index file. */
+    map->buffer = (uint8_t *)malloc( map->size );
+    if( !map->buffer )
+        return -1;
+    fseek( index, 0, SEEK_SET );
+    if( fread( map->buffer, 1, map->size, index ) != map->size )
+    {
+        lw_freep( &map->buffer );
+        return -1;
+    }
+    map->data = map->buffer;
+    return 0;
+}
+
+static void unmap_index_file
+(
+    lwindex_map_t *map
+)
+{
+    if( map->buffer )
+        lw_freep( &map->buffer );
+    else if( map->data )
+    {
+#ifdef _WIN32
+        UnmapViewOfFile( map->data );
+        CloseHandle( map->mapping );
+#else
+        munmap( (void *)map->data, map->size );
+#endif
+    }
+    map->data = NULL;
+}
+
+/* Check if a section lies within the index file. */
+static inline int check_index_section
+(
+    const lwindex_map_t *map,
+    uint64_t             offset,
+    uint64_t             count,
+    uint64_t             record_size
+)
+{
+    if( count == 0 )
+        return 0;
+    return (offset & 7) || offset > map->size || count > (map->size - offset) / record_size ? -1 : 0;
+}
+
+/* Return the header if the index file is a complete binary index file of this version. Otherwise return NULL. */
+static const lwindex_binary_header_t *check_binary_index_header
+(
+    const lwindex_map_t *map
+)
+{
+    const lwindex_binary_header_t *header = (const lwindex_binary_header_t *)map->data;
+    if( map->size < sizeof(lwindex_binary_header_t)
+     || memcmp( header->magic, LWINDEX_BINARY_MAGIC, sizeof(header->magic) )
+     || header->lwindex_version    != LWINDEX_VERSION
+     || header->index_file_version != LWINDEX_BINARY_INDEX_FILE_VERSION
+     || header->header_size        != sizeof(lwindex_binary_header_t)
+     || header->path_length >= 512
+     || check_index_section( map, header->path_offset,        header->path_length,       1 )
+     || check_index_section( map, header->stream_info_offset, header->stream_info_count, sizeof(lwindex_binary_stream_info_t) )
+     || check_index_section( map, header->packet_offset,      header->packet_count,      sizeof(lwindex_packet_record_t) )
+     || check_index_section( map, header->duration_offset,    header->duration_count,    sizeof(lwindex_binary_duration_t) )
+     || check_index_section( map, header->index_entry_offset, header->index_entry_count, sizeof(lwindex_binary_index_entry_t) )
+     || check_index_section( map, header->extradata_offset,   header->extradata_count,   sizeof(lwindex_binary_extradata_t) ) )
+        return NULL;
+    return header;
+}
+
+static int parse_binary_index
+(
+    lwlibav_file_handler_t         *lwhp,
+    lwlibav_video_decode_handler_t *vdhp,
+    lwlibav_video_output_handler_t *vohp,
+    lwlibav_audio_decode_handler_t *adhp,
+    lwlibav_audio_output_handler_t *aohp,
+    lwlibav_option_t               *opt,
+    FILE                           *index,
+    int                            *default_audio_index
+)
+{
+    lwindex_map_t map;
+    if( map_index_file( &map, index ) )
+        return -1;
+    lwindex_parser_t ip;
+    lwindex_stream_info_t *stream_info = NULL;
+    int stream_info_count = 0;
+    memset( &ip, 0, sizeof(lwindex_parser_t) );
+    const lwindex_binary_header_t *header = check_binary_index_header( &map );
+    if( !header )
+        goto fail_parsing;
+    char file_path[512] = { 0 };
+    char format_name[64];
+    memcpy( file_path, map.data + header->path_offset, header->path_length );
+    memcpy( format_name, header->format_name, sizeof(format_name) );
+    format_name[sizeof(format_name) - 1] = '\0';
+    if( check_index_source( lwhp, opt, file_path, header->file_size, header->file_last_modification_time, header->file_hash, 0 ) )
+        goto fail_parsing;
+    lwhp->format_flags = header->format_flags;
+    lwhp->raw_demuxer  = header->raw_demuxer;
+    lwhp->format_name  = format_name;
+    adhp->dv_in_avi = !strcmp( lwhp->format_name, "avi" ) ? -1 : 0;
+    int active_video_index = header->active_video_index;
+    int active_audio_index = header->active_audio_index;
+    if( setup_index_parser( &ip, vdhp, adhp, aohp, opt, active_video_index, active_audio_index, header->default_audio_index ) )
+        goto fail_parsing;
+    /* Stream information */
+    const lwindex_binary_stream_info_t *streams = (const lwindex_binary_stream_info_t *)(map.data + header->stream_info_offset);
+    for( uint32_t i = 0; i < header->stream_info_count; i++ )
+        if( streams[i].stream_index < 0 )
+            goto fail_parsing;
+        else if( stream_info_count <= streams[i].stream_index )
+            stream_info_count = streams[i].stream_index + 1;
+    if( stream_info_count > 0 )
+    {
+        stream_info = (lwindex_stream_info_t *)lw_malloc_zero( stream_info_count * sizeof(lwindex_stream_info_t) );
+        if( !stream_info )
+            goto fail_parsing;
+    }
+    for( uint32_t i = 0; i < header->stream_info_count; i++ )
+    {
+        lwindex_stream_info_t *info = &stream_info[ streams[i].stream_index ];
+        info->codec_type      = streams[i].codec_type;
+        info->codec_id        = streams[i].codec_id;
+        info->time_base.num   = streams[i].time_base_num;
+        info->time_base.den   = streams[i].time_base_den;
+        info->width           = streams[i].width;
+        info->height          = streams[i].height;
+        info->colorspace      = streams[i].colorspace;
+        info->channels        = streams[i].channels;
+        info->layout          = streams[i].layout;
+        info->sample_rate     = streams[i].sample_rate;
+        info->bits_per_sample = streams[i].bits_per_sample;
+        memcpy( info->fmt, streams[i].fmt, sizeof(info->fmt) );
+        info->fmt[sizeof(info->fmt) - 1] = '\0';
+    }
+    /* Packets are used in place. */
+    const lwindex_packet_record_t *records = (const lwindex_packet_record_t *)(map.data + header->packet_offset);
+    for( uint32_t i = 0; i < header->packet_count; i++ )
+    {
+        if( records[i].stream_index < 0 || records[i].stream_index >= stream_info_count )
+            goto fail_parsing;
+        if( parse_index_packet( &ip, vdhp, adhp, aohp, opt, stream_info, &records[i] ) )
             goto fail_parsing;
     }
-    if( !strncmp( buf, "</LibavReaderIndexFile>", strlen( "</LibavReaderIndexFile>" ) ) )
+    if( check_parsed_streams( &ip, vdhp, opt, active_video_index, active_audio_index ) )
+        goto fail_parsing;
+    /* Stream durations */
+    const lwindex_binary_duration_t *durations = (const lwindex_binary_duration_t *)(map.data + header->duration_offset);
+    for( uint32_t i = 0; i < header->duration_count; i++ )
+        if( durations[i].codec_type == AVMEDIA_TYPE_VIDEO && durations[i].stream_index == vdhp->stream_index )
+            vdhp->stream_duration = durations[i].duration;
+    /* AVIndexEntry */
+    const lwindex_binary_index_entry_t *entries = (const lwindex_binary_index_entry_t *)(map.data + header->index_entry_offset);
+    for( int pass = 0; pass < 2; pass++ )
     {
-        if( vdhp->stream_index >= 0 )
+        /* Count the entries at the first pass, and then store them at the second pass. */
+        vdhp->index_entries_count = 0;
+        adhp->index_entries_count = 0;
+        for( uint32_t i = 0; i < header->index_entry_count; i++ )
+        {
+            lwlibav_decode_handler_t *dhp;
+            if( entries[i].codec_type == AVMEDIA_TYPE_VIDEO && entries[i].stream_index == vdhp->stream_index )
+                dhp = (lwlibav_decode_handler_t *)vdhp;
+            else if( entries[i].codec_type == AVMEDIA_TYPE_AUDIO && entries[i].stream_index == adhp->stream_index )
+                dhp = (lwlibav_decode_handler_t *)adhp;
+            else
+                continue;
+            if( pass == 1 )
+            {
+                AVIndexEntry *ie = &dhp->index_entries[ dhp->index_entries_count ];
+                ie->pos          = entries[i].pos;
+                ie->timestamp    = entries[i].timestamp;
+                ie->flags        = entries[i].flags;
+                ie->size         = entries[i].size;
+                ie->min_distance = entries[i].min_distance;
+            }
+            ++ dhp->index_entries_count;
+        }
+        if( pass == 0 )
         {
-            vdhp->keyframe_list = (uint8_t *)lw_malloc_zero( (video_sample_count + 1) * sizeof(uint8_t) );
-            if( !vdhp->keyframe_list )
+            if( vdhp->index_entries_count > 0
+             && !(vdhp->index_entries = (AVIndexEntry *)av_malloc( vdhp->index_entries_count * sizeof(AVIndexEntry) )) )
                 goto fail_parsing;
-            vdhp->frame_list  = video_info;
-            vdhp->frame_count = video_sample_count;
-            if( decide_video_seek_method( lwhp, vdhp, video_sample_count ) )
+            if( adhp->index_entries_count > 0
+             && !(adhp->index_entries = (AVIndexEntry *)av_malloc( adhp->index_entries_count * sizeof(AVIndexEntry) )) )
                 goto fail_parsing;
-            /* Compute the stream duration. */
-            compute_stream_duration( lwhp, vdhp, vdhp->stream_duration );
-            /* Create the repeat control info. */
-            create_video_frame_order_list( vdhp, vohp, opt );
-            /* Exclude invisible frames from the output handler. */
-            create_video_visible_frame_list( vdhp, vohp, invisible_count );
         }
-        if( adhp->stream_index >= 0 )
+    }
+    /* Extradata */
+    for( int pass = 0; pass < 2; pass++ )
+    {
+        /* Count the entries at the first pass, and then store them at the second pass. */
+        int video_entry_count = 0;
+        int audio_entry_count = 0;
+        uint64_t offset = header->extradata_offset;
+        for( uint32_t i = 0; i < header->extradata_count; i++ )
         {
-            if( adhp->dv_in_avi == 1 && adhp->index_entries_count == 0 )
+            if( check_index_section( &map, offset, 1, sizeof(lwindex_binary_extradata_t) ) )
+                goto fail_parsing;
+            const lwindex_binary_extradata_t *record = (const lwindex_binary_extradata_t *)(map.data + offset);
+            offset += sizeof(lwindex_binary_extradata_t);
+            if( record->extradata_size < 0 || check_index_section( &map, offset, record->extradata_size, 1 ) )
+                goto fail_parsing;
+            const uint8_t *extradata = map.data + offset;
+            offset += LWINDEX_BINARY_ALIGN( record->extradata_size );
+            lwlibav_extradata_handler_t *exhp;
+            int *entry_count;
+            if( record->codec_type == AVMEDIA_TYPE_VIDEO && record->stream_index == vdhp->stream_index )
             {
-                /* DV in AVI Type-1 */
-                audio_sample_count = MIN( video_sample_count, audio_sample_count );
-                for( uint32_t i = 0; i <= audio_sample_count; i++ )
-                {
-                    audio_info[i].keyframe        = !!(video_info[i].flags & LW_VFRAME_FLAG_KEY);
-                    audio_info[i].sample_number   = video_info[i].sample_number;
-                    audio_info[i].pts             = video_info[i].pts;
-                    audio_info[i].dts             = video_info[i].dts;
-                    audio_info[i].file_offset     = video_info[i].file_offset;
-                    audio_info[i].extradata_index = video_info[i].extradata_index;
-                }
+                exhp        = &vdhp->exh;
+                entry_count = &video_entry_count;
+            }
+            else if( record->codec_type == AVMEDIA_TYPE_AUDIO && record->stream_index == adhp->stream_index )
+            {
+                exhp        = &adhp->exh;
+                entry_count = &audio_entry_count;
             }
             else
+                continue;
+            if( pass == 1 && import_binary_extradata( &exhp->entries[ *entry_count ], record, extradata ) < 0 )
+                goto fail_parsing;
+            ++ *entry_count;
+        }
+        if( pass == 0 )
+        {
+            if( video_entry_count > 0 )
             {
-                if( adhp->dv_in_avi == 1 && ((!opt->force_video && active_video_index == -1) || (opt->force_video && opt->force_video_index == -1)) )
-                {
-                    /* Disable DV video stream. */
-                    disable_video_stream( vdhp );
-                    video_info = NULL;
-                }
-                adhp->dv_in_avi = 0;
+                if( !alloc_extradata_entries( &vdhp->exh, video_entry_count ) )
+                    goto fail_parsing;
+                vdhp->exh.current_index = ip.video_info[1].extradata_index;
+            }
+            if( audio_entry_count > 0 )
+            {
+                if( !alloc_extradata_entries( &adhp->exh, audio_entry_count ) )
+                    goto fail_parsing;
+                adhp->exh.current_index = ip.audio_info[1].extradata_index;
             }
-            adhp->frame_list   = audio_info;
-            adhp->frame_count  = audio_sample_count;
-            adhp->frame_length = constant_frame_length ? audio_info[1].length : 0;
-            decide_audio_seek_method( lwhp, adhp, audio_sample_count );
-            if( opt->av_sync && vdhp->stream_index >= 0 )
-                lwhp->av_gap = calculate_av_gap( vdhp, vohp, adhp, audio_sample_rate );
         }
-        if( vdhp->stream_index != active_video_index || adhp->stream_index != active_audio_index )
+    }
+    if( finish_index_parsing( &ip, lwhp, vdhp, vohp, adhp, aohp, opt, active_video_index ) )
+        goto fail_parsing;
+    *default_audio_index = header->default_audio_index;
+    unmap_index_file( &map );
+    if( vdhp->stream_index != active_video_index || adhp->stream_index != active_audio_index )
+    {
+        /* Update the active stream indexes when specifying different stream indexes. */
+        int32_t active_index[2] = { vdhp->stream_index, adhp->stream_index };
+        fseek( index, offsetof( lwindex_binary_header_t, active_video_index ), SEEK_SET );
+        fwrite( active_index, sizeof(int32_t), 2, index );
+    }
+    free( stream_info );
+    return 0;
+fail_parsing:
+    unmap_index_file( &map );
+    cleanup_index_parser( &ip, vdhp, adhp );
+    free( stream_info );
+    return -1;
+}
+
+/* Load the checkpoint from the binary index file if the input file has grown since indexing.
+ * Return 0 on success. Otherwise return a negative value. */
+static int load_index_checkpoint
+(
+    lwlibav_file_handler_t *lwhp,
+    lwlibav_option_t       *opt,
+    FILE                   *index,
+    lwindex_checkpoint_t   *checkpoint
+)
+{
+    if( !lwhp->file_path )
+        return -1;
+#ifdef _WIN32
+    wchar_t *wname = NULL;
+    struct _stat64 file_stat;
+    int err;
+    if( lw_string_to_wchar( CP_UTF8, lwhp->file_path, &wname ) )
+    {
+        err = _wstat64( wname, &file_stat );
+        lw_free( wname );
+    }
+    else
+        err = _stat64( lwhp->file_path, &file_stat );
+    if( err )
+        return -1;
+#else
+    struct stat file_stat;
+    if( stat( lwhp->file_path, &file_stat ) )
+        return -1;
+#endif
+    lwindex_map_t map;
+    if( map_index_file( &map, index ) )
+        return -1;
+    memset( checkpoint, 0, sizeof(lwindex_checkpoint_t) );
+    const lwindex_binary_header_t *header = check_binary_index_header( &map );
+    if( !header
+     || header->checkpoint_pos <= 0
+     || header->head_hash == 0
+     || header->active_video_index < 0
+     || (header->active_audio_index == -2) != (opt->force_audio_index == -2)
+     || strncmp( header->format_name, "mpegts", sizeof(header->format_name) )
+     || file_stat.st_size <= header->file_size
+     || xxhash_file_head( lwhp->file_path, header->file_size ) != header->head_hash )
+        goto fail;
+    checkpoint->pos                = header->checkpoint_pos;
+    checkpoint->video_stream_index = header->active_video_index;
+    /* Stream information */
+    if( header->stream_info_count > 0 )
+    {
+        checkpoint->streams = (lwindex_binary_stream_info_t *)lw_malloc_zero( header->stream_info_count * sizeof(lwindex_binary_stream_info_t) );
+        if( !checkpoint->streams )
+            goto fail;
+        memcpy( checkpoint->streams, map.data + header->stream_info_offset, header->stream_info_count * sizeof(lwindex_binary_stream_info_t) );
+        checkpoint->stream_count = header->stream_info_count;
+    }
+    /* Packets before the checkpoint */
+    const lwindex_packet_record_t *records = (const lwindex_packet_record_t *)(map.data + header->packet_offset);
+    if( header->packet_count > 0 )
+    {
+        checkpoint->records = (lwindex_packet_record_t *)lw_malloc_zero( header->packet_count * sizeof(lwindex_packet_record_t) );
+        if( !checkpoint->records )
+            goto fail;
+    }
+    for( uint32_t i = 0; i < header->packet_count; i++ )
+        if( records[i].pos >= 0 && records[i].pos < checkpoint->pos )
+            checkpoint->records[ checkpoint->record_count++ ] = records[i];
+    /* Extradata */
+    uint64_t offset = header->extradata_offset;
+    for( uint32_t i = 0; i < header->extradata_count; i++ )
+    {
+        if( check_index_section( &map, offset, 1, sizeof(lwindex_binary_extradata_t) ) )
+            goto fail;
+        const lwindex_binary_extradata_t *record = (const lwindex_binary_extradata_t *)(map.data + offset);
+        offset += sizeof(lwindex_binary_extradata_t);
+        if( record->extradata_size < 0 || check_index_section( &map, offset, record->extradata_size, 1 ) )
+            goto fail;
+        offset += LWINDEX_BINARY_ALIGN( record->extradata_size );
+    }
+    if( offset > header->extradata_offset )
+    {
+        checkpoint->extradata = (uint8_t *)lw_malloc_zero( offset - header->extradata_offset );
+        if( !checkpoint->extradata )
+            goto fail;
+        memcpy( checkpoint->extradata, map.data + header->extradata_offset, offset - header->extradata_offset );
+        checkpoint->extradata_count = header->extradata_count;
+    }
+    /* The index file is replaced by indexing, so the mapping is not kept. */
+    unmap_index_file( &map );
+    return 0;
+fail:
+    unmap_index_file( &map );
+    cleanup_index_checkpoint( checkpoint );
+    return -1;
+}
+
+/* Try to open and parse the existing index file.
+ * Return 1 if parsed, 0 if the index file needs to be created, or a negative value on error.
+ * The default audio stream recorded in the index file is returned via 'default_audio_index' if parsed. */
+static int open_index_file
+(
+    lwlibav_file_handler_t         *lwhp,
+    lwlibav_video_decode_handler_t *vdhp,
+    lwlibav_video_output_handler_t *vohp,
+    lwlibav_audio_decode_handler_t *adhp,
+    lwlibav_audio_output_handler_t *aohp,
+    lwlibav_option_t               *opt,
+    lwindex_checkpoint_t           *checkpoint,
+    int                            *resumable,
+    int                            *default_audio_index
+)
+{
+    size_t file_path_length = strlen( opt->file_path );
+    const char *ext = file_path_length >= 5 ? &opt->file_path[file_path_length - 4] : NULL;
+    int has_lwi_ext = ext && !strncmp( ext, ".lwi", strlen( ".lwi" ) );
+    FILE *index;
+    if( has_lwi_ext )
+        index = lw_fopen( opt->file_path, (opt->force_video || opt->force_audio) ? "r+b" : "rb" );
+    else if( opt->index_file_path )
+        index = lw_fopen( opt->index_file_path, (opt->force_video || opt->force_audio) ? "r+b" : "rb" );
+    else
+    {
+        char *index_file_path = create_lwi_path ( opt );
+        if( !index_file_path )
+            return -1;
+        index = lw_fopen( index_file_path, (opt->force_video || opt->force_audio) ? "r+b" : "rb" );
+        free( index_file_path );
+    }
+    *resumable = 0;
+    if( !index )
+        return 0;
+    uint8_t lwindex_version[4] = { 0 };
+    int index_file_version = 0;
+    int parsed;
+    char magic[4] = { 0 };
+    if( fread( magic, 1, sizeof(magic), index ) == sizeof(magic) && !memcmp( magic, LWINDEX_BINARY_MAGIC, sizeof(magic) ) )
+    {
+        /* The binary index file is re-created as the text one if the text index file is requested. */
+        parsed = !opt->text_index
+              && parse_binary_index( lwhp, vdhp, vohp, adhp, aohp, opt, index, default_audio_index ) == 0;
+        /* Index only the appended part if the input file has grown. */
+        *resumable = !parsed && !opt->text_index && !opt->no_create_index
+                  && load_index_checkpoint( lwhp, opt, index, checkpoint ) == 0;
+    }
+    else
+    {
+        rewind( index );
+        parsed = 4 == fscanf( index, "<LSMASHWorksIndexVersion=%" SCNu8 ".%" SCNu8 ".%" SCNu8 ".%" SCNu8 ">\n",
+                              &lwindex_version[0], &lwindex_version[1], &lwindex_version[2], &lwindex_version[3] )
+              && ((lwindex_version[0] << 24) | (lwindex_version[1] << 16) | (lwindex_version[2] << 8) | lwindex_version[3]) == LWINDEX_VERSION
+              && 1 == fscanf( index, "<LibavReaderIndexFile=%d>\n", &index_file_version )
+              && index_file_version == LWINDEX_INDEX_FILE_VERSION
+              && parse_index( lwhp, vdhp, vohp, adhp, aohp, opt, index, default_audio_index ) == 0;
+    }
+    fclose( index );
+    return parsed;
+}
+
+/* Lock the index file across processes by its lock file.
+ * Return NULL if failed. */
+static lw_file_lock_t *lock_index_file
+(
+    const char *index_path
+)
+{
+    char *lock_path = (char *)lw_malloc_zero( strlen( index_path ) + sizeof(".lock") );
+    if( !lock_path )
+        return NULL;
+    sprintf( lock_path, "%s.lock", index_path );
+    lw_file_lock_t *lock = lw_file_lock( lock_path );
+    lw_free( lock_path );
+    return lock;
+}
+
+static int construct_index
+(
+    lwlibav_file_handler_t         *lwhp,
+    lwlibav_video_decode_handler_t *vdhp,
+    lwlibav_video_output_handler_t *vohp,
+    lwlibav_audio_decode_handler_t *adhp,
+    lwlibav_audio_output_handler_t *aohp,
+    lw_log_handler_t               *lhp,
+    lwlibav_option_t               *opt,
+    progress_indicator_t           *indicator,
+    progress_handler_t             *php,
+    int                            *default_audio_index
+)
+{
+    /* Try to open the index file. */
+    lwindex_checkpoint_t checkpoint = { 0 };
+    int resumable;
+    int parsed = open_index_file( lwhp, vdhp, vohp, adhp, aohp, opt, &checkpoint, &resumable, default_audio_index );
+    if( parsed < 0 )
+        return -1;
+    char           *index_path = NULL;
+    lw_file_lock_t *lock       = NULL;
+    if( !parsed && !opt->no_create_index )
+    {
+        index_path = opt->index_file_path ? duplicate_string( opt->index_file_path ) : create_lwi_path( opt );
+        if( !index_path )
+            goto fail;
+        /* Only one process creates the index file at a time.
+         * The others wait for it and then use the created index file. */
+        lock = lock_index_file( index_path );
+        if( lock )
         {
-            /* Update the active stream indexes when specifying different stream indexes. */
-            fseek( index, active_index_pos, SEEK_SET );
-            fprintf( index, "<ActiveVideoStreamIndex>%+011d</ActiveVideoStreamIndex>\n", vdhp->stream_index );
-            fprintf( index, "<ActiveAudioStreamIndex>%+011d</ActiveAudioStreamIndex>\n", adhp->stream_index );
+            cleanup_index_checkpoint( &checkpoint );
+            if( lwhp->file_path )
+                lw_freep( &lwhp->file_path );
+            parsed = open_index_file( lwhp, vdhp, vohp, adhp, aohp, opt, &checkpoint, &resumable, default_audio_index );
+            if( parsed < 0 )
+                goto fail;
+        }
+        else
+        {
+            /* Without the lock, the temporary index file could be written by another process at the same time.
+             * Index the file only in memory. */
+            lw_log_show( lhp, LW_LOG_WARNING, "Failed to lock the index file. The index file is not created." );
+            lw_freep( &index_path );
+        }
+    }
+    if( parsed )
+    {
+        /* Opening and parsing the index file succeeded. */
+        lw_file_unlock( lock );
+        lw_free( index_path );
+        lwhp->threads = opt->threads;
+        return 0;
+    }
+    size_t file_path_length = strlen( opt->file_path );
+    const char *ext = file_path_length >= 5 ? &opt->file_path[file_path_length - 4] : NULL;
+    int has_lwi_ext = ext && !strncmp( ext, ".lwi", strlen( ".lwi" ) );
+    /* Open file. */
+    if( !lwhp->file_path )
+    {
+        lwhp->file_path = (char *)lw_malloc_zero( file_path_length + 1 );
+        if( !lwhp->file_path )
+            goto fail;
+        memcpy( lwhp->file_path, opt->file_path, file_path_length );
+        if( has_lwi_ext )
+            lwhp->file_path[file_path_length - 4] = '\0';
+    }
+    AVFormatContext *format_ctx = NULL;
+    if( lavf_open_file( &format_ctx, lwhp->file_path, lhp ) )
+    {
+        if( format_ctx )
+            lavf_close_file( &format_ctx );
+        goto fail;
+    }
+    lwhp->threads      = opt->threads;
+    vdhp->stream_index = -1;
+    adhp->stream_index = opt->force_audio_index;
+    /* Create the index file. */
+    int err = create_index( lwhp, vdhp, vohp, adhp, aohp, format_ctx, index_path, opt, resumable ? &checkpoint : NULL, indicator, php );
+    if( err && checkpoint.failed )
+    {
+        /* The file does not continue from the checkpoint. Index the whole file again. */
+        lavf_close_file( &format_ctx );
+        if( lavf_open_file( &format_ctx, lwhp->file_path, lhp ) )
+        {
+            if( format_ctx )
+                lavf_close_file( &format_ctx );
+            goto fail;
         }
+        vdhp->stream_index = -1;
+        adhp->stream_index = opt->force_audio_index;
+        err = create_index( lwhp, vdhp, vohp, adhp, aohp, format_ctx, index_path, opt, NULL, indicator, php );
+    }
+    /* The first active audio stream becomes the default one unless the audio stream is specified. */
+    *default_audio_index = opt->force_audio_index == -1 ? adhp->stream_index : -1;
+    cleanup_index_checkpoint( &checkpoint );
+    lw_file_unlock( lock );
+    lw_free( index_path );
+    /* Close file.
+     * By opening file for video and audio separately, indecent work about frame reading can be avoidable. */
+    lavf_close_file( &format_ctx );
+    vdhp->ctx = NULL;
+    adhp->ctx = NULL;
+    return err;
+fail:
+    cleanup_index_checkpoint( &checkpoint );
+    lw_file_unlock( lock );
+    lw_free( index_path );
+    if( lwhp->file_path )
+        lw_freep( &lwhp->file_path );
+    return -1;
+}
+
+/* Return the file offset of the keyframe flag of the video packet in the text index file.
+ * Return -1 if not found or found more than once. The flag may be already cleared by another instance. */
+static int64_t find_text_index_keyframe_flag
+(
+    FILE   *index,
+    int     stream_index,
+    int64_t file_offset
+)
+{
+    int64_t flag_pos = -1;
+    char buf[1024];
+    while( fgets( buf, sizeof(buf), index ) )
+    {
+        if( !strncmp( buf, "</LibavReaderIndex>", strlen( "</LibavReaderIndex>" ) ) )
+            break;
+        int     index_number;
+        int64_t pos;
+        if( sscanf( buf, "Index=%d,POS=%" SCNd64 ",", &index_number, &pos ) != 2 )
+            continue;
+        int64_t line_pos = lw_ftell( index );
+        if( !fgets( buf, sizeof(buf), index ) )
+            break;
+        if( index_number != stream_index || pos != file_offset || strncmp( buf, "Key=", strlen( "Key=" ) ) )
+            continue;
+        if( flag_pos != -1 )
+            return -1;
+        flag_pos = line_pos + strlen( "Key=" );
+    }
+    return flag_pos;
+}
+
+/* Return the file offset of the keyframe flag of the video packet in the binary index file.
+ * Return -1 if not found or found more than once. */
+static int64_t find_binary_index_keyframe_flag
+(
+    FILE   *index,
+    int     stream_index,
+    int64_t file_offset
+)
+{
+    lwindex_binary_header_t header;
+    rewind( index );
+    if( fread( &header, 1, sizeof(lwindex_binary_header_t), index ) != sizeof(lwindex_binary_header_t)
+     || memcmp( header.magic, LWINDEX_BINARY_MAGIC, sizeof(header.magic) )
+     || header.lwindex_version    != LWINDEX_VERSION
+     || header.index_file_version != LWINDEX_BINARY_INDEX_FILE_VERSION
+     || header.header_size        != sizeof(lwindex_binary_header_t)
+     || lw_fseek( index, header.packet_offset, SEEK_SET ) )
+        return -1;
+    int64_t flag_pos = -1;
+    for( uint32_t i = 0; i < header.packet_count; i++ )
+    {
+        lwindex_packet_record_t record;
+        if( fread( &record, 1, sizeof(lwindex_packet_record_t), index ) != sizeof(lwindex_packet_record_t) )
+            return -1;
+        if( record.stream_index != stream_index || record.pos != file_offset )
+            continue;
+        if( flag_pos != -1 )
+            return -1;
+        flag_pos = header.packet_offset + i * (int64_t)sizeof(lwindex_packet_record_t)
+                 + offsetof( lwindex_packet_record_t, key );
+    }
+    return flag_pos;
+}
+
+int lwindex_clear_keyframe_flag
+(
+    const char *index_file_path,
+    int         stream_index,
+    int64_t     file_offset
+)
+{
+    /* The index file could be being created or replaced by another process. */
+    lw_file_lock_t *lock = lock_index_file( index_file_path );
+    if( !lock )
+        return -1;
+    FILE *index = lw_fopen( index_file_path, "r+b" );
+    if( !index )
+    {
+        lw_file_unlock( lock );
+        return -1;
+    }
+    /* The flag is overwritten in place since the cleared flag takes the same size in both formats. */
+    char magic[4] = { 0 };
+    int is_binary = fread( magic, 1, sizeof(magic), index ) == sizeof(magic)
+                 && !memcmp( magic, LWINDEX_BINARY_MAGIC, sizeof(magic) );
+    rewind( index );
+    int64_t flag_pos = is_binary ? find_binary_index_keyframe_flag( index, stream_index, file_offset )
+                                 : find_text_index_keyframe_flag  ( index, stream_index, file_offset );
+    int ret = -1;
+    if( flag_pos != -1 && lw_fseek( index, flag_pos, SEEK_SET ) == 0 )
+    {
+        int8_t key = 0;
+        ret = is_binary ? (fwrite( &key, 1, 1, index ) == 1 ? 0 : -1)
+                        : (fputc( '0', index ) == EOF ? -1 : 0);
+    }
+    if( fclose( index ) )
+        ret = -1;
+    lw_file_unlock( lock );
+    return ret;
+}
+
+/*****************************************************************************
+ * Index cache
+ *****************************************************************************/
+/* The frame lists, the extradata lists and the stream information are never modified after the index is
+ * constructed. The source instances of the same file in the process share them instead of reading and
+ * parsing the index file again. Each decode handler holds a reference, and the last one frees them. */
+struct lwlibav_index_cache_tag
+{
+    lwlibav_index_cache_t         *next;
+    int                            reference_count;
+    char                          *source_path;                 /* canonical path of the input file */
+    int64_t                        file_size;
+    int64_t                        file_last_modification_time;
+    int                            force_video;
+    int                            default_audio_index;
+    char                          *file_path;
+    int                            format_flags;
+    int                            raw_demuxer;
+    lwlibav_video_decode_handler_t vdh;                         /* only the fields shared by copy_shared_video_index() */
+    lwlibav_audio_decode_handler_t adh;                         /* only the fields shared by copy_shared_audio_index() */
+    AVChannelLayout                output_channel_layout;
+    enum AVSampleFormat            output_sample_format;
+    int                            output_sample_rate;
+    int                            output_bits_per_sample;
+};
+
+typedef struct
+{
+    char   *source_path;
+    int64_t file_size;
+    int64_t file_last_modification_time;
+} lwindex_cache_key_t;
+
+static lwlibav_index_cache_t *index_cache_list = NULL;   /* protected by lw_process_mutex() */
+
+static void copy_shared_video_index
+(
+    lwlibav_video_decode_handler_t       *dst,
+    const lwlibav_video_decode_handler_t *src
+)
+{
+    dst->stream_index        = src->stream_index;
+    dst->codec_id            = src->codec_id;
+    dst->time_base           = src->time_base;
+    dst->frame_count         = src->frame_count;
+    dst->lw_seek_flags       = src->lw_seek_flags;
+    dst->initial_width       = src->initial_width;
+    dst->initial_height      = src->initial_height;
+    dst->initial_pix_fmt     = src->initial_pix_fmt;
+    dst->initial_colorspace  = src->initial_colorspace;
+    dst->max_width           = src->max_width;
+    dst->max_height          = src->max_height;
+    dst->stream_duration     = src->stream_duration;
+    dst->min_ts              = src->min_ts;
+    dst->actual_time_base    = src->actual_time_base;
+    dst->strict_cfr          = src->strict_cfr;
+    dst->intra_only          = src->intra_only;
+    dst->closed_gop          = src->closed_gop;
+    dst->exh.entry_count     = src->exh.entry_count;
+    dst->exh.entries         = src->exh.entries;
+    dst->exh.current_index   = src->exh.current_index;
+    dst->index_entries       = src->index_entries;
+    dst->index_entries_count = src->index_entries_count;
+    dst->frame_table         = src->frame_table;
+    dst->order_converter     = src->order_converter;
+    dst->rap_list            = src->rap_list;
+}
+
+static void copy_shared_audio_index
+(
+    lwlibav_audio_decode_handler_t       *dst,
+    const lwlibav_audio_decode_handler_t *src
+)
+{
+    dst->stream_index        = src->stream_index;
+    dst->codec_id            = src->codec_id;
+    dst->dv_in_avi           = src->dv_in_avi;
+    dst->time_base           = src->time_base;
+    dst->frame_count         = src->frame_count;
+    dst->frame_length        = src->frame_length;
+    dst->lw_seek_flags       = src->lw_seek_flags;
+    dst->exh.entry_count     = src->exh.entry_count;
+    dst->exh.entries         = src->exh.entries;
+    dst->exh.current_index   = src->exh.current_index;
+    dst->index_entries       = src->index_entries;
+    dst->index_entries_count = src->index_entries_count;
+    dst->frame_list          = src->frame_list;
+}
+
+/* Identify the input file by its canonical path, size and last modification time.
+ * Return 0 if the input file can be cached. Otherwise return a negative value. */
+static int get_index_cache_key
+(
+    lwindex_cache_key_t *key,
+    lwlibav_option_t    *opt
+)
+{
+    memset( key, 0, sizeof(lwindex_cache_key_t) );
+    /* The index file given as the input is left to be checked every time. */
+    size_t file_path_length = strlen( opt->file_path );
+    const char *ext = file_path_length >= 5 ? &opt->file_path[file_path_length - 4] : NULL;
+    if( opt->progressive || (ext && !strncmp( ext, ".lwi", strlen( ".lwi" ) )) )
+        return -1;
+    key->source_path = lw_realpath( opt->file_path, NULL );
+    if( !key->source_path )
+        return -1;
 #ifdef _WIN32
-        lw_free(wname);
-#endif // _WIN32
-        free( stream_info );
+    wchar_t *wname = NULL;
+    struct _stat64 file_stat;
+    int err;
+    if( lw_string_to_wchar( CP_UTF8, key->source_path, &wname ) )
+    {
+        err = _wstat64( wname, &file_stat );
+        lw_free( wname );
+    }
+    else
+        err = _stat64( key->source_path, &file_stat );
+#else
+    struct stat file_stat;
+    int err = stat( key->source_path, &file_stat );
+#endif
+    if( err )
+    {
+        lw_freep( &key->source_path );
+        return -1;
+    }
+    key->file_size                   = file_stat.st_size;
+    key->file_last_modification_time = file_stat.st_mtime;
+    return 0;
+}
+
+/* Check if constructing the index with the options would result in the cached streams. */
+static int match_index_cache
+(
+    const lwlibav_index_cache_t *cache,
+    const lwindex_cache_key_t   *key,
+    const lwlibav_option_t      *opt
+)
+{
+    if( strcmp( cache->source_path, key->source_path )
+     || cache->file_size != key->file_size
+     || cache->file_last_modification_time != key->file_last_modification_time )
+        return 0;
+    /* Video */
+    if( opt->force_video != cache->force_video )
+        return 0;
+    if( opt->force_video
+     && (cache->vdh.stream_index != opt->force_video_index || (opt->force_video_index >= 0 && cache->vdh.frame_count == 0)) )
         return 0;
+    /* Audio */
+    if( opt->force_audio_index == -1 )
+        return cache->adh.stream_index == cache->default_audio_index;
+    if( opt->force_audio_index >= 0 )
+        return cache->adh.stream_index == opt->force_audio_index && !(opt->force_audio && cache->adh.frame_count == 0);
+    return 1;   /* -2: any active audio stream */
+}
+
+/* Set up the output handlers and the A/V gap, which depend on the options, from the shared index. */
+static void setup_index_cache_output
+(
+    lwlibav_file_handler_t         *lwhp,
+    lwlibav_video_decode_handler_t *vdhp,
+    lwlibav_video_output_handler_t *vohp,
+    lwlibav_audio_decode_handler_t *adhp,
+    lwlibav_audio_output_handler_t *aohp,
+    lwlibav_option_t               *opt
+)
+{
+    if( vdhp->stream_index >= 0 )
+    {
+        uint32_t invisible_count = 0;
+        for( uint32_t i = 1; i <= vdhp->frame_count; i++ )
+            if( lw_vframe_flags( vdhp->frame_table, i ) & LW_VFRAME_FLAG_INVISIBLE )
+                ++invisible_count;
+        /* Create the repeat control info. */
+        create_video_frame_order_list( vdhp, vohp, opt );
+        /* Exclude invisible frames from the output handler. */
+        create_video_visible_frame_list( vdhp, vohp, invisible_count );
     }
-fail_parsing:
-#ifdef _WIN32
-    lw_free(wname);
-#endif // _WIN32
-    vdhp->frame_list = NULL;
-    adhp->frame_list = NULL;
-    if( video_info )
-        free( video_info );
-    if( audio_info )
-        free( audio_info );
-    free( stream_info );
-    return -1;
+    if( adhp->stream_index >= 0 && opt->av_sync && vdhp->stream_index >= 0 )
+        lwhp->av_gap = calculate_av_gap( vdhp, vohp, adhp, aohp->output_sample_rate );
 }
 
-int lwlibav_construct_index
+/* Set up the handlers by the shared index if the same index is in use.
+ * Return 0 on success. Otherwise return a negative value. */
+static int attach_index_cache
 (
+    const lwindex_cache_key_t      *key,
     lwlibav_file_handler_t         *lwhp,
     lwlibav_video_decode_handler_t *vdhp,
     lwlibav_video_output_handler_t *vohp,
     lwlibav_audio_decode_handler_t *adhp,
     lwlibav_audio_output_handler_t *aohp,
-    lw_log_handler_t               *lhp,
+    lwlibav_option_t               *opt
+)
+{
+    lw_mutex_t *mutex = lw_process_mutex();
+    lw_mutex_lock( mutex );
+    lwlibav_index_cache_t *cache = index_cache_list;
+    while( cache && !match_index_cache( cache, key, opt ) )
+        cache = cache->next;
+    if( !cache
+     || !(lwhp->file_path = duplicate_string( cache->file_path ))
+     || av_channel_layout_copy( &aohp->output_channel_layout, &cache->output_channel_layout ) < 0 )
+    {
+        lw_mutex_unlock( mutex );
+        if( lwhp->file_path )
+            lw_freep( &lwhp->file_path );
+        return -1;
+    }
+    cache->reference_count += 2;
+    lw_mutex_unlock( mutex );
+    lwhp->format_flags = cache->format_flags;
+    lwhp->raw_demuxer  = cache->raw_demuxer;
+    lwhp->threads      = opt->threads;
+    copy_shared_video_index( vdhp, &cache->vdh );
+    copy_shared_audio_index( adhp, &cache->adh );
+    vdhp->index_cache = cache;
+    adhp->index_cache = cache;
+    aohp->output_sample_format   = cache->output_sample_format;
+    aohp->output_sample_rate     = cache->output_sample_rate;
+    aohp->output_bits_per_sample = cache->output_bits_per_sample;
+    setup_index_cache_output( lwhp, vdhp, vohp, adhp, aohp, opt );
+    return 0;
+}
+
+/* Hand over the lists of the constructed index to a new shared index.
+ * If failed, the handlers keep owning the lists. */
+static void register_index_cache
+(
+    lwindex_cache_key_t            *key,
+    lwlibav_file_handler_t         *lwhp,
+    lwlibav_video_decode_handler_t *vdhp,
+    lwlibav_audio_decode_handler_t *adhp,
+    lwlibav_audio_output_handler_t *aohp,
     lwlibav_option_t               *opt,
-    progress_indicator_t           *indicator,
-    progress_handler_t             *php
+    int                             default_audio_index
 )
 {
-    /* Try to open the index file. */
-    size_t file_path_length = strlen( opt->file_path );
-    const char *ext = file_path_length >= 5 ? &opt->file_path[file_path_length - 4] : NULL;
-    int has_lwi_ext = ext && !strncmp( ext, ".lwi", strlen( ".lwi" ) );
-    FILE *index;
-    if( has_lwi_ext )
-        index = lw_fopen( opt->file_path, (opt->force_video || opt->force_audio) ? "r+b" : "rb" );
-    else if( opt->index_file_path )
-        index = lw_fopen( opt->index_file_path, (opt->force_video || opt->force_audio) ? "r+b" : "rb" );
-    else
+    lwlibav_index_cache_t *cache = (lwlibav_index_cache_t *)lw_malloc_zero( sizeof(lwlibav_index_cache_t) );
+    if( !cache )
+        return;
+    cache->file_path = duplicate_string( lwhp->file_path );
+    if( !cache->file_path
+     || av_channel_layout_copy( &cache->output_channel_layout, &aohp->output_channel_layout ) < 0 )
     {
-        char *index_file_path = create_lwi_path ( opt );
-        if( !index_file_path )
-            return -1;
-        index = lw_fopen( index_file_path, (opt->force_video || opt->force_audio) ? "r+b" : "rb" );
-        free( index_file_path );
+        lw_free( cache->file_path );
+        lw_free( cache );
+        return;
     }
-    if( index )
+    cache->reference_count             = 2;
+    cache->source_path                 = key->source_path;
+    cache->file_size                   = key->file_size;
+    cache->file_last_modification_time = key->file_last_modification_time;
+    cache->force_video                 = opt->force_video;
+    cache->default_audio_index         = default_audio_index;
+    cache->format_flags                = lwhp->format_flags;
+    cache->raw_demuxer                 = lwhp->raw_demuxer;
+    cache->output_sample_format        = aohp->output_sample_format;
+    cache->output_sample_rate          = aohp->output_sample_rate;
+    cache->output_bits_per_sample      = aohp->output_bits_per_sample;
+    copy_shared_video_index( &cache->vdh, vdhp );
+    copy_shared_audio_index( &cache->adh, adhp );
+    vdhp->index_cache = cache;
+    adhp->index_cache = cache;
+    key->source_path  = NULL;
+    lw_mutex_t *mutex = lw_process_mutex();
+    lw_mutex_lock( mutex );
+    cache->next      = index_cache_list;
+    index_cache_list = cache;
+    lw_mutex_unlock( mutex );
+}
+
+void lwlibav_release_index_cache
+(
+    lwlibav_index_cache_t **cachep
+)
+{
+    if( !cachep || !*cachep )
+        return;
+    lwlibav_index_cache_t *cache = *cachep;
+    *cachep = NULL;
+    lw_mutex_t *mutex = lw_process_mutex();
+    lw_mutex_lock( mutex );
+    if( --cache->reference_count > 0 )
     {
-        uint8_t lwindex_version[4] = { 0 };
-        int index_file_version = 0;
-        if( 4 == fscanf( index, "<LSMASHWorksIndexVersion=%" SCNu8 ".%" SCNu8 ".%" SCNu8 ".%" SCNu8 ">\n",
-                         &lwindex_version[0], &lwindex_version[1], &lwindex_version[2], &lwindex_version[3] )
-         && ((lwindex_version[0] << 24) | (lwindex_version[1] << 16) | (lwindex_version[2] << 8) | lwindex_version[3]) == LWINDEX_VERSION
-         && 1 == fscanf( index, "<LibavReaderIndexFile=%d>\n", &index_file_version )
-         && index_file_version == LWINDEX_INDEX_FILE_VERSION
-         && parse_index( lwhp, vdhp, vohp, adhp, aohp, opt, index ) == 0 )
-        {
-            /* Opening and parsing the index file succeeded. */
-            fclose( index );
-            lwhp->threads = opt->threads;
-            return 0;
-        }
-        fclose( index );
+        lw_mutex_unlock( mutex );
+        return;
     }
-    /* Open file. */
-    if( !lwhp->file_path )
+    lwlibav_index_cache_t **p = &index_cache_list;
+    while( *p != cache )
+        p = &(*p)->next;
+    *p = cache->next;
+    lw_mutex_unlock( mutex );
+    free_extradata_entries( &cache->vdh.exh );
+    free_extradata_entries( &cache->adh.exh );
+    lw_free( cache->vdh.frame_table );
+    lw_free( cache->vdh.order_converter );
+    lw_free( cache->vdh.rap_list );
+    av_free( cache->vdh.index_entries );
+    lw_free( cache->adh.frame_list );
+    av_free( cache->adh.index_entries );
+    av_channel_layout_uninit( &cache->output_channel_layout );
+    lw_free( cache->source_path );
+    lw_free( cache->file_path );
+    lw_free( cache );
+}
+
+static void set_seek_failure_index_path
+(
+    lwlibav_video_decode_handler_t *vdhp,
+    lwlibav_option_t               *opt
+)
+{
+    if( !opt->save_seek_failures || opt->no_create_index || opt->progressive || vdhp->stream_index < 0 )
+        return;
+    size_t file_path_length = strlen( opt->file_path );
+    const char *ext = file_path_length >= 5 ? &opt->file_path[file_path_length - 4] : NULL;
+    vdhp->rap_failures.index_file_path = ext && !strncmp( ext, ".lwi", strlen( ".lwi" ) ) ? duplicate_string( opt->file_path )
+                                       : opt->index_file_path                            ? duplicate_string( opt->index_file_path )
+                                       :                                                   create_lwi_path( opt );
+}
+
+int lwlibav_construct_index
+(
+    lwlibav_file_handler_t         *lwhp,
+    lwlibav_video_decode_handler_t *vdhp,
+    lwlibav_video_output_handler_t *vohp,
+    lwlibav_audio_decode_handler_t *adhp,
+    lwlibav_audio_output_handler_t *aohp,
+    lw_log_handler_t               *lhp,
+    lwlibav_option_t               *opt,
+    progress_indicator_t           *indicator,
+    progress_handler_t             *php
+)
+{
+    /* Share the index already constructed for the same file in the process if possible. */
+    lwindex_cache_key_t key;
+    int cacheable = get_index_cache_key( &key, opt ) == 0;
+    if( cacheable && attach_index_cache( &key, lwhp, vdhp, vohp, adhp, aohp, opt ) == 0 )
     {
-        lwhp->file_path = (char *)lw_malloc_zero( file_path_length + 1 );
-        if( !lwhp->file_path )
-            goto fail;
-        memcpy( lwhp->file_path, opt->file_path, file_path_length );
-        if( has_lwi_ext )
-            lwhp->file_path[file_path_length - 4] = '\0';
+        lw_free( key.source_path );
+        set_seek_failure_index_path( vdhp, opt );
+        return 0;
     }
-    AVFormatContext *format_ctx = NULL;
-    if( lavf_open_file( &format_ctx, lwhp->file_path, lhp ) )
+    int default_audio_index = -1;
+    int err = construct_index( lwhp, vdhp, vohp, adhp, aohp, lhp, opt, indicator, php, &default_audio_index );
+    if( err == 0 && !cacheable && !opt->progressive )
     {
-        if( format_ctx )
-            lavf_close_file( &format_ctx );
-        goto fail;
+        /* The index file given as the input is parsed every time, but its index is shared as the one of the source file. */
+        lwlibav_option_t source_opt = *opt;
+        source_opt.file_path = lwhp->file_path;
+        cacheable = get_index_cache_key( &key, &source_opt ) == 0;
     }
-    lwhp->threads      = opt->threads;
-    vdhp->stream_index = -1;
-    adhp->stream_index = opt->force_audio_index;
-    /* Create the index file. */
-    int err = create_index( lwhp, vdhp, vohp, adhp, aohp, format_ctx, opt, indicator, php );
-    /* Close file.
-     * By opening file for video and audio separately, indecent work about frame reading can be avoidable. */
-    lavf_close_file( &format_ctx );
-    vdhp->ctx = NULL;
-    adhp->ctx = NULL;
+    if( err == 0 && cacheable )
+        register_index_cache( &key, lwhp, vdhp, adhp, aohp, opt, default_audio_index );
+    lw_free( key.source_path );
+    if( err == 0 )
+        set_seek_failure_index_path( vdhp, opt );
     return err;
-fail:
-    if( lwhp->file_path )
-        lw_freep( &lwhp->file_path );
-    return -1;
 }
 
 int lwlibav_import_av_index_entry
@@ -3564,3 +6938,337 @@ int lwlibav_import_av_index_entry
     }
     return 0;
 }
+
+static int update_progressive_indicator( progress_handler_t *php, const char *message, int percent )
+{
+    lwlibav_progressive_index_t *pip = (lwlibav_progressive_index_t *)php;
+    lw_mutex_lock( pip->mutex );
+    int abort = pip->abort;
+    lw_mutex_unlock( pip->mutex );
+    return abort;
+}
+
+static void *construct_progressive_index( void *arg )
+{
+    lwlibav_progressive_index_t *pip = (lwlibav_progressive_index_t *)arg;
+    progress_indicator_t indicator = { NULL, update_progressive_indicator, NULL };
+    pip->result = lwlibav_construct_index( &pip->lwh, pip->vdhp, pip->vohp, pip->adhp, pip->aohp,
+                                           &pip->lh, &pip->opt, &indicator, (progress_handler_t *)pip );
+    lw_mutex_lock( pip->mutex );
+    pip->complete = 1;
+    lw_cond_broadcast( pip->cond );
+    lw_mutex_unlock( pip->mutex );
+    return NULL;
+}
+
+static void set_progressive_file_handler
+(
+    lwlibav_progressive_index_t *pip,
+    lwlibav_file_handler_t      *lwhp
+)
+{
+    if( !lwhp->file_path )
+        lwhp->file_path = duplicate_string( pip->lwh.file_path );
+    lwhp->format_name  = pip->lwh.format_name;
+    lwhp->format_flags = pip->lwh.format_flags;
+    lwhp->raw_demuxer  = pip->lwh.raw_demuxer;
+    lwhp->threads      = pip->lwh.threads;
+}
+
+/* Take the snapshot of the frames published by the indexer and decide the seek method for them. */
+static int install_progressive_snapshot
+(
+    lwlibav_progressive_index_t    *pip,
+    lwlibav_video_decode_handler_t *vdhp,
+    lwlibav_video_output_handler_t *vohp
+)
+{
+    lw_mutex_lock( pip->mutex );
+    lwindex_progressive_snapshot_t *snapshot = &pip->snapshot;
+    uint32_t frame_count = snapshot->frame_count;
+    uint32_t horizon     = snapshot->horizon;
+    /* One more entry is allocated for safety. */
+    video_frame_info_t *frame_list = (video_frame_info_t *)lw_malloc_zero( (frame_count + 2) * sizeof(video_frame_info_t) );
+    uint32_t           *rap_list   = (uint32_t *)lw_malloc_zero( (frame_count + 1) * sizeof(uint32_t) );
+    if( !frame_list || !rap_list || copy_progressive_extradata( &vdhp->exh, &snapshot->exh ) < 0 )
+    {
+        lw_mutex_unlock( pip->mutex );
+        lw_free( frame_list );
+        lw_free( rap_list );
+        return -1;
+    }
+    memcpy( &frame_list[1], &snapshot->frame_list[1], frame_count * sizeof(video_frame_info_t) );
+    if( pip->installed_generation == 0 )
+    {
+        vdhp->stream_index       = snapshot->stream_index;
+        vdhp->codec_id           = snapshot->codec_id;
+        vdhp->time_base          = snapshot->time_base;
+        vdhp->initial_width      = snapshot->initial_width;
+        vdhp->initial_height     = snapshot->initial_height;
+        vdhp->initial_pix_fmt    = snapshot->initial_pix_fmt;
+        vdhp->initial_colorspace = snapshot->initial_colorspace;
+        vdhp->exh.current_index  = frame_list[1].extradata_index;
+    }
+    vdhp->max_width  = snapshot->max_width;
+    vdhp->max_height = snapshot->max_height;
+    pip->installed_generation = pip->generation;
+    lw_mutex_unlock( pip->mutex );
+    uint32_t previous_count = vdhp->frame_count;
+    lw_free( vdhp->frame_list );
+    lw_free( vdhp->rap_list );
+    lw_freep( &vdhp->order_converter );
+    vdhp->frame_list  = frame_list;
+    vdhp->rap_list    = rap_list;
+    vdhp->frame_count = frame_count;
+    if( decide_video_seek_method( &pip->lwh, vdhp, frame_count ) )
+        return -1;
+    if( pack_video_frame_list( vdhp ) < 0 )
+        return -1;
+    lw_freep( &vdhp->frame_list );
+    /* The frames presented before the previous keyframe are available.
+     * Keep the frames needed to output them within the indexed frames since the decoder is drained beyond them. */
+    uint32_t available_count = (vdhp->order_converter ? vdhp->order_converter[horizon].decoding_to_presentation : horizon) - 1;
+    uint32_t margin          = vdhp->ctx ? get_decoder_delay( vdhp->ctx ) + vdhp->exh.delay_count + 1 : 0;
+    available_count = frame_count > margin ? MIN( available_count, frame_count - margin ) : 0;
+    if( pip->available_count < available_count )
+        pip->available_count = available_count;
+    vohp->frame_count = pip->available_count;
+    /* Seek if the last decoding reached the end of the previous frames. */
+    if( vdhp->last_fed_picture_number > previous_count
+     || vdhp->last_frame_number       > previous_count )
+        lwlibav_video_force_seek( vdhp );
+    return 0;
+}
+
+/* Take over the final frame lists from the indexer. */
+static int adopt_progressive_index
+(
+    lwlibav_progressive_index_t    *pip,
+    lwlibav_video_decode_handler_t *vdhp,
+    lwlibav_video_output_handler_t *vohp
+)
+{
+    lw_thread_join( pip->thread );
+    pip->thread = NULL;
+    lwlibav_video_decode_handler_t *src_vdhp = pip->vdhp;
+    lwlibav_video_output_handler_t *src_vohp = pip->vohp;
+    if( pip->result < 0 || src_vdhp->stream_index < 0 || src_vdhp->frame_count == 0 )
+        return -1;
+    if( pip->installed_generation && vdhp->stream_index != src_vdhp->stream_index )
+        return -1;
+    lw_free( vdhp->frame_table );
+    lw_free( vdhp->rap_list );
+    lw_free( vdhp->order_converter );
+    av_free( vdhp->index_entries );
+    vdhp->frame_table         = src_vdhp->frame_table;
+    vdhp->rap_list            = src_vdhp->rap_list;
+    vdhp->order_converter     = src_vdhp->order_converter;
+    vdhp->index_entries       = src_vdhp->index_entries;
+    vdhp->index_entries_count = src_vdhp->index_entries_count;
+    vdhp->frame_count         = src_vdhp->frame_count;
+    vdhp->lw_seek_flags       = src_vdhp->lw_seek_flags;
+    vdhp->min_ts              = src_vdhp->min_ts;
+    vdhp->stream_duration     = src_vdhp->stream_duration;
+    vdhp->actual_time_base    = src_vdhp->actual_time_base;
+    vdhp->strict_cfr          = src_vdhp->strict_cfr;
+    vdhp->intra_only          = src_vdhp->intra_only;
+    vdhp->closed_gop          = src_vdhp->closed_gop;
+    vdhp->max_width           = src_vdhp->max_width;
+    vdhp->max_height          = src_vdhp->max_height;
+    src_vdhp->frame_table         = NULL;
+    src_vdhp->rap_list            = NULL;
+    src_vdhp->order_converter     = NULL;
+    src_vdhp->index_entries       = NULL;
+    src_vdhp->index_entries_count = 0;
+    if( pip->installed_generation == 0 )
+    {
+        vdhp->stream_index       = src_vdhp->stream_index;
+        vdhp->codec_id           = src_vdhp->codec_id;
+        vdhp->time_base          = src_vdhp->time_base;
+        vdhp->initial_width      = src_vdhp->initial_width;
+        vdhp->initial_height     = src_vdhp->initial_height;
+        vdhp->initial_pix_fmt    = src_vdhp->initial_pix_fmt;
+        vdhp->initial_colorspace = src_vdhp->initial_colorspace;
+        vdhp->exh.current_index  = src_vdhp->exh.current_index;
+    }
+    /* The current decoder configuration is kept. */
+    free_extradata_entries( &vdhp->exh );
+    vdhp->exh.entries     = src_vdhp->exh.entries;
+    vdhp->exh.entry_count = src_vdhp->exh.entry_count;
+    src_vdhp->exh.entries     = NULL;
+    src_vdhp->exh.entry_count = 0;
+    /* Take over the output frame list for invisible frames and field coded pictures. */
+    lw_free( vohp->frame_order_list );
+    vohp->repeat_control       = src_vohp->repeat_control;
+    vohp->repeat_correction_ts = src_vohp->repeat_correction_ts;
+    vohp->frame_order_count    = src_vohp->frame_order_count;
+    vohp->frame_order_list     = src_vohp->frame_order_list;
+    vohp->frame_count          = src_vohp->frame_count;
+    src_vohp->frame_order_list = NULL;
+    for( int i = 0; i < REPEAT_CONTROL_CACHE_NUM; i++ )
+    {
+        av_frame_free( &vohp->frame_cache_buffers[i] );
+        vohp->frame_cache_buffers[i] = src_vohp->frame_cache_buffers[i];
+        vohp->frame_cache_numbers[i] = src_vohp->frame_cache_numbers[i];
+        src_vohp->frame_cache_buffers[i] = NULL;
+    }
+    pip->adopted = 1;
+    if( vdhp->format )
+    {
+        /* The decoder is already set up. */
+        if( lwlibav_import_av_index_entry( (lwlibav_decode_handler_t *)vdhp ) < 0 )
+            return -1;
+        lwlibav_video_force_seek( vdhp );
+    }
+    return 0;
+}
+
+uint32_t lwlibav_progressive_index_wait
+(
+    lwlibav_progressive_index_t    *pip,
+    lwlibav_video_decode_handler_t *vdhp,
+    lwlibav_video_output_handler_t *vohp,
+    uint32_t                        frame_number
+)
+{
+    while( !pip->adopted && frame_number > pip->available_count )
+    {
+        lw_mutex_lock( pip->mutex );
+        while( !pip->complete && pip->generation == pip->installed_generation )
+            lw_cond_wait( pip->cond, pip->mutex );
+        int complete = pip->complete;
+        lw_mutex_unlock( pip->mutex );
+        if( complete ? adopt_progressive_index( pip, vdhp, vohp ) < 0
+                     : install_progressive_snapshot( pip, vdhp, vohp ) < 0 )
+        {
+            lw_log_show( &vdhp->lh, LW_LOG_FATAL, "Failed to update the progressive index." );
+            return 0;
+        }
+    }
+    return pip->adopted ? vohp->frame_count : pip->available_count;
+}
+
+uint32_t lwlibav_progressive_index_estimate_frame_count
+(
+    lwlibav_progressive_index_t    *pip,
+    lwlibav_video_decode_handler_t *vdhp,
+    lwlibav_video_output_handler_t *vohp,
+    int64_t                         fps_num,
+    int64_t                         fps_den
+)
+{
+    if( pip->adopted )
+        return vohp->frame_count;
+    if( !vdhp->format || fps_num <= 0 || fps_den <= 0 )
+        return 0;
+    AVStream *stream = vdhp->format->streams[ vdhp->stream_index ];
+    int64_t estimated_count;
+    if( stream->duration > 0 && stream->time_base.num > 0 )
+        estimated_count = av_rescale_rnd( stream->duration, stream->time_base.num * fps_num,
+                                          stream->time_base.den * fps_den, AV_ROUND_UP );
+    else if( vdhp->format->duration > 0 )
+        estimated_count = av_rescale_rnd( vdhp->format->duration, fps_num, AV_TIME_BASE * fps_den, AV_ROUND_UP );
+    else
+        return 0;
+    /* Allow a frame for the rounding of the duration. */
+    ++estimated_count;
+    if( estimated_count <= pip->available_count )
+        return pip->available_count;
+    return (uint32_t)MIN( estimated_count, INT32_MAX );
+}
+
+int lwlibav_progressive_index_is_complete
+(
+    lwlibav_progressive_index_t *pip
+)
+{
+    return pip->adopted;
+}
+
+void lwlibav_progressive_index_close
+(
+    lwlibav_progressive_index_t **pipp
+)
+{
+    if( !pipp || !*pipp )
+        return;
+    lwlibav_progressive_index_t *pip = *pipp;
+    if( pip->thread )
+    {
+        lw_mutex_lock( pip->mutex );
+        pip->abort = 1;
+        lw_mutex_unlock( pip->mutex );
+        lw_thread_join( pip->thread );
+    }
+    if( pip->mutex )
+        lw_mutex_destroy( pip->mutex );
+    if( pip->cond )
+        lw_cond_destroy( pip->cond );
+    free( pip->snapshot.frame_list );
+    free_extradata_entries( &pip->snapshot.exh );
+    lwlibav_video_free_decode_handler( pip->vdhp );
+    lwlibav_video_free_output_handler( pip->vohp );
+    lwlibav_audio_free_decode_handler( pip->adhp );
+    lwlibav_audio_free_output_handler( pip->aohp );
+    lw_free( pip->lwh.file_path );
+    lw_free( pip->file_path );
+    lw_free( pip->cache_dir );
+    lw_free( pip->index_file_path );
+    lw_freep( pipp );
+}
+
+lwlibav_progressive_index_t *lwlibav_progressive_index_start
+(
+    lwlibav_file_handler_t         *lwhp,
+    lwlibav_video_decode_handler_t *vdhp,
+    lwlibav_video_output_handler_t *vohp,
+    lwlibav_option_t               *opt
+)
+{
+    lwlibav_progressive_index_t *pip = (lwlibav_progressive_index_t *)lw_malloc_zero( sizeof(lwlibav_progressive_index_t) );
+    if( !pip )
+        return NULL;
+    pip->vdhp  = lwlibav_video_alloc_decode_handler();
+    pip->vohp  = lwlibav_video_alloc_output_handler();
+    pip->adhp  = lwlibav_audio_alloc_decode_handler();
+    pip->aohp  = lwlibav_audio_alloc_output_handler();
+    pip->mutex = lw_mutex_create();
+    pip->cond  = lw_cond_create();
+    if( !pip->vdhp || !pip->vohp || !pip->adhp || !pip->aohp || !pip->mutex || !pip->cond )
+        goto fail;
+    /* The indexer works with its own handlers and copies of the options since it outlives the caller's ones. */
+    pip->vdhp->preferred_decoder_names = vdhp->preferred_decoder_names;
+    pip->vdhp->prefer_hw_decoder       = vdhp->prefer_hw_decoder;
+    pip->file_path       = duplicate_string( opt->file_path );
+    pip->cache_dir       = duplicate_string( opt->cache_dir );
+    pip->index_file_path = duplicate_string( opt->index_file_path );
+    if( !pip->file_path
+     || (opt->cache_dir       && !pip->cache_dir)
+     || (opt->index_file_path && !pip->index_file_path) )
+        goto fail;
+    pip->opt                   = *opt;
+    pip->opt.file_path         = pip->file_path;
+    pip->opt.cache_dir         = pip->cache_dir;
+    pip->opt.index_file_path   = pip->index_file_path;
+    pip->opt.av_sync           = 0;
+    pip->opt.force_audio       = 0;
+    pip->opt.force_audio_index = -2;
+    pip->opt.apply_repeat_flag = 0;
+    pip->opt.vfr2cfr.active    = 0;
+    pip->opt.progressive       = pip;
+    pip->lh.level              = LW_LOG_FATAL;
+    pip->publishable           = -1;
+    pip->thread = lw_thread_create( construct_progressive_index, pip );
+    if( !pip->thread )
+        goto fail;
+    /* Wait for the first available frame. */
+    if( lwlibav_progressive_index_wait( pip, vdhp, vohp, 1 ) == 0 )
+        goto fail;
+    set_progressive_file_handler( pip, lwhp );
+    if( !lwhp->file_path )
+        goto fail;
+    return pip;
+fail:
+    lwlibav_progressive_index_close( &pip );
+    return NULL;
+}
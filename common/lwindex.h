@@ -27,7 +27,14 @@
 /* index file version
  * This version is bumped when its structure changed so that the lwindex invokes
  * reindexing opened file immediately. */
-#define LWINDEX_INDEX_FILE_VERSION 17
+#define LWINDEX_INDEX_FILE_VERSION 18
+
+/* binary index file version
+ * Same as above, but for the binary index file which is written by default.
+ * The text index file is still readable and writable for debugging. */
+#define LWINDEX_BINARY_INDEX_FILE_VERSION 3
+
+typedef struct lwlibav_progressive_index_tag lwlibav_progressive_index_t;
 
 typedef struct
 {
@@ -43,12 +50,15 @@ typedef struct
     int         force_audio_index;
     int         apply_repeat_flag;
     int         field_dominance;
+    int         text_index;     /* 0: binary index file, 1: text index file */
+    int         save_seek_failures; /* Record the random accessible pictures found unusable for seeking to the index file. */
     struct
     {
         int      active;
         uint32_t fps_num;
         uint32_t fps_den;
     } vfr2cfr;
+    lwlibav_progressive_index_t *progressive;   /* the background indexer publishing to, NULL if not */
 } lwlibav_option_t;
 
 #ifdef __cplusplus
@@ -74,6 +84,64 @@ int lwlibav_import_av_index_entry
     lwlibav_decode_handler_t *dhp
 );
 
+/* Start to construct the index in the background and set up the video handlers by the frames indexed so far.
+ * The indexer publishes the frames before each video keyframe, and the frames which can no longer be preceded
+ * in presentation order by frames indexed later become available. If the index file is valid, all frames are
+ * available immediately. Audio, repeat control and VFR->CFR conversion are not supported.
+ * Return NULL if failed. */
+lwlibav_progressive_index_t *lwlibav_progressive_index_start
+(
+    lwlibav_file_handler_t         *lwhp,
+    lwlibav_video_decode_handler_t *vdhp,
+    lwlibav_video_output_handler_t *vohp,
+    lwlibav_option_t               *opt
+);
+
+/* Wait until the requested frame becomes available or the indexing completes, and update the video handlers.
+ * Return the number of the available frames, which is the final number of the frames if the indexing completed.
+ * Return 0 if failed. */
+uint32_t lwlibav_progressive_index_wait
+(
+    lwlibav_progressive_index_t    *pip,
+    lwlibav_video_decode_handler_t *vdhp,
+    lwlibav_video_output_handler_t *vohp,
+    uint32_t                        frame_number
+);
+
+/* Return the number of the frames if the indexing completed.
+ * Otherwise, return the number of the frames estimated from the duration and the frame rate as the upper limit,
+ * or 0 if the duration is unknown. */
+uint32_t lwlibav_progressive_index_estimate_frame_count
+(
+    lwlibav_progressive_index_t    *pip,
+    lwlibav_video_decode_handler_t *vdhp,
+    lwlibav_video_output_handler_t *vohp,
+    int64_t                         fps_num,
+    int64_t                         fps_den
+);
+
+int lwlibav_progressive_index_is_complete
+(
+    lwlibav_progressive_index_t *pip
+);
+
+/* Abort the indexing if not completed yet and deallocate. */
+void lwlibav_progressive_index_close
+(
+    lwlibav_progressive_index_t **pipp
+);
+
+/* Clear the keyframe flag of the video packet at the file offset in the index file
+ * so that the random accessible picture is not used for seeking from the next time the index file is parsed.
+ * The index file is locked against its creation by other processes meanwhile.
+ * Return 0 on success, otherwise a negative value. */
+int lwindex_clear_keyframe_flag
+(
+    const char *index_file_path,
+    int         stream_index,
+    int64_t     file_offset
+);
+
 #ifdef __cplusplus
 }
 #endif  /* __cplusplus */
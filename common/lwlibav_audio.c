@@ -78,17 +78,22 @@ void lwlibav_audio_free_decode_handler
 {
     if( !adhp )
         return;
-    lwlibav_extradata_handler_t *exhp = &adhp->exh;
-    if( exhp->entries )
+    if( adhp->index_cache )
+        lwlibav_release_index_cache( &adhp->index_cache );
+    else
     {
-        for( int i = 0; i < exhp->entry_count; i++ )
-            if( exhp->entries[i].extradata )
-                av_free( exhp->entries[i].extradata );
-        lw_free( exhp->entries );
+        lwlibav_extradata_handler_t *exhp = &adhp->exh;
+        if( exhp->entries )
+        {
+            for( int i = 0; i < exhp->entry_count; i++ )
+                if( exhp->entries[i].extradata )
+                    av_free( exhp->entries[i].extradata );
+            lw_free( exhp->entries );
+        }
+        lw_free( adhp->frame_list );
+        av_free( adhp->index_entries );
     }
     av_packet_unref( &adhp->packet );
-    lw_free( adhp->frame_list );
-    av_free( adhp->index_entries );
     av_frame_free( &adhp->frame_buffer );
     avcodec_free_context( &adhp->ctx );
     if( adhp->format )
@@ -221,8 +226,12 @@ int lwlibav_audio_get_desired_track
      || find_and_open_decoder( &ctx, adhp->format->streams[ adhp->stream_index ]->codecpar,
                                adhp->preferred_decoder_names, 0, threads, adhp->drc, adhp->ff_options ) < 0 )
     {
-        av_freep( &adhp->index_entries );
-        lw_freep( &adhp->frame_list );
+        if( !adhp->index_cache )
+        {
+            /* The shared lists are left until the handler is deallocated. */
+            av_freep( &adhp->index_entries );
+            lw_freep( &adhp->frame_list );
+        }
         if( adhp->format )
             lavf_close_file( &adhp->format );
         return -1;
@@ -569,7 +578,7 @@ retry_seek:
             /* Update the extradata. */
             rap_number = get_audio_rap( adhp, frame_number );
             assert( rap_number != 0 );
-            lwlibav_update_configuration( (lwlibav_decode_handler_t *)adhp, rap_number, extradata_index, 0 );
+            lwlibav_update_configuration( (lwlibav_decode_handler_t *)adhp, rap_number, extradata_index, 0, NULL );
         }
         else
             lwlibav_flush_buffers( (lwlibav_decode_handler_t *)adhp );
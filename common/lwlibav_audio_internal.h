@@ -62,4 +62,5 @@ struct lwlibav_audio_decode_handler_tag
     uint32_t            last_frame_number;
     uint64_t            pcm_sample_count;
     uint64_t            next_pcm_sample_number;
+    lwlibav_index_cache_t *index_cache; /* the owner of the frame list and the extradata list if shared */
 };
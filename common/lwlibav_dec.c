@@ -37,6 +37,44 @@ extern "C"
 #include "qsv.h"
 #include "decode.h"
 
+int lwlibav_decoder_needs_reopen
+(
+    const AVCodecContext *ctx
+)
+{
+    if (!strcmp(ctx->codec->name, "libdav1d"))
+        return ctx->level <= 9;
+    return ctx->codec_type != AVMEDIA_TYPE_VIDEO;
+}
+
+int lwlibav_reset_decoder
+(
+    AVCodecContext         **ctx,
+    const AVCodecParameters *codecpar,
+    double                   drc,
+    const char              *ff_options
+)
+{
+    if (!lwlibav_decoder_needs_reopen(*ctx))
+    {
+        avcodec_flush_buffers(*ctx);
+        return 0;
+    }
+    const AVCodec* codec = (*ctx)->codec;
+    void* app_specific = (*ctx)->opaque;
+    AVCodecContext* new_ctx = NULL;
+    if (open_decoder(&new_ctx, codecpar, codec, (*ctx)->thread_count, drc, ff_options) < 0)
+    {
+        avcodec_flush_buffers(*ctx);
+        return -1;
+    }
+    (*ctx)->opaque = NULL;
+    avcodec_free_context(ctx);
+    *ctx = new_ctx;
+    (*ctx)->opaque = app_specific;
+    return 0;
+}
+
 /* Close and open the new decoder to flush buffers in the decoder even if the decoder implements avcodec_flush_buffers().
  * It seems this brings about more stable composition when seeking.
  * Note that this function could reallocate AVCodecContext. */
@@ -45,33 +83,13 @@ void lwlibav_flush_buffers
     lwlibav_decode_handler_t *dhp
 )
 {
-    if (!strcmp(dhp->ctx->codec->name, "libdav1d")
-        && dhp->ctx->level > 9)
-        avcodec_flush_buffers(dhp->ctx);
-    else if (dhp->ctx->codec_type == AVMEDIA_TYPE_VIDEO
-        && strcmp(dhp->ctx->codec->name, "libdav1d"))
-        avcodec_flush_buffers(dhp->ctx);
-    else
+    const AVCodecParameters* codecpar = dhp->format->streams[dhp->stream_index]->codecpar;
+    if (lwlibav_reset_decoder(&dhp->ctx, codecpar, dhp->drc, dhp->ff_options) < 0)
     {
-        const AVCodecParameters* codecpar = dhp->format->streams[dhp->stream_index]->codecpar;
-        const AVCodec* codec = dhp->ctx->codec;
-        void* app_specific = dhp->ctx->opaque;
-        AVCodecContext* ctx = NULL;
-        if (open_decoder(&ctx, codecpar, codec, dhp->ctx->thread_count, dhp->drc, dhp->ff_options) < 0)
-        {
-            avcodec_flush_buffers(dhp->ctx);
-            dhp->error = 1;
-            lw_log_show(&dhp->lh, LW_LOG_FATAL,
-                "Failed to flush buffers by a reliable way.\n"
-                "It is recommended you reopen the file.");
-        }
-        else
-        {
-            dhp->ctx->opaque = NULL;
-            avcodec_free_context(&dhp->ctx);
-            dhp->ctx = ctx;
-            dhp->ctx->opaque = app_specific;
-        }
+        dhp->error = 1;
+        lw_log_show(&dhp->lh, LW_LOG_FATAL,
+            "Failed to flush buffers by a reliable way.\n"
+            "It is recommended you reopen the file.");
     }
 
     dhp->exh.delay_count = 0;
@@ -82,7 +100,8 @@ void lwlibav_update_configuration
     lwlibav_decode_handler_t *dhp,
     uint32_t                  frame_number,
     int                       extradata_index,
-    int64_t                   rap_pos
+    int64_t                   rap_pos,
+    AVCodecContext          **old_ctx
 )
 {
     lwlibav_extradata_handler_t *exhp = &dhp->exh;
@@ -97,9 +116,17 @@ void lwlibav_update_configuration
     AVCodecParameters *codecpar          = dhp->format->streams[ dhp->stream_index ]->codecpar;
     void              *app_specific      = dhp->ctx->opaque;
     const int          thread_count      = dhp->ctx->thread_count;
-    /* Close the decoder here. */
-    dhp->ctx->opaque = NULL;
-    avcodec_free_context( &dhp->ctx );
+    /* Close the decoder here unless the caller keeps it. */
+    if( old_ctx )
+    {
+        *old_ctx  = dhp->ctx;
+        dhp->ctx = NULL;
+    }
+    else
+    {
+        dhp->ctx->opaque = NULL;
+        avcodec_free_context( &dhp->ctx );
+    }
     /* Find an appropriate decoder. */
     const lwlibav_extradata_t *entry = &exhp->entries[extradata_index];
     const AVCodec *codec = find_decoder( entry->codec_id, codecpar, dhp->preferred_decoder_names, dhp->prefer_hw_decoder );
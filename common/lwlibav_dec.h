@@ -60,6 +60,9 @@ typedef struct
     int                 block_align;
 } lwlibav_extradata_t;
 
+/* The index data shared between the decode handlers of the same file in the process. */
+typedef struct lwlibav_index_cache_tag lwlibav_index_cache_t;
+
 typedef struct
 {
     int                  current_index;
@@ -172,11 +175,35 @@ int find_and_open_decoder
     const char              *ff_options
 );
 
+/* Return non-zero if the decoder is flushed by closing and opening it again instead of avcodec_flush_buffers(). */
+int lwlibav_decoder_needs_reopen
+(
+    const AVCodecContext *ctx
+);
+
+/* Flush the decoder in the same way as lwlibav_flush_buffers(), where the codec parameters are used to reopen it.
+ * Note that this function could reallocate AVCodecContext.
+ * Return 0 on success, otherwise a negative value after flushing by avcodec_flush_buffers() instead. */
+int lwlibav_reset_decoder
+(
+    AVCodecContext         **ctx,
+    const AVCodecParameters *codecpar,
+    double                   drc,
+    const char              *ff_options
+);
+
 void lwlibav_flush_buffers
 (
     lwlibav_decode_handler_t *dhp
 );
 
+/* Drop the reference to the shared index data.
+ * The frame lists, the extradata lists and the AVIndexEntrys referenced by the decode handler become invalid. */
+void lwlibav_release_index_cache
+(
+    lwlibav_index_cache_t **cachep
+);
+
 int lwlibav_get_av_frame
 (
     AVFormatContext *format_ctx,
@@ -185,12 +212,14 @@ int lwlibav_get_av_frame
     AVPacket        *pkt
 );
 
+/* If old_ctx is not NULL, the current decoder is handed over to it instead of being closed. */
 void lwlibav_update_configuration
 (
     lwlibav_decode_handler_t *dhp,
     uint32_t                  frame_number,
     int                       extradata_index,
-    int64_t                   rap_pos
+    int64_t                   rap_pos,
+    AVCodecContext          **old_ctx
 );
 
 void set_video_basic_settings
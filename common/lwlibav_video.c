@@ -31,21 +31,33 @@ extern "C"
 #include <libavformat/avformat.h>   /* Demuxer */
 #include <libavcodec/avcodec.h>     /* Decoder */
 #include <libavutil/imgutils.h>
+#include <libavutil/time.h>
+#include <libswresample/swresample.h>
 #ifdef __cplusplus
 }
 #endif  /* __cplusplus */
 
 #include "utils.h"
+#include "osdep.h"
 #include "video_output.h"
 #include "lwlibav_dec.h"
 #include "lwlibav_video.h"
 #include "lwlibav_video_internal.h"
+#include "audio_output.h"
+#include "lwlibav_audio.h"
+#include "progress.h"
+#include "lwindex.h"
 #include "decode.h"
 
 #define SEEK_MODE_NORMAL     0
 #define SEEK_MODE_UNSAFE     1
 #define SEEK_MODE_AGGRESSIVE 2
 
+#define SEEK_COST_WEIGHT             0.125  /* the weight of a new measurement in the moving averages of the costs */
+#define SEEK_COST_FALLBACK_THRESHOLD 10     /* the forward seek threshold used until the costs are measured */
+
+#define GOP_PARALLEL_BUFFER_LIMIT ((int64_t)1 << 30)    /* the total size of the frames buffered for the GOP workers */
+
 #if LIBAVCODEC_VERSION_MICRO < 100
 #define avcodec_find_best_pix_fmt_of_list( _0, _1, _2, _3 ) avcodec_find_best_pix_fmt2( (enum AVPixelFormat *)(_0), _1, _2, _3 )
 #endif
@@ -78,6 +90,183 @@ lwlibav_video_output_handler_t *lwlibav_video_alloc_output_handler
     return (lwlibav_video_output_handler_t *)lw_malloc_zero( sizeof(lwlibav_video_output_handler_t) );
 }
 
+static void stop_prefetch
+(
+    lwlibav_prefetch_t *pfp
+)
+{
+    if( pfp->thread )
+    {
+        lw_mutex_lock( pfp->mutex );
+        pfp->stop = 1;
+        lw_cond_broadcast( pfp->cond );
+        lw_mutex_unlock( pfp->mutex );
+        lw_thread_join( pfp->thread );
+        pfp->thread = NULL;
+    }
+    if( pfp->frames )
+    {
+        for( uint32_t i = 0; i <= pfp->depth; i++ )
+            av_frame_free( &pfp->frames[i] );
+        lw_freep( &pfp->frames );
+    }
+    av_frame_free( &pfp->decode_frame );
+    if( pfp->cond )
+        lw_cond_destroy( pfp->cond );
+    if( pfp->mutex )
+        lw_mutex_destroy( pfp->mutex );
+    pfp->cond  = NULL;
+    pfp->mutex = NULL;
+}
+
+static void free_spare_decoder
+(
+    lwlibav_spare_decoder_t *entry
+)
+{
+    if( entry->ctx )
+        entry->ctx->opaque = NULL;
+    avcodec_free_context( &entry->ctx );
+    avcodec_parameters_free( &entry->codecpar );
+    entry->state = LW_SPARE_DECODER_EMPTY;
+}
+
+static void stop_spare_decoders
+(
+    lwlibav_spare_decoders_t *sdp
+)
+{
+    if( sdp->thread )
+    {
+        lw_mutex_lock( sdp->mutex );
+        sdp->stop = 1;
+        lw_cond_broadcast( sdp->cond );
+        lw_mutex_unlock( sdp->mutex );
+        lw_thread_join( sdp->thread );
+        sdp->thread = NULL;
+    }
+    if( sdp->entries )
+    {
+        for( int i = 0; i < sdp->capacity; i++ )
+            free_spare_decoder( &sdp->entries[i] );
+        lw_freep( &sdp->entries );
+    }
+    if( sdp->cond )
+        lw_cond_destroy( sdp->cond );
+    if( sdp->mutex )
+        lw_mutex_destroy( sdp->mutex );
+    sdp->cond  = NULL;
+    sdp->mutex = NULL;
+}
+
+/* Join the threads of the workers, which must have been told to stop, and close them. */
+static void close_parallel_workers
+(
+    lwlibav_parallel_worker_t *workers,
+    int                        worker_count
+)
+{
+    for( int i = 0; i < worker_count; i++ )
+    {
+        lwlibav_parallel_worker_t *worker = &workers[i];
+        if( worker->thread )
+            lw_thread_join( worker->thread );
+        avcodec_free_context( &worker->ctx );
+        if( worker->format )
+            lavf_close_file( &worker->format );
+        avio_closep( &worker->pb );
+        av_packet_free( &worker->pkt );
+        av_frame_free( &worker->frame );
+    }
+}
+
+static inline void free_frame_array
+(
+    AVFrame **frames,
+    uint32_t  count
+)
+{
+    if( frames )
+        for( uint32_t i = 0; i < count; i++ )
+            av_frame_free( &frames[i] );
+}
+
+static void stop_intra_parallel
+(
+    lwlibav_intra_parallel_t *ipp
+)
+{
+    if( ipp->workers )
+    {
+        if( ipp->mutex && ipp->cond )
+        {
+            lw_mutex_lock( ipp->mutex );
+            ipp->stop = 1;
+            lw_cond_broadcast( ipp->cond );
+            lw_mutex_unlock( ipp->mutex );
+        }
+        close_parallel_workers( ipp->workers, ipp->worker_count );
+        lw_freep( &ipp->workers );
+    }
+    if( ipp->slots )
+    {
+        for( uint32_t i = 0; i < ipp->window; i++ )
+            av_frame_free( &ipp->slots[i].frame );
+        lw_freep( &ipp->slots );
+    }
+    if( ipp->cond )
+        lw_cond_destroy( ipp->cond );
+    if( ipp->mutex )
+        lw_mutex_destroy( ipp->mutex );
+    ipp->cond         = NULL;
+    ipp->mutex        = NULL;
+    ipp->stop         = 0;
+    ipp->first_number = 0;
+}
+
+static void stop_gop_parallel
+(
+    lwlibav_gop_parallel_t *gpp
+)
+{
+    if( gpp->workers )
+    {
+        if( gpp->mutex && gpp->cond )
+        {
+            lw_mutex_lock( gpp->mutex );
+            gpp->stop = 1;
+            lw_cond_broadcast( gpp->cond );
+            lw_mutex_unlock( gpp->mutex );
+        }
+        close_parallel_workers( gpp->workers, gpp->worker_count );
+        for( int i = 0; i < gpp->worker_count; i++ )
+        {
+            free_frame_array( gpp->workers[i].frames, gpp->max_gop_length );
+            lw_freep( &gpp->workers[i].frames );
+        }
+        lw_freep( &gpp->workers );
+    }
+    if( gpp->slots )
+    {
+        for( uint32_t i = 0; i < gpp->window; i++ )
+        {
+            free_frame_array( gpp->slots[i].frames, gpp->max_gop_length );
+            lw_freep( &gpp->slots[i].frames );
+        }
+        lw_freep( &gpp->slots );
+    }
+    lw_freep( &gpp->gop_list );
+    avcodec_parameters_free( &gpp->codecpar );
+    if( gpp->cond )
+        lw_cond_destroy( gpp->cond );
+    if( gpp->mutex )
+        lw_mutex_destroy( gpp->mutex );
+    gpp->cond      = NULL;
+    gpp->mutex     = NULL;
+    gpp->stop      = 0;
+    gpp->first_gop = 0;
+}
+
 void lwlibav_video_free_decode_handler
 (
     lwlibav_video_decode_handler_t *vdhp
@@ -85,19 +274,50 @@ void lwlibav_video_free_decode_handler
 {
     if( !vdhp )
         return;
-    lwlibav_extradata_handler_t *exhp = &vdhp->exh;
-    if( exhp->entries )
+    stop_prefetch( &vdhp->prefetch );
+    stop_spare_decoders( &vdhp->spare_decoders );
+    stop_intra_parallel( &vdhp->intra_parallel );
+    stop_gop_parallel( &vdhp->gop_parallel );
+    /* The reader of the keyframe decoder is borrowed from the decode handler. */
+    vdhp->keyframes.decoder.format = NULL;
+    vdhp->keyframes.decoder.pb     = NULL;
+    close_parallel_workers( &vdhp->keyframes.decoder, 1 );
+    lw_freep( &vdhp->keyframes.list );
+    if( vdhp->index_cache )
+        lwlibav_release_index_cache( &vdhp->index_cache );
+    else
     {
-        for( int i = 0; i < exhp->entry_count; i++ )
-            if( exhp->entries[i].extradata )
-                av_free( exhp->entries[i].extradata );
-        lw_free( exhp->entries );
+        lwlibav_extradata_handler_t *exhp = &vdhp->exh;
+        if( exhp->entries )
+        {
+            for( int i = 0; i < exhp->entry_count; i++ )
+                if( exhp->entries[i].extradata )
+                    av_free( exhp->entries[i].extradata );
+            lw_free( exhp->entries );
+        }
+        lw_free( vdhp->frame_list );
+        lw_free( vdhp->frame_table );
+        lw_free( vdhp->order_converter );
+        lw_free( vdhp->rap_list );
+        av_free( vdhp->index_entries );
     }
     av_packet_unref( &vdhp->packet );
-    lw_free( vdhp->frame_list );
-    lw_free( vdhp->order_converter );
-    lw_free( vdhp->keyframe_list );
-    av_free( vdhp->index_entries );
+    if( vdhp->backward.frames )
+    {
+        for( uint32_t i = 0; i < vdhp->backward.capacity; i++ )
+            av_frame_free( &vdhp->backward.frames[i] );
+        lw_free( vdhp->backward.frames );
+    }
+    av_frame_free( &vdhp->backward.decode_frame );
+    lw_free( vdhp->rap_failures.entries );
+    if( vdhp->packet_cache.packets )
+    {
+        for( uint32_t i = 0; i < vdhp->packet_cache.capacity; i++ )
+            av_packet_free( &vdhp->packet_cache.packets[i] );
+        lw_free( vdhp->packet_cache.packets );
+    }
+    lw_free( vdhp->rap_failures.index_file_path );
+    avio_closep( &vdhp->direct_reader.pb );
     av_frame_free( &vdhp->frame_buffer );
     av_frame_free( &vdhp->first_valid_frame );
     av_frame_free( &vdhp->movable_frame_buffer );
@@ -161,6 +381,90 @@ void lwlibav_video_set_seek_mode
     vdhp->seek_mode = seek_mode;
 }
 
+void lwlibav_video_set_prefetch_depth
+(
+    lwlibav_video_decode_handler_t *vdhp,
+    uint32_t                        prefetch_depth
+)
+{
+    /* The worker can't be reconfigured once started. */
+    if( !vdhp->prefetch.thread )
+        vdhp->prefetch.depth = prefetch_depth;
+}
+
+void lwlibav_video_set_backward_buffer_size
+(
+    lwlibav_video_decode_handler_t *vdhp,
+    uint32_t                        backward_buffer_size
+)
+{
+    /* The buffer can't be resized once allocated. */
+    if( !vdhp->backward.frames )
+        vdhp->backward.capacity = backward_buffer_size;
+}
+
+void lwlibav_video_set_packet_cache_size
+(
+    lwlibav_video_decode_handler_t *vdhp,
+    size_t                          packet_cache_size
+)
+{
+    vdhp->packet_cache.budget = packet_cache_size;
+}
+
+void lwlibav_video_set_direct_read
+(
+    lwlibav_video_decode_handler_t *vdhp,
+    int                             direct_read
+)
+{
+    vdhp->direct_reader.requested = direct_read;
+}
+
+void lwlibav_video_set_spare_decoders
+(
+    lwlibav_video_decode_handler_t *vdhp,
+    int                             spare_decoders
+)
+{
+    /* The number of spare decoders can't be changed once the worker starts. */
+    if( !vdhp->spare_decoders.entries )
+        vdhp->spare_decoders.capacity = spare_decoders;
+}
+
+void lwlibav_video_set_intra_parallel
+(
+    lwlibav_video_decode_handler_t *vdhp,
+    int                             worker_count
+)
+{
+    /* The number of workers can't be changed once they start. */
+    if( !vdhp->intra_parallel.workers )
+        vdhp->intra_parallel.worker_count = worker_count;
+}
+
+void lwlibav_video_set_gop_parallel
+(
+    lwlibav_video_decode_handler_t *vdhp,
+    int                             worker_count
+)
+{
+    /* The number of workers can't be changed once they start. */
+    if( !vdhp->gop_parallel.workers )
+        vdhp->gop_parallel.worker_count = worker_count;
+}
+
+void lwlibav_video_set_keyframes_only
+(
+    lwlibav_video_decode_handler_t *vdhp,
+    int                             mode
+)
+{
+    /* The mode can't be changed once the keyframe list is created. */
+    if( !vdhp->keyframes.list )
+        vdhp->keyframes.mode = mode;
+}
+
 void lwlibav_video_set_preferred_decoder_names
 (
     lwlibav_video_decode_handler_t *vdhp,
@@ -256,6 +560,26 @@ int lwlibav_video_get_max_height
     return vdhp ? vdhp->max_height : 0;
 }
 
+void lwlibav_video_get_seek_stats
+(
+    lwlibav_video_decode_handler_t *vdhp,
+    lwlibav_video_seek_stats_t     *stats
+)
+{
+    if( !vdhp )
+    {
+        memset( stats, 0, sizeof(lwlibav_video_seek_stats_t) );
+        return;
+    }
+    /* The prefetch worker updates the statistics while decoding ahead. */
+    lw_mutex_t *mutex = vdhp->prefetch.mutex;
+    if( mutex )
+        lw_mutex_lock( mutex );
+    *stats = vdhp->seek_cost.stats;
+    if( mutex )
+        lw_mutex_unlock( mutex );
+}
+
 AVFrame *lwlibav_video_get_frame_buffer
 (
     lwlibav_video_decode_handler_t *vdhp
@@ -290,10 +614,15 @@ int lwlibav_video_get_desired_track
      || find_and_open_decoder( &ctx, vdhp->format->streams[ vdhp->stream_index ]->codecpar,
                                vdhp->preferred_decoder_names, vdhp->prefer_hw_decoder, threads, -1.0, vdhp->ff_options ) < 0 )
     {
-        av_freep( &vdhp->index_entries );
-        lw_freep( &vdhp->frame_list );
-        lw_freep( &vdhp->order_converter );
-        lw_freep( &vdhp->keyframe_list );
+        if( !vdhp->index_cache )
+        {
+            /* The shared lists are left until the handler is deallocated. */
+            av_freep( &vdhp->index_entries );
+            lw_freep( &vdhp->frame_list );
+            lw_freep( &vdhp->frame_table );
+            lw_freep( &vdhp->order_converter );
+            lw_freep( &vdhp->rap_list );
+        }
         if( vdhp->format )
             lavf_close_file( &vdhp->format );
         return -1;
@@ -435,14 +764,14 @@ static uint32_t correct_current_frame_number
     uint32_t                        goal
 )
 {
-#define MATCH_DTS( j ) (info[j].dts == pkt->dts)
-#define MATCH_POS( j ) ((vdhp->lw_seek_flags & SEEK_POS_CORRECTION) && info[j].file_offset == pkt->pos)
-    order_converter_t  *oc   = vdhp->order_converter;
-    video_frame_info_t *info = vdhp->frame_list;
+#define MATCH_DTS( j ) (lw_vframe_dts( table, j ) == pkt->dts)
+#define MATCH_POS( j ) ((vdhp->lw_seek_flags & SEEK_POS_CORRECTION) && lw_vframe_file_offset( table, j ) == pkt->pos)
+    order_converter_t   *oc    = vdhp->order_converter;
+    video_frame_table_t *table = vdhp->frame_table;
     uint32_t p = oc ? oc[i].decoding_to_presentation : i;
     if( pkt->dts == AV_NOPTS_VALUE || MATCH_DTS( p ) || MATCH_POS( p ) )
         return i;
-    if( pkt->dts > info[p].dts )
+    if( pkt->dts > lw_vframe_dts( table, p ) )
     {
         /* too forward */
         uint32_t limit = MIN( goal, vdhp->frame_count );
@@ -476,6 +805,137 @@ static uint32_t correct_current_frame_number
 #undef MATCH_POS
 }
 
+static void reset_packet_cache
+(
+    lwlibav_packet_cache_t *pcp,
+    uint32_t                rap_number,
+    int                     recording
+)
+{
+    for( uint32_t i = 0; i < pcp->count; i++ )
+        av_packet_unref( pcp->packets[i] );
+    pcp->size       = 0;
+    pcp->count      = 0;
+    pcp->position   = 0;
+    pcp->rap_number = rap_number;
+    pcp->recording  = recording && pcp->budget;
+}
+
+static void append_packet_cache
+(
+    lwlibav_packet_cache_t *pcp,
+    const AVPacket         *pkt
+)
+{
+    if( pcp->size + pkt->size > pcp->budget )
+        goto stop_recording;
+    if( pcp->count == pcp->capacity )
+    {
+        uint32_t capacity = pcp->capacity ? 2 * pcp->capacity : 64;
+        AVPacket **temp = (AVPacket **)realloc( pcp->packets, capacity * sizeof(AVPacket *) );
+        if( !temp )
+            goto stop_recording;
+        memset( &temp[ pcp->capacity ], 0, (capacity - pcp->capacity) * sizeof(AVPacket *) );
+        pcp->packets  = temp;
+        pcp->capacity = capacity;
+    }
+    if( !pcp->packets[ pcp->count ] && !(pcp->packets[ pcp->count ] = av_packet_alloc()) )
+        goto stop_recording;
+    if( av_packet_ref( pcp->packets[ pcp->count ], pkt ) < 0 )
+        goto stop_recording;
+    pcp->size    += pkt->size;
+    pcp->position = ++ pcp->count;
+    return;
+stop_recording:
+    /* The packets can't be fed instead of demuxing any more since the demuxer goes ahead of them. */
+    reset_packet_cache( pcp, 0, 0 );
+}
+
+/* Read the packet of the picture straight from the input file by its file offset and size in the index.
+ * Return 0 on success, 1 if the picture is beyond the stream, otherwise a negative value. */
+static int read_video_packet_directly
+(
+    lwlibav_video_decode_handler_t *vdhp,
+    AVIOContext                    *pb,
+    uint32_t                        picture_number,     /* decoding order */
+    AVPacket                       *pkt
+)
+{
+    av_packet_unref( pkt );
+    if( picture_number == 0 || picture_number > vdhp->frame_count )
+    {
+        /* Return a null packet. */
+        pkt->data = NULL;
+        pkt->size = 0;
+        return 1;
+    }
+    video_frame_table_t *table = vdhp->frame_table;
+    uint32_t p    = vdhp->order_converter ? vdhp->order_converter[picture_number].decoding_to_presentation : picture_number;
+    int64_t  pos  = lw_vframe_file_offset( table, p );
+    int      size = (int)lw_vframe_packet_size( table, p );
+    if( av_new_packet( pkt, size ) < 0 )
+        return -1;
+    if( avio_seek( pb, pos, SEEK_SET ) != pos
+     || avio_read( pb, pkt->data, size ) != size )
+    {
+        av_packet_unref( pkt );
+        return -1;
+    }
+    pkt->pos          = pos;
+    pkt->pts          = lw_vframe_pts( table, p );
+    pkt->dts          = lw_vframe_dts( table, p );
+    pkt->stream_index = vdhp->stream_index;
+    if( lw_vframe_flags( table, p ) & LW_VFRAME_FLAG_KEY )
+        pkt->flags |= AV_PKT_FLAG_KEY;
+    return 0;
+}
+
+/* Get the next packet of the stream straight from the input file if available.
+ * Otherwise, get it from the packet cache if the cached packets are being fed again,
+ * or from the demuxer and keep it for the following seeks within the GOP. */
+static int get_video_packet
+(
+    lwlibav_video_decode_handler_t *vdhp,
+    uint32_t                        picture_number,
+    AVPacket                       *pkt
+)
+{
+    if( vdhp->direct_reader.pb )
+    {
+        int ret = read_video_packet_directly( vdhp, vdhp->direct_reader.pb, picture_number, pkt );
+        if( ret < 0 )
+        {
+            /* Fall back on the demuxer, which needs seeking since it isn't at this picture. */
+            lw_log_show( &vdhp->lh, LW_LOG_WARNING, "Failed to read a video packet directly. Demuxing packets from now on." );
+            avio_closep( &vdhp->direct_reader.pb );
+            vdhp->direct_reader.failed = 1;
+        }
+        return ret;
+    }
+    lwlibav_packet_cache_t *pcp = &vdhp->packet_cache;
+    if( pcp->position < pcp->count )
+    {
+        av_packet_unref( pkt );
+        if( av_packet_ref( pkt, pcp->packets[ pcp->position++ ] ) == 0 )
+            return 0;
+        lw_log_show( &vdhp->lh, LW_LOG_ERROR, "Failed to reference a cached video packet." );
+        reset_packet_cache( pcp, 0, 0 );
+        return 1;
+    }
+    int ret = lwlibav_get_av_frame( vdhp->format, vdhp->stream_index, picture_number, pkt );
+    if( ret == 0 && pcp->budget )
+    {
+        /* Keep only the packets from the last random accessible picture in the index, which seeks resolve to.
+         * Once stopped by exceeding the budget, recording restarts from here since the demuxer is contiguous again. */
+        if( vdhp->rap_list && picture_number <= vdhp->frame_count && vdhp->rap_list[picture_number] == picture_number
+         && (pcp->count > 0 || !pcp->recording) )
+            reset_packet_cache( pcp, picture_number, 1 );
+        if( pcp->recording )
+            append_packet_cache( pcp, pkt );
+    }
+    return ret;
+}
+
 static int decode_video_picture
 (
     lwlibav_video_decode_handler_t *vdhp,
@@ -490,9 +950,14 @@ static int decode_video_picture
     /* Get a packet containing a frame. */
     uint32_t picture_number = *current;
     AVPacket *pkt = &vdhp->packet;
-    int ret = lwlibav_get_av_frame( vdhp->format, vdhp->stream_index, picture_number, pkt );
+    int ret = get_video_packet( vdhp, picture_number, pkt );
     if( ret > 0 )
         return ret;
+    else if( ret < 0 )
+    {
+        *pkt_pts = AV_NOPTS_VALUE;
+        return -2;
+    }
     /* Correct the current picture number in order to match DTS since libavformat might have sought wrong position. */
     uint32_t correction_distance = 0;
     if( picture_number == rap_number && (vdhp->lw_seek_flags & SEEK_DTS_BASED) )
@@ -504,6 +969,9 @@ static int decode_video_picture
         if( *current > picture_number )
             /* It seems we got a more backward frame rather than what we requested. */
             correction_distance = *current - picture_number;
+        if( *current != picture_number )
+            /* The packets kept so far don't start from the random accessible picture. */
+            reset_packet_cache( &vdhp->packet_cache, 0, 0 );
         *current = picture_number;
     }
     if( pkt->flags & AV_PKT_FLAG_KEY )
@@ -511,9 +979,14 @@ static int decode_video_picture
     /* Avoid decoding frames until the seek correction caused by too backward is done. */
     while( correction_distance )
     {
-        ret = lwlibav_get_av_frame( vdhp->format, vdhp->stream_index, ++picture_number, pkt );
+        ret = get_video_packet( vdhp, ++picture_number, pkt );
         if( ret > 0 )
             return ret;
+        else if( ret < 0 )
+        {
+            *pkt_pts = AV_NOPTS_VALUE;
+            return -2;
+        }
         if( pkt->flags & AV_PKT_FLAG_KEY )
             vdhp->last_rap_number = picture_number;
         *current = picture_number;
@@ -550,25 +1023,55 @@ static void find_random_accessible_point
     uint32_t                       *rap_number
 )
 {
-    int is_leading = !!(vdhp->frame_list[presentation_picture_number].flags & LW_VFRAME_FLAG_LEADING);
+    int is_leading = !!(lw_vframe_flags( vdhp->frame_table, presentation_picture_number ) & LW_VFRAME_FLAG_LEADING);
     if( decoding_picture_number == 0 )
-        decoding_picture_number = vdhp->frame_list[presentation_picture_number].sample_number;
-    *rap_number = decoding_picture_number;
-    while( *rap_number )
-    {
-        if( vdhp->keyframe_list[ *rap_number ] )
-        {
-            if( !is_leading )
-                break;
-            /* Shall be decoded from more past random access point. */
-            is_leading = 0;
-        }
-        --(*rap_number);
-    }
+        decoding_picture_number = lw_vframe_sample_number( vdhp->frame_table, presentation_picture_number );
+    *rap_number = vdhp->rap_list[decoding_picture_number];
+    if( is_leading && *rap_number )
+        /* Shall be decoded from more past random access point. */
+        *rap_number = vdhp->rap_list[*rap_number - 1];
     if( *rap_number == 0 )
         *rap_number = 1;
 }
 
+/* Return the index of the first entry whose random accessible picture is not less than the given one. */
+static uint32_t search_rap_failure
+(
+    const lwlibav_rap_failure_list_t *rflp,
+    uint32_t                          rap_number
+)
+{
+    uint32_t lower = 0;
+    uint32_t upper = rflp->count;
+    while( lower < upper )
+    {
+        uint32_t middle = lower + (upper - lower) / 2;
+        if( rflp->entries[middle].rap_number < rap_number )
+            lower = middle + 1;
+        else
+            upper = middle;
+    }
+    return lower;
+}
+
+/* Replace the random accessible picture found unusable with the one which worked instead.
+ * Return 1 if decoding from it worked only by ignoring errors, otherwise 0. */
+static int avoid_rap_failure
+(
+    lwlibav_video_decode_handler_t *vdhp,
+    uint32_t                       *rap_number
+)
+{
+    lwlibav_rap_failure_list_t *rflp = &vdhp->rap_failures;
+    if( rflp->count == 0 )
+        return 0;
+    uint32_t i = search_rap_failure( rflp, *rap_number );
+    if( i == rflp->count || rflp->entries[i].rap_number != *rap_number )
+        return 0;
+    *rap_number = rflp->entries[i].fallback_number;
+    return rflp->entries[i].aggressive;
+}
+
 static int64_t get_random_accessible_point_position
 (
     lwlibav_video_decode_handler_t *vdhp,
@@ -578,10 +1081,10 @@ static int64_t get_random_accessible_point_position
     uint32_t presentation_rap_number = vdhp->order_converter
                                      ? vdhp->order_converter[rap_number].decoding_to_presentation
                                      : rap_number;
-    return (vdhp->lw_seek_flags & SEEK_POS_BASED) ? vdhp->frame_list[presentation_rap_number].file_offset
-         : (vdhp->lw_seek_flags & SEEK_PTS_BASED) ? vdhp->frame_list[presentation_rap_number].pts
-         : (vdhp->lw_seek_flags & SEEK_DTS_BASED) ? vdhp->frame_list[presentation_rap_number].dts
-         :                                          vdhp->frame_list[presentation_rap_number].sample_number;
+    return (vdhp->lw_seek_flags & SEEK_POS_BASED) ? lw_vframe_file_offset( vdhp->frame_table, presentation_rap_number )
+         : (vdhp->lw_seek_flags & SEEK_PTS_BASED) ? lw_vframe_pts( vdhp->frame_table, presentation_rap_number )
+         : (vdhp->lw_seek_flags & SEEK_DTS_BASED) ? lw_vframe_dts( vdhp->frame_table, presentation_rap_number )
+         :                                          lw_vframe_sample_number( vdhp->frame_table, presentation_rap_number );
 }
 
 static inline uint32_t is_half_frame
@@ -591,7 +1094,7 @@ static inline uint32_t is_half_frame
 )
 {
     return (output_picture_number <= vdhp->frame_count
-         && vdhp->frame_list[output_picture_number].repeat_pict == 0);
+         && lw_vframe_repeat_pict( vdhp->frame_table, output_picture_number ) == 0);
 }
 
 static void correct_output_delay
@@ -656,64 +1159,324 @@ static int lavf_seek_frame
     return av_seek_frame(s, stream_index, timestamp, flags);
 }
 
-static uint32_t seek_video
+static void *reset_spare_decoders
 (
-    lwlibav_video_decode_handler_t *vdhp,
-    AVFrame                        *frame,
-    uint32_t                        presentation_picture_number,
-    uint32_t                        rap_number,
-    int64_t                         rap_pos,
-    int                             error_ignorance
+    void *arg
 )
 {
-    /* Prepare to decode from random accessible picture. */
-    lwlibav_extradata_handler_t *exhp = &vdhp->exh;
-    int extradata_index = vdhp->frame_list[rap_number].extradata_index;
-    if( extradata_index != exhp->current_index )
-        /* Update the decoder configuration. */
-        lwlibav_update_configuration( (lwlibav_decode_handler_t *)vdhp, rap_number, extradata_index, rap_pos );
-    else
-        lwlibav_flush_buffers( (lwlibav_decode_handler_t *)vdhp );
-    if( vdhp->error )
-        return 0;
-    if( lavf_seek_frame( vdhp->format, vdhp->stream_index, rap_pos, vdhp->av_seek_flags ) < 0 )
-        lavf_seek_frame( vdhp->format, vdhp->stream_index, rap_pos, vdhp->av_seek_flags | AVSEEK_FLAG_ANY );
-    int      got_picture  = 0;
-    int      output_ready = 0;
-    int64_t  rap_pts = AV_NOPTS_VALUE;
-    uint32_t current;
-    uint32_t decoder_delay = get_decoder_delay( vdhp->ctx );
-    uint32_t thread_delay  = decoder_delay - vdhp->ctx->has_b_frames;
-    uint32_t goal = presentation_picture_number + decoder_delay;
-    exhp->delay_count     = 0;
-    vdhp->last_half_frame = 0;
-    for( current = rap_number; current <= goal; current++ )
+    lwlibav_spare_decoders_t *sdp = (lwlibav_spare_decoders_t *)arg;
+    lw_mutex_lock( sdp->mutex );
+    while( !sdp->stop )
     {
-        int64_t pkt_pts;
-        int ret = decode_video_picture( vdhp, frame, &got_picture, &pkt_pts, &current, goal, rap_number );
-        if( ret == -2 )
-            return 0;
-        else if( ret >= 1 )
-            /* No decoding occurs. */
-            break;
-        if( got_picture )
+        lwlibav_spare_decoder_t *entry = NULL;
+        for( int i = 0; i < sdp->capacity && !entry; i++ )
+            if( sdp->entries[i].state == LW_SPARE_DECODER_DIRTY )
+                entry = &sdp->entries[i];
+        if( !entry )
         {
-            exhp->delay_count = MIN( decoder_delay, current - rap_number );
-            uint32_t picture_number;
-            int64_t output_id = get_output_order_id( frame );
-            if( output_id != AV_NOPTS_VALUE )
-            {
-                picture_number = (uint32_t)output_id;
-                uint32_t estimated_picture_number = current - exhp->delay_count;
-                correct_output_delay( vdhp, &goal, picture_number, estimated_picture_number );
-                if( picture_number == presentation_picture_number )
-                {
-                    /* Got the desired output frame now.
-                     * Shorten the decoder delay if we got a frame earlier than expected. */;
-                    vdhp->last_half_frame = is_half_frame( vdhp, picture_number );
-                    return current + 1;
-                }
-                decoder_delay = exhp->delay_count;
+            lw_cond_wait( sdp->cond, sdp->mutex );
+            continue;
+        }
+        /* The entry in resetting is neither taken nor evicted, so it can be reset without locking. */
+        entry->state = LW_SPARE_DECODER_RESETTING;
+        lw_mutex_unlock( sdp->mutex );
+        int ret = lwlibav_reset_decoder( &entry->ctx, entry->codecpar, sdp->drc, sdp->ff_options );
+        lw_mutex_lock( sdp->mutex );
+        if( ret < 0 )
+            free_spare_decoder( entry );
+        else
+            entry->state = LW_SPARE_DECODER_READY;
+        lw_cond_broadcast( sdp->cond );
+    }
+    lw_mutex_unlock( sdp->mutex );
+    return NULL;
+}
+
+static int start_spare_decoders
+(
+    lwlibav_video_decode_handler_t *vdhp
+)
+{
+    lwlibav_spare_decoders_t *sdp = &vdhp->spare_decoders;
+    sdp->entries = (lwlibav_spare_decoder_t *)lw_malloc_zero( sdp->capacity * sizeof(lwlibav_spare_decoder_t) );
+    sdp->mutex   = lw_mutex_create();
+    sdp->cond    = lw_cond_create();
+    if( !sdp->entries || !sdp->mutex || !sdp->cond )
+        goto fail;
+    sdp->drc        = vdhp->drc;
+    sdp->ff_options = vdhp->ff_options;
+    sdp->thread     = lw_thread_create( reset_spare_decoders, sdp );
+    if( !sdp->thread )
+        goto fail;
+    return 0;
+fail:
+    stop_spare_decoders( sdp );
+    sdp->capacity = 0;
+    lw_log_show( &vdhp->lh, LW_LOG_WARNING, "Failed to start keeping spare decoders. Reopen decoders instead." );
+    return -1;
+}
+
+/* Take the spare decoder opened with the extradata after waiting for its reset.
+ * Return 1 if taken, otherwise 0. */
+static int take_spare_decoder
+(
+    lwlibav_spare_decoders_t *sdp,
+    int                       extradata_index,
+    AVCodecContext          **ctx,
+    AVCodecParameters       **codecpar
+)
+{
+    if( !sdp->thread )
+        return 0;
+    int taken = 0;
+    lw_mutex_lock( sdp->mutex );
+    while( 1 )
+    {
+        lwlibav_spare_decoder_t *entry = NULL;
+        for( int i = 0; i < sdp->capacity; i++ )
+            if( sdp->entries[i].state != LW_SPARE_DECODER_EMPTY && sdp->entries[i].extradata_index == extradata_index )
+            {
+                entry = &sdp->entries[i];
+                if( entry->state == LW_SPARE_DECODER_READY )
+                    break;
+            }
+        if( !entry )
+            break;
+        if( entry->state == LW_SPARE_DECODER_READY )
+        {
+            *ctx            = entry->ctx;
+            *codecpar       = entry->codecpar;
+            entry->ctx      = NULL;
+            entry->codecpar = NULL;
+            entry->state    = LW_SPARE_DECODER_EMPTY;
+            taken = 1;
+            break;
+        }
+        /* Resetting the spare decoder is cheaper than opening a new decoder on this thread. */
+        lw_cond_wait( sdp->cond, sdp->mutex );
+    }
+    lw_mutex_unlock( sdp->mutex );
+    return taken;
+}
+
+/* Keep the decoder swapped out as a spare one to be reset by the worker.
+ * If no entry is available, the least recently swapped out one is evicted. */
+static void park_spare_decoder
+(
+    lwlibav_video_decode_handler_t *vdhp,
+    AVCodecContext                 *ctx,
+    AVCodecParameters              *codecpar,
+    int                             extradata_index
+)
+{
+    lwlibav_spare_decoders_t *sdp = &vdhp->spare_decoders;
+    if( sdp->thread || (sdp->capacity > 0 && start_spare_decoders( vdhp ) == 0) )
+    {
+        lw_mutex_lock( sdp->mutex );
+        lwlibav_spare_decoder_t *entry = NULL;
+        for( int i = 0; i < sdp->capacity; i++ )
+        {
+            lwlibav_spare_decoder_t *candidate = &sdp->entries[i];
+            if( candidate->state == LW_SPARE_DECODER_EMPTY )
+            {
+                entry = candidate;
+                break;
+            }
+            if( candidate->state != LW_SPARE_DECODER_RESETTING
+             && (!entry || candidate->last_use < entry->last_use) )
+                entry = candidate;
+        }
+        if( entry )
+        {
+            /* Swap the decoders so that the evicted one is closed after unlocking since closing could take long. */
+            AVCodecContext    *evicted_ctx      = entry->ctx;
+            AVCodecParameters *evicted_codecpar = entry->codecpar;
+            entry->state           = LW_SPARE_DECODER_DIRTY;
+            entry->extradata_index = extradata_index;
+            entry->last_use        = ++ sdp->use_count;
+            entry->ctx             = ctx;
+            entry->codecpar        = codecpar;
+            ctx      = evicted_ctx;
+            codecpar = evicted_codecpar;
+            lw_cond_broadcast( sdp->cond );
+        }
+        lw_mutex_unlock( sdp->mutex );
+    }
+    if( ctx )
+        ctx->opaque = NULL;
+    avcodec_free_context( &ctx );
+    avcodec_parameters_free( &codecpar );
+}
+
+/* Switch the decoder to the extradata to decode from.
+ * The spare decoder opened with it is swapped in if present, otherwise a new decoder is opened and set up.
+ * The current decoder is kept as a spare one in either case. */
+static void update_video_configuration
+(
+    lwlibav_video_decode_handler_t *vdhp,
+    uint32_t                        rap_number,
+    int                             extradata_index,
+    int64_t                         rap_pos
+)
+{
+    lwlibav_extradata_handler_t *exhp     = &vdhp->exh;
+    lwlibav_spare_decoders_t    *sdp      = &vdhp->spare_decoders;
+    AVCodecParameters           *codecpar = vdhp->format->streams[ vdhp->stream_index ]->codecpar;
+    AVCodecParameters           *current_codecpar;
+    if( sdp->capacity == 0 || exhp->entry_count == 0 || extradata_index < 0 || exhp->current_index < 0
+     || !(current_codecpar = avcodec_parameters_alloc()) )
+    {
+        lwlibav_update_configuration( (lwlibav_decode_handler_t *)vdhp, rap_number, extradata_index, rap_pos, NULL );
+        return;
+    }
+    if( avcodec_parameters_copy( current_codecpar, codecpar ) < 0 )
+    {
+        avcodec_parameters_free( &current_codecpar );
+        lwlibav_update_configuration( (lwlibav_decode_handler_t *)vdhp, rap_number, extradata_index, rap_pos, NULL );
+        return;
+    }
+    int                current_index = exhp->current_index;
+    AVCodecContext    *current_ctx   = NULL;
+    AVCodecContext    *spare_ctx;
+    AVCodecParameters *spare_codecpar;
+    if( take_spare_decoder( sdp, extradata_index, &spare_ctx, &spare_codecpar ) )
+    {
+        current_ctx = vdhp->ctx;
+        vdhp->ctx   = spare_ctx;
+        if( avcodec_parameters_copy( codecpar, spare_codecpar ) < 0 )
+        {
+            vdhp->error = 1;
+            lw_log_show( &vdhp->lh, LW_LOG_FATAL, "Failed to restore the codec parameters.\n"
+                         "It is recommended you reopen the file." );
+        }
+        avcodec_parameters_free( &spare_codecpar );
+        vdhp->ctx->get_buffer2 = exhp->get_buffer ? exhp->get_buffer : avcodec_default_get_buffer2;
+        vdhp->ctx->opaque      = current_ctx->opaque;
+        exhp->current_index    = extradata_index;
+        exhp->delay_count      = 0;
+    }
+    else
+        lwlibav_update_configuration( (lwlibav_decode_handler_t *)vdhp, rap_number, extradata_index, rap_pos, &current_ctx );
+    park_spare_decoder( vdhp, current_ctx, current_codecpar, current_index );
+}
+
+/* Flush the decoder to decode from a random accessible picture.
+ * The decoder that needs reopening for that is swapped for the spare one reset in the background. */
+static void flush_video_decoder
+(
+    lwlibav_video_decode_handler_t *vdhp
+)
+{
+    lwlibav_extradata_handler_t *exhp     = &vdhp->exh;
+    AVCodecParameters           *codecpar = vdhp->format->streams[ vdhp->stream_index ]->codecpar;
+    AVCodecParameters           *current_codecpar;
+    if( vdhp->spare_decoders.capacity == 0 || exhp->current_index < 0 || !lwlibav_decoder_needs_reopen( vdhp->ctx )
+     || !(current_codecpar = avcodec_parameters_alloc()) )
+    {
+        lwlibav_flush_buffers( (lwlibav_decode_handler_t *)vdhp );
+        return;
+    }
+    AVCodecContext    *current_ctx = vdhp->ctx;
+    AVCodecContext    *spare_ctx;
+    AVCodecParameters *spare_codecpar;
+    if( avcodec_parameters_copy( current_codecpar, codecpar ) < 0 )
+    {
+        avcodec_parameters_free( &current_codecpar );
+        lwlibav_flush_buffers( (lwlibav_decode_handler_t *)vdhp );
+        return;
+    }
+    if( take_spare_decoder( &vdhp->spare_decoders, exhp->current_index, &spare_ctx, &spare_codecpar ) )
+    {
+        avcodec_parameters_free( &spare_codecpar );
+        spare_ctx->opaque = current_ctx->opaque;
+        vdhp->ctx = spare_ctx;
+    }
+    else if( open_decoder( &vdhp->ctx, codecpar, current_ctx->codec, current_ctx->thread_count, vdhp->drc, vdhp->ff_options ) < 0 )
+    {
+        /* Flush by the usual way, which reports the failure. */
+        vdhp->ctx = current_ctx;
+        avcodec_parameters_free( &current_codecpar );
+        lwlibav_flush_buffers( (lwlibav_decode_handler_t *)vdhp );
+        return;
+    }
+    else
+        vdhp->ctx->opaque = current_ctx->opaque;
+    exhp->delay_count = 0;
+    park_spare_decoder( vdhp, current_ctx, current_codecpar, exhp->current_index );
+}
+
+static uint32_t seek_video
+(
+    lwlibav_video_decode_handler_t *vdhp,
+    AVFrame                        *frame,
+    uint32_t                        presentation_picture_number,
+    uint32_t                        rap_number,
+    int64_t                         rap_pos,
+    int                             error_ignorance
+)
+{
+    /* Prepare to decode from random accessible picture. */
+    lwlibav_extradata_handler_t *exhp = &vdhp->exh;
+    lwlibav_packet_cache_t      *pcp  = &vdhp->packet_cache;
+    int extradata_index = lw_vframe_extradata_index( vdhp->frame_table, rap_number );
+    int reconfigured    = (extradata_index != exhp->current_index);
+    if( reconfigured )
+        /* Update the decoder configuration. */
+        update_video_configuration( vdhp, rap_number, extradata_index, rap_pos );
+    else
+        flush_video_decoder( vdhp );
+    if( vdhp->error )
+        return 0;
+    if( vdhp->direct_reader.pb )
+    {
+        /* Each packet is read at its file offset, so neither the demuxer nor the packet cache is used. */
+    }
+    else if( !reconfigured && pcp->count && pcp->rap_number == rap_number )
+        /* Feed the packets kept from the random accessible picture again without touching the demuxer.
+         * The decoder configuration is updated by reading the demuxer, so this is not applicable then. */
+        pcp->position = 0;
+    else
+    {
+        reset_packet_cache( pcp, rap_number, 1 );
+        if( lavf_seek_frame( vdhp->format, vdhp->stream_index, rap_pos, vdhp->av_seek_flags ) < 0 )
+            lavf_seek_frame( vdhp->format, vdhp->stream_index, rap_pos, vdhp->av_seek_flags | AVSEEK_FLAG_ANY );
+    }
+    int      got_picture  = 0;
+    int      output_ready = 0;
+    int64_t  rap_pts = AV_NOPTS_VALUE;
+    uint32_t current;
+    uint32_t decoder_delay = get_decoder_delay( vdhp->ctx );
+    uint32_t thread_delay  = decoder_delay - vdhp->ctx->has_b_frames;
+    uint32_t goal = presentation_picture_number + decoder_delay;
+    exhp->delay_count     = 0;
+    vdhp->last_half_frame = 0;
+    for( current = rap_number; current <= goal; current++ )
+    {
+        int64_t pkt_pts;
+        int ret = decode_video_picture( vdhp, frame, &got_picture, &pkt_pts, &current, goal, rap_number );
+        if( ret == -2 )
+            return 0;
+        else if( ret >= 1 )
+            /* No decoding occurs. */
+            break;
+        if( got_picture )
+        {
+            exhp->delay_count = MIN( decoder_delay, current - rap_number );
+            uint32_t picture_number;
+            int64_t output_id = get_output_order_id( frame );
+            if( output_id != AV_NOPTS_VALUE )
+            {
+                picture_number = (uint32_t)output_id;
+                uint32_t estimated_picture_number = current - exhp->delay_count;
+                correct_output_delay( vdhp, &goal, picture_number, estimated_picture_number );
+                if( picture_number == presentation_picture_number )
+                {
+                    /* Got the desired output frame now.
+                     * Shorten the decoder delay if we got a frame earlier than expected. */;
+                    vdhp->last_half_frame = is_half_frame( vdhp, picture_number );
+                    return current + 1;
+                }
+                decoder_delay = exhp->delay_count;
             }
             else
             {
@@ -732,7 +1495,7 @@ static uint32_t seek_video
         /* Handle decoder delay derived from PAFF field coded pictures. */
         else if( current <= vdhp->frame_count
               && current >= rap_number + decoder_delay
-              && vdhp->frame_list[current].repeat_pict == 0 )
+              && lw_vframe_repeat_pict( vdhp->frame_table, current ) == 0 )
         {
             /* No output frame since the second field coded picture of the next frame is not decoded yet. */
             if( decoder_delay - thread_delay < 2 * vdhp->ctx->has_b_frames + 1UL )
@@ -789,12 +1552,12 @@ static inline int field_number_of_picture_in_frame
 )
 {
     if( frame->top_field_first )
-        return vdhp->frame_list[output_picture_number].field_info == LW_FIELD_INFO_TOP    ? 1
-             : vdhp->frame_list[output_picture_number].field_info == LW_FIELD_INFO_BOTTOM ? 2
+        return lw_vframe_field_info( vdhp->frame_table, output_picture_number ) == LW_FIELD_INFO_TOP    ? 1
+             : lw_vframe_field_info( vdhp->frame_table, output_picture_number ) == LW_FIELD_INFO_BOTTOM ? 2
              :                                                                              0;
     else
-        return vdhp->frame_list[output_picture_number].field_info == LW_FIELD_INFO_TOP    ? 2
-             : vdhp->frame_list[output_picture_number].field_info == LW_FIELD_INFO_BOTTOM ? 1
+        return lw_vframe_field_info( vdhp->frame_table, output_picture_number ) == LW_FIELD_INFO_TOP    ? 2
+             : lw_vframe_field_info( vdhp->frame_table, output_picture_number ) == LW_FIELD_INFO_BOTTOM ? 1
              :                                                                              0;
 }
 
@@ -969,7 +1732,7 @@ static int get_frame
                 picture_number        = estimated_picture_number;
                 vdhp->last_half_frame = last_half_frame;
             }
-            current += (vdhp->frame_list[picture_number].flags & LW_VFRAME_FLAG_COUNTERPART_MISSING) ? 2 : 1;
+            current += (lw_vframe_flags( vdhp->frame_table, picture_number ) & LW_VFRAME_FLAG_COUNTERPART_MISSING) ? 2 : 1;
         }
     return got_picture ? REQUESTED_FRAME_IS_ALREADY_ON_OUTPUT_FRAME_BUFFER : -1;
 return_last_frame:
@@ -993,6 +1756,126 @@ static inline uint32_t get_last_half_offset
          :                     0;
 }
 
+/* Return 1 if decoding forward from the last fed picture is expected to get the requested picture faster than seeking.
+ * Otherwise return 0. */
+static int is_decoding_forward_cheaper
+(
+    lwlibav_video_decode_handler_t *vdhp,
+    uint32_t                        picture_number,
+    uint32_t                        last_frame_number
+)
+{
+    if( picture_number <= last_frame_number )
+        return 0;
+    if( vdhp->forward_seek_threshold )
+        return picture_number <= last_frame_number + vdhp->forward_seek_threshold;
+    lwlibav_seek_cost_t *scp = &vdhp->seek_cost;
+    if( scp->decode_samples == 0 || scp->seek_samples == 0 )
+        return picture_number <= last_frame_number + SEEK_COST_FALLBACK_THRESHOLD;
+    /* Both ways decode the pictures from the later of the random accessible picture and the next picture to feed.
+     * Seeking skips the pictures in between at the cost of a seek. */
+    uint32_t rap_number;
+    find_random_accessible_point( vdhp, picture_number, 0, &rap_number );
+    avoid_rap_failure( vdhp, &rap_number );
+    uint32_t next_number = vdhp->last_fed_picture_number + 1;
+    return rap_number <= next_number
+        || (rap_number - next_number) * scp->stats.decode_cost <= scp->stats.seek_cost;
+}
+
+static inline void update_moving_average
+(
+    double   *average,
+    uint64_t *sample_count,
+    double    sample
+)
+{
+    *average = (*sample_count)++ ? *average + SEEK_COST_WEIGHT * (sample - *average) : sample;
+}
+
+static void update_seek_cost
+(
+    lwlibav_video_decode_handler_t *vdhp,
+    int64_t                         elapsed_time,
+    uint32_t                        first_fed_number,
+    int                             seeked
+)
+{
+    lwlibav_seek_cost_t *scp = &vdhp->seek_cost;
+    /* Only the holder of the decoder updates the statistics, but lwlibav_video_get_seek_stats() may read them meanwhile. */
+    lw_mutex_t *mutex = vdhp->prefetch.mutex;
+    if( mutex )
+        lw_mutex_lock( mutex );
+    if( seeked )
+        ++ scp->stats.seek_count;
+    else
+        ++ scp->stats.forward_count;
+    /* Nothing is measured if no decoding occurred. */
+    if( vdhp->last_fed_picture_number >= first_fed_number )
+    {
+        double decoded_count = vdhp->last_fed_picture_number - first_fed_number + 1;
+        if( !seeked )
+            update_moving_average( &scp->stats.decode_cost, &scp->decode_samples, elapsed_time / decoded_count );
+        else if( scp->decode_samples )
+            /* Separate the time to decode from the random accessible picture. */
+            update_moving_average( &scp->stats.seek_cost, &scp->seek_samples,
+                                   MAX( elapsed_time - decoded_count * scp->stats.decode_cost, 0.0 ) );
+    }
+    if( mutex )
+        lw_mutex_unlock( mutex );
+}
+
+/* Record the random accessible pictures from which decoding failed and the one from which decoding worked by retrying.
+ * Each unusable picture is also recorded to the index file by clearing its keyframe flag if requested. */
+static void record_rap_failures
+(
+    lwlibav_video_decode_handler_t *vdhp,
+    const uint32_t                 *failed_numbers,
+    int                             failed_count,
+    uint32_t                        fallback_number,
+    int                             aggressive
+)
+{
+    lwlibav_rap_failure_list_t *rflp = &vdhp->rap_failures;
+    for( int i = 0; i < failed_count; i++ )
+    {
+        uint32_t rap_number = failed_numbers[i];
+        uint32_t index      = search_rap_failure( rflp, rap_number );
+        if( index == rflp->count || rflp->entries[index].rap_number != rap_number )
+        {
+            if( rflp->count == rflp->capacity )
+            {
+                uint32_t capacity = rflp->capacity ? 2 * rflp->capacity : 16;
+                lwlibav_rap_failure_t *temp = (lwlibav_rap_failure_t *)realloc( rflp->entries, capacity * sizeof(lwlibav_rap_failure_t) );
+                if( !temp )
+                    return;
+                rflp->entries  = temp;
+                rflp->capacity = capacity;
+            }
+            memmove( &rflp->entries[index + 1], &rflp->entries[index], (rflp->count - index) * sizeof(lwlibav_rap_failure_t) );
+            ++ rflp->count;
+        }
+        else if( rflp->entries[index].fallback_number == fallback_number
+              && rflp->entries[index].aggressive      == aggressive )
+            continue;
+        rflp->entries[index].rap_number      = rap_number;
+        rflp->entries[index].fallback_number = fallback_number;
+        rflp->entries[index].aggressive      = aggressive;
+        /* Only falling back to a preceding picture is expressible in the index file. */
+        if( !rflp->index_file_path || rap_number == fallback_number )
+            continue;
+        uint32_t presentation_rap_number = vdhp->order_converter
+                                         ? vdhp->order_converter[rap_number].decoding_to_presentation
+                                         : rap_number;
+        int64_t file_offset = lw_vframe_file_offset( vdhp->frame_table, presentation_rap_number );
+        if( file_offset == -1
+         || lwindex_clear_keyframe_flag( rflp->index_file_path, vdhp->stream_index, file_offset ) < 0 )
+        {
+            lw_log_show( &vdhp->lh, LW_LOG_WARNING, "Failed to record the unusable random accessible picture to the index file." );
+            lw_freep( &rflp->index_file_path );
+        }
+    }
+}
+
 static int get_requested_picture
 (
     lwlibav_video_decode_handler_t *vdhp,
@@ -1011,7 +1894,7 @@ static int get_requested_picture
         /* The last frame is the requested frame. */
         if( copy_last_req_frame( vdhp, frame ) < 0 )
             goto video_fail;
-        extradata_index = vdhp->frame_list[picture_number].extradata_index;
+        extradata_index = lw_vframe_extradata_index( vdhp->frame_table, picture_number );
         goto return_frame;
     }
     if( picture_number < vdhp->first_valid_frame_number || vdhp->frame_count == 1 )
@@ -1023,7 +1906,7 @@ static int get_requested_picture
         /* Force seeking at the next access for valid video frame. */
         vdhp->last_frame_number = vdhp->frame_count + 1;
         /* Return the first valid video frame. */
-        extradata_index = vdhp->frame_list[ vdhp->first_valid_frame_number ].extradata_index;
+        extradata_index = lw_vframe_extradata_index( vdhp->frame_table, vdhp->first_valid_frame_number );
         goto return_frame;
     }
     uint32_t start_number;  /* number of picture, for normal decoding, where decoding starts excluding decoding delay */
@@ -1031,8 +1914,11 @@ static int get_requested_picture
     uint32_t last_frame_number = vdhp->last_frame_number + last_half_offset;
     int      seek_mode         = vdhp->seek_mode;
     int64_t  rap_pos           = INT64_MIN;
-    if( picture_number > last_frame_number
-     && picture_number <= last_frame_number + vdhp->forward_seek_threshold )
+    int64_t  start_time        = av_gettime_relative();
+    uint32_t first_fed_number  = vdhp->last_fed_picture_number + 1;
+    int      seeked            = 0;
+    vdhp->direct_reader.failed = 0;
+    if( is_decoding_forward_cheaper( vdhp, picture_number, last_frame_number ) )
     {
         start_number = vdhp->last_fed_picture_number + 1;
         rap_number   = vdhp->last_rap_number;
@@ -1040,6 +1926,8 @@ static int get_requested_picture
     else
     {
         find_random_accessible_point( vdhp, picture_number, 0, &rap_number );
+        if( avoid_rap_failure( vdhp, &rap_number ) && seek_mode == SEEK_MODE_NORMAL )
+            seek_mode = SEEK_MODE_AGGRESSIVE;
         if( rap_number == vdhp->last_rap_number && picture_number > last_frame_number )
             start_number = vdhp->last_fed_picture_number + 1;
         else
@@ -1047,14 +1935,27 @@ static int get_requested_picture
             /* Require starting to decode from random accessible picture. */
             rap_pos = get_random_accessible_point_position( vdhp, rap_number );
             vdhp->last_rap_number = rap_number;
+            first_fed_number = rap_number;
+            seeked           = 1;
             start_number = seek_video( vdhp, frame, picture_number, rap_number, rap_pos, seek_mode != SEEK_MODE_NORMAL );
         }
     }
     /* Get frame containing the requested picture. */
-    int error_count = 0;
+    int      error_count = 0;
+    uint32_t failed_rap_numbers[MAX_ERROR_COUNT + 1];
+    int      failed_rap_count = 0;
     while( start_number == 0
         || get_frame( vdhp, frame, start_number, picture_number, rap_number ) < 0 )
     {
+        if( vdhp->direct_reader.failed && !vdhp->error )
+        {
+            /* Not a failure of the random accessible picture. Decode from it again by demuxing. */
+            vdhp->direct_reader.failed = 0;
+            rap_pos = get_random_accessible_point_position( vdhp, rap_number );
+            vdhp->last_rap_number = rap_number;
+            start_number = seek_video( vdhp, frame, picture_number, rap_number, rap_pos, seek_mode != SEEK_MODE_NORMAL );
+            continue;
+        }
         /* Failed to get requested picture. */
         if( vdhp->error || seek_mode == SEEK_MODE_AGGRESSIVE )
             goto video_fail;
@@ -1068,14 +1969,26 @@ static int get_requested_picture
         else
         {
             /* Retry to decode from more past random accessible picture. */
+            failed_rap_numbers[ failed_rap_count++ ] = rap_number;
             find_random_accessible_point( vdhp, picture_number, rap_number - 1, &rap_number );
+            if( avoid_rap_failure( vdhp, &rap_number ) && seek_mode == SEEK_MODE_NORMAL )
+                seek_mode = SEEK_MODE_AGGRESSIVE;
             rap_pos = get_random_accessible_point_position( vdhp, rap_number );
             vdhp->last_rap_number = rap_number;
         }
         start_number = seek_video( vdhp, frame, picture_number, rap_number, rap_pos, seek_mode != SEEK_MODE_NORMAL );
     }
+    if( error_count == 0 )
+        update_seek_cost( vdhp, av_gettime_relative() - start_time, first_fed_number, seeked );
+    else
+    {
+        /* Remember the way found by retrying so as not to pay for the failures again. */
+        if( seek_mode == SEEK_MODE_AGGRESSIVE )
+            failed_rap_numbers[ failed_rap_count++ ] = rap_number;
+        record_rap_failures( vdhp, failed_rap_numbers, failed_rap_count, rap_number, seek_mode == SEEK_MODE_AGGRESSIVE );
+    }
     vdhp->last_frame_number = picture_number;
-    extradata_index = vdhp->frame_list[picture_number].extradata_index;
+    extradata_index = lw_vframe_extradata_index( vdhp->frame_table, picture_number );
 return_frame:;
     vdhp->last_req_frame = frame;
     /* Don't exceed the maximum presentation size specified for each sequence. */
@@ -1085,7 +1998,7 @@ return_frame:;
     if( vdhp->ctx->height > entry->height )
         vdhp->ctx->height = entry->height;
     /* Set the actual PTS here. */
-    frame->pts = vdhp->frame_list[picture_number].pts;
+    frame->pts = lw_vframe_pts( vdhp->frame_table, picture_number );
     return 0;
 video_fail:
     /* fatal error of decoding */
@@ -1206,7 +2119,14 @@ static int lwlibav_repeat_control
          && first_field_number != vohp->frame_order_list[frame_number + 1].top
          && first_field_number != vohp->frame_order_list[frame_number + 1].bottom )
         {
-            if( get_requested_picture( vdhp, vdhp->frame_buffer, first_field_number ) < 0 )
+            /* The output frame buffer may be replaced with a cached frame, so don't let the decoder own it then. */
+            if( vohp->frame_lru )
+            {
+                if( get_requested_picture( vdhp, vohp->decode_frame_buffer, first_field_number ) < 0
+                 || copy_frame( &vdhp->lh, vdhp->frame_buffer, vohp->decode_frame_buffer ) < 0 )
+                    return -1;
+            }
+            else if( get_requested_picture( vdhp, vdhp->frame_buffer, first_field_number ) < 0 )
                 return -1;
             /* Treat this frame as interlaced. */
             vdhp->frame_buffer->interlaced_frame = vdhp->last_req_frame->interlaced_frame;
@@ -1275,11 +2195,46 @@ static int64_t lwlibav_get_ts
     uint32_t                        frame_number
 )
 {
-    return (vdhp->lw_seek_flags & (SEEK_PTS_GENERATED | SEEK_PTS_BASED)) ? vdhp->frame_list[frame_number].pts
-         : (vdhp->lw_seek_flags & SEEK_DTS_BASED)                        ? vdhp->frame_list[frame_number].dts
+    return (vdhp->lw_seek_flags & (SEEK_PTS_GENERATED | SEEK_PTS_BASED)) ? lw_vframe_pts( vdhp->frame_table, frame_number )
+         : (vdhp->lw_seek_flags & SEEK_DTS_BASED)                        ? lw_vframe_dts( vdhp->frame_table, frame_number )
          :                                                                 AV_NOPTS_VALUE;
 }
 
+/* Set up the VFR->CFR table from the timestamps of the frames in the same units as lwlibav_vfr2cfr(). */
+static void build_vfr2cfr_table
+(
+    lwlibav_video_decode_handler_t *vdhp,
+    lw_vfr2cfr_table_t             *table
+)
+{
+    AVRational time_base = vdhp->format->streams[ vdhp->stream_index ]->time_base;
+    uint32_t   count     = 0;
+    for( uint32_t i = 1; i <= vdhp->frame_count; i++ )
+        if( lwlibav_get_ts( vdhp, i ) != AV_NOPTS_VALUE )
+            ++count;
+    table->seconds = count ? (double *)lw_malloc_zero( count * sizeof(double) ) : NULL;
+    if( count < vdhp->frame_count && table->seconds )
+    {
+        table->frame_numbers = (uint32_t *)lw_malloc_zero( count * sizeof(uint32_t) );
+        if( !table->frame_numbers )
+            lw_freep( &table->seconds );
+    }
+    if( table->seconds )
+    {
+        table->count = count;
+        for( uint32_t i = 1, j = 0; i <= vdhp->frame_count; i++ )
+        {
+            int64_t ts = lwlibav_get_ts( vdhp, i );
+            if( ts == AV_NOPTS_VALUE )
+                continue;
+            if( table->frame_numbers )
+                table->frame_numbers[j] = i;
+            table->seconds[j++] = ((double)(ts - vdhp->min_ts) * time_base.num) / time_base.den;
+        }
+    }
+    lw_check_vfr2cfr_table( table );
+}
+
 static uint32_t lwlibav_vfr2cfr
 (
     lwlibav_video_decode_handler_t *vdhp,
@@ -1289,6 +2244,19 @@ static uint32_t lwlibav_vfr2cfr
 {
     /* Convert VFR to CFR. */
     double target_ts  = (double)((uint64_t)(frame_number - 1) * vohp->cfr_den) / vohp->cfr_num;
+    lw_vfr2cfr_table_t *table = &vohp->cfr_table;
+    if( table->state == LW_VFR2CFR_TABLE_UNBUILT )
+        build_vfr2cfr_table( vdhp, table );
+    if( table->state == LW_VFR2CFR_TABLE_AVAILABLE
+     && vdhp->last_ts_frame_number >= 1 && vdhp->last_ts_frame_number <= vdhp->frame_count )
+    {
+        double next_target_ts = (double)((uint64_t)frame_number * vohp->cfr_den) / vohp->cfr_num;
+        frame_number = lw_vfr2cfr_search( table, vdhp->last_ts_frame_number, vdhp->frame_count, target_ts, next_target_ts );
+        if( frame_number )
+            vdhp->last_ts_frame_number = frame_number;
+        return frame_number;
+    }
+    /* Scan the frames one by one if the timestamps are out of order. */
     double current_ts = DBL_MAX;
     AVRational time_base = vdhp->format->streams[ vdhp->stream_index ]->time_base;
     int64_t ts = lwlibav_get_ts( vdhp, vdhp->last_ts_frame_number );
@@ -1381,61 +2349,1097 @@ static void handle_decoder_pix_fmt
         codecpar->format = (int)pix_fmt;
 }
 
-static int get_video_frame
+static void release_backward_frames
 (
-    lwlibav_video_decode_handler_t *vdhp,
-    lwlibav_video_output_handler_t *vohp,
-    uint32_t                        frame_number
+    lwlibav_backward_buffer_t *bbp
 )
 {
-    if( vohp->repeat_control )
-        return lwlibav_repeat_control( vdhp, vohp, frame_number );
-    if( frame_number == vdhp->last_frame_number )
+    for( uint32_t i = 0; i < bbp->count; i++ )
+        av_frame_unref( bbp->frames[i] );
+    bbp->count = 0;
+}
+
+/* Return 1 if the requests go backward consecutively.
+ * Otherwise, drop the retained frames and return 0. */
+static int is_backward_request
+(
+    lwlibav_backward_buffer_t *bbp,
+    uint32_t                   frame_number
+)
+{
+    if( frame_number < bbp->last_request )
+        bbp->decreasing_count = MIN( bbp->decreasing_count + 1, 2 );
+    else if( frame_number > bbp->last_request )
+        bbp->decreasing_count = 0;
+    bbp->last_request = frame_number;
+    if( bbp->decreasing_count >= 2 )
         return 1;
-    return get_requested_picture( vdhp, vdhp->frame_buffer, frame_number );
+    release_backward_frames( bbp );
+    return 0;
 }
 
-/* Return 0 if successful.
- * Return 1 if the same frame was requested at the last call.
- * Return a negative value otherwise. */
-int lwlibav_video_get_frame
+/* Decoding from the random accessible point up to each frame requested backward costs quadratic time per GOP.
+ * To avoid this, decode the frames up to the requested one in a batch and retain them for the following requests. */
+static int get_backward_picture
 (
     lwlibav_video_decode_handler_t *vdhp,
-    lwlibav_video_output_handler_t *vohp,
     uint32_t                        frame_number
 )
 {
-    if( vohp->vfr2cfr )
+    lwlibav_backward_buffer_t *bbp = &vdhp->backward;
+    if( frame_number > vdhp->frame_count )
+        frame_number = vdhp->frame_count;
+    if( frame_number < bbp->first_number || frame_number >= bbp->first_number + bbp->count )
     {
-        frame_number = lwlibav_vfr2cfr( vdhp, vohp, frame_number );
-        if( frame_number == 0 )
-            return -1;
+        if( !bbp->frames )
+        {
+            bbp->frames = (AVFrame **)lw_malloc_zero( bbp->capacity * sizeof(AVFrame *) );
+            if( !bbp->frames )
+                goto fail;
+        }
+        if( !bbp->decode_frame && !(bbp->decode_frame = av_frame_alloc()) )
+            goto fail;
+        release_backward_frames( bbp );
+        /* Retain the frames from the random accessible point if they fit in the buffer. */
+        uint32_t rap_number;
+        find_random_accessible_point( vdhp, frame_number, 0, &rap_number );
+        avoid_rap_failure( vdhp, &rap_number );
+        uint32_t first_number = vdhp->order_converter
+                              ? vdhp->order_converter[rap_number].decoding_to_presentation
+                              : rap_number;
+        if( first_number == 0 || first_number > frame_number || frame_number - first_number >= bbp->capacity )
+            first_number = frame_number >= bbp->capacity ? frame_number - bbp->capacity + 1 : 1;
+        bbp->first_number = first_number;
+        for( uint32_t number = first_number; number <= frame_number; number++ )
+        {
+            if( !bbp->frames[ bbp->count ] && !(bbp->frames[ bbp->count ] = av_frame_alloc()) )
+                goto fail;
+            if( get_requested_picture( vdhp, bbp->decode_frame, number ) < 0 )
+                return -1;
+            if( av_frame_ref( bbp->frames[ bbp->count ], bbp->decode_frame ) < 0 )
+                goto fail;
+            ++ bbp->count;
+        }
     }
-    int ret;
-    if( (ret = get_video_frame( vdhp, vohp, frame_number )) != 0
-     || (ret = update_scaler_configuration_if_needed( &vohp->scaler, &vdhp->lh, vdhp->frame_buffer )) < 0 )
-        return ret;
+    if( copy_frame( &vdhp->lh, vdhp->frame_buffer, bbp->frames[ frame_number - bbp->first_number ] ) < 0 )
+        return -1;
+    bbp->on_output = 1;
     return 0;
+fail:
+    lw_log_show( &vdhp->lh, LW_LOG_ERROR, "Failed to allocate the frame buffers for backward requests." );
+    return -1;
 }
 
-int lwlibav_video_is_keyframe
+static void reset_prefetch_queue
 (
-    lwlibav_video_decode_handler_t *vdhp,
-    lwlibav_video_output_handler_t *vohp,
-    uint32_t                        frame_number
+    lwlibav_prefetch_t *pfp
 )
 {
-    assert( frame_number );
-    if( vohp->vfr2cfr )
-        frame_number = lwlibav_vfr2cfr( vdhp, vohp, frame_number );
-    if( vohp->repeat_control )
+    for( uint32_t i = 0; i < pfp->count; i++ )
+        av_frame_unref( pfp->frames[ (pfp->first_number + i) % (pfp->depth + 1) ] );
+    pfp->first_number = 0;
+    pfp->count        = 0;
+}
+
+static void *prefetch_video_frames
+(
+    void *arg
+)
+{
+    lwlibav_video_decode_handler_t *vdhp = (lwlibav_video_decode_handler_t *)arg;
+    lwlibav_prefetch_t *pfp = &vdhp->prefetch;
+    uint32_t ring_size = pfp->depth + 1;
+    lw_mutex_lock( pfp->mutex );
+    while( !pfp->stop )
     {
-        lw_video_frame_order_t *curr = &vohp->frame_order_list[frame_number    ];
-        lw_video_frame_order_t *prev = &vohp->frame_order_list[frame_number - 1];
-        return ((vdhp->frame_list[ curr->top    ].flags & LW_VFRAME_FLAG_KEY) && curr->top    != prev->top && curr->top    != prev->bottom)
-            || ((vdhp->frame_list[ curr->bottom ].flags & LW_VFRAME_FLAG_KEY) && curr->bottom != prev->top && curr->bottom != prev->bottom);
+        uint32_t next_number = pfp->first_number + pfp->count;
+        if( pfp->requesting
+         || pfp->first_number == 0
+         || pfp->exhausted
+         || pfp->count >= ring_size
+         || next_number > vdhp->frame_count )
+        {
+            lw_cond_wait( pfp->cond, pfp->mutex );
+            continue;
+        }
+        /* Decode without the mutex so that the requester can ask for the decoder meanwhile. */
+        pfp->decoding = 1;
+        lw_mutex_unlock( pfp->mutex );
+        int ret = get_requested_picture( vdhp, pfp->decode_frame, next_number );
+        lw_mutex_lock( pfp->mutex );
+        pfp->decoding = 0;
+        if( ret < 0 || av_frame_ref( pfp->frames[ next_number % ring_size ], pfp->decode_frame ) < 0 )
+            /* Leave the following frames to the requester. */
+            pfp->exhausted = 1;
+        else
+            ++ pfp->count;
+        lw_cond_broadcast( pfp->cond );
+    }
+    lw_mutex_unlock( pfp->mutex );
+    return NULL;
+}
+
+static int start_prefetch
+(
+    lwlibav_video_decode_handler_t *vdhp
+)
+{
+    lwlibav_prefetch_t *pfp = &vdhp->prefetch;
+    pfp->frames = (AVFrame **)lw_malloc_zero( (pfp->depth + 1) * sizeof(AVFrame *) );
+    if( !pfp->frames )
+        goto fail;
+    for( uint32_t i = 0; i <= pfp->depth; i++ )
+        if( !(pfp->frames[i] = av_frame_alloc()) )
+            goto fail;
+    pfp->decode_frame = av_frame_alloc();
+    pfp->mutex        = lw_mutex_create();
+    pfp->cond         = lw_cond_create();
+    if( !pfp->decode_frame || !pfp->mutex || !pfp->cond )
+        goto fail;
+    pfp->thread = lw_thread_create( prefetch_video_frames, vdhp );
+    if( !pfp->thread )
+        goto fail;
+    return 0;
+fail:
+    stop_prefetch( pfp );
+    lw_log_show( &vdhp->lh, LW_LOG_WARNING, "Failed to start decoding ahead. Decode synchronously." );
+    return -1;
+}
+
+/* Serve the request from the frames decoded ahead if present.
+ * Otherwise, resynchronize decoding ahead with the requested frame. */
+static int get_prefetched_picture
+(
+    lwlibav_video_decode_handler_t *vdhp,
+    uint32_t                        frame_number
+)
+{
+    lwlibav_prefetch_t *pfp = &vdhp->prefetch;
+    uint32_t ring_size = pfp->depth + 1;
+    if( frame_number > vdhp->frame_count )
+        frame_number = vdhp->frame_count;
+    if( pfp->first_number
+     && frame_number >= pfp->first_number
+     && frame_number <  pfp->first_number + pfp->count )
+        /* Drop the frames preceding the requested one. */
+        for( ; pfp->first_number < frame_number; pfp->first_number++, pfp->count-- )
+            av_frame_unref( pfp->frames[ pfp->first_number % ring_size ] );
+    else
+    {
+        reset_prefetch_queue( pfp );
+        if( get_requested_picture( vdhp, pfp->decode_frame, frame_number ) < 0
+         || av_frame_ref( pfp->frames[ frame_number % ring_size ], pfp->decode_frame ) < 0 )
+            return -1;
+        pfp->first_number = frame_number;
+        pfp->count        = 1;
+        pfp->exhausted    = 0;
+    }
+    return copy_frame( &vdhp->lh, vdhp->frame_buffer, pfp->frames[ frame_number % ring_size ] );
+}
+
+/* Get the packet of the picture for the worker by its own reader.
+ * The demuxer is read forward if the picture is slightly ahead of the last one. Otherwise, it is sought,
+ * so the picture must be a random accessible one unless it is right after the last one. */
+static int get_worker_packet
+(
+    lwlibav_parallel_worker_t *worker,
+    uint32_t                   picture_number       /* decoding order */
+)
+{
+#define WORKER_READ_FORWARD_LIMIT 64
+    lwlibav_video_decode_handler_t *vdhp  = worker->vdhp;
+    video_frame_table_t            *table = vdhp->frame_table;
+    AVPacket                       *pkt   = worker->pkt;
+    if( worker->pb )
+        return read_video_packet_directly( vdhp, worker->pb, picture_number, pkt );
+    if( worker->next_number == 0
+     || picture_number < worker->next_number
+     || picture_number > worker->next_number + WORKER_READ_FORWARD_LIMIT )
+    {
+        int64_t rap_pos = get_random_accessible_point_position( vdhp, picture_number );
+        if( lavf_seek_frame( worker->format, vdhp->stream_index, rap_pos, vdhp->av_seek_flags ) < 0 )
+            lavf_seek_frame( worker->format, vdhp->stream_index, rap_pos, vdhp->av_seek_flags | AVSEEK_FLAG_ANY );
+    }
+    worker->next_number = 0;
+    /* Identify the packet since the seek might be inaccurate. */
+    uint32_t p = vdhp->order_converter ? vdhp->order_converter[picture_number].decoding_to_presentation : picture_number;
+    int use_dts = !!(vdhp->lw_seek_flags & SEEK_DTS_BASED);
+    int64_t goal = use_dts ? lw_vframe_dts( table, p ) : lw_vframe_file_offset( table, p );
+    for( uint32_t i = 0; i <= 2 * WORKER_READ_FORWARD_LIMIT; i++ )
+    {
+        if( lwlibav_get_av_frame( worker->format, vdhp->stream_index, picture_number, pkt ) != 0 )
+            return -1;
+        int64_t value = use_dts ? pkt->dts : pkt->pos;
+        if( value == goal )
+        {
+            worker->next_number = picture_number + 1;
+            return 0;
+        }
+        if( value > goal || value == (use_dts ? AV_NOPTS_VALUE : -1) )
+            return -1;
+    }
+    return -1;
+#undef WORKER_READ_FORWARD_LIMIT
+}
+
+/* Decode the picture apart from the others.
+ * The decoder is drained if it holds the output back, and flushed for the next picture. */
+static int decode_intra_picture
+(
+    lwlibav_parallel_worker_t *worker,
+    uint32_t                   picture_number
+)
+{
+    if( get_worker_packet( worker, picture_number ) < 0 )
+        return -1;
+    int got_picture;
+    if( decode_video_packet( worker->ctx, worker->frame, &got_picture, worker->pkt ) < 0 )
+        return -1;
+    if( !got_picture )
+    {
+        AVPacket *pkt = worker->pkt;
+        av_packet_unref( pkt );
+        pkt->data = NULL;
+        pkt->size = 0;
+        int ret = decode_video_packet( worker->ctx, worker->frame, &got_picture, pkt );
+        avcodec_flush_buffers( worker->ctx );
+        if( ret < 0 )
+            return -1;
+    }
+    return got_picture ? 0 : -1;
+}
+
+static void *decode_intra_frames
+(
+    void *arg
+)
+{
+    lwlibav_parallel_worker_t *worker = (lwlibav_parallel_worker_t *)arg;
+    lwlibav_intra_parallel_t  *ipp    = &worker->vdhp->intra_parallel;
+    lw_mutex_lock( ipp->mutex );
+    while( !ipp->stop )
+    {
+        lwlibav_intra_slot_t *slot = NULL;
+        if( ipp->first_number )
+            for( uint32_t number = ipp->first_number; number <= ipp->last_number && !slot; number++ )
+                if( ipp->slots[ number % ipp->window ].number == number
+                 && ipp->slots[ number % ipp->window ].state  == LW_PARALLEL_SLOT_QUEUED )
+                    slot = &ipp->slots[ number % ipp->window ];
+        if( !slot )
+        {
+            lw_cond_wait( ipp->cond, ipp->mutex );
+            continue;
+        }
+        uint32_t number     = slot->number;
+        uint32_t generation = slot->generation;
+        slot->state = LW_PARALLEL_SLOT_DECODING;
+        lw_mutex_unlock( ipp->mutex );
+        int ret = decode_intra_picture( worker, number );
+        lw_mutex_lock( ipp->mutex );
+        /* The slot might have been assigned to another frame meanwhile. */
+        if( slot->number == number && slot->generation == generation && slot->state == LW_PARALLEL_SLOT_DECODING )
+        {
+            if( ret == 0 )
+            {
+                av_frame_unref( slot->frame );
+                av_frame_move_ref( slot->frame, worker->frame );
+                slot->state = LW_PARALLEL_SLOT_DONE;
+            }
+            else
+                slot->state = LW_PARALLEL_SLOT_FAILED;
+            lw_cond_broadcast( ipp->cond );
+        }
+        av_frame_unref( worker->frame );
+    }
+    lw_mutex_unlock( ipp->mutex );
+    return NULL;
+}
+
+/* Return non-zero if the workers can decode and read packets apart from the main decoder and its reader. */
+static int is_parallel_decodable
+(
+    lwlibav_video_decode_handler_t *vdhp
+)
+{
+    if( (vdhp->ctx->codec->capabilities & (AV_CODEC_CAP_HARDWARE | AV_CODEC_CAP_HYBRID))
+     || (!vdhp->direct_reader.pb && !(vdhp->lw_seek_flags & (SEEK_DTS_BASED | SEEK_POS_CORRECTION))) )
+    {
+        lw_log_show( &vdhp->lh, LW_LOG_INFO, "The frames can't be decoded apart from the decoder. Decode frames sequentially." );
+        return 0;
+    }
+    if( vdhp->exh.entry_count > 1 )
+    {
+        /* The decoders opened here follow neither the changes of the extradata nor those of the stream properties. */
+        lw_log_show( &vdhp->lh, LW_LOG_INFO, "The video stream has multiple extradata. Decode frames sequentially." );
+        return 0;
+    }
+    return 1;
+}
+
+/* Open the decoder and the reader of each worker. The threads are not created here. */
+static int open_parallel_workers
+(
+    lwlibav_video_decode_handler_t *vdhp,
+    lwlibav_parallel_worker_t      *workers,
+    int                             worker_count,
+    const AVCodecParameters        *codecpar
+)
+{
+    for( int i = 0; i < worker_count; i++ )
+    {
+        lwlibav_parallel_worker_t *worker = &workers[i];
+        worker->vdhp  = vdhp;
+        worker->pkt   = av_packet_alloc();
+        worker->frame = av_frame_alloc();
+        if( !worker->pkt || !worker->frame
+         || open_decoder( &worker->ctx, codecpar, vdhp->ctx->codec, 1, vdhp->drc, vdhp->ff_options ) < 0 )
+            return -1;
+        if( vdhp->direct_reader.pb )
+        {
+            if( avio_open2( &worker->pb, vdhp->format->url, AVIO_FLAG_READ, NULL, NULL ) < 0 )
+                return -1;
+        }
+        else
+        {
+            if( lavf_open_file( &worker->format, vdhp->format->url, &vdhp->lh ) < 0
+             || vdhp->stream_index >= (int)worker->format->nb_streams )
+                return -1;
+            /* Only the video stream is read. */
+            for( unsigned int j = 0; j < worker->format->nb_streams; j++ )
+                if( (int)j != vdhp->stream_index )
+                    worker->format->streams[j]->discard = AVDISCARD_ALL;
+        }
+    }
+    return 0;
+}
+
+static int start_intra_parallel
+(
+    lwlibav_video_decode_handler_t *vdhp
+)
+{
+    lwlibav_intra_parallel_t *ipp = &vdhp->intra_parallel;
+    if( !vdhp->intra_only )
+    {
+        lw_log_show( &vdhp->lh, LW_LOG_INFO, "The video stream is not intra-only. Decode frames sequentially." );
+        return -1;
+    }
+    if( !is_parallel_decodable( vdhp ) )
+        return -1;
+    AVCodecParameters *codecpar = avcodec_parameters_alloc();
+    ipp->window  = 2 * ipp->worker_count;
+    ipp->slots   = (lwlibav_intra_slot_t *)lw_malloc_zero( ipp->window * sizeof(lwlibav_intra_slot_t) );
+    ipp->workers = (lwlibav_parallel_worker_t *)lw_malloc_zero( ipp->worker_count * sizeof(lwlibav_parallel_worker_t) );
+    ipp->mutex   = lw_mutex_create();
+    ipp->cond    = lw_cond_create();
+    if( !codecpar || !ipp->slots || !ipp->workers || !ipp->mutex || !ipp->cond
+     || avcodec_parameters_copy( codecpar, vdhp->format->streams[ vdhp->stream_index ]->codecpar ) < 0 )
+        goto fail;
+    for( uint32_t i = 0; i < ipp->window; i++ )
+        if( !(ipp->slots[i].frame = av_frame_alloc()) )
+            goto fail;
+    if( open_parallel_workers( vdhp, ipp->workers, ipp->worker_count, codecpar ) < 0 )
+        goto fail;
+    for( int i = 0; i < ipp->worker_count; i++ )
+        if( !(ipp->workers[i].thread = lw_thread_create( decode_intra_frames, &ipp->workers[i] )) )
+            goto fail;
+    avcodec_parameters_free( &codecpar );
+    lw_log_show( &vdhp->lh, LW_LOG_INFO, "Decoding intra-only frames on %d workers.", ipp->worker_count );
+    return 0;
+fail:
+    avcodec_parameters_free( &codecpar );
+    stop_intra_parallel( ipp );
+    lw_log_show( &vdhp->lh, LW_LOG_WARNING, "Failed to start decoding frames in parallel. Decode frames sequentially." );
+    return -1;
+}
+
+/* Queue the frames of the window from the requested one, and wait for the requested one.
+ * The frames out of the new window are dropped even if being decoded. */
+static int get_intra_parallel_picture
+(
+    lwlibav_video_decode_handler_t *vdhp,
+    uint32_t                        frame_number
+)
+{
+    lwlibav_intra_parallel_t *ipp = &vdhp->intra_parallel;
+    if( frame_number > vdhp->frame_count )
+        frame_number = vdhp->frame_count;
+    lw_mutex_lock( ipp->mutex );
+    ipp->first_number = frame_number;
+    ipp->last_number  = MIN( frame_number + ipp->window - 1, vdhp->frame_count );
+    for( uint32_t number = ipp->first_number; number <= ipp->last_number; number++ )
+    {
+        lwlibav_intra_slot_t *slot = &ipp->slots[ number % ipp->window ];
+        if( slot->number != number )
+        {
+            av_frame_unref( slot->frame );
+            slot->number = number;
+            slot->state  = LW_PARALLEL_SLOT_QUEUED;
+            ++ slot->generation;
+        }
+    }
+    lw_cond_broadcast( ipp->cond );
+    lwlibav_intra_slot_t *slot = &ipp->slots[ frame_number % ipp->window ];
+    while( slot->state == LW_PARALLEL_SLOT_QUEUED || slot->state == LW_PARALLEL_SLOT_DECODING )
+        lw_cond_wait( ipp->cond, ipp->mutex );
+    int ret = slot->state == LW_PARALLEL_SLOT_DONE ? copy_frame( &vdhp->lh, vdhp->frame_buffer, slot->frame ) : -1;
+    lw_mutex_unlock( ipp->mutex );
+    if( ret < 0 )
+        /* Fall back on the sequential decoder. */
+        return get_requested_picture( vdhp, vdhp->frame_buffer, frame_number );
+    vdhp->frame_buffer->pts = lw_vframe_pts( vdhp->frame_table, frame_number );
+    /* The output frame buffer no longer holds the last frame requested to the sequential decoder. */
+    vdhp->last_frame_number = vdhp->frame_count + 1;
+    return 0;
+}
+
+/* Send the packet, or drain the decoder if NULL, and move all frames output by the decoder to the worker's GOP buffers.
+ * Return the number of frames output so far, or a negative value on error. */
+static int receive_gop_frames
+(
+    lwlibav_parallel_worker_t *worker,
+    AVPacket                  *pkt,
+    uint32_t                   output_count,
+    uint32_t                   frame_count
+)
+{
+    int ret = avcodec_send_packet( worker->ctx, pkt );
+    if( ret < 0 && ret != AVERROR_EOF )
+        return -1;
+    while( (ret = avcodec_receive_frame( worker->ctx, worker->frame )) >= 0 )
+    {
+        if( output_count >= frame_count )
+        {
+            /* More frames than the GOP has. */
+            av_frame_unref( worker->frame );
+            return -1;
+        }
+        av_frame_unref( worker->frames[output_count] );
+        av_frame_move_ref( worker->frames[output_count++], worker->frame );
+    }
+    return ret == AVERROR( EAGAIN ) || ret == AVERROR_EOF ? (int)output_count : -1;
+}
+
+/* Return the random accessible picture in decoding order of the GOP which the frame belongs to. */
+static inline uint32_t get_gop_rap_number
+(
+    lwlibav_video_decode_handler_t *vdhp,
+    uint32_t                        frame_number
+)
+{
+    return vdhp->rap_list[ lw_vframe_sample_number( vdhp->frame_table, frame_number ) ];
+}
+
+/* Return non-zero if the leading pictures of the GOPs of the codec can be checked to be closed by is_closed_gop_packet(). */
+static int is_closed_gop_checkable
+(
+    enum AVCodecID codec_id
+)
+{
+    return codec_id == AV_CODEC_ID_MPEG1VIDEO || codec_id == AV_CODEC_ID_MPEG2VIDEO || codec_id == AV_CODEC_ID_VC1;
+}
+
+/* Return non-zero if the packet of the random accessible picture declares that no leading picture of its GOP
+ * refers to the previous GOP, i.e. the closed_gop flag of the GOP header in MPEG-1/2 Video
+ * or the CLOSED_ENTRY flag of the entry-point header in VC-1. */
+static int is_closed_gop_packet
+(
+    enum AVCodecID  codec_id,
+    const AVPacket *pkt
+)
+{
+    const uint8_t *data = pkt->data;
+    for( int i = 0; i + 4 < pkt->size; i++ )
+    {
+        if( data[i] || data[i + 1] || data[i + 2] != 0x01 )
+            continue;
+        uint8_t code = data[i + 3];
+        if( codec_id == AV_CODEC_ID_MPEG1VIDEO || codec_id == AV_CODEC_ID_MPEG2VIDEO )
+        {
+            /* The closed_gop flag follows the 25-bit time_code. */
+            if( code == 0xB8 )
+                return i + 7 < pkt->size && ((data[i + 7] >> 6) & 1);
+            if( code == 0x00 )
+                /* No GOP header precedes the picture. */
+                return 0;
+        }
+        else if( codec_id == AV_CODEC_ID_VC1 )
+        {
+            /* The CLOSED_ENTRY flag follows the BROKEN_LINK flag. */
+            if( code == 0x0E )
+                return (data[i + 4] >> 6) & 1;
+            if( code == 0x0D )
+                /* No entry-point header precedes the frame. */
+                return 0;
+        }
+        else
+            return 0;
+    }
+    return 0;
+}
+
+/* Decode the whole GOP from its random accessible picture into the worker's GOP buffers in presentation order.
+ * The decoder is drained at the end of the GOP and reset for the next one.
+ * Decoding is abandoned as soon as the GOP is no longer queued. */
+static int decode_gop
+(
+    lwlibav_parallel_worker_t *worker,
+    lwlibav_gop_slot_t        *slot,
+    uint32_t                   gop_number,
+    uint32_t                   generation
+)
+{
+    lwlibav_video_decode_handler_t *vdhp = worker->vdhp;
+    lwlibav_gop_parallel_t         *gpp  = &vdhp->gop_parallel;
+    uint32_t first_number = gpp->gop_list[gop_number];
+    uint32_t frame_count  = gpp->gop_list[gop_number + 1] - first_number;
+    uint32_t rap_number   = get_gop_rap_number( vdhp, first_number );
+    /* The leading pictures are displayed first, and they are decodable apart from the previous GOP only if declared so. */
+    int      has_leading  = lw_vframe_sample_number( vdhp->frame_table, first_number ) != rap_number;
+    int      output_count = 0;
+    for( uint32_t i = 0; i < frame_count && output_count >= 0; i++ )
+    {
+        lw_mutex_lock( gpp->mutex );
+        int wanted = !gpp->stop && slot->gop_number == gop_number && slot->generation == generation;
+        lw_mutex_unlock( gpp->mutex );
+        if( !wanted || get_worker_packet( worker, rap_number + i ) < 0
+         || (i == 0 && has_leading && !is_closed_gop_packet( gpp->codecpar->codec_id, worker->pkt )) )
+            output_count = -1;
+        else
+            output_count = receive_gop_frames( worker, worker->pkt, output_count, frame_count );
+    }
+    if( output_count >= 0 )
+        output_count = receive_gop_frames( worker, NULL, output_count, frame_count );
+    av_packet_unref( worker->pkt );
+    lwlibav_reset_decoder( &worker->ctx, gpp->codecpar, vdhp->drc, vdhp->ff_options );
+    /* Every frame of the GOP must be output. */
+    return output_count == (int)frame_count ? 0 : -1;
+}
+
+static void *decode_gop_frames
+(
+    void *arg
+)
+{
+    lwlibav_parallel_worker_t *worker = (lwlibav_parallel_worker_t *)arg;
+    lwlibav_gop_parallel_t    *gpp    = &worker->vdhp->gop_parallel;
+    lw_mutex_lock( gpp->mutex );
+    while( !gpp->stop )
+    {
+        lwlibav_gop_slot_t *slot = NULL;
+        if( gpp->first_gop )
+            for( uint32_t number = gpp->first_gop; number <= gpp->last_gop && !slot; number++ )
+                if( gpp->slots[ number % gpp->window ].gop_number == number
+                 && gpp->slots[ number % gpp->window ].state      == LW_PARALLEL_SLOT_QUEUED )
+                    slot = &gpp->slots[ number % gpp->window ];
+        if( !slot )
+        {
+            lw_cond_wait( gpp->cond, gpp->mutex );
+            continue;
+        }
+        uint32_t gop_number = slot->gop_number;
+        uint32_t generation = slot->generation;
+        slot->state = LW_PARALLEL_SLOT_DECODING;
+        lw_mutex_unlock( gpp->mutex );
+        int ret = decode_gop( worker, slot, gop_number, generation );
+        lw_mutex_lock( gpp->mutex );
+        /* The slot might have been assigned to another GOP meanwhile. */
+        if( slot->gop_number == gop_number && slot->generation == generation && slot->state == LW_PARALLEL_SLOT_DECODING )
+        {
+            if( ret == 0 )
+            {
+                /* Hand over the decoded frames by swapping the buffers. */
+                AVFrame **frames = slot->frames;
+                slot->frames   = worker->frames;
+                worker->frames = frames;
+                slot->state    = LW_PARALLEL_SLOT_DONE;
+            }
+            else
+                slot->state = LW_PARALLEL_SLOT_FAILED;
+            lw_cond_broadcast( gpp->cond );
+        }
+    }
+    lw_mutex_unlock( gpp->mutex );
+    return NULL;
+}
+
+static AVFrame **alloc_frame_array
+(
+    uint32_t count
+)
+{
+    AVFrame **frames = (AVFrame **)lw_malloc_zero( count * sizeof(AVFrame *) );
+    if( !frames )
+        return NULL;
+    for( uint32_t i = 0; i < count; i++ )
+        if( !(frames[i] = av_frame_alloc()) )
+        {
+            free_frame_array( frames, count );
+            lw_free( frames );
+            return NULL;
+        }
+    return frames;
+}
+
+static int start_gop_parallel
+(
+    lwlibav_video_decode_handler_t *vdhp
+)
+{
+    lwlibav_gop_parallel_t *gpp = &vdhp->gop_parallel;
+    if( !vdhp->closed_gop )
+    {
+        lw_log_show( &vdhp->lh, LW_LOG_INFO, "The video stream does not consist of closed GOPs. Decode frames sequentially." );
+        return -1;
+    }
+    if( !is_parallel_decodable( vdhp ) )
+        return -1;
+    /* Set up the GOP list from the random accessible pictures in decoding order.
+     * Each GOP starts with its leading pictures in presentation order if any. */
+    int      has_leading = 0;
+    uint32_t gop_rap     = 0;
+    gpp->gop_count = 0;
+    for( uint32_t i = 1; i <= vdhp->frame_count; i++ )
+        if( get_gop_rap_number( vdhp, i ) != gop_rap )
+        {
+            gop_rap = get_gop_rap_number( vdhp, i );
+            ++ gpp->gop_count;
+            if( lw_vframe_sample_number( vdhp->frame_table, i ) != gop_rap )
+                has_leading = 1;
+        }
+    if( has_leading && !is_closed_gop_checkable( vdhp->ctx->codec_id ) )
+    {
+        lw_log_show( &vdhp->lh, LW_LOG_INFO, "The GOPs have leading pictures which might refer to the previous GOPs. "
+                                             "Decode frames sequentially." );
+        return -1;
+    }
+    gpp->gop_list = (uint32_t *)lw_malloc_zero( (gpp->gop_count + 2) * sizeof(uint32_t) );
+    if( !gpp->gop_list )
+        goto fail;
+    uint32_t longest_gop_length = 0;
+    gop_rap = 0;
+    for( uint32_t i = 1, gop_number = 0; i <= vdhp->frame_count + 1; i++ )
+        if( i > vdhp->frame_count || get_gop_rap_number( vdhp, i ) != gop_rap )
+        {
+            if( i <= vdhp->frame_count )
+                gop_rap = get_gop_rap_number( vdhp, i );
+            gpp->gop_list[ ++gop_number ] = i;
+            if( gop_number > 1 )
+                longest_gop_length = MAX( longest_gop_length, i - gpp->gop_list[gop_number - 1] );
+        }
+    gpp->window = gpp->worker_count + 1;    /* the GOP being output and the GOPs being decoded ahead */
+    /* Limit the frames buffered by the slots and the workers. */
+    int64_t frame_size = av_image_get_buffer_size( vdhp->ctx->pix_fmt, vdhp->ctx->width, vdhp->ctx->height, 1 );
+    if( frame_size <= 0 )
+        frame_size = 8 * (int64_t)MAX( vdhp->ctx->width, 1 ) * MAX( vdhp->ctx->height, 1 );
+    int64_t buffered_gop_length = GOP_PARALLEL_BUFFER_LIMIT / (frame_size * (gpp->window + gpp->worker_count));
+    gpp->max_gop_length = (uint32_t)MIN( (int64_t)longest_gop_length, buffered_gop_length );
+    if( gpp->max_gop_length == 0 )
+    {
+        lw_log_show( &vdhp->lh, LW_LOG_INFO, "No GOP can be buffered to be decoded ahead. Decode frames sequentially." );
+        lw_freep( &gpp->gop_list );
+        return -1;
+    }
+    gpp->codecpar = avcodec_parameters_alloc();
+    gpp->slots    = (lwlibav_gop_slot_t *)lw_malloc_zero( gpp->window * sizeof(lwlibav_gop_slot_t) );
+    gpp->workers  = (lwlibav_parallel_worker_t *)lw_malloc_zero( gpp->worker_count * sizeof(lwlibav_parallel_worker_t) );
+    gpp->mutex    = lw_mutex_create();
+    gpp->cond     = lw_cond_create();
+    if( !gpp->codecpar || !gpp->slots || !gpp->workers || !gpp->mutex || !gpp->cond
+     || avcodec_parameters_copy( gpp->codecpar, vdhp->format->streams[ vdhp->stream_index ]->codecpar ) < 0 )
+        goto fail;
+    for( uint32_t i = 0; i < gpp->window; i++ )
+        if( !(gpp->slots[i].frames = alloc_frame_array( gpp->max_gop_length )) )
+            goto fail;
+    for( int i = 0; i < gpp->worker_count; i++ )
+        if( !(gpp->workers[i].frames = alloc_frame_array( gpp->max_gop_length )) )
+            goto fail;
+    if( open_parallel_workers( vdhp, gpp->workers, gpp->worker_count, gpp->codecpar ) < 0 )
+        goto fail;
+    for( int i = 0; i < gpp->worker_count; i++ )
+        if( !(gpp->workers[i].thread = lw_thread_create( decode_gop_frames, &gpp->workers[i] )) )
+            goto fail;
+    lw_log_show( &vdhp->lh, LW_LOG_INFO, "Decoding %u closed GOPs of up to %u frames on %d workers.",
+                 gpp->gop_count, gpp->max_gop_length, gpp->worker_count );
+    if( longest_gop_length > gpp->max_gop_length )
+        lw_log_show( &vdhp->lh, LW_LOG_INFO, "The GOPs longer than %u frames are decoded sequentially.", gpp->max_gop_length );
+    return 0;
+fail:
+    stop_gop_parallel( gpp );
+    lw_log_show( &vdhp->lh, LW_LOG_WARNING, "Failed to start decoding GOPs in parallel. Decode frames sequentially." );
+    return -1;
+}
+
+/* Return the number of the GOP which the frame belongs to. */
+static uint32_t find_gop
+(
+    lwlibav_gop_parallel_t *gpp,
+    uint32_t                frame_number
+)
+{
+    uint32_t lo = 1;
+    uint32_t hi = gpp->gop_count;
+    while( lo < hi )
+    {
+        uint32_t mid = lo + (hi - lo + 1) / 2;
+        if( gpp->gop_list[mid] <= frame_number )
+            lo = mid;
+        else
+            hi = mid - 1;
+    }
+    return lo;
+}
+
+static int is_gop_buffered
+(
+    lwlibav_gop_parallel_t *gpp,
+    uint32_t                gop_number
+)
+{
+    return gpp->gop_list[gop_number + 1] - gpp->gop_list[gop_number] <= gpp->max_gop_length;
+}
+
+/* Queue the GOPs of the window from the one of the requested frame, and wait for that GOP.
+ * The GOPs out of the new window are dropped even if being decoded. */
+static int get_gop_parallel_picture
+(
+    lwlibav_video_decode_handler_t *vdhp,
+    uint32_t                        frame_number
+)
+{
+    lwlibav_gop_parallel_t *gpp = &vdhp->gop_parallel;
+    if( frame_number > vdhp->frame_count )
+        frame_number = vdhp->frame_count;
+    uint32_t gop_number = find_gop( gpp, frame_number );
+    if( frame_number < gpp->gop_list[gop_number] || !is_gop_buffered( gpp, gop_number ) )
+        /* The frames before the first GOP and the frames of the GOPs too long to be buffered. */
+        return get_requested_picture( vdhp, vdhp->frame_buffer, frame_number );
+    lw_mutex_lock( gpp->mutex );
+    if( gpp->first_gop != gop_number )
+    {
+        gpp->first_gop = gop_number;
+        gpp->last_gop  = MIN( gop_number + gpp->window - 1, gpp->gop_count );
+        for( uint32_t number = gpp->first_gop; number <= gpp->last_gop; number++ )
+        {
+            lwlibav_gop_slot_t *slot = &gpp->slots[ number % gpp->window ];
+            if( slot->gop_number != number )
+            {
+                for( uint32_t i = 0; i < gpp->max_gop_length; i++ )
+                    av_frame_unref( slot->frames[i] );
+                slot->gop_number = number;
+                slot->state      = is_gop_buffered( gpp, number ) ? LW_PARALLEL_SLOT_QUEUED : LW_PARALLEL_SLOT_FAILED;
+                ++ slot->generation;
+            }
+        }
+        lw_cond_broadcast( gpp->cond );
+    }
+    lwlibav_gop_slot_t *slot = &gpp->slots[ gop_number % gpp->window ];
+    while( slot->state == LW_PARALLEL_SLOT_QUEUED || slot->state == LW_PARALLEL_SLOT_DECODING )
+        lw_cond_wait( gpp->cond, gpp->mutex );
+    int ret = slot->state == LW_PARALLEL_SLOT_DONE
+            ? copy_frame( &vdhp->lh, vdhp->frame_buffer, slot->frames[ frame_number - gpp->gop_list[gop_number] ] )
+            : -1;
+    lw_mutex_unlock( gpp->mutex );
+    if( ret < 0 )
+        /* Fall back on the sequential decoder. */
+        return get_requested_picture( vdhp, vdhp->frame_buffer, frame_number );
+    vdhp->frame_buffer->pts = lw_vframe_pts( vdhp->frame_table, frame_number );
+    /* The output frame buffer no longer holds the last frame requested to the sequential decoder. */
+    vdhp->last_frame_number = vdhp->frame_count + 1;
+    return 0;
+}
+
+/* Decode the keyframe on its own by the decoder dedicated to the keyframe-only mode, which shares the reader of
+ * the decode handler. Fall back on the usual decoding if the keyframe can't be decoded in this way. */
+static int get_keyframe_picture
+(
+    lwlibav_video_decode_handler_t *vdhp,
+    uint32_t                        frame_number
+)
+{
+    lwlibav_keyframes_only_t  *kfp    = &vdhp->keyframes;
+    lwlibav_parallel_worker_t *worker = &kfp->decoder;
+    if( kfp->opened == 0 )
+    {
+        kfp->opened = -1;
+        if( is_parallel_decodable( vdhp ) )
+        {
+            const AVCodecParameters *codecpar = vdhp->format->streams[ vdhp->stream_index ]->codecpar;
+            worker->vdhp  = vdhp;
+            worker->pkt   = av_packet_alloc();
+            worker->frame = av_frame_alloc();
+            if( worker->pkt && worker->frame
+             && open_decoder( &worker->ctx, codecpar, vdhp->ctx->codec, 1, vdhp->drc, vdhp->ff_options ) == 0 )
+            {
+                worker->ctx->skip_frame = AVDISCARD_NONKEY;
+                if( kfp->mode == LW_KEYFRAMES_ONLY_REDUCED )
+                    worker->ctx->skip_loop_filter = AVDISCARD_ALL;
+                kfp->opened = 1;
+            }
+            else
+                lw_log_show( &vdhp->lh, LW_LOG_WARNING, "Failed to open the keyframe decoder. Decode keyframes in the usual way." );
+        }
+    }
+    int ret = -1;
+    if( kfp->opened > 0 )
+    {
+        /* The reader could have been changed since the last call. */
+        worker->format = vdhp->format;
+        worker->pb     = vdhp->direct_reader.pb;
+        if( !worker->pb )
+            /* The packets kept for the usual decoding are no longer followed by the demuxer. */
+            reset_packet_cache( &vdhp->packet_cache, 0, 0 );
+        ret = decode_intra_picture( worker, lw_vframe_sample_number( vdhp->frame_table, frame_number ) );
+        if( ret == 0 )
+            ret = copy_frame( &vdhp->lh, vdhp->frame_buffer, worker->frame );
+        av_frame_unref( worker->frame );
+    }
+    if( ret < 0 )
+    {
+        /* The usual decoding moves the demuxer. */
+        worker->next_number = 0;
+        return get_requested_picture( vdhp, vdhp->frame_buffer, frame_number );
+    }
+    vdhp->frame_buffer->pts = lw_vframe_pts( vdhp->frame_table, frame_number );
+    /* The output frame buffer no longer holds the last frame requested to the usual decoder,
+     * and the demuxer is no longer where the usual decoder left it. */
+    vdhp->last_frame_number = vdhp->frame_count + 1;
+    return 0;
+}
+
+static int decode_video_frame
+(
+    lwlibav_video_decode_handler_t *vdhp,
+    lwlibav_video_output_handler_t *vohp,
+    uint32_t                        frame_number
+)
+{
+    if( vohp->repeat_control )
+        return lwlibav_repeat_control( vdhp, vohp, frame_number );
+    if( vdhp->keyframes.list )
+        return get_keyframe_picture( vdhp, frame_number );
+    if( vdhp->intra_parallel.workers )
+        return get_intra_parallel_picture( vdhp, frame_number );
+    if( vdhp->gop_parallel.workers )
+        return get_gop_parallel_picture( vdhp, frame_number );
+    if( vdhp->backward.capacity && is_backward_request( &vdhp->backward, frame_number ) )
+    {
+        if( vdhp->prefetch.thread )
+            /* Don't decode ahead while going backward. */
+            reset_prefetch_queue( &vdhp->prefetch );
+        return get_backward_picture( vdhp, frame_number );
+    }
+    if( vdhp->prefetch.thread )
+        return get_prefetched_picture( vdhp, frame_number );
+    if( vohp->frame_lru )
+    {
+        /* Keep the frame the decoder outputs to apart from the output frame buffer. */
+        if( get_requested_picture( vdhp, vohp->decode_frame_buffer, frame_number ) < 0 )
+            return -1;
+        return copy_frame( &vdhp->lh, vdhp->frame_buffer, vohp->decode_frame_buffer );
+    }
+    if( frame_number == vdhp->last_frame_number && !vdhp->backward.on_output )
+        return 1;
+    int ret = get_requested_picture( vdhp, vdhp->frame_buffer, frame_number );
+    if( ret == 0 )
+        vdhp->backward.on_output = 0;
+    return ret;
+}
+
+static int get_video_frame
+(
+    lwlibav_video_decode_handler_t *vdhp,
+    lwlibav_video_output_handler_t *vohp,
+    uint32_t                        frame_number
+)
+{
+    if( vohp->frame_lru )
+    {
+        int ret = lw_frame_lru_get( vohp->frame_lru, frame_number, vdhp->frame_buffer );
+        if( ret != 0 )
+            return ret > 0 ? 0 : -1;
+    }
+    lwlibav_intra_parallel_t *ipp = &vdhp->intra_parallel;
+    lwlibav_gop_parallel_t   *gpp = &vdhp->gop_parallel;
+    if( ipp->worker_count && !ipp->workers && start_intra_parallel( vdhp ) < 0 )
+        ipp->worker_count = 0;
+    if( gpp->worker_count && !gpp->workers && (ipp->workers || start_gop_parallel( vdhp ) < 0) )
+        gpp->worker_count = 0;
+    lwlibav_prefetch_t *pfp = &vdhp->prefetch;
+    if( ipp->workers || gpp->workers )
+        /* The workers decode ahead instead. */
+        pfp->depth = 0;
+    if( pfp->depth && !pfp->thread && start_prefetch( vdhp ) < 0 )
+        pfp->depth = 0;
+    if( pfp->thread )
+    {
+        /* Take the decoder from the worker, which stops decoding ahead after the current frame. */
+        lw_mutex_lock( pfp->mutex );
+        pfp->requesting = 1;
+        while( pfp->decoding )
+            lw_cond_wait( pfp->cond, pfp->mutex );
+        lw_mutex_unlock( pfp->mutex );
+    }
+    int ret = decode_video_frame( vdhp, vohp, frame_number );
+    if( ret == 0 && vohp->frame_lru
+     && lw_frame_lru_put( vohp->frame_lru, frame_number, vdhp->frame_buffer ) < 0 )
+        lw_log_show( &vdhp->lh, LW_LOG_WARNING, "Failed to cache a decoded video frame." );
+    if( pfp->thread )
+    {
+        lw_mutex_lock( pfp->mutex );
+        /* The log handler set by the requester is valid only during this request, so the worker can't use it. */
+        vdhp->lh.priv   = NULL;
+        pfp->requesting = 0;
+        lw_cond_broadcast( pfp->cond );
+        lw_mutex_unlock( pfp->mutex );
+    }
+    return ret;
+}
+
+/* Return 0 if successful.
+ * Return 1 if the same frame was requested at the last call.
+ * Return a negative value otherwise. */
+int lwlibav_video_get_frame
+(
+    lwlibav_video_decode_handler_t *vdhp,
+    lwlibav_video_output_handler_t *vohp,
+    uint32_t                        frame_number
+)
+{
+    if( vohp->vfr2cfr )
+    {
+        frame_number = lwlibav_vfr2cfr( vdhp, vohp, frame_number );
+        if( frame_number == 0 )
+            return -1;
+    }
+    if( vdhp->keyframes.list )
+        frame_number = vdhp->keyframes.list[ MIN( frame_number, vdhp->keyframes.count ) ];
+    int ret;
+    if( (ret = get_video_frame( vdhp, vohp, frame_number )) != 0
+     || (ret = update_scaler_configuration_if_needed( &vohp->scaler, &vdhp->lh, vdhp->frame_buffer )) < 0 )
+        return ret;
+    return 0;
+}
+
+int lwlibav_video_is_keyframe
+(
+    lwlibav_video_decode_handler_t *vdhp,
+    lwlibav_video_output_handler_t *vohp,
+    uint32_t                        frame_number
+)
+{
+    assert( frame_number );
+    if( vdhp->keyframes.list )
+        return 1;
+    if( vohp->vfr2cfr )
+        frame_number = lwlibav_vfr2cfr( vdhp, vohp, frame_number );
+    if( vohp->repeat_control )
+    {
+        lw_video_frame_order_t *curr = &vohp->frame_order_list[frame_number    ];
+        lw_video_frame_order_t *prev = &vohp->frame_order_list[frame_number - 1];
+        return ((lw_vframe_flags( vdhp->frame_table, curr->top ) & LW_VFRAME_FLAG_KEY) && curr->top    != prev->top && curr->top    != prev->bottom)
+            || ((lw_vframe_flags( vdhp->frame_table, curr->bottom ) & LW_VFRAME_FLAG_KEY) && curr->bottom != prev->top && curr->bottom != prev->bottom);
+    }
+    return !!(lw_vframe_flags( vdhp->frame_table, frame_number ) & LW_VFRAME_FLAG_KEY);
+}
+
+int lwlibav_video_create_keyframe_list
+(
+    lwlibav_video_decode_handler_t *vdhp,
+    lwlibav_video_output_handler_t *vohp
+)
+{
+    lwlibav_keyframes_only_t *kfp = &vdhp->keyframes;
+    if( kfp->mode == LW_KEYFRAMES_ONLY_NONE || kfp->list )
+        return 0;
+    if( vohp->repeat_control || vohp->vfr2cfr )
+    {
+        lw_log_show( &vdhp->lh, LW_LOG_WARNING, "The keyframe-only mode is not available with repeat control or VFR->CFR conversion." );
+        kfp->mode = LW_KEYFRAMES_ONLY_NONE;
+        return 0;
+    }
+    uint32_t count = 0;
+    for( uint32_t i = 1; i <= vdhp->frame_count; i++ )
+        if( lw_vframe_flags( vdhp->frame_table, i ) & LW_VFRAME_FLAG_KEY )
+            ++count;
+    if( count == 0 )
+    {
+        lw_log_show( &vdhp->lh, LW_LOG_WARNING, "No keyframe is found. Expose all frames." );
+        kfp->mode = LW_KEYFRAMES_ONLY_NONE;
+        return 0;
+    }
+    kfp->list = (uint32_t *)lw_malloc_zero( (count + 1) * sizeof(uint32_t) );
+    if( !kfp->list )
+    {
+        lw_log_show( &vdhp->lh, LW_LOG_FATAL, "Failed to allocate the keyframe list." );
+        return -1;
+    }
+    for( uint32_t i = 1, j = 0; i <= vdhp->frame_count; i++ )
+        if( lw_vframe_flags( vdhp->frame_table, i ) & LW_VFRAME_FLAG_KEY )
+            kfp->list[ ++j ] = i;
+    kfp->count        = count;
+    vohp->frame_count = count;
+    /* Each keyframe is decoded on request, so nothing is decoded ahead. */
+    vdhp->prefetch.depth              = 0;
+    vdhp->intra_parallel.worker_count = 0;
+    vdhp->gop_parallel.worker_count   = 0;
+    lw_log_show( &vdhp->lh, LW_LOG_INFO, "Expose only %u keyframes.", count );
+    return 0;
+}
+
+/* Check whether the packets at the beginning of the stream read straight from the input file are identical
+ * to the ones demuxed, and open the input file for direct reads if so.
+ * The demuxer position is left undefined. */
+static void setup_direct_read
+(
+    lwlibav_video_decode_handler_t *vdhp
+)
+{
+#define DIRECT_READ_CHECK_COUNT 16
+    lwlibav_direct_reader_t *drp   = &vdhp->direct_reader;
+    video_frame_table_t     *table = vdhp->frame_table;
+    if( !drp->requested || drp->pb || vdhp->frame_count <= 1 )
+        return;
+    for( uint32_t i = 1; i <= vdhp->frame_count; i++ )
+        if( lw_vframe_file_offset( table, i ) == -1 || lw_vframe_packet_size( table, i ) == 0 )
+        {
+            lw_log_show( &vdhp->lh, LW_LOG_INFO, "The index has no file offset or size of some packets. Demuxing them instead." );
+            return;
+        }
+    if( avio_open2( &drp->pb, vdhp->format->url, AVIO_FLAG_READ, NULL, NULL ) < 0 )
+    {
+        lw_log_show( &vdhp->lh, LW_LOG_WARNING, "Failed to open the input file for direct reads. Demuxing packets instead." );
+        drp->pb = NULL;
+        return;
+    }
+    uint32_t rap_number;
+    find_random_accessible_point( vdhp, 1, 0, &rap_number );
+    int64_t rap_pos = get_random_accessible_point_position( vdhp, rap_number );
+    if( lavf_seek_frame( vdhp->format, vdhp->stream_index, rap_pos, vdhp->av_seek_flags ) < 0 )
+        lavf_seek_frame( vdhp->format, vdhp->stream_index, rap_pos, vdhp->av_seek_flags | AVSEEK_FLAG_ANY );
+    AVPacket *demuxed = av_packet_alloc();
+    AVPacket *direct  = av_packet_alloc();
+    int identical = demuxed && direct;
+    uint32_t check_count = MIN( DIRECT_READ_CHECK_COUNT, vdhp->frame_count - rap_number + 1 );
+    for( uint32_t i = 0; identical && i < check_count; i++ )
+        identical = lwlibav_get_av_frame( vdhp->format, vdhp->stream_index, rap_number + i, demuxed ) == 0
+                 && read_video_packet_directly( vdhp, drp->pb, rap_number + i, direct ) == 0
+                 && demuxed->side_data_elems == 0
+                 && demuxed->pos  == direct->pos
+                 && demuxed->pts  == direct->pts
+                 && demuxed->dts  == direct->dts
+                 && demuxed->size == direct->size
+                 && memcmp( demuxed->data, direct->data, direct->size ) == 0;
+    av_packet_free( &demuxed );
+    av_packet_free( &direct );
+    if( identical )
+        lw_log_show( &vdhp->lh, LW_LOG_INFO, "Reading packets straight from the input file." );
+    else
+    {
+        lw_log_show( &vdhp->lh, LW_LOG_INFO, "The demuxed packets differ from the stored ones. Demuxing them instead." );
+        avio_closep( &drp->pb );
     }
-    return !!(vdhp->frame_list[frame_number].flags & LW_VFRAME_FLAG_KEY);
+#undef DIRECT_READ_CHECK_COUNT
 }
 
 int lwlibav_video_find_first_valid_frame
@@ -1457,6 +3461,7 @@ int lwlibav_video_find_first_valid_frame
     if( vdhp->frame_count != 1 )
     {
         vdhp->av_seek_flags |= AVSEEK_FLAG_BACKWARD;
+        setup_direct_read( vdhp );
         uint32_t rap_number;
         find_random_accessible_point( vdhp, 1, 0, &rap_number );
         int64_t rap_pos = get_random_accessible_point_position( vdhp, rap_number );
@@ -1475,7 +3480,7 @@ int lwlibav_video_find_first_valid_frame
         int ret = decode_video_packet( vdhp->ctx, vdhp->frame_buffer, &got_picture, pkt );
         /* Handle decoder delay derived from PAFF field coded pictures. */
         if( i <= vdhp->frame_count && i > decoder_delay
-         && !got_picture && vdhp->frame_list[i].repeat_pict == 0 )
+         && !got_picture && lw_vframe_repeat_pict( vdhp->frame_table, i ) == 0 )
         {
             /* No output picture since the second field coded picture of the next frame is not decoded yet. */
             if( decoder_delay - thread_delay < 2 * vdhp->ctx->has_b_frames + 1UL )
@@ -1497,7 +3502,7 @@ int lwlibav_video_find_first_valid_frame
                     if( !vdhp->first_valid_frame )
                         return -1;
                     av_frame_unref( vdhp->frame_buffer );
-                    vdhp->first_valid_frame->pts = vdhp->frame_list[ vdhp->first_valid_frame_number ].pts;
+                    vdhp->first_valid_frame->pts = lw_vframe_pts( vdhp->frame_table, vdhp->first_valid_frame_number );
                 }
                 break;
             }
@@ -1519,8 +3524,10 @@ enum lw_field_info lwlibav_video_get_field_info
     uint32_t                        frame_number
 )
 {
+    if( vdhp->keyframes.list )
+        frame_number = vdhp->keyframes.list[ MIN( frame_number, vdhp->keyframes.count ) ];
     return frame_number <= vdhp->frame_count
-         ? vdhp->frame_list[frame_number].field_info
+         ? lw_vframe_field_info( vdhp->frame_table, frame_number )
          : LW_FIELD_INFO_UNKNOWN;
 }
 
@@ -1533,7 +3540,7 @@ void set_video_basic_settings
 {
     lwlibav_video_decode_handler_t *vdhp = (lwlibav_video_decode_handler_t *)dhp;
     AVCodecParameters   *codecpar = vdhp->format->streams[ vdhp->stream_index ]->codecpar;
-    lwlibav_extradata_t *entry    = &vdhp->exh.entries[ vdhp->frame_list[frame_number].extradata_index ];
+    lwlibav_extradata_t *entry    = &vdhp->exh.entries[ lw_vframe_extradata_index( vdhp->frame_table, frame_number ) ];
     codecpar->width                 = entry->width;
     codecpar->height                = entry->height;
     codecpar->bits_per_coded_sample = entry->bits_per_sample;
@@ -1566,7 +3573,7 @@ int try_decode_video_frame
             break;
         /* Get a frame. */
         AVPacket pkt = { 0 };
-        int extradata_index = vdhp->frame_list[frame_number].extradata_index;
+        int extradata_index = lw_vframe_extradata_index( vdhp->frame_table, frame_number );
         if( extradata_index != vdhp->exh.current_index )
             break;
         int ret = lwlibav_get_av_frame( format_ctx, stream_index, frame_number, &pkt );
@@ -38,6 +38,17 @@ typedef enum lw_field_info
     LW_FIELD_INFO_BOTTOM,       /* bottom field first or bottom field coded */
 } lw_field_info_t;
 
+/*****************************************************************************
+ * Statistics
+ *****************************************************************************/
+typedef struct
+{
+    double   decode_cost;       /* the moving average of the time to decode a picture in microseconds */
+    double   seek_cost;         /* the moving average of the time to seek excluding decoding in microseconds */
+    uint64_t forward_count;     /* the number of requests served by decoding forward */
+    uint64_t seek_count;        /* the number of requests served by seeking */
+} lwlibav_video_seek_stats_t;
+
 #ifdef __cplusplus
 extern "C"
 {
@@ -79,6 +90,8 @@ void lwlibav_video_free_output_handler_ptr
 /*****************************************************************************
  * Setters
  *****************************************************************************/
+/* Set the maximum distance to decode forward instead of seeking.
+ * Setting 0 decides whether to seek or to decode forward by comparing the costs measured while decoding. */
 void lwlibav_video_set_forward_seek_threshold
 (
     lwlibav_video_decode_handler_t *vdhp,
@@ -91,6 +104,79 @@ void lwlibav_video_set_seek_mode
     int                             seek_mode
 );
 
+/* Set the number of frames decoded ahead in the background while the requester processes the current frame.
+ * Setting 0 disables decoding ahead.
+ * The decoder must not be touched except for getting frames once frames are decoded ahead.
+ * Don't enable this with direct rendering since the frame buffers are allocated in the background. */
+void lwlibav_video_set_prefetch_depth
+(
+    lwlibav_video_decode_handler_t *vdhp,
+    uint32_t                        prefetch_depth
+);
+
+/* Set the maximum number of frames decoded in a batch and retained for backward requests.
+ * Setting 0 disables batch decoding for backward requests. */
+void lwlibav_video_set_backward_buffer_size
+(
+    lwlibav_video_decode_handler_t *vdhp,
+    uint32_t                        backward_buffer_size
+);
+
+/* Set the maximum total size in bytes of the packets kept from the last random accessible picture.
+ * Seeking back within them feeds them again instead of seeking and demuxing.
+ * Setting 0 disables keeping packets. */
+void lwlibav_video_set_packet_cache_size
+(
+    lwlibav_video_decode_handler_t *vdhp,
+    size_t                          packet_cache_size
+);
+
+/* Read the packets straight from the input file by their file offsets and sizes in the index instead of demuxing.
+ * This takes effect in lwlibav_video_find_first_valid_frame() only if the packets read in both ways are identical,
+ * otherwise the demuxer is used as usual. */
+void lwlibav_video_set_direct_read
+(
+    lwlibav_video_decode_handler_t *vdhp,
+    int                             direct_read
+);
+
+/* Set the maximum number of decoders kept open apart from the current one to be swapped in by seeks.
+ * They are kept per extradata and for decoders reopened to flush, and reset in the background.
+ * Setting 0 disables keeping decoders, where seeks close and open decoders as needed. */
+void lwlibav_video_set_spare_decoders
+(
+    lwlibav_video_decode_handler_t *vdhp,
+    int                             spare_decoders
+);
+
+/* Set the number of workers which decode the frames from the requested one concurrently, each with its own
+ * single-threaded decoder. This takes effect only if every frame of the stream is a keyframe decodable independently,
+ * which is detected when the index is loaded. Setting 0 disables the workers. */
+void lwlibav_video_set_intra_parallel
+(
+    lwlibav_video_decode_handler_t *vdhp,
+    int                             worker_count
+);
+
+/* Set the number of workers which decode the GOPs from the one of the requested frame concurrently, each with its own
+ * single-threaded decoder, and hand out the decoded frames in presentation order. This takes effect only if every GOP
+ * of the stream is closed, which is detected when the index is loaded. Each worker and each GOP decoded ahead keeps
+ * the frames of a whole GOP. Setting 0 disables the workers. */
+void lwlibav_video_set_gop_parallel
+(
+    lwlibav_video_decode_handler_t *vdhp,
+    int                             worker_count
+);
+
+/* Set the keyframe-only mode, which exposes only the keyframes as frames and decodes each of them on its own.
+ * 0: disabled, 1: decode keyframes fully, 2: decode keyframes without the loop filter.
+ * This takes effect when lwlibav_video_create_keyframe_list() is called after the index is constructed. */
+void lwlibav_video_set_keyframes_only
+(
+    lwlibav_video_decode_handler_t *vdhp,
+    int                             mode
+);
+
 void lwlibav_video_set_preferred_decoder_names
 (
     lwlibav_video_decode_handler_t *vdhp,
@@ -143,6 +229,14 @@ AVCodecContext *lwlibav_video_get_codec_context
     lwlibav_video_decode_handler_t *vdhp
 );
 
+/* Get the costs measured for the seek decision and the numbers of the requests served by each way.
+ * All of them are 0 if the handler is NULL. */
+void lwlibav_video_get_seek_stats
+(
+    lwlibav_video_decode_handler_t *vdhp,
+    lwlibav_video_seek_stats_t     *stats
+);
+
 int lwlibav_video_get_max_width
 (
     lwlibav_video_decode_handler_t *vdhp
@@ -202,6 +296,16 @@ int lwlibav_video_is_keyframe
     uint32_t                        frame_number
 );
 
+/* Create the list of the keyframes exposed in the keyframe-only mode, and set the number of them to the frame count
+ * of the output handler. The frame numbers requested afterwards are the numbers in the list.
+ * Nothing is done unless the mode is set, and the mode is disabled with repeat control or VFR->CFR conversion.
+ * Return 0 if successful, otherwise a negative value. */
+int lwlibav_video_create_keyframe_list
+(
+    lwlibav_video_decode_handler_t *vdhp,
+    lwlibav_video_output_handler_t *vohp
+);
+
 int lwlibav_video_find_first_valid_frame
 (
     lwlibav_video_decode_handler_t *vdhp
@@ -31,6 +31,7 @@ typedef struct
     int64_t         pts;                /* presentation timestamp */
     int64_t         dts;                /* decoding timestamp */
     int64_t         file_offset;        /* offset from the beginning of file */
+    int32_t         packet_size;        /* size of the packet in bytes, or 0 if unknown */
     uint32_t        sample_number;      /* unique value in decoding order */
     int             extradata_index;    /* index of extradata to decode this frame */
     int             flags;              /* a combination of LW_VFRAME_FLAG_*s */
@@ -40,11 +41,311 @@ typedef struct
     lw_field_info_t field_info;
 } video_frame_info_t;
 
+/* The frame table is the compact form of the frame info used for decoding.
+ * Each of the timestamps and the file offsets is stored as 32-bit differences from the first valid value in every
+ * block of 1 << LW_VFRAME_BLOCK_SHIFT frames, or as it is if any difference doesn't fit in 32 bits.
+ * The other fields needed for decoding are packed into a 32-bit attribute word. */
+#define LW_VFRAME_BLOCK_SHIFT 8
+#define LW_VFRAME_DELTA_INVALID INT32_MIN
+
+#define LW_VFRAME_ATTR_FLAGS_MASK         0x1F
+#define LW_VFRAME_ATTR_REPEAT_PICT_SHIFT  5
+#define LW_VFRAME_ATTR_REPEAT_PICT_MASK   0xF
+#define LW_VFRAME_ATTR_FIELD_INFO_SHIFT   9
+#define LW_VFRAME_ATTR_FIELD_INFO_MASK    0x3
+#define LW_VFRAME_ATTR_EXTRADATA_SHIFT    11        /* extradata_index + 1 is stored. */
+#define LW_VFRAME_ATTR_EXTRADATA_MAX      ((1 << (32 - LW_VFRAME_ATTR_EXTRADATA_SHIFT)) - 2)
+
+typedef struct
+{
+    int64_t  invalid;           /* the value of the invalid entries */
+    int64_t *base;              /* the first valid value in each block */
+    int32_t *delta;             /* differences from the base or LW_VFRAME_DELTA_INVALID */
+    int64_t *value;             /* values stored as they are if the differences don't fit in 32 bits, otherwise NULL */
+} video_frame_column_t;
+
+typedef struct
+{
+    uint32_t             frame_count;
+    video_frame_column_t pts;
+    video_frame_column_t dts;
+    video_frame_column_t file_offset;
+    uint32_t            *sample_number;
+    uint32_t            *attributes;    /* flags, repeat_pict, field_info and extradata_index */
+    uint32_t            *packet_size;
+} video_frame_table_t;                  /* allocated as a single block with its columns */
+
+static inline int64_t get_video_frame_column
+(
+    const video_frame_column_t *column,
+    uint32_t                    frame_number
+)
+{
+    if( column->value )
+        return column->value[frame_number];
+    int32_t delta = column->delta[frame_number];
+    return delta == LW_VFRAME_DELTA_INVALID ? column->invalid
+         : column->base[frame_number >> LW_VFRAME_BLOCK_SHIFT] + delta;
+}
+
+static inline int64_t lw_vframe_pts( const video_frame_table_t *table, uint32_t frame_number )
+{
+    return get_video_frame_column( &table->pts, frame_number );
+}
+
+static inline int64_t lw_vframe_dts( const video_frame_table_t *table, uint32_t frame_number )
+{
+    return get_video_frame_column( &table->dts, frame_number );
+}
+
+static inline int64_t lw_vframe_file_offset( const video_frame_table_t *table, uint32_t frame_number )
+{
+    return get_video_frame_column( &table->file_offset, frame_number );
+}
+
+static inline uint32_t lw_vframe_packet_size( const video_frame_table_t *table, uint32_t frame_number )
+{
+    return table->packet_size[frame_number];
+}
+
+static inline uint32_t lw_vframe_sample_number( const video_frame_table_t *table, uint32_t frame_number )
+{
+    return table->sample_number[frame_number];
+}
+
+static inline int lw_vframe_flags( const video_frame_table_t *table, uint32_t frame_number )
+{
+    return table->attributes[frame_number] & LW_VFRAME_ATTR_FLAGS_MASK;
+}
+
+static inline int lw_vframe_repeat_pict( const video_frame_table_t *table, uint32_t frame_number )
+{
+    return (table->attributes[frame_number] >> LW_VFRAME_ATTR_REPEAT_PICT_SHIFT) & LW_VFRAME_ATTR_REPEAT_PICT_MASK;
+}
+
+static inline lw_field_info_t lw_vframe_field_info( const video_frame_table_t *table, uint32_t frame_number )
+{
+    return (lw_field_info_t)((table->attributes[frame_number] >> LW_VFRAME_ATTR_FIELD_INFO_SHIFT) & LW_VFRAME_ATTR_FIELD_INFO_MASK);
+}
+
+static inline int lw_vframe_extradata_index( const video_frame_table_t *table, uint32_t frame_number )
+{
+    return (int)(table->attributes[frame_number] >> LW_VFRAME_ATTR_EXTRADATA_SHIFT) - 1;
+}
+
 typedef struct
 {
     uint32_t decoding_to_presentation;
 } order_converter_t;
 
+/* The frames decoded in a batch to serve backward requests.
+ * Once requests go backward consecutively, the frames up to the requested one from its random accessible point are
+ * decoded at once and retained, so the following backward requests are served without seeking and decoding again. */
+typedef struct
+{
+    uint32_t  capacity;                 /* the maximum number of retained frames, or 0 if disabled */
+    uint32_t  first_number;             /* the picture number of the first retained frame */
+    uint32_t  count;                    /* the number of retained frames */
+    uint32_t  last_request;             /* the last requested picture number */
+    uint32_t  decreasing_count;         /* the number of consecutive decreasing requests */
+    int       on_output;                /* The output frame buffer holds a retained frame
+                                         * instead of the last requested frame by the decoder if set to non-zero. */
+    AVFrame  *decode_frame;             /* the frame buffer where the decoder outputs frame data in batch decoding */
+    AVFrame **frames;
+} lwlibav_backward_buffer_t;
+
+/* The costs measured while decoding to decide whether to seek or to decode forward.
+ * The statistics are updated under the prefetch mutex if any, since they are read while the worker decodes. */
+typedef struct
+{
+    lwlibav_video_seek_stats_t stats;
+    uint64_t                   decode_samples;  /* the number of measurements of decoding forward */
+    uint64_t                   seek_samples;    /* the number of measurements of seeking */
+} lwlibav_seek_cost_t;
+
+/* The worker which decodes the frames following the last requested one in the background.
+ * The decoder is shared with the requester, which takes it over by setting 'requesting' and waiting until the worker
+ * is not decoding. The flags are accessed only under the mutex, while the decoding itself runs without the mutex.
+ * The queued frames are stored in the ring of depth + 1 frame buffers including the last requested one. */
+typedef struct
+{
+    uint32_t     depth;                 /* the number of frames decoded ahead, or 0 if disabled */
+    lw_thread_t *thread;
+    lw_mutex_t  *mutex;
+    lw_cond_t   *cond;
+    int          stop;                  /* Stop the worker if set to non-zero. */
+    int          requesting;            /* The requester uses or waits for the decoder if set to non-zero. */
+    int          decoding;              /* The worker is decoding if set to non-zero. */
+    int          exhausted;             /* Decoding ahead failed or reached the end if set to non-zero. */
+    uint32_t     first_number;          /* the picture number of the first queued frame, or 0 if not synchronized */
+    uint32_t     count;                 /* the number of queued frames */
+    AVFrame     *decode_frame;          /* the frame buffer where the decoder outputs frame data */
+    AVFrame    **frames;
+} lwlibav_prefetch_t;
+
+/* The packets demuxed from the last random accessible picture or the last seek up to the current position.
+ * A seek to the random accessible picture of the first packet feeds them again instead of seeking and demuxing.
+ * The packets are kept only while they contain every packet read from the demuxer since the first one,
+ * so the demuxer continues from the last packet when all of them are fed. */
+typedef struct
+{
+    size_t     budget;                  /* the maximum total size of the packets in bytes, or 0 if disabled */
+    size_t     size;                    /* the total size of the packets */
+    int        recording;               /* Packets read from the demuxer are appended if set to non-zero. */
+    uint32_t   rap_number;              /* the decoding number of the first packet */
+    uint32_t   count;                   /* the number of the packets */
+    uint32_t   position;                /* the index of the next packet to feed, or count if the demuxer is read */
+    uint32_t   capacity;                /* the number of the allocated packets */
+    AVPacket **packets;
+} lwlibav_packet_cache_t;
+
+/* The reader of the packets straight from the input file by their file offsets and sizes in the index.
+ * This bypasses the demuxer only if the packets read in both ways are identical at the beginning of the stream,
+ * which is the case with simple layouts where each packet is stored contiguously as it is. */
+typedef struct
+{
+    int          requested;             /* Reading packets directly is tried if set to non-zero. */
+    AVIOContext *pb;                    /* the input file opened for direct reads, or NULL if the demuxer is used */
+    int          failed;                /* Reading directly failed during the current request if set to non-zero. */
+} lwlibav_direct_reader_t;
+
+/* The decoders kept open apart from the current one, and the worker which resets them in the background.
+ * A seek swaps the current decoder for the spare one opened with the extradata to decode from instead of closing
+ * the current decoder and opening a new one. The decoder swapped out becomes a spare one after reset by the worker. */
+#define LW_SPARE_DECODER_EMPTY     0
+#define LW_SPARE_DECODER_DIRTY     1    /* waiting for the reset */
+#define LW_SPARE_DECODER_RESETTING 2
+#define LW_SPARE_DECODER_READY     3
+
+typedef struct
+{
+    int                state;           /* LW_SPARE_DECODER_* */
+    int                extradata_index; /* index of extradata which the decoder is opened with */
+    uint64_t           last_use;        /* the order of being swapped out, used to evict the least recently used one */
+    AVCodecContext    *ctx;
+    AVCodecParameters *codecpar;        /* the codec parameters which the decoder is opened with */
+} lwlibav_spare_decoder_t;
+
+typedef struct
+{
+    int                      capacity;  /* the maximum number of spare decoders, or 0 if disabled */
+    uint64_t                 use_count;
+    double                   drc;
+    const char              *ff_options;
+    lw_thread_t             *thread;
+    lw_mutex_t              *mutex;
+    lw_cond_t               *cond;
+    int                      stop;      /* Stop the worker if set to non-zero. */
+    lwlibav_spare_decoder_t *entries;   /* capacity entries */
+} lwlibav_spare_decoders_t;
+
+/* The states of the units, frames or GOPs, queued to the parallel workers. */
+#define LW_PARALLEL_SLOT_QUEUED   0
+#define LW_PARALLEL_SLOT_DECODING 1
+#define LW_PARALLEL_SLOT_DONE     2
+#define LW_PARALLEL_SLOT_FAILED   3
+
+/* A worker which decodes the queued units apart from the main decoder.
+ * Each worker has its own single-threaded decoder and its own reader of the input file. */
+typedef struct
+{
+    lwlibav_video_decode_handler_t *vdhp;
+    lw_thread_t                    *thread;
+    AVFormatContext                *format;         /* the demuxer used unless the packets are read directly */
+    AVIOContext                    *pb;             /* the input file opened for direct reads, or NULL */
+    AVCodecContext                 *ctx;
+    AVPacket                       *pkt;
+    AVFrame                        *frame;          /* the frame buffer where the decoder outputs frame data */
+    AVFrame                       **frames;         /* the frames of the GOP being decoded, used only by the GOP workers */
+    uint32_t                        next_number;    /* the decoding number of the next packet of the demuxer, or 0 if unknown */
+} lwlibav_parallel_worker_t;
+
+/* The workers which decode the frames from the requested one concurrently when every frame is decodable independently.
+ * Each worker decodes the queued frame of the smallest number in the window of the frames from the last requested one. */
+
+typedef struct
+{
+    uint32_t number;                    /* the picture number assigned, or 0 if unused */
+    uint32_t generation;                /* bumped on every assignment to discard the late result for the previous one */
+    int      state;                     /* LW_PARALLEL_SLOT_* */
+    AVFrame *frame;
+} lwlibav_intra_slot_t;
+
+typedef struct
+{
+    int                     worker_count;   /* the number of workers, or 0 if disabled */
+    lw_mutex_t             *mutex;
+    lw_cond_t              *cond;
+    int                     stop;           /* Stop the workers if set to non-zero. */
+    uint32_t                first_number;   /* the picture number of the first frame of the window, or 0 if none */
+    uint32_t                last_number;    /* the picture number of the last frame of the window */
+    uint32_t                window;         /* the number of slots, which is the maximum size of the window */
+    lwlibav_intra_slot_t   *slots;          /* The slot of each frame of the window is indexed by number % window. */
+    lwlibav_parallel_worker_t *workers;
+} lwlibav_intra_parallel_t;
+
+/* The workers which decode the GOPs from the one of the requested frame concurrently when every GOP is closed.
+ * Each worker decodes the whole queued GOP of the smallest number in the window, and the frames are handed out
+ * in presentation order from the slot of the GOP of each requested frame. */
+typedef struct
+{
+    uint32_t  gop_number;               /* the GOP number assigned, or 0 if unused */
+    uint32_t  generation;               /* bumped on every assignment to discard the late result for the previous one */
+    int       state;                    /* LW_PARALLEL_SLOT_* */
+    AVFrame **frames;                   /* the frames of the GOP in presentation order */
+} lwlibav_gop_slot_t;
+
+typedef struct
+{
+    int                        worker_count;    /* the number of workers, or 0 if disabled */
+    lw_mutex_t                *mutex;
+    lw_cond_t                 *cond;
+    int                        stop;            /* Stop the workers if set to non-zero. */
+    uint32_t                   gop_count;
+    uint32_t                  *gop_list;        /* the presentation number of the first frame of each GOP
+                                                 * The entry at gop_count + 1 is frame_count + 1. */
+    uint32_t                   max_gop_length;  /* the number of frame buffers of each slot and each worker
+                                                 * The longer GOPs are decoded sequentially. */
+    AVCodecParameters         *codecpar;        /* the parameters to reopen the decoders of the workers */
+    uint32_t                   first_gop;       /* the GOP number of the first GOP of the window, or 0 if none */
+    uint32_t                   last_gop;        /* the GOP number of the last GOP of the window */
+    uint32_t                   window;          /* the number of slots, which is the maximum size of the window */
+    lwlibav_gop_slot_t        *slots;           /* The slot of each GOP of the window is indexed by number % window. */
+    lwlibav_parallel_worker_t *workers;
+} lwlibav_gop_parallel_t;
+
+/* The keyframe-only mode, where only the random accessible pictures are exposed as frames.
+ * Each keyframe is decoded on its own by a decoder which discards non-keyframes, so no preceding picture is decoded. */
+#define LW_KEYFRAMES_ONLY_NONE    0
+#define LW_KEYFRAMES_ONLY_FULL    1     /* Decode keyframes fully. */
+#define LW_KEYFRAMES_ONLY_REDUCED 2     /* Decode keyframes without the loop filter for lower quality but faster decoding. */
+
+typedef struct
+{
+    int                       mode;     /* LW_KEYFRAMES_ONLY_* */
+    uint32_t                  count;    /* the number of the exposed keyframes */
+    uint32_t                 *list;     /* the presentation number of each exposed keyframe, 1-origin */
+    int                       opened;   /* 1 if the decoder below is opened, -1 if unavailable, otherwise 0 */
+    lwlibav_parallel_worker_t decoder;  /* the decoder and the reader of the keyframes used in the requesting thread */
+} lwlibav_keyframes_only_t;
+
+/* The random accessible pictures found unusable as the starting points of decoding after seeking.
+ * Retrying from the preceding random accessible pictures is costly, so later seeks go straight to the one which worked. */
+typedef struct
+{
+    uint32_t rap_number;                /* the decoding number of the unusable random accessible picture */
+    uint32_t fallback_number;           /* the decoding number of the random accessible picture which worked instead */
+    int      aggressive;                /* Decoding from the fallback worked only by ignoring errors if set to non-zero. */
+} lwlibav_rap_failure_t;
+
+typedef struct
+{
+    uint32_t               count;
+    uint32_t               capacity;
+    lwlibav_rap_failure_t *entries;     /* sorted by rap_number */
+    char                  *index_file_path; /* the index file where the unusable pictures are recorded, or NULL if not recorded */
+} lwlibav_rap_failure_list_t;
+
 struct lwlibav_video_decode_handler_tag
 {
     /* common */
@@ -65,7 +366,7 @@ struct lwlibav_video_decode_handler_tag
     AVRational          time_base;
     uint32_t            frame_count;
     AVFrame            *frame_buffer;
-    video_frame_info_t *frame_list;         /* stored in presentation order */
+    video_frame_info_t *frame_list;         /* stored in presentation order while constructing the index */
     const char         *ff_options;
     /* */
     uint32_t            forward_seek_threshold;
@@ -78,7 +379,9 @@ struct lwlibav_video_decode_handler_tag
     enum AVColorSpace   initial_colorspace;
     AVPacket            packet;
     order_converter_t  *order_converter;            /* maps of decoding to presentation stored in decoding order */
-    uint8_t            *keyframe_list;              /* keyframe list stored in decoding order */
+    uint32_t           *rap_list;                   /* the nearest random accessible picture at or before each picture
+                                                     * stored in decoding order, or 0 if none */
+    video_frame_table_t *frame_table;               /* frame table packed from frame_list, stored in presentation order */
     uint32_t            last_half_frame;            /* The last frame consists of complementary field coded picture pair
                                                      * if set to non-zero, otherwise single frame coded picture. */
     uint32_t            last_frame_number;          /* the number of the last requested frame */
@@ -99,4 +402,20 @@ struct lwlibav_video_decode_handler_tag
     uint32_t            last_ts_frame_number;
     AVRational          actual_time_base;
     int                 strict_cfr;
+    int                 intra_only;                 /* Every frame is decodable independently in presentation order
+                                                     * with the same extradata if set to non-zero. */
+    int                 closed_gop;                 /* Every GOP in decoding order is displayed contiguously with the same
+                                                     * extradata, so it is decodable independently unless its leading
+                                                     * pictures refer to the previous GOP, if set to non-zero. */
+    lwlibav_backward_buffer_t backward;
+    lwlibav_prefetch_t  prefetch;
+    lwlibav_seek_cost_t seek_cost;
+    lwlibav_rap_failure_list_t rap_failures;
+    lwlibav_packet_cache_t packet_cache;
+    lwlibav_direct_reader_t direct_reader;
+    lwlibav_spare_decoders_t spare_decoders;
+    lwlibav_intra_parallel_t intra_parallel;
+    lwlibav_gop_parallel_t gop_parallel;
+    lwlibav_keyframes_only_t keyframes;
+    lwlibav_index_cache_t *index_cache;         /* the owner of the frame lists and the extradata lists if shared */
 };
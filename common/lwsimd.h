@@ -24,10 +24,14 @@
 #define LW_ALIGN(x) __attribute__((aligned(x)))
 #define LW_FUNC_ALIGN __attribute__((force_align_arg_pointer))
 #define LW_FORCEINLINE inline __attribute__((always_inline))
+#define LW_TARGET_AVX2 __attribute__((target("avx2")))
+#define LW_TARGET_AVX512BW __attribute__((target("avx512f,avx512bw")))
 #else
 #define LW_ALIGN(x) __declspec(align(x))
 #define LW_FUNC_ALIGN
 #define LW_FORCEINLINE __forceinline
+#define LW_TARGET_AVX2
+#define LW_TARGET_AVX512BW
 #endif
 
 #ifdef __cplusplus
@@ -39,6 +43,7 @@ int lw_check_sse2();
 int lw_check_ssse3();
 int lw_check_sse41();
 int lw_check_avx2();
+int lw_check_avx512bw();
 
 #ifdef __cplusplus
 }
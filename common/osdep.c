@@ -22,15 +22,26 @@
 
 #ifdef _WIN32
 #define _CRT_SECURE_NO_WARNINGS
+#endif
 
 #include "osdep.h"
 #include "utils.h"
 #include <stdio.h>
 #include <stdlib.h>
 
+#ifdef _WIN32
 #define WIN32_LEAN_AND_MEAN
 #include <windows.h>
+#include <process.h>
+#else
+#include <pthread.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#endif
 
+#ifdef _WIN32
 int lw_string_to_wchar( int cp, const char *from, wchar_t **to )
 {
     int nc = MultiByteToWideChar( cp, MB_ERR_INVALID_CHARS, from, -1, 0, 0 );
@@ -84,4 +95,308 @@ char *lw_realpath( const char *path, char *resolved )
     return ret;
 }
 
+struct lw_thread_tag
+{
+    HANDLE handle;
+    void *(*func)( void * );
+    void  *arg;
+    void  *ret;
+};
+
+struct lw_mutex_tag
+{
+    SRWLOCK lock;
+};
+
+struct lw_cond_tag
+{
+    CONDITION_VARIABLE cond;
+};
+
+static unsigned __stdcall lw_thread_entry( void *arg )
+{
+    lw_thread_t *thread = (lw_thread_t *)arg;
+    thread->ret = thread->func( thread->arg );
+    return 0;
+}
+
+lw_thread_t *lw_thread_create( void *(*func)( void * ), void *arg )
+{
+    lw_thread_t *thread = (lw_thread_t *)lw_malloc_zero( sizeof(lw_thread_t) );
+    if( !thread )
+        return NULL;
+    thread->func   = func;
+    thread->arg    = arg;
+    thread->handle = (HANDLE)_beginthreadex( NULL, 0, lw_thread_entry, thread, 0, NULL );
+    if( !thread->handle )
+    {
+        lw_free( thread );
+        return NULL;
+    }
+    return thread;
+}
+
+void *lw_thread_join( lw_thread_t *thread )
+{
+    WaitForSingleObject( thread->handle, INFINITE );
+    CloseHandle( thread->handle );
+    void *ret = thread->ret;
+    lw_free( thread );
+    return ret;
+}
+
+lw_mutex_t *lw_mutex_create( void )
+{
+    lw_mutex_t *mutex = (lw_mutex_t *)lw_malloc_zero( sizeof(lw_mutex_t) );
+    if( mutex )
+        InitializeSRWLock( &mutex->lock );
+    return mutex;
+}
+
+void lw_mutex_destroy( lw_mutex_t *mutex )
+{
+    lw_free( mutex );
+}
+
+void lw_mutex_lock( lw_mutex_t *mutex )
+{
+    AcquireSRWLockExclusive( &mutex->lock );
+}
+
+void lw_mutex_unlock( lw_mutex_t *mutex )
+{
+    ReleaseSRWLockExclusive( &mutex->lock );
+}
+
+lw_mutex_t *lw_process_mutex( void )
+{
+    static lw_mutex_t process_mutex = { SRWLOCK_INIT };
+    return &process_mutex;
+}
+
+lw_cond_t *lw_cond_create( void )
+{
+    lw_cond_t *cond = (lw_cond_t *)lw_malloc_zero( sizeof(lw_cond_t) );
+    if( cond )
+        InitializeConditionVariable( &cond->cond );
+    return cond;
+}
+
+void lw_cond_destroy( lw_cond_t *cond )
+{
+    lw_free( cond );
+}
+
+void lw_cond_wait( lw_cond_t *cond, lw_mutex_t *mutex )
+{
+    SleepConditionVariableSRW( &cond->cond, &mutex->lock, INFINITE, 0 );
+}
+
+void lw_cond_signal( lw_cond_t *cond )
+{
+    WakeConditionVariable( &cond->cond );
+}
+
+void lw_cond_broadcast( lw_cond_t *cond )
+{
+    WakeAllConditionVariable( &cond->cond );
+}
+
+struct lw_file_lock_tag
+{
+    HANDLE handle;
+};
+
+lw_file_lock_t *lw_file_lock( const char *name )
+{
+    wchar_t *wname = NULL;
+    if( !lw_string_to_wchar( CP_UTF8, name, &wname ) )
+        return NULL;
+    HANDLE handle = CreateFileW( wname, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                                 NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL );
+    lw_free( wname );
+    if( handle == INVALID_HANDLE_VALUE )
+        return NULL;
+    OVERLAPPED overlapped = { 0 };
+    lw_file_lock_t *lock = (lw_file_lock_t *)lw_malloc_zero( sizeof(lw_file_lock_t) );
+    if( !lock || !LockFileEx( handle, LOCKFILE_EXCLUSIVE_LOCK, 0, 1, 0, &overlapped ) )
+    {
+        CloseHandle( handle );
+        lw_free( lock );
+        return NULL;
+    }
+    lock->handle = handle;
+    return lock;
+}
+
+void lw_file_unlock( lw_file_lock_t *lock )
+{
+    if( !lock )
+        return;
+    OVERLAPPED overlapped = { 0 };
+    UnlockFileEx( lock->handle, 0, 1, 0, &overlapped );
+    CloseHandle( lock->handle );
+    lw_free( lock );
+}
+
+int lw_rename( const char *from, const char *to )
+{
+    wchar_t *wfrom = NULL, *wto = NULL;
+    int ret = -1;
+    if( lw_string_to_wchar( CP_UTF8, from, &wfrom ) &&
+        lw_string_to_wchar( CP_UTF8, to, &wto ) )
+        ret = MoveFileExW( wfrom, wto, MOVEFILE_REPLACE_EXISTING ) ? 0 : -1;
+    lw_freep( &wfrom );
+    lw_freep( &wto );
+    return ret;
+}
+
+int lw_remove( const char *name )
+{
+    wchar_t *wname = NULL;
+    int ret = lw_string_to_wchar( CP_UTF8, name, &wname ) ? _wremove( wname ) : remove( name );
+    lw_freep( &wname );
+    return ret;
+}
+#else
+struct lw_thread_tag
+{
+    pthread_t handle;
+};
+
+struct lw_mutex_tag
+{
+    pthread_mutex_t lock;
+};
+
+struct lw_cond_tag
+{
+    pthread_cond_t cond;
+};
+
+lw_thread_t *lw_thread_create( void *(*func)( void * ), void *arg )
+{
+    lw_thread_t *thread = (lw_thread_t *)lw_malloc_zero( sizeof(lw_thread_t) );
+    if( !thread )
+        return NULL;
+    if( pthread_create( &thread->handle, NULL, func, arg ) )
+    {
+        lw_free( thread );
+        return NULL;
+    }
+    return thread;
+}
+
+void *lw_thread_join( lw_thread_t *thread )
+{
+    void *ret = NULL;
+    pthread_join( thread->handle, &ret );
+    lw_free( thread );
+    return ret;
+}
+
+lw_mutex_t *lw_mutex_create( void )
+{
+    lw_mutex_t *mutex = (lw_mutex_t *)lw_malloc_zero( sizeof(lw_mutex_t) );
+    if( mutex && pthread_mutex_init( &mutex->lock, NULL ) )
+        lw_freep( &mutex );
+    return mutex;
+}
+
+void lw_mutex_destroy( lw_mutex_t *mutex )
+{
+    if( !mutex )
+        return;
+    pthread_mutex_destroy( &mutex->lock );
+    lw_free( mutex );
+}
+
+void lw_mutex_lock( lw_mutex_t *mutex )
+{
+    pthread_mutex_lock( &mutex->lock );
+}
+
+void lw_mutex_unlock( lw_mutex_t *mutex )
+{
+    pthread_mutex_unlock( &mutex->lock );
+}
+
+lw_mutex_t *lw_process_mutex( void )
+{
+    static lw_mutex_t process_mutex = { PTHREAD_MUTEX_INITIALIZER };
+    return &process_mutex;
+}
+
+lw_cond_t *lw_cond_create( void )
+{
+    lw_cond_t *cond = (lw_cond_t *)lw_malloc_zero( sizeof(lw_cond_t) );
+    if( cond && pthread_cond_init( &cond->cond, NULL ) )
+        lw_freep( &cond );
+    return cond;
+}
+
+void lw_cond_destroy( lw_cond_t *cond )
+{
+    if( !cond )
+        return;
+    pthread_cond_destroy( &cond->cond );
+    lw_free( cond );
+}
+
+void lw_cond_wait( lw_cond_t *cond, lw_mutex_t *mutex )
+{
+    pthread_cond_wait( &cond->cond, &mutex->lock );
+}
+
+void lw_cond_signal( lw_cond_t *cond )
+{
+    pthread_cond_signal( &cond->cond );
+}
+
+void lw_cond_broadcast( lw_cond_t *cond )
+{
+    pthread_cond_broadcast( &cond->cond );
+}
+
+struct lw_file_lock_tag
+{
+    int fd;
+};
+
+lw_file_lock_t *lw_file_lock( const char *name )
+{
+    int fd = open( name, O_RDWR | O_CREAT, 0666 );
+    if( fd < 0 )
+        return NULL;
+    /* Locks by flock() are held by the open file description, so threads in a process are also excluded. */
+    int err;
+    while( (err = flock( fd, LOCK_EX )) < 0 && errno == EINTR );
+    lw_file_lock_t *lock = err ? NULL : (lw_file_lock_t *)lw_malloc_zero( sizeof(lw_file_lock_t) );
+    if( !lock )
+    {
+        close( fd );
+        return NULL;
+    }
+    lock->fd = fd;
+    return lock;
+}
+
+void lw_file_unlock( lw_file_lock_t *lock )
+{
+    if( !lock )
+        return;
+    flock( lock->fd, LOCK_UN );
+    close( lock->fd );
+    lw_free( lock );
+}
+
+int lw_rename( const char *from, const char *to )
+{
+    return rename( from, to );
+}
+
+int lw_remove( const char *name )
+{
+    return remove( name );
+}
 #endif
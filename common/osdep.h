@@ -33,10 +33,60 @@
 #  define lw_realpath realpath
 #endif
 
+/* Seek and tell by 64-bit file offsets even where long is 32-bit. */
+#ifdef _WIN32
+#  define lw_fseek _fseeki64
+#  define lw_ftell _ftelli64
+#else
+#  define lw_fseek fseeko
+#  define lw_ftell ftello
+#endif
+
 #ifdef _WIN32
 #  include <wchar.h>
    int lw_string_to_wchar( int cp, const char *from, wchar_t **to );
    int lw_string_from_wchar( int cp, const wchar_t *from, char **to );
 #endif
 
+/* Advisory locks of files across processes. The lock file is created if not present. */
+typedef struct lw_file_lock_tag lw_file_lock_t;
+
+/* Thin wrappers of native threads. These are implemented by Win32 API on Windows and by pthreads otherwise. */
+typedef struct lw_thread_tag lw_thread_t;
+typedef struct lw_mutex_tag  lw_mutex_t;
+typedef struct lw_cond_tag   lw_cond_t;
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif  /* __cplusplus */
+
+lw_thread_t *lw_thread_create( void *(*func)( void * ), void *arg );
+void *lw_thread_join( lw_thread_t *thread );
+
+lw_mutex_t *lw_mutex_create( void );
+void lw_mutex_destroy( lw_mutex_t *mutex );
+void lw_mutex_lock( lw_mutex_t *mutex );
+void lw_mutex_unlock( lw_mutex_t *mutex );
+
+/* The mutex for process-wide state. It is available without creation and must not be destroyed. */
+lw_mutex_t *lw_process_mutex( void );
+
+lw_cond_t *lw_cond_create( void );
+void lw_cond_destroy( lw_cond_t *cond );
+void lw_cond_wait( lw_cond_t *cond, lw_mutex_t *mutex );
+void lw_cond_signal( lw_cond_t *cond );
+void lw_cond_broadcast( lw_cond_t *cond );
+
+lw_file_lock_t *lw_file_lock( const char *name );
+void lw_file_unlock( lw_file_lock_t *lock );
+
+/* Replace the file 'to' with the file 'from'. This is atomic except on Windows. */
+int lw_rename( const char *from, const char *to );
+int lw_remove( const char *name );
+
+#ifdef __cplusplus
+}
+#endif  /* __cplusplus */
+
 #endif
@@ -1,52 +1,280 @@
+/* This file is available under an ISC license. */
+
+#include <string.h>
+#include <stdint.h>
 #include <emmintrin.h>
-#include  <stdint.h>
+#include <immintrin.h>
+
+#include <libavutil/pixfmt.h>
+
+#include "lwsimd.h"
+#include "planar_yuv_sse2.h"
+
+/* Split the interleaved chroma samples of a line into the U and V lines.
+ * The 16-bit samples are shifted right by 'shift' bits. */
+typedef void func_split_8 ( uint8_t  *dst_u, uint8_t  *dst_v, const uint8_t  *src, int width );
+typedef void func_split_16( uint16_t *dst_u, uint16_t *dst_v, const uint16_t *src, int width, int shift );
+/* Shift the 16-bit samples of a line right by 'shift' bits. */
+typedef void func_shift_16( uint16_t *dst, const uint16_t *src, int width, int shift );
 
-static inline __m128i _MM_PACKUS_EPI32(const __m128i* low, const __m128i* high)
+static void split_8_c( uint8_t *dst_u, uint8_t *dst_v, const uint8_t *src, int width )
 {
-    const __m128i val_32 = _mm_set1_epi32(0x8000);
-    const __m128i val_16 = _mm_set1_epi16(0x8000);
-    const __m128i low1 = _mm_sub_epi32(*low, val_32);
-    const __m128i high1 = _mm_sub_epi32(*high, val_32);
-    return _mm_add_epi16(_mm_packs_epi32(low1, high1), val_16);
+    for( int x = 0; x < width; x++ )
+    {
+        dst_u[x] = src[2 * x    ];
+        dst_v[x] = src[2 * x + 1];
+    }
 }
 
-void planar_yuv_sse2(uint16_t* dstp_y, uint16_t* dstp_u, uint16_t* dstp_v, uint16_t* srcp_y, uint16_t* srcp_uv, const int dst_stride_y, const int dst_stride_uv, const int src_stride_y, const int src_stride_uv, 
-    const int width_y, const int width_uv, const int height_y, const int height_uv)
-{                    
-    for (int y = 0; y < height_y; y++)
+static void split_16_c( uint16_t *dst_u, uint16_t *dst_v, const uint16_t *src, int width, int shift )
+{
+    for( int x = 0; x < width; x++ )
     {
-        for (int x = 0; x < width_y; x += 8)
-        {
-            __m128i yy = _mm_load_si128((const __m128i*)(srcp_y + x));
-            yy = _mm_srli_epi16(yy, 6);
-            _mm_stream_si128((__m128i*)(dstp_y + x), yy);
-        }
-        srcp_y += src_stride_y;
-        dstp_y += dst_stride_y;
+        dst_u[x] = src[2 * x    ] >> shift;
+        dst_v[x] = src[2 * x + 1] >> shift;
+    }
+}
+
+static void shift_16_c( uint16_t *dst, const uint16_t *src, int width, int shift )
+{
+    for( int x = 0; x < width; x++ )
+        dst[x] = src[x] >> shift;
+}
+
+static void split_8_sse2( uint8_t *dst_u, uint8_t *dst_v, const uint8_t *src, int width )
+{
+    const __m128i mask = _mm_set1_epi16( 0x00ff );
+    int x = 0;
+    for( ; x <= width - 16; x += 16 )
+    {
+        __m128i uv0 = _mm_loadu_si128( (const __m128i *)(src + 2 * x     ) );
+        __m128i uv1 = _mm_loadu_si128( (const __m128i *)(src + 2 * x + 16) );
+        __m128i u   = _mm_packus_epi16( _mm_and_si128( uv0, mask ), _mm_and_si128( uv1, mask ) );
+        __m128i v   = _mm_packus_epi16( _mm_srli_epi16( uv0, 8 ), _mm_srli_epi16( uv1, 8 ) );
+        _mm_storeu_si128( (__m128i *)(dst_u + x), u );
+        _mm_storeu_si128( (__m128i *)(dst_v + x), v );
+    }
+    split_8_c( dst_u + x, dst_v + x, src + 2 * x, width - x );
+}
+
+static void split_16_sse2( uint16_t *dst_u, uint16_t *dst_v, const uint16_t *src, int width, int shift )
+{
+    const __m128i count = _mm_cvtsi32_si128( shift );
+    int x = 0;
+    for( ; x <= width - 8; x += 8 )
+    {
+        __m128i uv0 = _mm_loadu_si128( (const __m128i *)(src + 2 * x    ) );
+        __m128i uv1 = _mm_loadu_si128( (const __m128i *)(src + 2 * x + 8) );
+        /* SSE2 has no unsigned saturation from 32-bit to 16-bit.
+         * Sign-extend the 16-bit samples so that the signed saturation keeps their bits as they are. */
+        __m128i u   = _mm_packs_epi32( _mm_srai_epi32( _mm_slli_epi32( uv0, 16 ), 16 ),
+                                       _mm_srai_epi32( _mm_slli_epi32( uv1, 16 ), 16 ) );
+        __m128i v   = _mm_packs_epi32( _mm_srai_epi32( uv0, 16 ), _mm_srai_epi32( uv1, 16 ) );
+        _mm_storeu_si128( (__m128i *)(dst_u + x), _mm_srl_epi16( u, count ) );
+        _mm_storeu_si128( (__m128i *)(dst_v + x), _mm_srl_epi16( v, count ) );
+    }
+    split_16_c( dst_u + x, dst_v + x, src + 2 * x, width - x, shift );
+}
+
+static void shift_16_sse2( uint16_t *dst, const uint16_t *src, int width, int shift )
+{
+    const __m128i count = _mm_cvtsi32_si128( shift );
+    int x = 0;
+    for( ; x <= width - 8; x += 8 )
+    {
+        __m128i y = _mm_loadu_si128( (const __m128i *)(src + x) );
+        _mm_storeu_si128( (__m128i *)(dst + x), _mm_srl_epi16( y, count ) );
+    }
+    shift_16_c( dst + x, src + x, width - x, shift );
+}
+
+/* The packing instructions of AVX2 and AVX-512 work within each 128-bit lane.
+ * So, the results are put back in order by permuting 64-bit elements. */
+static LW_TARGET_AVX2 void split_8_avx2( uint8_t *dst_u, uint8_t *dst_v, const uint8_t *src, int width )
+{
+    const __m256i mask = _mm256_set1_epi16( 0x00ff );
+    int x = 0;
+    for( ; x <= width - 32; x += 32 )
+    {
+        __m256i uv0 = _mm256_loadu_si256( (const __m256i *)(src + 2 * x     ) );
+        __m256i uv1 = _mm256_loadu_si256( (const __m256i *)(src + 2 * x + 32) );
+        __m256i u   = _mm256_packus_epi16( _mm256_and_si256( uv0, mask ), _mm256_and_si256( uv1, mask ) );
+        __m256i v   = _mm256_packus_epi16( _mm256_srli_epi16( uv0, 8 ), _mm256_srli_epi16( uv1, 8 ) );
+        _mm256_storeu_si256( (__m256i *)(dst_u + x), _mm256_permute4x64_epi64( u, 0xd8 ) );
+        _mm256_storeu_si256( (__m256i *)(dst_v + x), _mm256_permute4x64_epi64( v, 0xd8 ) );
+    }
+    split_8_c( dst_u + x, dst_v + x, src + 2 * x, width - x );
+}
+
+static LW_TARGET_AVX2 void split_16_avx2( uint16_t *dst_u, uint16_t *dst_v, const uint16_t *src, int width, int shift )
+{
+    const __m256i mask  = _mm256_set1_epi32( 0x0000ffff );
+    const __m128i count = _mm_cvtsi32_si128( shift );
+    int x = 0;
+    for( ; x <= width - 16; x += 16 )
+    {
+        __m256i uv0 = _mm256_loadu_si256( (const __m256i *)(src + 2 * x     ) );
+        __m256i uv1 = _mm256_loadu_si256( (const __m256i *)(src + 2 * x + 16) );
+        __m256i u   = _mm256_packus_epi32( _mm256_and_si256( uv0, mask ), _mm256_and_si256( uv1, mask ) );
+        __m256i v   = _mm256_packus_epi32( _mm256_srli_epi32( uv0, 16 ), _mm256_srli_epi32( uv1, 16 ) );
+        u = _mm256_srl_epi16( _mm256_permute4x64_epi64( u, 0xd8 ), count );
+        v = _mm256_srl_epi16( _mm256_permute4x64_epi64( v, 0xd8 ), count );
+        _mm256_storeu_si256( (__m256i *)(dst_u + x), u );
+        _mm256_storeu_si256( (__m256i *)(dst_v + x), v );
+    }
+    split_16_c( dst_u + x, dst_v + x, src + 2 * x, width - x, shift );
+}
+
+static LW_TARGET_AVX2 void shift_16_avx2( uint16_t *dst, const uint16_t *src, int width, int shift )
+{
+    const __m128i count = _mm_cvtsi32_si128( shift );
+    int x = 0;
+    for( ; x <= width - 16; x += 16 )
+    {
+        __m256i y = _mm256_loadu_si256( (const __m256i *)(src + x) );
+        _mm256_storeu_si256( (__m256i *)(dst + x), _mm256_srl_epi16( y, count ) );
+    }
+    shift_16_c( dst + x, src + x, width - x, shift );
+}
+
+static LW_TARGET_AVX512BW void split_8_avx512bw( uint8_t *dst_u, uint8_t *dst_v, const uint8_t *src, int width )
+{
+    const __m512i mask  = _mm512_set1_epi16( 0x00ff );
+    const __m512i order = _mm512_set_epi64( 7, 5, 3, 1, 6, 4, 2, 0 );
+    int x = 0;
+    for( ; x <= width - 64; x += 64 )
+    {
+        __m512i uv0 = _mm512_loadu_si512( (const void *)(src + 2 * x     ) );
+        __m512i uv1 = _mm512_loadu_si512( (const void *)(src + 2 * x + 64) );
+        __m512i u   = _mm512_packus_epi16( _mm512_and_si512( uv0, mask ), _mm512_and_si512( uv1, mask ) );
+        __m512i v   = _mm512_packus_epi16( _mm512_srli_epi16( uv0, 8 ), _mm512_srli_epi16( uv1, 8 ) );
+        _mm512_storeu_si512( (void *)(dst_u + x), _mm512_permutexvar_epi64( order, u ) );
+        _mm512_storeu_si512( (void *)(dst_v + x), _mm512_permutexvar_epi64( order, v ) );
+    }
+    split_8_c( dst_u + x, dst_v + x, src + 2 * x, width - x );
+}
+
+static LW_TARGET_AVX512BW void split_16_avx512bw( uint16_t *dst_u, uint16_t *dst_v, const uint16_t *src, int width, int shift )
+{
+    const __m512i mask  = _mm512_set1_epi32( 0x0000ffff );
+    const __m512i order = _mm512_set_epi64( 7, 5, 3, 1, 6, 4, 2, 0 );
+    const __m128i count = _mm_cvtsi32_si128( shift );
+    int x = 0;
+    for( ; x <= width - 32; x += 32 )
+    {
+        __m512i uv0 = _mm512_loadu_si512( (const void *)(src + 2 * x     ) );
+        __m512i uv1 = _mm512_loadu_si512( (const void *)(src + 2 * x + 32) );
+        __m512i u   = _mm512_packus_epi32( _mm512_and_si512( uv0, mask ), _mm512_and_si512( uv1, mask ) );
+        __m512i v   = _mm512_packus_epi32( _mm512_srli_epi32( uv0, 16 ), _mm512_srli_epi32( uv1, 16 ) );
+        u = _mm512_srl_epi16( _mm512_permutexvar_epi64( order, u ), count );
+        v = _mm512_srl_epi16( _mm512_permutexvar_epi64( order, v ), count );
+        _mm512_storeu_si512( (void *)(dst_u + x), u );
+        _mm512_storeu_si512( (void *)(dst_v + x), v );
+    }
+    split_16_c( dst_u + x, dst_v + x, src + 2 * x, width - x, shift );
+}
+
+static LW_TARGET_AVX512BW void shift_16_avx512bw( uint16_t *dst, const uint16_t *src, int width, int shift )
+{
+    const __m128i count = _mm_cvtsi32_si128( shift );
+    int x = 0;
+    for( ; x <= width - 32; x += 32 )
+    {
+        __m512i y = _mm512_loadu_si512( (const void *)(src + x) );
+        _mm512_storeu_si512( (void *)(dst + x), _mm512_srl_epi16( y, count ) );
     }
+    shift_16_c( dst + x, src + x, width - x, shift );
+}
+
+/* 0: C, 1: SSE2, 2: AVX2, 3: AVX-512BW */
+static int get_simd_level( void )
+{
+    static int simd_level = -1;
+    if( simd_level == -1 )
+        simd_level = lw_check_avx512bw() ? 3
+                   : lw_check_avx2()     ? 2
+                   : lw_check_sse2()     ? 1
+                   :                       0;
+    return simd_level;
+}
 
-    const __m128i mask = _mm_set1_epi32(0x0000FFFF);
-    for (int y = 0; y < height_uv; y++)
+int convert_semi_planar_yuv
+(
+    enum AVPixelFormat input_pixel_format,
+    enum AVPixelFormat output_pixel_format,
+    uint8_t          **dst_data,
+    const int         *dst_linesize,
+    uint8_t          **src_data,
+    const int         *src_linesize,
+    int                width,
+    int                height
+)
+{
+    static const struct
     {
-        for (int x = 0; x < width_uv; x += 8)
+        enum AVPixelFormat input_pixel_format;
+        enum AVPixelFormat output_pixel_format;
+        int                log2_chroma_w;
+        int                log2_chroma_h;
+        int                bytes_per_sample;
+        int                shift;   /* the number of the padding LSBs of the input samples */
+        int                swap_uv;
+    } format_table[] =
         {
-            __m128i uv_low = _mm_load_si128((__m128i*)((uint32_t*)srcp_uv + x + 0));
-            __m128i uv_high = _mm_load_si128((__m128i*)((uint32_t*)srcp_uv + x + 4));
-
-            __m128i u_low = _mm_and_si128(uv_low, mask);
-            __m128i u_high = _mm_and_si128(uv_high, mask);
-            __m128i u = _MM_PACKUS_EPI32(&u_low, &u_high);
-            u = _mm_srli_epi16(u, 6);
-            _mm_stream_si128((__m128i*)(dstp_u + x), u);
-
-            __m128i v_low = _mm_srli_epi32(uv_low, 16);
-            __m128i v_high = _mm_srli_epi32(uv_high, 16);
-            __m128i v = _MM_PACKUS_EPI32(&v_low, &v_high);
-            v = _mm_srli_epi16(v, 6);
-            _mm_stream_si128((__m128i*)(dstp_v + x), v);
-        }
-        srcp_uv += src_stride_uv;
-        dstp_u += dst_stride_uv;
-        dstp_v += dst_stride_uv;
+            { AV_PIX_FMT_NV12,    AV_PIX_FMT_YUV420P,     1, 1, 1, 0, 0 },
+            { AV_PIX_FMT_NV21,    AV_PIX_FMT_YUV420P,     1, 1, 1, 0, 1 },
+            { AV_PIX_FMT_NV16,    AV_PIX_FMT_YUV422P,     1, 0, 1, 0, 0 },
+            { AV_PIX_FMT_NV24,    AV_PIX_FMT_YUV444P,     0, 0, 1, 0, 0 },
+            { AV_PIX_FMT_NV42,    AV_PIX_FMT_YUV444P,     0, 0, 1, 0, 1 },
+            { AV_PIX_FMT_P010LE,  AV_PIX_FMT_YUV420P10LE, 1, 1, 2, 6, 0 },
+            { AV_PIX_FMT_P012LE,  AV_PIX_FMT_YUV420P12LE, 1, 1, 2, 4, 0 },
+            { AV_PIX_FMT_P016LE,  AV_PIX_FMT_YUV420P16LE, 1, 1, 2, 0, 0 },
+            { AV_PIX_FMT_NV20LE,  AV_PIX_FMT_YUV422P10LE, 1, 0, 2, 0, 0 },
+            { AV_PIX_FMT_P210LE,  AV_PIX_FMT_YUV422P10LE, 1, 0, 2, 6, 0 },
+            { AV_PIX_FMT_P212LE,  AV_PIX_FMT_YUV422P12LE, 1, 0, 2, 4, 0 },
+            { AV_PIX_FMT_P216LE,  AV_PIX_FMT_YUV422P16LE, 1, 0, 2, 0, 0 },
+            { AV_PIX_FMT_P410LE,  AV_PIX_FMT_YUV444P10LE, 0, 0, 2, 6, 0 },
+            { AV_PIX_FMT_P412LE,  AV_PIX_FMT_YUV444P12LE, 0, 0, 2, 4, 0 },
+            { AV_PIX_FMT_P416LE,  AV_PIX_FMT_YUV444P16LE, 0, 0, 2, 0, 0 },
+            { AV_PIX_FMT_NONE,    AV_PIX_FMT_NONE,        0, 0, 0, 0, 0 }
+        };
+    int i;
+    for( i = 0; format_table[i].input_pixel_format != AV_PIX_FMT_NONE; i++ )
+        if( format_table[i].input_pixel_format  == input_pixel_format
+         && format_table[i].output_pixel_format == output_pixel_format )
+            break;
+    if( format_table[i].input_pixel_format == AV_PIX_FMT_NONE || width <= 0 || height <= 0 )
+        return -1;
+    static func_split_8  *const func_split_8_list [4] = { split_8_c,  split_8_sse2,  split_8_avx2,  split_8_avx512bw  };
+    static func_split_16 *const func_split_16_list[4] = { split_16_c, split_16_sse2, split_16_avx2, split_16_avx512bw };
+    static func_shift_16 *const func_shift_16_list[4] = { shift_16_c, shift_16_sse2, shift_16_avx2, shift_16_avx512bw };
+    const int simd_level       = get_simd_level();
+    const int bytes_per_sample = format_table[i].bytes_per_sample;
+    const int shift            = format_table[i].shift;
+    const int chroma_width     = (width  + (1 << format_table[i].log2_chroma_w) - 1) >> format_table[i].log2_chroma_w;
+    const int chroma_height    = (height + (1 << format_table[i].log2_chroma_h) - 1) >> format_table[i].log2_chroma_h;
+    const int u_plane          = format_table[i].swap_uv ? 2 : 1;
+    const int v_plane          = format_table[i].swap_uv ? 1 : 2;
+    /* Luma */
+    for( int y = 0; y < height; y++ )
+    {
+        uint8_t       *dst = dst_data[0] + y * dst_linesize[0];
+        const uint8_t *src = src_data[0] + y * src_linesize[0];
+        if( shift )
+            func_shift_16_list[simd_level]( (uint16_t *)dst, (const uint16_t *)src, width, shift );
+        else
+            memcpy( dst, src, width * bytes_per_sample );
+    }
+    /* Chroma */
+    for( int y = 0; y < chroma_height; y++ )
+    {
+        uint8_t       *dst_u = dst_data[u_plane] + y * dst_linesize[u_plane];
+        uint8_t       *dst_v = dst_data[v_plane] + y * dst_linesize[v_plane];
+        const uint8_t *src   = src_data[1]       + y * src_linesize[1];
+        if( bytes_per_sample == 1 )
+            func_split_8_list[simd_level]( dst_u, dst_v, src, chroma_width );
+        else
+            func_split_16_list[simd_level]( (uint16_t *)dst_u, (uint16_t *)dst_v, (const uint16_t *)src, chroma_width, shift );
     }
+    return height;
 }
@@ -0,0 +1,27 @@
+/* This file is available under an ISC license. */
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif  /* __cplusplus */
+
+/* Convert the semi-planar YUV picture into the planar YUV picture of the same bit depth and chroma subsampling
+ * by the fastest kernel the CPU supports.
+ * The chroma samples are split into the U and V planes, and the samples stored in the MSBs are shifted into the LSBs.
+ * Return the number of the converted luma lines if successful.
+ * Return -1 if the pair of the pixel formats is not handled here, in which case the caller should use swscale instead. */
+int convert_semi_planar_yuv
+(
+    enum AVPixelFormat input_pixel_format,
+    enum AVPixelFormat output_pixel_format,
+    uint8_t          **dst_data,
+    const int         *dst_linesize,
+    uint8_t          **src_data,
+    const int         *src_linesize,
+    int                width,
+    int                height
+);
+
+#ifdef __cplusplus
+}
+#endif  /* __cplusplus */
@@ -27,6 +27,7 @@ extern "C"
 {
 #endif  /* __cplusplus */
 #include <libavutil/opt.h>
+#include <libavutil/imgutils.h>
 #include <libavcodec/avcodec.h>
 #include <libswscale/swscale.h>
 #ifdef __cplusplus
@@ -34,6 +35,7 @@ extern "C"
 #endif  /* __cplusplus */
 
 #include "utils.h"
+#include "osdep.h"
 #include "video_output.h"
 
 /* If YUV is treated as full range, return 1.
@@ -186,6 +188,507 @@ int update_scaler_configuration_if_needed
     return 0;
 }
 
+typedef struct lw_frame_lru_entry_tag lw_frame_lru_entry_t;
+
+struct lw_frame_lru_entry_tag
+{
+    lw_frame_lru_entry_t *prev;     /* the more recently used entry */
+    lw_frame_lru_entry_t *next;     /* the less recently used entry */
+    lw_frame_lru_entry_t *chain;    /* the next entry in the same hash bucket */
+    uint32_t              frame_number;
+    size_t                size;
+    AVFrame              *frame;
+};
+
+#define FRAME_LRU_HASH_SIZE 256     /* must be a power of 2 */
+
+struct lw_frame_lru_tag
+{
+    lw_frame_lru_entry_t *head;     /* the most recently used entry */
+    lw_frame_lru_entry_t *tail;     /* the least recently used entry */
+    lw_frame_lru_entry_t *buckets[FRAME_LRU_HASH_SIZE];
+    size_t                size;
+    size_t                budget;
+};
+
+static size_t get_frame_buffer_size
+(
+    const AVFrame *frame
+)
+{
+    size_t size = 0;
+    for( int i = 0; i < AV_NUM_DATA_POINTERS && frame->buf[i]; i++ )
+        size += frame->buf[i]->size;
+    for( int i = 0; i < frame->nb_extended_buf; i++ )
+        size += frame->extended_buf[i]->size;
+    return size;
+}
+
+static void unlink_frame_lru_entry
+(
+    lw_frame_lru_t       *lru,
+    lw_frame_lru_entry_t *entry
+)
+{
+    if( entry->prev )
+        entry->prev->next = entry->next;
+    else
+        lru->head = entry->next;
+    if( entry->next )
+        entry->next->prev = entry->prev;
+    else
+        lru->tail = entry->prev;
+    entry->prev = NULL;
+    entry->next = NULL;
+}
+
+static void link_frame_lru_entry
+(
+    lw_frame_lru_t       *lru,
+    lw_frame_lru_entry_t *entry
+)
+{
+    entry->prev = NULL;
+    entry->next = lru->head;
+    if( lru->head )
+        lru->head->prev = entry;
+    else
+        lru->tail = entry;
+    lru->head = entry;
+}
+
+static lw_frame_lru_entry_t **get_frame_lru_bucket
+(
+    lw_frame_lru_t *lru,
+    uint32_t        frame_number
+)
+{
+    return &lru->buckets[ frame_number & (FRAME_LRU_HASH_SIZE - 1) ];
+}
+
+static void free_frame_lru_entry
+(
+    lw_frame_lru_t       *lru,
+    lw_frame_lru_entry_t *entry
+)
+{
+    lw_frame_lru_entry_t **link = get_frame_lru_bucket( lru, entry->frame_number );
+    while( *link != entry )
+        link = &(*link)->chain;
+    *link = entry->chain;
+    unlink_frame_lru_entry( lru, entry );
+    lru->size -= entry->size;
+    av_frame_free( &entry->frame );
+    lw_free( entry );
+}
+
+static void free_frame_lru
+(
+    lw_frame_lru_t **lrup
+)
+{
+    lw_frame_lru_t *lru = *lrup;
+    if( !lru )
+        return;
+    while( lru->head )
+        free_frame_lru_entry( lru, lru->head );
+    lw_freep( lrup );
+}
+
+/* The entries are hashed by the frame number, so the consecutive frames fall in the different buckets. */
+static lw_frame_lru_entry_t *find_frame_lru_entry
+(
+    lw_frame_lru_t *lru,
+    uint32_t        frame_number
+)
+{
+    for( lw_frame_lru_entry_t *entry = *get_frame_lru_bucket( lru, frame_number ); entry; entry = entry->chain )
+        if( entry->frame_number == frame_number )
+            return entry;
+    return NULL;
+}
+
+int lw_setup_frame_lru
+(
+    lw_video_output_handler_t *vohp,
+    size_t                     budget
+)
+{
+    if( budget == 0 )
+        return 0;
+    vohp->frame_lru           = (lw_frame_lru_t *)lw_malloc_zero( sizeof(lw_frame_lru_t) );
+    vohp->decode_frame_buffer = av_frame_alloc();
+    if( !vohp->frame_lru || !vohp->decode_frame_buffer )
+    {
+        lw_freep( &vohp->frame_lru );
+        av_frame_free( &vohp->decode_frame_buffer );
+        return -1;
+    }
+    vohp->frame_lru->budget = budget;
+    return 0;
+}
+
+int lw_frame_lru_get
+(
+    lw_frame_lru_t *lru,
+    uint32_t        frame_number,
+    AVFrame        *dst
+)
+{
+    lw_frame_lru_entry_t *entry = find_frame_lru_entry( lru, frame_number );
+    if( !entry )
+        return 0;
+    unlink_frame_lru_entry( lru, entry );
+    link_frame_lru_entry( lru, entry );
+    av_frame_unref( dst );
+    if( av_frame_ref( dst, entry->frame ) < 0 )
+        return -1;
+    return 1;
+}
+
+int lw_frame_lru_put
+(
+    lw_frame_lru_t *lru,
+    uint32_t        frame_number,
+    const AVFrame  *src
+)
+{
+    size_t size = get_frame_buffer_size( src );
+    lw_frame_lru_entry_t *entry = find_frame_lru_entry( lru, frame_number );
+    if( entry )
+        free_frame_lru_entry( lru, entry );
+    if( size > lru->budget )
+        return 0;
+    entry = (lw_frame_lru_entry_t *)lw_malloc_zero( sizeof(lw_frame_lru_entry_t) );
+    if( !entry )
+        return -1;
+    entry->frame = av_frame_alloc();
+    if( !entry->frame || av_frame_ref( entry->frame, src ) < 0 )
+    {
+        av_frame_free( &entry->frame );
+        lw_free( entry );
+        return -1;
+    }
+    entry->frame_number = frame_number;
+    entry->size         = size;
+    lw_frame_lru_entry_t **bucket = get_frame_lru_bucket( lru, frame_number );
+    entry->chain = *bucket;
+    *bucket      = entry;
+    link_frame_lru_entry( lru, entry );
+    lru->size += size;
+    /* Evict the least recently used frames. */
+    while( lru->size > lru->budget && lru->tail != entry )
+        free_frame_lru_entry( lru, lru->tail );
+    return 0;
+}
+
+void lw_free_vfr2cfr_table
+(
+    lw_vfr2cfr_table_t *table
+)
+{
+    lw_freep( &table->frame_numbers );
+    lw_freep( &table->seconds );
+    table->count = 0;
+}
+
+void lw_check_vfr2cfr_table
+(
+    lw_vfr2cfr_table_t *table
+)
+{
+    table->state = table->seconds ? LW_VFR2CFR_TABLE_AVAILABLE : LW_VFR2CFR_TABLE_UNAVAILABLE;
+    for( uint32_t i = 1; i < table->count && table->state == LW_VFR2CFR_TABLE_AVAILABLE; i++ )
+        if( table->seconds[i] < table->seconds[i - 1] )
+            table->state = LW_VFR2CFR_TABLE_UNAVAILABLE;
+    if( table->state == LW_VFR2CFR_TABLE_UNAVAILABLE )
+        lw_free_vfr2cfr_table( table );
+}
+
+/* Return the number of the entries less than the value, or not greater than the value if inclusive is non-zero. */
+static uint32_t count_vfr2cfr_seconds
+(
+    const double *seconds,
+    uint32_t      count,
+    double        value,
+    int           inclusive
+)
+{
+    uint32_t lo = 0;
+    uint32_t hi = count;
+    while( lo < hi )
+    {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if( seconds[mid] < value || (inclusive && seconds[mid] == value) )
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+/* Return the number of the source frames with valid timestamps before the frame number. */
+static uint32_t count_vfr2cfr_frames
+(
+    const lw_vfr2cfr_table_t *table,
+    uint32_t                  frame_number
+)
+{
+    if( !table->frame_numbers )
+        return frame_number ? MIN( frame_number - 1, table->count ) : 0;
+    uint32_t lo = 0;
+    uint32_t hi = table->count;
+    while( lo < hi )
+    {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if( table->frame_numbers[mid] < frame_number )
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+uint32_t lw_vfr2cfr_search
+(
+    const lw_vfr2cfr_table_t *table,
+    uint32_t                  last_number,
+    uint32_t                  frame_count,
+    double                    target_ts,
+    double                    next_target_ts
+)
+{
+#define FRAME_NUMBER( i ) (table->frame_numbers ? table->frame_numbers[i] : (i) + 1)
+    const double *seconds = table->seconds;
+    /* The last frame is at this index if it has a valid timestamp. */
+    uint32_t last_index = count_vfr2cfr_frames( table, last_number );
+    int      last_valid = last_number && last_index < table->count && FRAME_NUMBER( last_index ) == last_number;
+    if( last_valid && seconds[last_index] == target_ts )
+        return last_number;
+    /* Find the frame where the forward scan starts from.
+     * If the target is before the last frame, it is the last frame at or before the target among the frames before the last one. */
+    uint32_t start_index = last_index;
+    if( !last_valid || target_ts < seconds[last_index] )
+    {
+        uint32_t count = MIN( count_vfr2cfr_seconds( seconds, table->count, target_ts, 1 ), last_index );
+        if( count == 0 )
+            return 0;
+        start_index = count - 1;
+    }
+    /* Find the first frame at or after the target after the starting frame. */
+    uint32_t index = MAX( start_index + 1, count_vfr2cfr_seconds( seconds, table->count, target_ts, 0 ) );
+    if( index >= table->count )
+        return frame_count;
+    double current_ts = seconds[index];
+    double prev_ts    = seconds[index - 1];
+    if( current_ts > next_target_ts )
+        /* Between the current target and the next target, there are no input frames.
+         * Therefore, output the previous frame. */
+        return FRAME_NUMBER( index - 1 );
+    if( current_ts > (next_target_ts + target_ts) / 2 )
+        /* The current frame is far from the current target and should be a candidate for the next target. */
+        return FRAME_NUMBER( index - 1 );
+    /* Choose the nearest one. */
+    return current_ts - target_ts >= target_ts - prev_ts ? FRAME_NUMBER( index - 1 ) : FRAME_NUMBER( index );
+#undef FRAME_NUMBER
+}
+
+/* The number of the threads copying a picture including the calling thread */
+#define LW_PLANE_COPY_THREADS  4
+/* Smaller pictures are copied by the calling thread alone since waking up the workers costs more. */
+#define LW_PLANE_COPY_MIN_SIZE (512 << 10)
+
+typedef struct
+{
+    int            plane_count;
+    int            band_count;
+    uint8_t       *dst_data    [4];
+    int            dst_linesize[4];
+    const uint8_t *src_data    [4];
+    int            src_linesize[4];
+    int            row_size    [4];
+    int            height      [4];
+} lw_plane_copy_job_t;
+
+typedef struct
+{
+    lw_plane_copier_t *copier;
+    int                band;
+    lw_thread_t       *thread;
+} lw_plane_copy_worker_t;
+
+struct lw_plane_copier_tag
+{
+    lw_mutex_t            *mutex;
+    lw_cond_t             *job_cond;    /* signaled when a job is posted or the workers are stopped */
+    lw_cond_t             *done_cond;   /* signaled when all workers have finished the current job */
+    int                    stop;
+    uint32_t               generation;  /* incremented every job */
+    int                    pending;     /* the number of the workers that have not finished the current job */
+    int                    worker_count;
+    lw_plane_copy_worker_t workers[LW_PLANE_COPY_THREADS - 1];
+    lw_plane_copy_job_t    job;
+};
+
+static void copy_plane_band
+(
+    const lw_plane_copy_job_t *job,
+    int                        band
+)
+{
+    for( int i = 0; i < job->plane_count; i++ )
+    {
+        int start = (int)((int64_t)job->height[i] *  band      / job->band_count);
+        int end   = (int)((int64_t)job->height[i] * (band + 1) / job->band_count);
+        uint8_t       *dst = job->dst_data[i] + (ptrdiff_t)start * job->dst_linesize[i];
+        const uint8_t *src = job->src_data[i] + (ptrdiff_t)start * job->src_linesize[i];
+        if( job->dst_linesize[i] == job->row_size[i] && job->src_linesize[i] == job->row_size[i] )
+            /* No padding at the end of each line */
+            memcpy( dst, src, (size_t)(end - start) * job->row_size[i] );
+        else
+            for( int y = start; y < end; y++ )
+            {
+                memcpy( dst, src, job->row_size[i] );
+                dst += job->dst_linesize[i];
+                src += job->src_linesize[i];
+            }
+    }
+}
+
+static void *copy_planes_in_background
+(
+    void *arg
+)
+{
+    lw_plane_copy_worker_t *worker = (lw_plane_copy_worker_t *)arg;
+    lw_plane_copier_t      *copier = worker->copier;
+    uint32_t generation = 0;
+    lw_mutex_lock( copier->mutex );
+    while( 1 )
+    {
+        while( !copier->stop && copier->generation == generation )
+            lw_cond_wait( copier->job_cond, copier->mutex );
+        if( copier->stop )
+            break;
+        generation = copier->generation;
+        lw_mutex_unlock( copier->mutex );
+        copy_plane_band( &copier->job, worker->band );
+        lw_mutex_lock( copier->mutex );
+        if( --copier->pending == 0 )
+            lw_cond_signal( copier->done_cond );
+    }
+    lw_mutex_unlock( copier->mutex );
+    return NULL;
+}
+
+static void free_plane_copier
+(
+    lw_plane_copier_t **copierp
+)
+{
+    lw_plane_copier_t *copier = *copierp;
+    if( !copier )
+        return;
+    if( copier->worker_count > 0 )
+    {
+        lw_mutex_lock( copier->mutex );
+        copier->stop = 1;
+        lw_cond_broadcast( copier->job_cond );
+        lw_mutex_unlock( copier->mutex );
+        for( int i = 0; i < copier->worker_count; i++ )
+            lw_thread_join( copier->workers[i].thread );
+    }
+    lw_cond_destroy( copier->done_cond );
+    lw_cond_destroy( copier->job_cond );
+    lw_mutex_destroy( copier->mutex );
+    lw_freep( copierp );
+}
+
+static lw_plane_copier_t *create_plane_copier( void )
+{
+    lw_plane_copier_t *copier = (lw_plane_copier_t *)lw_malloc_zero( sizeof(lw_plane_copier_t) );
+    if( !copier )
+        return NULL;
+    copier->mutex     = lw_mutex_create();
+    copier->job_cond  = lw_cond_create();
+    copier->done_cond = lw_cond_create();
+    if( !copier->mutex || !copier->job_cond || !copier->done_cond )
+    {
+        free_plane_copier( &copier );
+        return NULL;
+    }
+    /* Band 0 is copied by the calling thread. If a thread can't be created, the others share its band. */
+    for( int i = 0; i < LW_PLANE_COPY_THREADS - 1; i++ )
+    {
+        lw_plane_copy_worker_t *worker = &copier->workers[ copier->worker_count ];
+        worker->copier = copier;
+        worker->band   = copier->worker_count + 1;
+        worker->thread = lw_thread_create( copy_planes_in_background, worker );
+        if( !worker->thread )
+            break;
+        ++copier->worker_count;
+    }
+    return copier;
+}
+
+int lw_copy_planes
+(
+    lw_video_scaler_handler_t *vshp,
+    enum AVPixelFormat         pixel_format,
+    uint8_t                  **dst_data,
+    const int                 *dst_linesize,
+    uint8_t                  **src_data,
+    const int                 *src_linesize,
+    int                        width,
+    int                        height
+)
+{
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get( pixel_format );
+    if( !desc || (desc->flags & (AV_PIX_FMT_FLAG_HWACCEL | AV_PIX_FMT_FLAG_BITSTREAM | AV_PIX_FMT_FLAG_PAL)) || width <= 0 || height <= 0 )
+        return -1;
+    lw_plane_copy_job_t job = { 0 };
+    job.plane_count = av_pix_fmt_count_planes( pixel_format );
+    if( job.plane_count <= 0 || job.plane_count > 4 )
+        return -1;
+    size_t size = 0;
+    for( int i = 0; i < job.plane_count; i++ )
+    {
+        if( !dst_data[i] || !src_data[i] )
+            return -1;
+        job.row_size[i] = av_image_get_linesize( pixel_format, width, i );
+        if( job.row_size[i] <= 0 )
+            return -1;
+        job.height      [i] = (i == 1 || i == 2) ? AV_CEIL_RSHIFT( height, desc->log2_chroma_h ) : height;
+        job.dst_data    [i] = dst_data[i];
+        job.dst_linesize[i] = dst_linesize[i];
+        job.src_data    [i] = src_data[i];
+        job.src_linesize[i] = src_linesize[i];
+        size += (size_t)job.row_size[i] * job.height[i];
+    }
+    if( size >= LW_PLANE_COPY_MIN_SIZE && !vshp->plane_copier )
+        vshp->plane_copier = create_plane_copier();
+    lw_plane_copier_t *copier = size >= LW_PLANE_COPY_MIN_SIZE ? vshp->plane_copier : NULL;
+    if( !copier || copier->worker_count == 0 )
+    {
+        job.band_count = 1;
+        copy_plane_band( &job, 0 );
+        return height;
+    }
+    job.band_count = copier->worker_count + 1;
+    lw_mutex_lock( copier->mutex );
+    copier->job     = job;
+    copier->pending = copier->worker_count;
+    ++copier->generation;
+    lw_cond_broadcast( copier->job_cond );
+    lw_mutex_unlock( copier->mutex );
+    copy_plane_band( &job, 0 );
+    lw_mutex_lock( copier->mutex );
+    while( copier->pending > 0 )
+        lw_cond_wait( copier->done_cond, copier->mutex );
+    lw_mutex_unlock( copier->mutex );
+    return height;
+}
+
 void lw_cleanup_video_output_handler
 (
     lw_video_output_handler_t *vohp
@@ -197,9 +700,13 @@ void lw_cleanup_video_output_handler
     lw_freep( &vohp->frame_order_list );
     for( int i = 0; i < REPEAT_CONTROL_CACHE_NUM; i++ )
         av_frame_free( &vohp->frame_cache_buffers[i] );
+    free_frame_lru( &vohp->frame_lru );
+    lw_free_vfr2cfr_table( &vohp->cfr_table );
+    av_frame_free( &vohp->decode_frame_buffer );
     if( vohp->scaler.sws_ctx )
     {
         sws_freeContext( vohp->scaler.sws_ctx );
         vohp->scaler.sws_ctx = NULL;
     }
+    free_plane_copier( &vohp->scaler.plane_copier );
 }
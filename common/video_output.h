@@ -28,6 +28,10 @@
 #define LW_FRAME_PROP_CHANGE_FLAG_COLORSPACE   (1<<3)
 #define LW_FRAME_PROP_CHANGE_FLAG_YUV_RANGE    (1<<4)
 
+/* Worker threads copying the planes of a picture in horizontal bands.
+ * This is used instead of swscale when the output pixel format is the same as the input one. */
+typedef struct lw_plane_copier_tag lw_plane_copier_t;
+
 typedef struct
 {
     int                scaler_flags;
@@ -39,6 +43,7 @@ typedef struct
     enum AVColorSpace  input_colorspace;
     int                input_yuv_range;
     struct SwsContext *sws_ctx;
+    lw_plane_copier_t *plane_copier;
 } lw_video_scaler_handler_t;
 
 typedef struct
@@ -47,6 +52,26 @@ typedef struct
     uint32_t bottom;
 } lw_video_frame_order_t;
 
+/* Decoded frame cache which holds the references to the output frames keyed by the frame number.
+ * The least recently used frames are evicted when the total size of their buffers exceeds the budget. */
+typedef struct lw_frame_lru_tag lw_frame_lru_t;
+
+/* The presentation timestamps of the source frames for VFR->CFR conversion.
+ * Each output frame is mapped to a source frame by binary search instead of scanning the source frames one by one
+ * if the timestamps are in non-decreasing order. */
+#define LW_VFR2CFR_TABLE_UNBUILT      0
+#define LW_VFR2CFR_TABLE_AVAILABLE    1
+#define LW_VFR2CFR_TABLE_UNAVAILABLE -1
+
+typedef struct
+{
+    int       state;            /* LW_VFR2CFR_TABLE_* */
+    uint32_t  count;            /* the number of the source frames with valid timestamps */
+    uint32_t *frame_numbers;    /* the presentation numbers of those frames in ascending order
+                                 * If NULL, all source frames are valid and the number of each is its index plus one. */
+    double   *seconds;          /* the timestamp of each of those frames in seconds */
+} lw_vfr2cfr_table_t;
+
 typedef struct
 {
     lw_video_scaler_handler_t scaler;
@@ -56,6 +81,7 @@ typedef struct
     int                       vfr2cfr;
     uint32_t                  cfr_num;
     uint32_t                  cfr_den;
+    lw_vfr2cfr_table_t        cfr_table;
     /* Repeat control */
     int                       repeat_control;
     int                       repeat_requested;
@@ -65,6 +91,10 @@ typedef struct
     lw_video_frame_order_t   *frame_order_list;
     AVFrame                  *frame_cache_buffers[REPEAT_CONTROL_CACHE_NUM];
     uint32_t                  frame_cache_numbers[REPEAT_CONTROL_CACHE_NUM];
+    /* Decoded frame cache */
+    lw_frame_lru_t           *frame_lru;
+    AVFrame                  *decode_frame_buffer;      /* the frame buffer where the decoder outputs frame data
+                                                         * instead of the output frame buffer if frame_lru is enabled */
     /* Application private extension */
     void                     *private_handler;
     void (*free_private_handler)( void *private_handler );
@@ -103,6 +133,76 @@ void lw_cleanup_video_output_handler
     lw_video_output_handler_t *vohp
 );
 
+/* Make the VFR->CFR table available if the timestamps filled in it are in non-decreasing order.
+ * Otherwise, release the table and mark it unavailable. */
+void lw_check_vfr2cfr_table
+(
+    lw_vfr2cfr_table_t *table
+);
+
+void lw_free_vfr2cfr_table
+(
+    lw_vfr2cfr_table_t *table
+);
+
+/* Map the output frame whose timestamp is target_ts to the source frame by the available VFR->CFR table.
+ * The result is the same as scanning the source frames from last_number, the source frame mapped last time,
+ * toward the target: the nearest frame is chosen among the last frame before the target and the first frame
+ * at or after the target, and the former is chosen if the latter is at or beyond the middle of the next target.
+ * Return frame_count if no source frame is at or after the target, or 0 if no source frame is at or before it. */
+uint32_t lw_vfr2cfr_search
+(
+    const lw_vfr2cfr_table_t *table,
+    uint32_t                  last_number,
+    uint32_t                  frame_count,
+    double                    target_ts,
+    double                    next_target_ts
+);
+
+/* Copy the planes of the picture in the pixel format without any conversion.
+ * The destination planes are given in the same order as the source ones.
+ * Large pictures are copied in parallel by the plane copier, which is created on demand.
+ * Return the number of the copied lines if successful. Otherwise return a negative value. */
+int lw_copy_planes
+(
+    lw_video_scaler_handler_t *vshp,
+    enum AVPixelFormat         pixel_format,
+    uint8_t                  **dst_data,
+    const int                 *dst_linesize,
+    uint8_t                  **src_data,
+    const int                 *src_linesize,
+    int                        width,
+    int                        height
+);
+
+/* Enable the decoded frame cache whose budget is given in bytes.
+ * Do nothing if the budget is 0.
+ * Return 0 if successful. Otherwise return a negative value. */
+int lw_setup_frame_lru
+(
+    lw_video_output_handler_t *vohp,
+    size_t                     budget
+);
+
+/* Return 1 and make the destination reference the cached frame if present.
+ * Return 0 if not present.
+ * Return a negative value otherwise. */
+int lw_frame_lru_get
+(
+    lw_frame_lru_t *lru,
+    uint32_t        frame_number,
+    AVFrame        *dst
+);
+
+/* Add the reference to the frame as the most recently used one.
+ * Return 0 if successful or the frame doesn't fit in the budget. Otherwise return a negative value. */
+int lw_frame_lru_put
+(
+    lw_frame_lru_t *lru,
+    uint32_t        frame_number,
+    const AVFrame  *src
+);
+
 #ifdef __cplusplus
 }
 #endif  /* __cplusplus */
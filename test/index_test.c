@@ -0,0 +1,517 @@
+/*****************************************************************************
+ * index_test.c
+ *****************************************************************************
+ * Copyright (C) 2026 L-SMASH Works project
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *****************************************************************************/
+
+/* This file is available under an ISC license. */
+
+/* Behavioural checks of the index files written for a generated MPEG-2 transport stream.
+ * Usage: index_test <test name> <work directory> */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+#include <libswresample/swresample.h>
+
+#include "../common/utils.h"
+#include "../common/osdep.h"
+#include "../common/video_output.h"
+#include "../common/audio_output.h"
+#include "../common/progress.h"
+#include "../common/lwlibav_dec.h"
+#include "../common/lwlibav_audio.h"
+#include "../common/lwlibav_video.h"
+#include "../common/lwlibav_video_internal.h"
+#include "../common/lwindex.h"
+
+#define TEST_SKIP 77
+
+/* Noise pictures of CIF size are about 150 KiB each even at the lowest quantizer,
+ * so the stream is split into several ranges of the size given to the test build. */
+#define TEST_FRAME_COUNT 120
+#define TEST_GOP_SIZE    12
+#define TEST_WIDTH       352
+#define TEST_HEIGHT      288
+
+struct progress_handler_tag
+{
+    int min_percent;    /* the least progress reported while creating the index file */
+};
+
+static int update_indicator( progress_handler_t *php, const char *message, int percent )
+{
+    if( php && !strcmp( message, "Creating Index file" ) && percent < php->min_percent )
+        php->min_percent = percent;
+    return 0;
+}
+
+/* Encode the noise pictures into the MPEG-2 transport stream.
+ * Return 0 if successful, TEST_SKIP if the encoder or the muxer is unavailable, or a negative value otherwise. */
+static int write_test_stream
+(
+    const char *file_path
+)
+{
+    const AVCodec        *codec  = avcodec_find_encoder( AV_CODEC_ID_MPEG2VIDEO );
+    const AVOutputFormat *format = av_guess_format( "mpegts", NULL, NULL );
+    if( !codec || !format )
+        return TEST_SKIP;
+    AVFormatContext *format_ctx = NULL;
+    AVCodecContext  *codec_ctx  = NULL;
+    AVFrame         *frame      = av_frame_alloc();
+    AVPacket        *pkt        = av_packet_alloc();
+    int              ret        = -1;
+    if( !frame || !pkt
+     || avformat_alloc_output_context2( &format_ctx, format, NULL, file_path ) < 0 )
+        goto end;
+    AVStream *stream = avformat_new_stream( format_ctx, NULL );
+    codec_ctx = avcodec_alloc_context3( codec );
+    if( !stream || !codec_ctx )
+        goto end;
+    codec_ctx->width          = TEST_WIDTH;
+    codec_ctx->height         = TEST_HEIGHT;
+    codec_ctx->pix_fmt        = AV_PIX_FMT_YUV420P;
+    codec_ctx->time_base      = (AVRational){ 1, 25 };
+    codec_ctx->framerate      = (AVRational){ 25, 1 };
+    codec_ctx->gop_size       = TEST_GOP_SIZE;
+    codec_ctx->max_b_frames   = 2;
+    codec_ctx->flags         |= AV_CODEC_FLAG_QSCALE | AV_CODEC_FLAG_CLOSED_GOP;
+    codec_ctx->global_quality = FF_QP2LAMBDA * 2;
+    if( avcodec_open2( codec_ctx, codec, NULL ) < 0
+     || avcodec_parameters_from_context( stream->codecpar, codec_ctx ) < 0 )
+        goto end;
+    stream->time_base = codec_ctx->time_base;
+    frame->format = codec_ctx->pix_fmt;
+    frame->width  = codec_ctx->width;
+    frame->height = codec_ctx->height;
+    if( av_frame_get_buffer( frame, 0 ) < 0
+     || avio_open( &format_ctx->pb, file_path, AVIO_FLAG_WRITE ) < 0
+     || avformat_write_header( format_ctx, NULL ) < 0 )
+        goto end;
+    uint32_t seed = 1;
+    for( int i = 0; i <= TEST_FRAME_COUNT; i++ )
+    {
+        AVFrame *input = NULL;
+        if( i < TEST_FRAME_COUNT )
+        {
+            if( av_frame_make_writable( frame ) < 0 )
+                goto end;
+            for( int plane = 0; plane < 3; plane++ )
+            {
+                int height = plane ? TEST_HEIGHT / 2 : TEST_HEIGHT;
+                int width  = plane ? TEST_WIDTH  / 2 : TEST_WIDTH;
+                for( int y = 0; y < height; y++ )
+                    for( int x = 0; x < width; x++ )
+                    {
+                        seed = seed * 1664525 + 1013904223;
+                        frame->data[plane][y * frame->linesize[plane] + x] = (uint8_t)(seed >> 24);
+                    }
+            }
+            frame->pts = i;
+            input = frame;
+        }
+        if( avcodec_send_frame( codec_ctx, input ) < 0 )
+            goto end;
+        while( avcodec_receive_packet( codec_ctx, pkt ) == 0 )
+        {
+            av_packet_rescale_ts( pkt, codec_ctx->time_base, stream->time_base );
+            pkt->stream_index = stream->index;
+            if( av_interleaved_write_frame( format_ctx, pkt ) < 0 )
+                goto end;
+        }
+    }
+    if( av_write_trailer( format_ctx ) < 0 )
+        goto end;
+    ret = 0;
+end:
+    if( format_ctx && format_ctx->pb )
+        avio_closep( &format_ctx->pb );
+    avformat_free_context( format_ctx );
+    avcodec_free_context( &codec_ctx );
+    av_packet_free( &pkt );
+    av_frame_free( &frame );
+    return ret;
+}
+
+typedef struct
+{
+    lwlibav_file_handler_t          lwh;
+    lwlibav_video_decode_handler_t *vdhp;
+    lwlibav_video_output_handler_t *vohp;
+    lwlibav_audio_decode_handler_t *adhp;
+    lwlibav_audio_output_handler_t *aohp;
+} test_handler_t;
+
+static void close_handler
+(
+    test_handler_t *hp
+)
+{
+    lwlibav_video_free_decode_handler( hp->vdhp );
+    lwlibav_video_free_output_handler( hp->vohp );
+    lwlibav_audio_free_decode_handler( hp->adhp );
+    lwlibav_audio_free_output_handler( hp->aohp );
+    lw_free( hp->lwh.file_path );
+    memset( hp, 0, sizeof(test_handler_t) );
+}
+
+/* Construct the index of the file, or parse it if the file is an index file.
+ * The least progress reported is returned via 'min_percent' if not NULL.
+ * Return 0 if successful. Otherwise return a negative value. */
+static int open_handler
+(
+    test_handler_t *hp,
+    const char     *file_path,
+    const char     *index_path,
+    int             threads,
+    int             text_index,
+    int            *min_percent
+)
+{
+    memset( hp, 0, sizeof(test_handler_t) );
+    if( !(hp->vdhp = lwlibav_video_alloc_decode_handler())
+     || !(hp->vohp = lwlibav_video_alloc_output_handler())
+     || !(hp->adhp = lwlibav_audio_alloc_decode_handler())
+     || !(hp->aohp = lwlibav_audio_alloc_output_handler()) )
+    {
+        close_handler( hp );
+        return -1;
+    }
+    lwlibav_option_t opt = { 0 };
+    opt.file_path         = file_path;
+    opt.cache_dir         = "";
+    opt.index_file_path   = index_path;
+    opt.threads           = threads;
+    opt.force_video_index = -1;
+    opt.force_audio_index = -2;
+    opt.text_index        = text_index;
+    progress_handler_t   progress  = { 100 };
+    progress_indicator_t indicator = { NULL, update_indicator, NULL };
+    if( lwlibav_construct_index( &hp->lwh, hp->vdhp, hp->vohp, hp->adhp, hp->aohp, NULL, &opt, &indicator, &progress ) < 0 )
+    {
+        close_handler( hp );
+        return -1;
+    }
+    if( min_percent )
+        *min_percent = progress.min_percent;
+    return 0;
+}
+
+/* Construct the index of the file and release the handlers.
+ * Return 0 if successful. Otherwise return a negative value. */
+static int index_file
+(
+    const char *file_path,
+    const char *index_path,
+    int         threads,
+    int         text_index,
+    int        *min_percent
+)
+{
+    test_handler_t h;
+    if( open_handler( &h, file_path, index_path, threads, text_index, min_percent ) < 0 )
+        return -1;
+    close_handler( &h );
+    return 0;
+}
+
+/* Return the contents of the file, or NULL if failed. */
+static uint8_t *read_file
+(
+    const char *file_path,
+    size_t     *size
+)
+{
+    FILE *fp = fopen( file_path, "rb" );
+    if( !fp )
+        return NULL;
+    uint8_t *data = NULL;
+    long     end;
+    if( fseek( fp, 0, SEEK_END ) == 0 && (end = ftell( fp )) >= 0 && fseek( fp, 0, SEEK_SET ) == 0
+     && (data = (uint8_t *)malloc( end + 1 )) )
+    {
+        *size = fread( data, 1, end, fp );
+        if( *size != (size_t)end )
+        {
+            free( data );
+            data = NULL;
+        }
+    }
+    fclose( fp );
+    return data;
+}
+
+/* Return 0 if the files have the same contents. Otherwise return a negative value. */
+static int compare_files
+(
+    const char *path_a,
+    const char *path_b
+)
+{
+    size_t   size_a = 0;
+    size_t   size_b = 0;
+    uint8_t *data_a = read_file( path_a, &size_a );
+    uint8_t *data_b = read_file( path_b, &size_b );
+    int ret = -1;
+    if( !data_a || !data_b )
+        fprintf( stderr, "failed to read %s or %s\n", path_a, path_b );
+    else if( size_a != size_b || memcmp( data_a, data_b, size_a ) )
+        fprintf( stderr, "%s and %s differ\n", path_a, path_b );
+    else
+        ret = 0;
+    free( data_a );
+    free( data_b );
+    return ret;
+}
+
+/* Return 0 if successful. Otherwise return a negative value. */
+static int write_file
+(
+    const char    *file_path,
+    const uint8_t *data,
+    size_t         size
+)
+{
+    FILE *fp = fopen( file_path, "wb" );
+    if( !fp )
+        return -1;
+    int ret = fwrite( data, 1, size, fp ) == size ? 0 : -1;
+    if( fclose( fp ) )
+        ret = -1;
+    return ret;
+}
+
+static char *make_path
+(
+    const char *dir,
+    const char *name
+)
+{
+    char *path = (char *)malloc( strlen( dir ) + strlen( name ) + 2 );
+    if( path )
+        sprintf( path, "%s/%s", dir, name );
+    return path;
+}
+
+/* The parallel indexing writes the same index file as the sequential indexing. */
+static int test_parallel
+(
+    const char *dir
+)
+{
+    char *ts_path         = make_path( dir, "parallel.ts" );
+    char *sequential_path = make_path( dir, "parallel_sequential.lwi" );
+    char *parallel_path   = make_path( dir, "parallel_parallel.lwi" );
+    int ret = -1;
+    if( !ts_path || !sequential_path || !parallel_path )
+        goto end;
+    remove( sequential_path );
+    remove( parallel_path );
+    if( (ret = write_test_stream( ts_path )) != 0 )
+        goto end;
+    ret = -1;
+    if( index_file( ts_path, sequential_path, 1, 0, NULL ) < 0
+     || index_file( ts_path, parallel_path,   4, 0, NULL ) < 0 )
+        goto end;
+    ret = compare_files( sequential_path, parallel_path );
+end:
+    free( ts_path );
+    free( sequential_path );
+    free( parallel_path );
+    return ret;
+}
+
+/* Indexing the grown file from the checkpoint writes the same index file as indexing the whole file. */
+static int test_resume
+(
+    const char *dir
+)
+{
+    char    *ts_path        = make_path( dir, "resume.ts" );
+    char    *growing_path   = make_path( dir, "resume_growing.ts" );
+    char    *resumed_path   = make_path( dir, "resume_resumed.lwi" );
+    char    *reference_path = make_path( dir, "resume_reference.lwi" );
+    uint8_t *data           = NULL;
+    size_t   size           = 0;
+    int      min_percent    = 0;
+    int ret = -1;
+    if( !ts_path || !growing_path || !resumed_path || !reference_path )
+        goto end;
+    remove( resumed_path );
+    remove( reference_path );
+    if( (ret = write_test_stream( ts_path )) != 0 )
+        goto end;
+    ret = -1;
+    if( !(data = read_file( ts_path, &size )) )
+        goto end;
+    /* Index the first half of the stream as if it were being recorded, and then let it grow. */
+    if( write_file( growing_path, data, size / 2 / 188 * 188 ) < 0
+     || index_file( growing_path, resumed_path, 1, 0, NULL ) < 0
+     || write_file( growing_path, data, size ) < 0
+     || index_file( growing_path, resumed_path, 1, 0, &min_percent ) < 0 )
+        goto end;
+    /* The indexing from the beginning of the file reports 0% first. */
+    if( min_percent == 0 )
+    {
+        fprintf( stderr, "the indexing was not resumed from the checkpoint\n" );
+        goto end;
+    }
+    if( index_file( growing_path, reference_path, 1, 0, NULL ) < 0 )
+        goto end;
+    ret = compare_files( resumed_path, reference_path );
+end:
+    free( data );
+    free( ts_path );
+    free( growing_path );
+    free( resumed_path );
+    free( reference_path );
+    return ret;
+}
+
+/* Return 0 if the file starts with the prefix. Otherwise return a negative value. */
+static int check_file_prefix
+(
+    const char *file_path,
+    const char *prefix
+)
+{
+    size_t   size = 0;
+    uint8_t *data = read_file( file_path, &size );
+    int ret = data && size >= strlen( prefix ) && !memcmp( data, prefix, strlen( prefix ) ) ? 0 : -1;
+    if( ret < 0 )
+        fprintf( stderr, "%s does not start with %s\n", file_path, prefix );
+    free( data );
+    return ret;
+}
+
+/* Return 0 if the frames parsed from the index files are the same and match the generated stream.
+ * Otherwise return a negative value. */
+static int compare_video_frames
+(
+    lwlibav_video_decode_handler_t *a,
+    lwlibav_video_decode_handler_t *b
+)
+{
+    if( a->frame_count != TEST_FRAME_COUNT || b->frame_count != TEST_FRAME_COUNT )
+    {
+        fprintf( stderr, "%u and %u frames are indexed instead of %d\n", a->frame_count, b->frame_count, TEST_FRAME_COUNT );
+        return -1;
+    }
+    uint32_t key_count = 0;
+    for( uint32_t i = 1; i <= TEST_FRAME_COUNT; i++ )
+    {
+        const video_frame_table_t *ta = a->frame_table;
+        const video_frame_table_t *tb = b->frame_table;
+        if( lw_vframe_pts            ( ta, i ) != lw_vframe_pts            ( tb, i )
+         || lw_vframe_dts            ( ta, i ) != lw_vframe_dts            ( tb, i )
+         || lw_vframe_file_offset    ( ta, i ) != lw_vframe_file_offset    ( tb, i )
+         || lw_vframe_packet_size    ( ta, i ) != lw_vframe_packet_size    ( tb, i )
+         || lw_vframe_sample_number  ( ta, i ) != lw_vframe_sample_number  ( tb, i )
+         || lw_vframe_flags          ( ta, i ) != lw_vframe_flags          ( tb, i )
+         || lw_vframe_repeat_pict    ( ta, i ) != lw_vframe_repeat_pict    ( tb, i )
+         || lw_vframe_field_info     ( ta, i ) != lw_vframe_field_info     ( tb, i )
+         || lw_vframe_extradata_index( ta, i ) != lw_vframe_extradata_index( tb, i )
+         || a->rap_list[i] != b->rap_list[i] )
+        {
+            fprintf( stderr, "frame %u differs\n", i );
+            return -1;
+        }
+        /* The presentation order follows the frame rate of the stream. */
+        if( i > 1 && lw_vframe_pts( ta, i ) <= lw_vframe_pts( ta, i - 1 ) )
+        {
+            fprintf( stderr, "frame %u is not in presentation order\n", i );
+            return -1;
+        }
+        if( lw_vframe_flags( ta, i ) & LW_VFRAME_FLAG_KEY )
+            ++key_count;
+    }
+    if( key_count != TEST_FRAME_COUNT / TEST_GOP_SIZE )
+    {
+        fprintf( stderr, "%u keyframes are indexed instead of %d\n", key_count, TEST_FRAME_COUNT / TEST_GOP_SIZE );
+        return -1;
+    }
+    return 0;
+}
+
+/* The binary index file and the text index file describe the same frames. */
+static int test_formats
+(
+    const char *dir
+)
+{
+    char *ts_path     = make_path( dir, "formats.ts" );
+    char *binary_path = make_path( dir, "formats_binary.lwi" );
+    char *text_path   = make_path( dir, "formats_text.lwi" );
+    test_handler_t binary = { 0 };
+    test_handler_t text   = { 0 };
+    int ret = -1;
+    if( !ts_path || !binary_path || !text_path )
+        goto end;
+    remove( binary_path );
+    remove( text_path );
+    if( (ret = write_test_stream( ts_path )) != 0 )
+        goto end;
+    ret = -1;
+    if( index_file( ts_path, binary_path, 1, 0, NULL ) < 0
+     || index_file( ts_path, text_path,   1, 1, NULL ) < 0 )
+        goto end;
+    /* Open the index files as the input. Each must be parsed as it is instead of being re-created. */
+    if( open_handler( &binary, binary_path, NULL, 1, 0, NULL ) < 0
+     || open_handler( &text,   text_path,   NULL, 1, 0, NULL ) < 0
+     || check_file_prefix( binary_path, "LWIB" ) < 0
+     || check_file_prefix( text_path, "<LSMASHWorksIndexVersion=" ) < 0 )
+        goto end;
+    ret = compare_video_frames( binary.vdhp, text.vdhp );
+end:
+    close_handler( &binary );
+    close_handler( &text );
+    free( ts_path );
+    free( binary_path );
+    free( text_path );
+    return ret;
+}
+
+int main( int argc, char *argv[] )
+{
+    static const struct
+    {
+        const char *name;
+        int (*func)( const char *dir );
+    } tests[] =
+        {
+            { "formats",  test_formats  },
+            { "parallel", test_parallel },
+            { "resume",   test_resume   },
+            { NULL,       NULL          }
+        };
+    if( argc != 3 )
+    {
+        fprintf( stderr, "Usage: %s <test name> <work directory>\n", argv[0] );
+        return 1;
+    }
+    av_log_set_level( AV_LOG_ERROR );
+    for( int i = 0; tests[i].name; i++ )
+        if( !strcmp( argv[1], tests[i].name ) )
+        {
+            int ret = tests[i].func( argv[2] );
+            return ret == TEST_SKIP ? TEST_SKIP : ret < 0 ? 1 : 0;
+        }
+    fprintf( stderr, "Unknown test: %s\n", argv[1] );
+    return 1;
+}
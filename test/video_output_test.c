@@ -0,0 +1,451 @@
+/*****************************************************************************
+ * video_output_test.c
+ *****************************************************************************
+ * Copyright (C) 2026 L-SMASH Works project
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *****************************************************************************/
+
+/* This file is available under an ISC license. */
+
+/* Behavioural checks of the common video output layer against straightforward reference implementations.
+ * Usage: video_output_test <test name> */
+
+#include <float.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libavcodec/avcodec.h>
+#include <libavutil/imgutils.h>
+#include <libavutil/pixdesc.h>
+
+#include "../common/utils.h"
+#include "../common/osdep.h"
+#include "../common/video_output.h"
+#ifdef SSE2_ENABLED
+#include "../common/planar_yuv_sse2.h"
+#endif
+
+static uint32_t test_seed = 1;
+
+static uint32_t test_random( void )
+{
+    test_seed = test_seed * 1664525 + 1013904223;
+    return test_seed >> 8;
+}
+
+/* The source frames of the VFR->CFR tests. Frame numbers start from 1 and invalid timestamps are skipped. */
+typedef struct
+{
+    uint32_t  frame_count;
+    double   *seconds;
+    int      *valid;
+} test_vfr_stream_t;
+
+/* The linear scan which lw_vfr2cfr_search() replaces, as done by lwlibav_vfr2cfr() without the table. */
+static uint32_t reference_vfr2cfr
+(
+    const test_vfr_stream_t *stream,
+    uint32_t                *last_number,
+    uint32_t                 frame_number,
+    uint32_t                 cfr_num,
+    uint32_t                 cfr_den
+)
+{
+    double   target_ts  = (double)((uint64_t)(frame_number - 1) * cfr_den) / cfr_num;
+    double   current_ts = DBL_MAX;
+    uint32_t n          = *last_number;
+    if( stream->valid[n] )
+    {
+        current_ts = stream->seconds[n];
+        if( target_ts == current_ts )
+            return n;
+    }
+    double prev_ts = current_ts;
+    if( target_ts < current_ts )
+    {
+        for( n--; n; n-- )
+            if( stream->valid[n] )
+            {
+                current_ts = stream->seconds[n];
+                prev_ts    = current_ts;
+                if( current_ts <= target_ts )
+                    break;
+            }
+        if( n == 0 )
+            return 0;
+    }
+    double next_target_ts = (double)((uint64_t)frame_number * cfr_den) / cfr_num;
+    for( n++; n <= stream->frame_count; n++ )
+    {
+        if( !stream->valid[n] )
+            continue;
+        current_ts = stream->seconds[n];
+        if( current_ts >= target_ts )
+        {
+            uint32_t prev = n - 1;
+            while( prev && !stream->valid[prev] )
+                --prev;
+            if( prev == 0 )
+                frame_number = 1;
+            else if( current_ts > next_target_ts
+                  || current_ts > (next_target_ts + target_ts) / 2
+                  || current_ts - target_ts >= target_ts - prev_ts )
+                frame_number = prev;
+            else
+                frame_number = n;
+            break;
+        }
+        prev_ts = current_ts;
+    }
+    if( n > stream->frame_count )
+        frame_number = stream->frame_count;
+    *last_number = frame_number;
+    return frame_number;
+}
+
+/* Set up the table in the same way as build_vfr2cfr_table(). */
+static int build_test_vfr2cfr_table
+(
+    const test_vfr_stream_t *stream,
+    lw_vfr2cfr_table_t      *table
+)
+{
+    memset( table, 0, sizeof(lw_vfr2cfr_table_t) );
+    uint32_t count = 0;
+    for( uint32_t i = 1; i <= stream->frame_count; i++ )
+        count += !!stream->valid[i];
+    table->seconds = (double *)lw_malloc_zero( (count + 1) * sizeof(double) );
+    if( table->seconds && count < stream->frame_count )
+        table->frame_numbers = (uint32_t *)lw_malloc_zero( (count + 1) * sizeof(uint32_t) );
+    if( !table->seconds || (count < stream->frame_count && !table->frame_numbers) )
+    {
+        lw_free_vfr2cfr_table( table );
+        return -1;
+    }
+    table->count = count;
+    for( uint32_t i = 1, j = 0; i <= stream->frame_count; i++ )
+        if( stream->valid[i] )
+        {
+            if( table->frame_numbers )
+                table->frame_numbers[j] = i;
+            table->seconds[j++] = stream->seconds[i];
+        }
+    lw_check_vfr2cfr_table( table );
+    return table->state == LW_VFR2CFR_TABLE_AVAILABLE ? 0 : -1;
+}
+
+/* The table search maps every output frame to the same source frame as the linear scan
+ * for both sequential and random requests. */
+static int test_vfr2cfr( void )
+{
+    static const struct
+    {
+        uint32_t num;
+        uint32_t den;
+    } cfr_list[] = { { 24000, 1001 }, { 30000, 1001 }, { 60, 1 }, { 25, 1 } };
+    for( int pattern = 0; pattern < 8; pattern++ )
+    {
+        test_vfr_stream_t stream;
+        stream.frame_count = 500 + test_random() % 500;
+        stream.seconds     = (double *)lw_malloc_zero( (stream.frame_count + 1) * sizeof(double) );
+        stream.valid       = (int    *)lw_malloc_zero( (stream.frame_count + 1) * sizeof(int) );
+        if( !stream.seconds || !stream.valid )
+            return -1;
+        /* Durations of 24, 30 and 60 fps and repeated timestamps in 90 kHz, with invalid timestamps in odd patterns. */
+        static const int64_t durations[] = { 3754, 3003, 1501, 1502, 0 };
+        int64_t ticks = 0;
+        for( uint32_t i = 1; i <= stream.frame_count; i++ )
+        {
+            stream.valid  [i] = (pattern & 1) ? test_random() % 10 != 0 : 1;
+            stream.seconds[i] = (double)ticks / 90000;
+            ticks += durations[ test_random() % (sizeof(durations) / sizeof(durations[0])) ];
+        }
+        lw_vfr2cfr_table_t table;
+        if( build_test_vfr2cfr_table( &stream, &table ) < 0 )
+            return -1;
+        uint32_t cfr_num = cfr_list[ pattern % 4 ].num;
+        uint32_t cfr_den = cfr_list[ pattern % 4 ].den;
+        uint32_t output_count = (uint32_t)(stream.seconds[ stream.frame_count ] * cfr_num / cfr_den) + 2;
+        /* The first valid frame is mapped first as the linear scan starts from it. */
+        uint32_t first_valid = 1;
+        while( !stream.valid[first_valid] )
+            ++first_valid;
+        uint32_t reference_last = first_valid;
+        uint32_t table_last     = first_valid;
+        for( uint32_t i = 0; i < 2 * output_count; i++ )
+        {
+            /* Sequential requests first, and then random ones. */
+            uint32_t frame_number = i < output_count ? i + 1 : 1 + test_random() % output_count;
+            double   target_ts      = (double)((uint64_t)(frame_number - 1) * cfr_den) / cfr_num;
+            double   next_target_ts = (double)((uint64_t)frame_number * cfr_den) / cfr_num;
+            uint32_t expected = reference_vfr2cfr( &stream, &reference_last, frame_number, cfr_num, cfr_den );
+            uint32_t actual   = lw_vfr2cfr_search( &table, table_last, stream.frame_count, target_ts, next_target_ts );
+            if( actual )
+                table_last = actual;
+            if( actual != expected || table_last != reference_last )
+            {
+                fprintf( stderr, "pattern %d: output frame %u is mapped to %u instead of %u\n",
+                         pattern, frame_number, actual, expected );
+                lw_free_vfr2cfr_table( &table );
+                return -1;
+            }
+        }
+        lw_free_vfr2cfr_table( &table );
+        lw_free( stream.seconds );
+        lw_free( stream.valid );
+    }
+    return 0;
+}
+
+/* The plane copier writes the same planes as av_image_copy_plane() whether a picture is copied by the calling thread
+ * alone or in bands by the workers, and writes nothing beyond the row size of each line. */
+static int test_copy_planes( void )
+{
+    static const enum AVPixelFormat formats[] =
+        {
+            AV_PIX_FMT_YUV420P, AV_PIX_FMT_YUV422P10LE, AV_PIX_FMT_NV12, AV_PIX_FMT_P010LE,
+            AV_PIX_FMT_GBRP, AV_PIX_FMT_YUVA444P, AV_PIX_FMT_RGBA, AV_PIX_FMT_GRAY16LE
+        };
+    /* The last size is large enough to be copied by the workers. */
+    static const int sizes[][2] = { { 1, 1 }, { 7, 5 }, { 33, 17 }, { 1920, 1080 } };
+    /* The pairs of the padding at the end of each line of the source and the destination */
+    static const int paddings[][2] = { { 0, 0 }, { 0, 64 }, { 32, 0 }, { 96, 160 } };
+    enum { GUARD = 0xA5 };
+    lw_video_output_handler_t voh = { 0 };
+    uint8_t *src_data[4] = { NULL };
+    uint8_t *dst_data[4] = { NULL };
+    uint8_t *ref_data[4] = { NULL };
+    int ret = -1;
+    for( int i = 0; i < (int)(sizeof(formats) / sizeof(formats[0])); i++ )
+        for( int j = 0; j < (int)(sizeof(sizes) / sizeof(sizes[0])); j++ )
+            for( int k = 0; k < (int)(sizeof(paddings) / sizeof(paddings[0])); k++ )
+            {
+                const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get( formats[i] );
+                int width       = sizes[j][0];
+                int height      = sizes[j][1];
+                int plane_count = av_pix_fmt_count_planes( formats[i] );
+                int row_size    [4];
+                int plane_height[4];
+                int src_linesize[4] = { 0 };
+                int dst_linesize[4] = { 0 };
+                if( av_image_fill_linesizes( row_size, formats[i], width ) < 0 )
+                    goto end;
+                for( int plane = 0; plane < plane_count; plane++ )
+                {
+                    plane_height[plane] = (plane == 1 || plane == 2) ? AV_CEIL_RSHIFT( height, desc->log2_chroma_h ) : height;
+                    src_linesize[plane] = row_size[plane] + paddings[k][0];
+                    dst_linesize[plane] = row_size[plane] + paddings[k][1];
+                    src_data[plane] = (uint8_t *)lw_malloc_zero( (size_t)src_linesize[plane] * plane_height[plane] );
+                    dst_data[plane] = (uint8_t *)lw_malloc_zero( (size_t)dst_linesize[plane] * plane_height[plane] );
+                    ref_data[plane] = (uint8_t *)lw_malloc_zero( (size_t)dst_linesize[plane] * plane_height[plane] );
+                    if( !src_data[plane] || !dst_data[plane] || !ref_data[plane] )
+                        goto end;
+                    for( size_t n = 0; n < (size_t)src_linesize[plane] * plane_height[plane]; n++ )
+                        src_data[plane][n] = (uint8_t)test_random();
+                    memset( dst_data[plane], GUARD, (size_t)dst_linesize[plane] * plane_height[plane] );
+                    memset( ref_data[plane], GUARD, (size_t)dst_linesize[plane] * plane_height[plane] );
+                    av_image_copy_plane( ref_data[plane], dst_linesize[plane], src_data[plane], src_linesize[plane],
+                                         row_size[plane], plane_height[plane] );
+                }
+                if( lw_copy_planes( &voh.scaler, formats[i], dst_data, dst_linesize, src_data, src_linesize, width, height ) != height )
+                {
+                    fprintf( stderr, "%s: %dx%d is not copied\n", desc->name, width, height );
+                    goto end;
+                }
+                for( int plane = 0; plane < plane_count; plane++ )
+                {
+                    if( memcmp( dst_data[plane], ref_data[plane], (size_t)dst_linesize[plane] * plane_height[plane] ) )
+                    {
+                        fprintf( stderr, "%s: %dx%d: plane %d with the padding %d and %d differs from av_image_copy_plane()\n",
+                                 desc->name, width, height, plane, paddings[k][0], paddings[k][1] );
+                        goto end;
+                    }
+                    lw_freep( &src_data[plane] );
+                    lw_freep( &dst_data[plane] );
+                    lw_freep( &ref_data[plane] );
+                }
+            }
+    /* The pixel formats without the planes in memory or with a palette are not copied. */
+    {
+        uint8_t dummy[64];
+        uint8_t *data[4]     = { dummy, dummy, dummy, dummy };
+        int      linesize[4] = { 16, 16, 16, 16 };
+        if( lw_copy_planes( &voh.scaler, AV_PIX_FMT_PAL8, data, linesize, data, linesize, 4, 4 ) != -1
+         || lw_copy_planes( &voh.scaler, AV_PIX_FMT_VAAPI, data, linesize, data, linesize, 4, 4 ) != -1 )
+        {
+            fprintf( stderr, "a picture in a pixel format without the planes is copied\n" );
+            goto end;
+        }
+    }
+    ret = 0;
+end:
+    for( int plane = 0; plane < 4; plane++ )
+    {
+        lw_free( src_data[plane] );
+        lw_free( dst_data[plane] );
+        lw_free( ref_data[plane] );
+    }
+    lw_cleanup_video_output_handler( &voh );
+    return ret;
+}
+
+#ifdef SSE2_ENABLED
+/* The semi-planar kernels write the same planes as splitting the chroma and shifting every sample one by one,
+ * and write nothing beyond the width of each plane. */
+static int test_semi_planar( void )
+{
+    static const struct
+    {
+        enum AVPixelFormat input;
+        enum AVPixelFormat output;
+        int                log2_chroma_w;
+        int                log2_chroma_h;
+        int                bytes_per_sample;
+        int                shift;
+        int                swap_uv;
+    } formats[] =
+        {
+            { AV_PIX_FMT_NV12,   AV_PIX_FMT_YUV420P,     1, 1, 1, 0, 0 },
+            { AV_PIX_FMT_NV21,   AV_PIX_FMT_YUV420P,     1, 1, 1, 0, 1 },
+            { AV_PIX_FMT_NV16,   AV_PIX_FMT_YUV422P,     1, 0, 1, 0, 0 },
+            { AV_PIX_FMT_NV24,   AV_PIX_FMT_YUV444P,     0, 0, 1, 0, 0 },
+            { AV_PIX_FMT_NV42,   AV_PIX_FMT_YUV444P,     0, 0, 1, 0, 1 },
+            { AV_PIX_FMT_P010LE, AV_PIX_FMT_YUV420P10LE, 1, 1, 2, 6, 0 },
+            { AV_PIX_FMT_P012LE, AV_PIX_FMT_YUV420P12LE, 1, 1, 2, 4, 0 },
+            { AV_PIX_FMT_P016LE, AV_PIX_FMT_YUV420P16LE, 1, 1, 2, 0, 0 },
+            { AV_PIX_FMT_NV20LE, AV_PIX_FMT_YUV422P10LE, 1, 0, 2, 0, 0 },
+            { AV_PIX_FMT_P210LE, AV_PIX_FMT_YUV422P10LE, 1, 0, 2, 6, 0 },
+            { AV_PIX_FMT_P212LE, AV_PIX_FMT_YUV422P12LE, 1, 0, 2, 4, 0 },
+            { AV_PIX_FMT_P216LE, AV_PIX_FMT_YUV422P16LE, 1, 0, 2, 0, 0 },
+            { AV_PIX_FMT_P410LE, AV_PIX_FMT_YUV444P10LE, 0, 0, 2, 6, 0 },
+            { AV_PIX_FMT_P412LE, AV_PIX_FMT_YUV444P12LE, 0, 0, 2, 4, 0 },
+            { AV_PIX_FMT_P416LE, AV_PIX_FMT_YUV444P16LE, 0, 0, 2, 0, 0 }
+        };
+    /* Wide enough for the tails of every vector width and a few full AVX-512 iterations. */
+    enum { MAX_WIDTH = 300, HEIGHT = 5, PADDING = 64, GUARD = 0xA5 };
+    const int linesize = 2 * (MAX_WIDTH + PADDING) * 2;
+    uint8_t *src = (uint8_t *)lw_malloc_zero( 2 * linesize * HEIGHT );
+    uint8_t *dst = (uint8_t *)lw_malloc_zero( 3 * linesize * HEIGHT );
+    if( !src || !dst )
+        return -1;
+    int ret = -1;
+    for( int i = 0; i < (int)(sizeof(formats) / sizeof(formats[0])); i++ )
+        for( int width = 1; width <= MAX_WIDTH; width += width < 80 ? 1 : 37 )
+        {
+            int bytes         = formats[i].bytes_per_sample;
+            int chroma_width  = (width  + (1 << formats[i].log2_chroma_w) - 1) >> formats[i].log2_chroma_w;
+            int chroma_height = (HEIGHT + (1 << formats[i].log2_chroma_h) - 1) >> formats[i].log2_chroma_h;
+            for( int j = 0; j < 2 * linesize * HEIGHT; j++ )
+                src[j] = (uint8_t)test_random();
+            memset( dst, GUARD, 3 * linesize * HEIGHT );
+            uint8_t *src_data[4]     = { src, src + linesize * HEIGHT, NULL, NULL };
+            int      src_linesize[4] = { linesize, linesize, 0, 0 };
+            uint8_t *dst_data[4]     = { dst, dst + linesize * HEIGHT, dst + 2 * linesize * HEIGHT, NULL };
+            int      dst_linesize[4] = { linesize, linesize, linesize, 0 };
+            if( convert_semi_planar_yuv( formats[i].input, formats[i].output, dst_data, dst_linesize,
+                                         src_data, src_linesize, width, HEIGHT ) != HEIGHT )
+            {
+                fprintf( stderr, "format %d: width %d is not converted\n", i, width );
+                goto end;
+            }
+            /* Every output sample is compared with the reference, and the guard bytes must be intact. */
+            for( int plane = 0; plane < 3; plane++ )
+            {
+                int plane_width  = plane ? chroma_width  : width;
+                int plane_height = plane ? chroma_height : HEIGHT;
+                for( int y = 0; y < plane_height; y++ )
+                {
+                    const uint8_t *src_row = src_data[ plane ? 1 : 0 ] + y * linesize;
+                    const uint8_t *dst_row = dst_data[plane] + y * linesize;
+                    int            offset  = plane == 0 ? 0 : (plane == 1) == !formats[i].swap_uv ? 0 : 1;
+                    int            step    = plane == 0 ? 1 : 2;
+                    for( int x = 0; x < plane_width; x++ )
+                    {
+                        int expected;
+                        int actual;
+                        if( bytes == 1 )
+                        {
+                            expected = src_row[ x * step + offset ];
+                            actual   = dst_row[x];
+                        }
+                        else
+                        {
+                            expected = ((const uint16_t *)src_row)[ x * step + offset ] >> formats[i].shift;
+                            actual   = ((const uint16_t *)dst_row)[x];
+                        }
+                        if( actual != expected )
+                        {
+                            fprintf( stderr, "format %d: width %d: plane %d: sample (%d, %d) is %d instead of %d\n",
+                                     i, width, plane, x, y, actual, expected );
+                            goto end;
+                        }
+                    }
+                    for( int x = plane_width * bytes; x < linesize; x++ )
+                        if( dst_row[x] != GUARD )
+                        {
+                            fprintf( stderr, "format %d: width %d: plane %d: byte %d of line %d is overwritten\n",
+                                     i, width, plane, x, y );
+                            goto end;
+                        }
+                }
+            }
+        }
+    /* The pairs of the pixel formats which are not handled are left to swscale. */
+    {
+        uint8_t *dst_data[4]     = { dst, dst, dst, NULL };
+        int      dst_linesize[4] = { linesize, linesize, linesize, 0 };
+        uint8_t *src_data[4]     = { src, src, NULL, NULL };
+        int      src_linesize[4] = { linesize, linesize, 0, 0 };
+        if( convert_semi_planar_yuv( AV_PIX_FMT_NV12, AV_PIX_FMT_YUV444P, dst_data, dst_linesize, src_data, src_linesize, 16, 2 ) != -1
+         || convert_semi_planar_yuv( AV_PIX_FMT_YUV420P, AV_PIX_FMT_YUV420P, dst_data, dst_linesize, src_data, src_linesize, 16, 2 ) != -1 )
+        {
+            fprintf( stderr, "an unsupported pair of the pixel formats is converted\n" );
+            goto end;
+        }
+    }
+    ret = 0;
+end:
+    lw_free( src );
+    lw_free( dst );
+    return ret;
+}
+#endif
+
+int main( int argc, char *argv[] )
+{
+    static const struct
+    {
+        const char *name;
+        int (*func)( void );
+    } tests[] =
+        {
+            { "vfr2cfr", test_vfr2cfr },
+            { "copy_planes", test_copy_planes },
+#ifdef SSE2_ENABLED
+            { "semi_planar", test_semi_planar },
+#endif
+            { NULL,      NULL         }
+        };
+    if( argc != 2 )
+    {
+        fprintf( stderr, "Usage: %s <test name>\n", argv[0] );
+        return 1;
+    }
+    for( int i = 0; tests[i].name; i++ )
+        if( !strcmp( argv[1], tests[i].name ) )
+            return tests[i].func() < 0 ? 1 : 0;
+    fprintf( stderr, "Unknown test: %s\n", argv[1] );
+    return 1;
+}